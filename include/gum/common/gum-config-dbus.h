@@ -78,4 +78,156 @@
  */
 #define GUM_CONFIG_DBUS_GROUP_TIMEOUT      GUM_CONFIG_DBUS_TIMEOUTS \
                                                 "/GROUP_TIMEOUT"
+
+/**
+ * GUM_CONFIG_DBUS_USER_CACHE_SIZE:
+ *
+ * Maximum number of user entries the daemon retains in its least recently
+ * used cache. Clients are always handed their own copy of a cached entry, so
+ * edits stay private until committed. The cache is dropped whenever the user
+ * database is modified by another program. If set to 0, user entries are not
+ * retained.
+ */
+#define GUM_CONFIG_DBUS_USER_CACHE_SIZE    GUM_CONFIG_DBUS_TIMEOUTS \
+                                                "/USER_CACHE_SIZE"
+
+/**
+ * GUM_CONFIG_DBUS_GROUP_CACHE_SIZE:
+ *
+ * Maximum number of group entries the daemon retains in its least recently
+ * used cache. Clients are always handed their own copy of a cached entry, so
+ * edits stay private until committed. The cache is dropped whenever the group
+ * database is modified by another program. If set to 0, group entries are not
+ * retained.
+ */
+#define GUM_CONFIG_DBUS_GROUP_CACHE_SIZE   GUM_CONFIG_DBUS_TIMEOUTS \
+                                                "/GROUP_CACHE_SIZE"
+
+/**
+ * GUM_CONFIG_DBUS_CACHE_TIMEOUT:
+ *
+ * A timeout in seconds, after which unused user and group objects are dropped
+ * from the daemon cache and reloaded from the database on next access. If
+ * set to 0, cached objects are only dropped when the cache is full.
+ */
+#define GUM_CONFIG_DBUS_CACHE_TIMEOUT      GUM_CONFIG_DBUS_TIMEOUTS \
+                                                "/CACHE_TIMEOUT"
+
+/**
+ * GUM_CONFIG_DBUS_NEGATIVE_CACHE_SIZE:
+ *
+ * Maximum number of failed user/group lookups (by name or id) the daemon
+ * remembers, so that repeated lookups of non-existent accounts do not rescan
+ * the database. Remembered misses are forgotten on any database change. If
+ * set to 0, failed lookups are not remembered.
+ */
+#define GUM_CONFIG_DBUS_NEGATIVE_CACHE_SIZE GUM_CONFIG_DBUS_TIMEOUTS \
+                                                "/NEGATIVE_CACHE_SIZE"
+
+/**
+ * GUM_CONFIG_DBUS_CHANGE_LOG_SIZE:
+ *
+ * Number of most recent user changes, and separately group changes, the
+ * daemon remembers for the getChangesSince methods of the user and group
+ * services. Clients asking for older changes are told to resync. If set to
+ * 0, changes are not remembered.
+ */
+#define GUM_CONFIG_DBUS_CHANGE_LOG_SIZE    GUM_CONFIG_DBUS_TIMEOUTS \
+                                                "/CHANGE_LOG_SIZE"
+
+/**
+ * GUM_CONFIG_DBUS_CHANGE_SIGNAL_DELAY:
+ *
+ * A delay in milliseconds over which user and group changes are collected
+ * before a single usersChanged or groupsChanged signal reports them all. If
+ * set to 0, these signals are not emitted. The per user and per group added,
+ * deleted and updated signals are emitted regardless.
+ */
+#define GUM_CONFIG_DBUS_CHANGE_SIGNAL_DELAY GUM_CONFIG_DBUS_TIMEOUTS \
+                                                "/CHANGE_SIGNAL_DELAY"
+/**
+ * GUM_CONFIG_DBUS_LIMITS:
+ *
+ * A prefix for dbus rate limit keys. Should be used only when defining new
+ * keys.
+ */
+#define GUM_CONFIG_DBUS_LIMITS             "RateLimits"
+
+/**
+ * GUM_CONFIG_DBUS_WRITE_RATE:
+ *
+ * Maximum sustained number of write requests (adding, updating and deleting
+ * users and groups) per minute accepted from a single client. Requests over
+ * the limit fail with #GUM_ERROR_RATE_LIMITED. If set to 0 (the default),
+ * write requests are not limited.
+ */
+#define GUM_CONFIG_DBUS_WRITE_RATE         GUM_CONFIG_DBUS_LIMITS \
+                                                "/WRITE_RATE"
+
+/**
+ * GUM_CONFIG_DBUS_WRITE_BURST:
+ *
+ * Number of write requests a single client can issue in a row before
+ * #GUM_CONFIG_DBUS_WRITE_RATE applies. Default is 20.
+ */
+#define GUM_CONFIG_DBUS_WRITE_BURST        GUM_CONFIG_DBUS_LIMITS \
+                                                "/WRITE_BURST"
+
+/**
+ * GUM_CONFIG_DBUS_CREATE_RATE:
+ *
+ * Maximum sustained number of new user and group dbus objects per minute
+ * created for a single client. Requests over the limit fail with
+ * #GUM_ERROR_RATE_LIMITED. If set to 0 (the default), object creation is not
+ * limited.
+ */
+#define GUM_CONFIG_DBUS_CREATE_RATE        GUM_CONFIG_DBUS_LIMITS \
+                                                "/CREATE_RATE"
+
+/**
+ * GUM_CONFIG_DBUS_CREATE_BURST:
+ *
+ * Number of new user and group dbus objects a single client can create in a
+ * row before #GUM_CONFIG_DBUS_CREATE_RATE applies. Default is 10.
+ */
+#define GUM_CONFIG_DBUS_CREATE_BURST       GUM_CONFIG_DBUS_LIMITS \
+                                                "/CREATE_BURST"
+
+/**
+ * GUM_CONFIG_DBUS_THREADS:
+ *
+ * A prefix for dbus threading keys. Should be used only when defining new
+ * keys.
+ */
+#define GUM_CONFIG_DBUS_THREADS            "Threads"
+
+/**
+ * GUM_CONFIG_DBUS_P2P_WORKERS:
+ *
+ * Number of worker threads serving P2P DBus connections. Each accepted
+ * connection is handed to the worker thread serving the fewest connections
+ * and all its requests are processed there. The user and group objects of a
+ * connection are private copies, so workers never modify objects another
+ * worker reads. If not set (or set to 0), all connections are served from the
+ * main thread. Has no effect if P2P DBus is not in use.
+ */
+#define GUM_CONFIG_DBUS_P2P_WORKERS        GUM_CONFIG_DBUS_THREADS \
+                                                "/P2P_WORKERS"
+
+/**
+ * GUM_CONFIG_DBUS_THREADED_READS:
+ *
+ * If set to 1, read-only UserService and GroupService requests (getUser,
+ * getUserByName, getUserList, getUserListFd, getGroup, getGroupByName,
+ * getChangesSince and getSnapshot) received on the message bus are handled
+ * directly in GDBus worker threads, so that lookups are served in parallel.
+ * Lookups only wait for the database while it is written; getSnapshot may
+ * rewrite the snapshot file and waits for other lookups. The user and group
+ * objects are still exported from the main thread. If not
+ * set (or set to 0), all requests are handled from the main thread. Has no
+ * effect if P2P DBus is in use.
+ */
+#define GUM_CONFIG_DBUS_THREADED_READS     GUM_CONFIG_DBUS_THREADS \
+                                                "/THREADED_READS"
+
 #endif /* __GUM_CONFIG_DBUS_H_ */
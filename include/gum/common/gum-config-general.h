@@ -137,6 +137,21 @@
 #define GUM_CONFIG_GENERAL_HOME_DIR_PREF    GUM_CONFIG_GENERAL \
                                               "/HOME_DIR"
 
+/**
+ * GUM_CONFIG_GENERAL_HOME_DIR_LAYOUT:
+ *
+ * Layout of the home directories created under
+ * #GUM_CONFIG_GENERAL_HOME_DIR_PREF. With 'flat', user 'newu' home directory
+ * is '/home/newu'. To keep the directories small with many users, 'hash2'
+ * adds a subdirectory named after the first 2 hex digits of the md5 sum of
+ * the user name, e.g. '/home/28/newu', and 'hash2x2' adds another one for
+ * the next 2 digits, e.g. '/home/28/ed/newu'. Existing home directories can
+ * be moved to the configured layout with 'gum-utils --migrate-home-dirs'.
+ * Default value is 'flat'
+ */
+#define GUM_CONFIG_GENERAL_HOME_DIR_LAYOUT  GUM_CONFIG_GENERAL \
+                                              "/HOME_DIR_LAYOUT"
+
 /**
  * GUM_CONFIG_GENERAL_SHELL:
  *
@@ -173,6 +188,21 @@
 #define GUM_CONFIG_GENERAL_USERINFO_DIR         GUM_CONFIG_GENERAL \
                                               "/USERINFO_DIR"
 
+/**
+ * GUM_CONFIG_GENERAL_SNAPSHOT_FILE:
+ *
+ * Path to the read-only snapshot of the user and group database, which is
+ * replaced shortly after changes and handed to clients for local lookups. The
+ * directory is created if needed. Set to an empty value to disable the
+ * snapshot. Default value is '/run/gumd/snapshot'
+ *
+ * Can be overriden in debug builds by setting UM_SNAPSHOT_FILE
+ * environment variable. The NSS module only reads the snapshot from the path
+ * set at build time with --enable-snapshotfile.
+ */
+#define GUM_CONFIG_GENERAL_SNAPSHOT_FILE    GUM_CONFIG_GENERAL \
+                                              "/SNAPSHOT_FILE"
+
 /**
  * GUM_CONFIG_GENERAL_UID_MIN:
  *
@@ -301,6 +331,16 @@
 #define GUM_CONFIG_GENERAL_ENCRYPT_METHOD    GUM_CONFIG_GENERAL \
 	                                          "/ENCRYPT_METHOD"
 
+/**
+ * GUM_CONFIG_GENERAL_LOCK_TIMEOUT:
+ *
+ * Time in milliseconds to wait for the user/group database lock when it is
+ * held by another process, before the operation fails. 0 means failing at
+ * once. Default value is: #GUM_LOCK_PWDF_TIMEOUT_DEFAULT.
+ */
+#define GUM_CONFIG_GENERAL_LOCK_TIMEOUT    GUM_CONFIG_GENERAL \
+                                           "/LOCK_TIMEOUT"
+
 /**
  * GUM_CONFIG_GENERAL_SMACK64_NEW_FILES:
  *
@@ -40,6 +40,7 @@ typedef enum {
     GUM_ERROR_UNKNOWN = 1,
     GUM_ERROR_INTERNAL_SERVER,
     GUM_ERROR_PERMISSION_DENIED,
+    GUM_ERROR_RATE_LIMITED,
 
     GUM_ERROR_USER_ALREADY_EXISTS = 32,
     GUM_ERROR_USER_GROUP_ADD_FAILURE,
@@ -73,6 +74,7 @@ typedef enum {
     GUM_ERROR_HOME_DIR_CREATE_FAILURE,
     GUM_ERROR_HOME_DIR_DELETE_FAILURE,
     GUM_ERROR_HOME_DIR_COPY_FAILURE,
+    GUM_ERROR_DAEMON_RUNNING,
 
     GUM_ERROR_INVALID_NAME = 120,
     GUM_ERROR_INVALID_NICKNAME,
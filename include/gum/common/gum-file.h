@@ -75,6 +75,10 @@ gum_file_close_db_files (
         FILE *dup_file,
         GError **error);
 
+struct passwd *
+gum_file_getpwent (
+        FILE *fp);
+
 struct passwd *
 gum_file_getpwnam (
         const gchar *username,
@@ -115,6 +119,12 @@ gum_file_new_path (
 		const gchar *dir,
 		const gchar *filename);
 
+gchar *
+gum_file_get_home_dir_path (
+        const gchar *prefix,
+        const gchar *layout,
+        const gchar *username);
+
 gboolean
 gum_file_create_home_dir (
         const gchar *home_dir,
@@ -128,6 +138,17 @@ gum_file_delete_home_dir (
         const gchar *dir,
         GError **error);
 
+gboolean
+gum_file_trash_home_dir (
+        const gchar *dir,
+        const gchar *trash_dir,
+        GError **error);
+
+gboolean
+gum_file_empty_trash_dir (
+        const gchar *trash_dir,
+        GError **error);
+
 G_END_DECLS
 
 #endif /* __GUM_FILE_H_ */
@@ -30,6 +30,18 @@
 
 G_BEGIN_DECLS
 
+/**
+ * GUM_LOCK_PWDF_TIMEOUT_DEFAULT:
+ *
+ * Default time in milliseconds to wait for the user/group database lock, same
+ * as that of lckpwdf (3).
+ */
+#define GUM_LOCK_PWDF_TIMEOUT_DEFAULT 15000
+
+void
+gum_lock_pwdf_set_timeout (
+        guint timeout);
+
 gboolean
 gum_lock_pwdf_lock (void);
 
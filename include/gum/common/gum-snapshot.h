@@ -0,0 +1,127 @@
+/* vi: set et sw=4 ts=4 cino=t0,(0: */
+/* -*- Mode: C; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+/*
+ * This file is part of gum
+ *
+ * Copyright (C) 2013 Intel Corporation.
+ *
+ * Contact: Imran Zaman <imran.zaman@intel.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+
+#ifndef __GUM_SNAPSHOT_H_
+#define __GUM_SNAPSHOT_H_
+
+#include <glib.h>
+#include <pwd.h>
+#include <grp.h>
+
+G_BEGIN_DECLS
+
+typedef struct _GumSnapshot GumSnapshot;
+
+gboolean
+gum_snapshot_write (
+        const gchar *path,
+        const gchar *passwd_file,
+        const gchar *group_file,
+        guint64 generation,
+        GError **error);
+
+GumSnapshot *
+gum_snapshot_new_from_fd (
+        gint fd,
+        GError **error);
+
+GumSnapshot *
+gum_snapshot_new_from_file (
+        const gchar *path,
+        GError **error);
+
+GumSnapshot *
+gum_snapshot_ref (
+        GumSnapshot *self);
+
+void
+gum_snapshot_unref (
+        GumSnapshot *self);
+
+guint64
+gum_snapshot_get_generation (
+        GumSnapshot *self);
+
+gboolean
+gum_snapshot_is_current (
+        GumSnapshot *self);
+
+gboolean
+gum_snapshot_is_in_sync (
+        GumSnapshot *self,
+        const gchar *passwd_file,
+        const gchar *group_file);
+
+gint
+gum_snapshot_getpwuid (
+        GumSnapshot *self,
+        uid_t uid,
+        struct passwd *pwd,
+        gchar *buf,
+        gsize buflen);
+
+gint
+gum_snapshot_getpwnam (
+        GumSnapshot *self,
+        const gchar *username,
+        struct passwd *pwd,
+        gchar *buf,
+        gsize buflen);
+
+gint
+gum_snapshot_getpwent (
+        GumSnapshot *self,
+        guint32 index,
+        struct passwd *pwd,
+        gchar *buf,
+        gsize buflen);
+
+gint
+gum_snapshot_getgrgid (
+        GumSnapshot *self,
+        gid_t gid,
+        struct group *grp,
+        gchar *buf,
+        gsize buflen);
+
+gint
+gum_snapshot_getgrnam (
+        GumSnapshot *self,
+        const gchar *groupname,
+        struct group *grp,
+        gchar *buf,
+        gsize buflen);
+
+gint
+gum_snapshot_getgrent (
+        GumSnapshot *self,
+        guint32 index,
+        struct group *grp,
+        gchar *buf,
+        gsize buflen);
+
+G_END_DECLS
+
+#endif /* __GUM_SNAPSHOT_H_ */
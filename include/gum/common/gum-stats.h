@@ -0,0 +1,63 @@
+/* vi: set et sw=4 ts=4 cino=t0,(0: */
+/* -*- Mode: C; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+/*
+ * This file is part of gum
+ *
+ * Copyright (C) 2013 Intel Corporation.
+ *
+ * Contact: Imran Zaman <imran.zaman@intel.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+
+#ifndef __GUM_STATS_H_
+#define __GUM_STATS_H_
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/* phases of the account operations, shared by all the operations */
+#define GUM_STATS_PHASE_LOCK_WAIT       "phase.lockWait"
+#define GUM_STATS_PHASE_LOCK_HOLD       "phase.lockHold"
+#define GUM_STATS_PHASE_ID_ALLOC        "phase.idAlloc"
+#define GUM_STATS_PHASE_FILE_REWRITE    "phase.fileRewrite"
+#define GUM_STATS_PHASE_FSYNC           "phase.fsync"
+#define GUM_STATS_PHASE_CRYPT           "phase.crypt"
+#define GUM_STATS_PHASE_SCRIPTS         "phase.scripts"
+#define GUM_STATS_PHASE_HOME_DIR        "phase.homeDir"
+
+/* lock acquisitions which found the lock held by another process; failed
+ * ones timed out */
+#define GUM_STATS_LOCK_CONTENDED        "lock.contended"
+
+#define GUM_STATS_VARIANT_TYPE  ((const GVariantType *) "a{s(ttttttta(tt))}")
+
+void
+gum_stats_record (
+        const gchar *name,
+        gint64 start_time,
+        gboolean failed);
+
+GVariant *
+gum_stats_to_variant (void);
+
+void
+gum_stats_reset (void);
+
+G_END_DECLS
+
+#endif /* __GUM_STATS_H_ */
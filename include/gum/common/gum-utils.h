@@ -58,6 +58,17 @@ gum_utils_run_group_scripts (
         gid_t gid,
         uid_t uid);
 
+gint
+gum_utils_variant_to_fd (
+        GVariant *variant,
+        GError **error);
+
+GVariant *
+gum_utils_variant_new_from_fd (
+        gint fd,
+        const GVariantType *type,
+        GError **error);
+
 G_END_DECLS
 
 #endif  /* _GUM_UTILS_H_ */
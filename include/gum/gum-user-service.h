@@ -63,6 +63,23 @@ struct _GumUserServiceClass
 
 typedef GList GumUserList;
 
+/**
+ * GumUserListFlags:
+ * @GUM_USER_LIST_FLAGS_NONE: each listed user is fetched with its remote
+ * object, as by #gum_user_get_sync
+ * @GUM_USER_LIST_FLAGS_RECORDS: the listed users are built from records
+ * handed over in a sealed memory file, without a remote object. The object is
+ * only fetched when the user is changed or a property the record lacks (e.g.
+ * the icon) is read. Falls back to #GUM_USER_LIST_FLAGS_NONE if the
+ * connection does not support file descriptor passing.
+ *
+ * Flags for #gum_user_service_get_user_list_full.
+ */
+typedef enum {
+    GUM_USER_LIST_FLAGS_NONE = 0,
+    GUM_USER_LIST_FLAGS_RECORDS = 1 << 0
+} GumUserListFlags;
+
 typedef void (*GumUserServiceCb) (
         GumUserService *service,
         const GError *error,
@@ -98,6 +115,20 @@ gum_user_service_get_user_list_sync (
         GumUserService *self,
         const gchar *const *types);
 
+gboolean
+gum_user_service_get_user_list_full (
+        GumUserService *self,
+        const gchar *const *types,
+        GumUserListFlags flags,
+        GumUserServiceListCb callback,
+        gpointer user_data);
+
+GumUserList *
+gum_user_service_get_user_list_full_sync (
+        GumUserService *self,
+        const gchar *const *types,
+        GumUserListFlags flags);
+
 void
 gum_user_service_list_free (
         GumUserList *users);
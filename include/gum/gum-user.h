@@ -132,6 +132,14 @@ gboolean
 gum_user_update_sync (
         GumUser *self);
 
+struct passwd *
+gum_user_lookup_by_uid (
+        uid_t uid);
+
+struct passwd *
+gum_user_lookup_by_name (
+        const gchar *username);
+
 G_END_DECLS
 
 #endif /* __GUM_USER_H_ */
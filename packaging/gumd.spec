@@ -31,7 +31,7 @@ Requires(postun): /sbin/ldconfig
 BuildRequires: pkgconfig(systemd)
 BuildRequires: pkgconfig(dbus-1)
 BuildRequires: pkgconfig(gtk-doc)
-BuildRequires: pkgconfig(glib-2.0) >= 2.30
+BuildRequires: pkgconfig(glib-2.0) >= 2.32
 BuildRequires: pkgconfig(gobject-2.0)
 BuildRequires: pkgconfig(gio-2.0)
 BuildRequires: pkgconfig(gio-unix-2.0)
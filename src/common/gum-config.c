@@ -359,7 +359,19 @@ _load_config (
                 g_strcmp0 (GUM_CONFIG_GENERAL_PASS_MAX_DAYS, key) == 0 ||
                 g_strcmp0 (GUM_CONFIG_GENERAL_PASS_MIN_DAYS, key) == 0 ||
                 g_strcmp0 (GUM_CONFIG_GENERAL_PASS_WARN_AGE, key) == 0 ||
-                g_strcmp0 (GUM_CONFIG_DBUS_GROUP_TIMEOUT, key) == 0) {
+                g_strcmp0 (GUM_CONFIG_DBUS_GROUP_TIMEOUT, key) == 0 ||
+                g_strcmp0 (GUM_CONFIG_DBUS_USER_CACHE_SIZE, key) == 0 ||
+                g_strcmp0 (GUM_CONFIG_DBUS_GROUP_CACHE_SIZE, key) == 0 ||
+                g_strcmp0 (GUM_CONFIG_DBUS_CACHE_TIMEOUT, key) == 0 ||
+                g_strcmp0 (GUM_CONFIG_DBUS_NEGATIVE_CACHE_SIZE, key) == 0 ||
+                g_strcmp0 (GUM_CONFIG_DBUS_CHANGE_LOG_SIZE, key) == 0 ||
+                g_strcmp0 (GUM_CONFIG_DBUS_CHANGE_SIGNAL_DELAY, key) == 0 ||
+                g_strcmp0 (GUM_CONFIG_DBUS_WRITE_RATE, key) == 0 ||
+                g_strcmp0 (GUM_CONFIG_DBUS_WRITE_BURST, key) == 0 ||
+                g_strcmp0 (GUM_CONFIG_DBUS_CREATE_RATE, key) == 0 ||
+                g_strcmp0 (GUM_CONFIG_DBUS_CREATE_BURST, key) == 0 ||
+                g_strcmp0 (GUM_CONFIG_DBUS_P2P_WORKERS, key) == 0 ||
+                g_strcmp0 (GUM_CONFIG_DBUS_THREADED_READS, key) == 0) {
                 long cv;
                 if (_convert_strtol (value, NULL, 10, &cv) &&
                     cv <= INT_MAX &&
@@ -378,7 +390,8 @@ _load_config (
                     g_strcmp0 (GUM_CONFIG_GENERAL_GID_MAX, key) == 0 ||
                     g_strcmp0 (GUM_CONFIG_GENERAL_SYS_GID_MIN, key) == 0 ||
                     g_strcmp0 (GUM_CONFIG_GENERAL_SYS_GID_MAX, key) == 0 ||
-                    g_strcmp0 (GUM_CONFIG_GENERAL_UMASK, key) == 0) {
+                    g_strcmp0 (GUM_CONFIG_GENERAL_UMASK, key) == 0 ||
+                    g_strcmp0 (GUM_CONFIG_GENERAL_LOCK_TIMEOUT, key) == 0) {
                     unsigned long cv;
                     if (_convert_strtoul (value, NULL, 10, &cv) &&
                         cv <= UINT_MAX)
@@ -447,6 +460,10 @@ _load_environment (
     e_val = g_getenv ("UM_SKEL_DIR");
     if (e_val)
         gum_config_set_string (self, GUM_CONFIG_GENERAL_SKEL_DIR, e_val);
+
+    e_val = g_getenv ("UM_SNAPSHOT_FILE");
+    if (e_val)
+        gum_config_set_string (self, GUM_CONFIG_GENERAL_SNAPSHOT_FILE, e_val);
 }
 #endif  /* ENABLE_DEBUG */
 
@@ -574,6 +591,7 @@ gum_config_set_string (
          g_strcmp0 (key, GUM_CONFIG_GENERAL_GROUP_FILE) == 0 ||
          g_strcmp0 (key, GUM_CONFIG_GENERAL_GSHADOW_FILE) == 0 ||
          g_strcmp0 (key, GUM_CONFIG_GENERAL_SKEL_DIR) == 0 ||
+         g_strcmp0 (key, GUM_CONFIG_GENERAL_SNAPSHOT_FILE) == 0 ||
          g_strcmp0 (key, GUM_CONFIG_GENERAL_HOME_DIR_PREF) == 0)) {
          gchar *sysval = g_build_filename (self->priv->sysroot, value, NULL);
          gum_dictionary_set_string (self->priv->config_table, key, sysval);
@@ -642,10 +660,13 @@ _gum_config_initialize (
     } else  {
         gum_config_set_string (self, GUM_CONFIG_GENERAL_HOME_DIR_PREF, GUM_HOME_DIR_PREFIX);
     }
+    gum_config_set_string (self, GUM_CONFIG_GENERAL_HOME_DIR_LAYOUT, "flat");
 
     gum_config_set_string (self, GUM_CONFIG_GENERAL_SHELL, GUM_SHELL);
     gum_config_set_string (self, GUM_CONFIG_GENERAL_SEC_SHELL, GUM_SHELL);
     gum_config_set_string (self, GUM_CONFIG_GENERAL_SKEL_DIR, GUM_SKEL_DIR);
+    gum_config_set_string (self, GUM_CONFIG_GENERAL_SNAPSHOT_FILE,
+            GUM_SNAPSHOT_FILE);
 
     gum_config_set_uint (self, GUM_CONFIG_GENERAL_UID_MIN, UID_MIN);
     gum_config_set_uint (self, GUM_CONFIG_GENERAL_UID_MAX, UID_MAX);
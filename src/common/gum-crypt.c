@@ -31,6 +31,8 @@
 
 #include "common/gum-crypt.h"
 #include "common/gum-log.h"
+#include "common/gum-stats.h"
+#include "common/gum-trace.h"
 
 /**
  * SECTION:gum-crypt
@@ -115,11 +117,20 @@ gum_crypt_encrypt_secret (
         const gchar *encryp_algo)
 {
     gchar *enc_sec = NULL;
-    gchar *salt = _generate_salt (encryp_algo);
-    if (!salt) return NULL;
+    gint64 start = g_get_monotonic_time ();
+    gchar *salt = NULL;
+
+    GUM_TRACE1 (crypt__start, encryp_algo);
+    salt = _generate_salt (encryp_algo);
+    if (!salt) {
+        GUM_TRACE2 (crypt__done, encryp_algo, FALSE);
+        return NULL;
+    }
 
     enc_sec = g_strdup (crypt (secret, salt));
     g_free (salt);
+    gum_stats_record (GUM_STATS_PHASE_CRYPT, start, enc_sec == NULL);
+    GUM_TRACE2 (crypt__done, encryp_algo, enc_sec != NULL);
     return enc_sec;
 }
 
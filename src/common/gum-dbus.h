@@ -38,6 +38,8 @@
     "/org/O1/SecurityAccounts/gUserManagement/User"
 #define GUM_GROUP_SERVICE_OBJECTPATH     \
     "/org/O1/SecurityAccounts/gUserManagement/Group"
+#define GUM_STATS_OBJECTPATH             \
+    "/org/O1/SecurityAccounts/gUserManagement/Stats"
 
 #define GUM_DBUS_FREEDESKTOP_SERVICE    "org.freedesktop.DBus"
 #define GUM_DBUS_FREEDESKTOP_PATH       "/org/freedesktop/DBus"
@@ -92,6 +92,9 @@ struct _GumDisposablePrivate
     guint timeout;       /* timeout in seconds */
     volatile gint  keep_obj_counter; /* keep object request counter */
     guint timer_id;      /* timer source id */
+    GMainContext *context; /* context the timer sources are attached to */
+    GMutex lock;         /* guards the timer, which may be (re)set from any
+                            thread */
     gboolean delete_later;
 };
 
@@ -117,6 +120,36 @@ static guint       signals[SIG_MAX];
 
 G_DEFINE_ABSTRACT_TYPE (GumDisposable, gum_disposable, G_TYPE_OBJECT);
 
+static guint
+_attach_timer (
+        GumDisposable *self,
+        GSource *source,
+        GSourceFunc func)
+{
+    guint id = 0;
+
+    g_source_set_callback (source, func, self, NULL);
+    id = g_source_attach (source, self->priv->context);
+    g_source_unref (source);
+
+    return id;
+}
+
+static void
+_remove_timer (
+        GumDisposable *self)
+{
+    GSource *source = NULL;
+
+    if (!self->priv->timer_id) return;
+
+    source = g_main_context_find_source_by_id (self->priv->context,
+            self->priv->timer_id);
+    if (source)
+        g_source_destroy (source);
+    self->priv->timer_id = 0;
+}
+
 static void
 _set_property (
         GObject *object,
@@ -176,11 +209,12 @@ _dispose (
     GumDisposable *self = GUM_DISPOSABLE (object);
 
     DBG ("%s DISPOSE", G_OBJECT_TYPE_NAME (self));
+    g_mutex_lock (&self->priv->lock);
     if (self->priv->timer_id) {
         DBG (" - TIMER CLEAR");
-        g_source_remove (self->priv->timer_id);
-        self->priv->timer_id = 0;
+        _remove_timer (self);
     }
+    g_mutex_unlock (&self->priv->lock);
 
     G_OBJECT_CLASS (gum_disposable_parent_class)->dispose (object);
 }
@@ -191,7 +225,15 @@ _finalize (
 {
     g_return_if_fail (object && GUM_IS_DISPOSABLE (object));
 
+    GumDisposable *self = GUM_DISPOSABLE (object);
+
     DBG ("FINALIZE");
+    if (self->priv->context) {
+        g_main_context_unref (self->priv->context);
+        self->priv->context = NULL;
+    }
+    g_mutex_clear (&self->priv->lock);
+
     G_OBJECT_CLASS (gum_disposable_parent_class)->finalize (object);
 }
 
@@ -277,6 +319,9 @@ gum_disposable_init (
     self->priv = GUM_DISPOSABLE_PRIV (self);
 
     self->priv->timer_id = 0;
+    g_mutex_init (&self->priv->lock);
+    /* timers fire in the thread the object was created in */
+    self->priv->context = g_main_context_ref_thread_default ();
     self->priv->timeout = 0;
     self->priv->delete_later = FALSE;
     g_atomic_int_set(&self->priv->keep_obj_counter, 0);
@@ -307,8 +352,15 @@ _timer_dispose (
     GumDisposable *self = GUM_DISPOSABLE (user_data);
 
     DBG ("%s (%p) timer dispose", G_OBJECT_TYPE_NAME (self), self);
+    g_mutex_lock (&self->priv->lock);
+    /* timer was cancelled from another thread while firing */
+    if (g_source_is_destroyed (g_main_current_source ())) {
+        g_mutex_unlock (&self->priv->lock);
+        return FALSE;
+    }
     /* clear out timer since we are already inside timer cb */
     self->priv->timer_id = 0;
+    g_mutex_unlock (&self->priv->lock);
 
     return _auto_dispose (user_data);
 }
@@ -328,13 +380,13 @@ _update_timer (
 
     if (g_atomic_int_get(&self->priv->keep_obj_counter) == 0) {
         if (self->priv->timeout) {
-            self->priv->timer_id = g_timeout_add_seconds (self->priv->timeout,
-                    _timer_dispose,
-                    self);
+            _remove_timer (self);
+            self->priv->timer_id = _attach_timer (self,
+                    g_timeout_source_new_seconds (self->priv->timeout),
+                    _timer_dispose);
         }
     } else if (self->priv->timer_id) {
-        g_source_remove (self->priv->timer_id);
-        self->priv->timer_id = 0;
+        _remove_timer (self);
     }
 }
 
@@ -353,11 +405,16 @@ gum_disposable_set_auto_dispose (
 {
     g_return_if_fail (self && GUM_IS_DISPOSABLE (self));
 
-    if (g_atomic_int_get(&self->priv->keep_obj_counter) == 0 && dispose) return;
+    g_mutex_lock (&self->priv->lock);
+    if (g_atomic_int_get(&self->priv->keep_obj_counter) == 0 && dispose) {
+        g_mutex_unlock (&self->priv->lock);
+        return;
+    }
 
     g_atomic_int_add (&self->priv->keep_obj_counter, !dispose ? +1 : -1);
 
     _update_timer (self);
+    g_mutex_unlock (&self->priv->lock);
 }
 
 /**
@@ -375,11 +432,12 @@ gum_disposable_set_timeout (
 {
     g_return_if_fail (self && GUM_IS_DISPOSABLE (self));
 
-    if (self->priv->timeout == timeout) return;
-
-    self->priv->timeout = timeout;
-
-    _update_timer (self);
+    g_mutex_lock (&self->priv->lock);
+    if (self->priv->timeout != timeout) {
+        self->priv->timeout = timeout;
+        _update_timer (self);
+    }
+    g_mutex_unlock (&self->priv->lock);
 }
 
 /**
@@ -393,12 +451,14 @@ void
 gum_disposable_delete_later (
         GumDisposable *self)
 {
-    if (self->priv->timer_id)
-        g_source_remove (self->priv->timer_id);
+    g_mutex_lock (&self->priv->lock);
+    _remove_timer (self);
 
     DBG ("object (%p) '%s' about to dispose", self, G_OBJECT_TYPE_NAME (self));
-    self->priv->timer_id = g_idle_add (_auto_dispose, self);
+    self->priv->timer_id = _attach_timer (self, g_idle_source_new (),
+            _auto_dispose);
     self->priv->delete_later = TRUE;
+    g_mutex_unlock (&self->priv->lock);
 }
 
 /**
@@ -59,6 +59,8 @@
  * @GUM_ERROR_INTERNAL_SERVER: Server internal error
  * @GUM_ERROR_PERMISSION_DENIED: The operation cannot be performed due to
  * insufficient client permissions
+ * @GUM_ERROR_RATE_LIMITED: The request was rejected as the client exceeded
+ * its request rate limit or has too many requests pending
  * @GUM_ERROR_USER_ALREADY_EXISTS: User already exists
  * @GUM_ERROR_USER_GROUP_ADD_FAILURE: Adding/creating groups for the user
  * failure
@@ -91,6 +93,7 @@
  * @GUM_ERROR_HOME_DIR_CREATE_FAILURE: Directory create failure
  * @GUM_ERROR_HOME_DIR_DELETE_FAILURE: Directory delete failure
  * @GUM_ERROR_HOME_DIR_COPY_FAILURE: Directory copy failure
+ * @GUM_ERROR_DAEMON_RUNNING: Operation not allowed while gumd is running
  * @GUM_ERROR_INVALID_NAME: Invalid name specified
  * @GUM_ERROR_INVALID_NICKNAME: Invalid nickname specified
  * @GUM_ERROR_INVALID_SECRET: Invalid secret specified
@@ -149,6 +152,7 @@ GDBusErrorEntry _gum_errors[] =
     {GUM_ERROR_UNKNOWN, _ERROR_PREFIX".Unknown"},
     {GUM_ERROR_INTERNAL_SERVER, _ERROR_PREFIX".InternalServerError"},
     {GUM_ERROR_PERMISSION_DENIED, _ERROR_PREFIX".PermissionDenied"},
+    {GUM_ERROR_RATE_LIMITED, _ERROR_PREFIX".RateLimited"},
 
     {GUM_ERROR_USER_ALREADY_EXISTS, _ERROR_PREFIX".UserAlreadyExists"},
     {GUM_ERROR_USER_GROUP_ADD_FAILURE, _ERROR_PREFIX".UserGroupAddFailure"},
@@ -187,6 +191,7 @@ GDBusErrorEntry _gum_errors[] =
     {GUM_ERROR_HOME_DIR_CREATE_FAILURE, _ERROR_PREFIX".HomeDirCreateFailure"},
     {GUM_ERROR_HOME_DIR_DELETE_FAILURE, _ERROR_PREFIX".HomeDirDeleteFailure"},
     {GUM_ERROR_HOME_DIR_COPY_FAILURE, _ERROR_PREFIX".HomeDirCopyFailure"},
+    {GUM_ERROR_DAEMON_RUNNING, _ERROR_PREFIX".DaemonRunning"},
 
     {GUM_ERROR_INVALID_NAME, _ERROR_PREFIX".InvalidName"},
     {GUM_ERROR_INVALID_NICKNAME, _ERROR_PREFIX".InvalidNickName"},
@@ -31,9 +31,17 @@
 #endif
 #include <linux/xattr.h>
 
+#include <sys/ioctl.h>
+#include <sys/inotify.h>
+#include <sys/wait.h>
+#include <linux/fs.h>
+
 #include <unistd.h>
 #include <string.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <limits.h>
 #include <glib/gstdio.h>
 
 #include "common/gum-file.h"
@@ -42,6 +50,8 @@
 #include "common/gum-log.h"
 #include "common/gum-error.h"
 #include "common/gum-config.h"
+#include "common/gum-stats.h"
+#include "common/gum-trace.h"
 
 /**
  * SECTION:gum-file
@@ -310,17 +320,21 @@ gum_file_close_db_files (
 {
     gboolean retval = TRUE;
     gchar *old_file_path = NULL;
+    gint64 start = 0;
 
     if (source_file) fclose (source_file);
 
+    start = g_get_monotonic_time ();
     if (!dup_file ||
         fflush (dup_file) != 0 ||
         fsync (fileno (dup_file)) != 0 ||
         fclose (dup_file) != 0) {
+        gum_stats_record (GUM_STATS_PHASE_FSYNC, start, TRUE);
         GUM_SET_ERROR (GUM_ERROR_FILE_WRITE, "File write failure", error,
                 retval, FALSE);
         goto _fail;
     }
+    gum_stats_record (GUM_STATS_PHASE_FSYNC, start, FALSE);
 
     if (!source_file_path) {
         GUM_SET_ERROR(GUM_ERROR_FILE_WRITE, "null source file path", error,
@@ -386,7 +400,12 @@ gum_file_update (
     gboolean retval = TRUE;
     FILE *source_file = NULL, *dup_file = NULL;
     gchar *dup_file_path = NULL;
+#ifdef HAVE_SYS_SDT_H
+    glong bytes = -1;
+#endif
+    gint64 start = g_get_monotonic_time ();
 
+    GUM_TRACE2 (file_update__start, source_file_path, op);
     dup_file_path = g_strdup_printf ("%s-tmp.%lu", source_file_path,
             (unsigned long)getpid ());
     retval = gum_file_open_db_files (source_file_path, dup_file_path,
@@ -404,6 +423,9 @@ gum_file_update (
     if (!retval) {
         goto _close;
     }
+#ifdef HAVE_SYS_SDT_H
+    bytes = ftell (dup_file);
+#endif
 
     retval = gum_file_close_db_files (source_file_path, dup_file_path,
             source_file,  dup_file, error);
@@ -418,10 +440,176 @@ _close:
     }
 _finished:
     g_free (dup_file_path);
+    gum_stats_record (GUM_STATS_PHASE_FILE_REWRITE, start, !retval);
+    GUM_TRACE4 (file_update__done, source_file_path, op, retval, bytes);
 
     return retval;
 }
 
+/* entries read from the database files are kept in per thread buffers, as
+ * the daemon reads the files from several threads at once */
+#define GUM_FILE_ENTRY_BUFSIZE  1024
+
+typedef struct {
+    gchar *data;
+    gsize size;
+} GumFileEntryBuffer;
+
+typedef struct {
+    struct passwd pw;
+    GumFileEntryBuffer pw_buf;
+    struct spwd sp;
+    GumFileEntryBuffer sp_buf;
+    struct group gr;
+    GumFileEntryBuffer gr_buf;
+    struct sgrp sg;
+    GumFileEntryBuffer sg_buf;
+} GumFileEntries;
+
+static void
+_free_entries (
+        gpointer data)
+{
+    GumFileEntries *entries = (GumFileEntries *) data;
+
+    g_free (entries->pw_buf.data);
+    g_free (entries->sp_buf.data);
+    g_free (entries->gr_buf.data);
+    g_free (entries->sg_buf.data);
+    g_slice_free (GumFileEntries, entries);
+}
+
+static GPrivate entries_key = G_PRIVATE_INIT (_free_entries);
+
+static GumFileEntries *
+_get_entries ()
+{
+    GumFileEntries *entries = g_private_get (&entries_key);
+
+    if (!entries) {
+        entries = g_slice_new0 (GumFileEntries);
+        g_private_set (&entries_key, entries);
+    }
+    return entries;
+}
+
+/* makes room for a longer line and rewinds to its start */
+static gboolean
+_grow_buffer (
+        GumFileEntryBuffer *buf,
+        FILE *fp,
+        long pos)
+{
+    if (pos < 0 || fseek (fp, pos, SEEK_SET) < 0) {
+        return FALSE;
+    }
+    buf->size = buf->size ? buf->size * 2 : GUM_FILE_ENTRY_BUFSIZE;
+    buf->data = g_realloc (buf->data, buf->size);
+    return TRUE;
+}
+
+/* the reentrant readers of fgetpwent (3) and the like, failing with ERANGE
+ * until the buffer is large enough for the line */
+static struct passwd *
+_getpwent (
+        FILE *fp)
+{
+    GumFileEntries *entries = _get_entries ();
+    struct passwd *pent = NULL;
+    long pos = ftell (fp);
+
+    if (!entries->pw_buf.data && !_grow_buffer (&entries->pw_buf, fp, pos)) {
+        return NULL;
+    }
+    while (fgetpwent_r (fp, &entries->pw, entries->pw_buf.data,
+            entries->pw_buf.size, &pent) == ERANGE) {
+        if (!_grow_buffer (&entries->pw_buf, fp, pos)) {
+            return NULL;
+        }
+    }
+    return pent;
+}
+
+static struct spwd *
+_getspent (
+        FILE *fp)
+{
+    GumFileEntries *entries = _get_entries ();
+    struct spwd *spent = NULL;
+    long pos = ftell (fp);
+
+    if (!entries->sp_buf.data && !_grow_buffer (&entries->sp_buf, fp, pos)) {
+        return NULL;
+    }
+    while (fgetspent_r (fp, &entries->sp, entries->sp_buf.data,
+            entries->sp_buf.size, &spent) == ERANGE) {
+        if (!_grow_buffer (&entries->sp_buf, fp, pos)) {
+            return NULL;
+        }
+    }
+    return spent;
+}
+
+static struct group *
+_getgrent (
+        FILE *fp)
+{
+    GumFileEntries *entries = _get_entries ();
+    struct group *gent = NULL;
+    long pos = ftell (fp);
+
+    if (!entries->gr_buf.data && !_grow_buffer (&entries->gr_buf, fp, pos)) {
+        return NULL;
+    }
+    while (fgetgrent_r (fp, &entries->gr, entries->gr_buf.data,
+            entries->gr_buf.size, &gent) == ERANGE) {
+        if (!_grow_buffer (&entries->gr_buf, fp, pos)) {
+            return NULL;
+        }
+    }
+    return gent;
+}
+
+static struct sgrp *
+_getsgent (
+        FILE *fp)
+{
+    GumFileEntries *entries = _get_entries ();
+    struct sgrp *sgent = NULL;
+    long pos = ftell (fp);
+
+    if (!entries->sg_buf.data && !_grow_buffer (&entries->sg_buf, fp, pos)) {
+        return NULL;
+    }
+    while (fgetsgent_r (fp, &entries->sg, entries->sg_buf.data,
+            entries->sg_buf.size, &sgent) == ERANGE) {
+        if (!_grow_buffer (&entries->sg_buf, fp, pos)) {
+            return NULL;
+        }
+    }
+    return sgent;
+}
+
+/**
+ * gum_file_getpwent:
+ * @fp: (transfer none): the opened passwd file
+ *
+ * Reads the next passwd entry from @fp, like fgetpwent (3) but safe to call
+ * from several threads at once.
+ *
+ * Returns: (transfer none): passwd structure if successful, NULL at the end of
+ * the file or on error. It is valid until the next call from the same thread.
+ */
+struct passwd *
+gum_file_getpwent (
+        FILE *fp)
+{
+    if (!fp) {
+        return NULL;
+    }
+    return _getpwent (fp);
+}
+
 /**
  * gum_file_getpwnam:
  * @username: (transfer none): name of the user
@@ -430,6 +618,7 @@ _finished:
  * Gets the passwd structure from the file based on username.
  *
  * Returns: (transfer full): passwd structure if successful, NULL otherwise.
+ * It is valid until the next lookup of the same kind from the same thread.
  */
 struct passwd *
 gum_file_getpwnam (
@@ -446,7 +635,7 @@ gum_file_getpwnam (
     if (!(fp = _open_file (filename, "r"))) {
         return NULL;
     }
-    while ((pent = fgetpwent (fp)) != NULL) {
+    while ((pent = _getpwent (fp)) != NULL) {
         if(g_strcmp0 (username, pent->pw_name) == 0)
             break;
         pent = NULL;
@@ -464,6 +653,7 @@ gum_file_getpwnam (
  * Gets the passwd structure from the file based on uid.
  *
  * Returns: (transfer full): passwd structure if successful, NULL otherwise.
+ * It is valid until the next lookup of the same kind from the same thread.
  */
 struct passwd *
 gum_file_getpwuid (
@@ -481,7 +671,7 @@ gum_file_getpwuid (
         return NULL;
     }
 
-    while ((pent = fgetpwent (fp)) != NULL) {
+    while ((pent = _getpwent (fp)) != NULL) {
         if(uid == pent->pw_uid)
             break;
         pent = NULL;
@@ -499,6 +689,7 @@ gum_file_getpwuid (
  * Gets the passwd structure from the file based on the primary group id.
  *
  * Returns: (transfer full): passwd structure if successful, NULL otherwise.
+ * It is valid until the next lookup of the same kind from the same thread.
  */
 struct passwd *
 gum_file_find_user_by_gid (
@@ -516,7 +707,7 @@ gum_file_find_user_by_gid (
         return NULL;
     }
 
-    while ((pent = fgetpwent (fp)) != NULL) {
+    while ((pent = _getpwent (fp)) != NULL) {
         if(primary_gid == pent->pw_gid)
             break;
         pent = NULL;
@@ -534,6 +725,7 @@ gum_file_find_user_by_gid (
  * Gets the spwd structure from the file based on the username.
  *
  * Returns: (transfer full): spwd structure if successful, NULL otherwise.
+ * It is valid until the next lookup of the same kind from the same thread.
  */
 struct spwd *
 gum_file_getspnam (
@@ -551,7 +743,7 @@ gum_file_getspnam (
         return NULL;
     }
 
-    while ((spent = fgetspent (fp)) != NULL) {
+    while ((spent = _getspent (fp)) != NULL) {
         if(g_strcmp0 (username, spent->sp_namp) == 0)
             break;
         spent = NULL;
@@ -569,6 +761,7 @@ gum_file_getspnam (
  * Gets the group structure from the file based on the groupname @grname.
  *
  * Returns: (transfer full): group structure if successful, NULL otherwise.
+ * It is valid until the next lookup of the same kind from the same thread.
  */
 struct group *
 gum_file_getgrnam (
@@ -585,7 +778,7 @@ gum_file_getgrnam (
     if (!(fp = _open_file (filename, "r"))) {
         return NULL;
     }
-    while ((gent = fgetgrent (fp)) != NULL) {
+    while ((gent = _getgrent (fp)) != NULL) {
         if(g_strcmp0 (grname, gent->gr_name) == 0)
             break;
         gent = NULL;
@@ -603,6 +796,7 @@ gum_file_getgrnam (
  * Gets the group structure from the file based on the gid.
  *
  * Returns: (transfer full): group structure if successful, NULL otherwise.
+ * It is valid until the next lookup of the same kind from the same thread.
  */
 struct group *
 gum_file_getgrgid (
@@ -619,7 +813,7 @@ gum_file_getgrgid (
     if (!(fp = _open_file (filename, "r"))) {
         return NULL;
     }
-    while ((gent = fgetgrent (fp)) != NULL) {
+    while ((gent = _getgrent (fp)) != NULL) {
         if(gid == gent->gr_gid)
             break;
         gent = NULL;
@@ -637,6 +831,7 @@ gum_file_getgrgid (
  * Gets the sgrp structure from the file based on the groupname @grname.
  *
  * Returns: (transfer full): sgrp structure if successful, NULL otherwise.
+ * It is valid until the next lookup of the same kind from the same thread.
  */
 struct sgrp *
 gum_file_getsgnam (
@@ -655,7 +850,7 @@ gum_file_getsgnam (
         return NULL;
     }
 
-    while ((sgent = fgetsgent (fp)) != NULL) {
+    while ((sgent = _getsgent (fp)) != NULL) {
         if(g_strcmp0 (grname, sgent->sg_namp) == 0)
             break;
         sgent = NULL;
@@ -695,8 +890,510 @@ gum_file_new_path (
 	return file;
 }
 
+/**
+ * gum_file_get_home_dir_path:
+ * @prefix: (transfer none): the home directory prefix
+ * @layout: (transfer none): the layout of the home directories, as described
+ * for #GUM_CONFIG_GENERAL_HOME_DIR_LAYOUT; NULL is the same as 'flat'
+ * @username: (transfer none): name of the user
+ *
+ * Builds the default home directory path of the user, e.g.
+ * '/home/28/newu' for the 'hash2' layout.
+ *
+ * Returns: (transfer full): the path if successful, NULL otherwise.
+ */
+gchar *
+gum_file_get_home_dir_path (
+        const gchar *prefix,
+        const gchar *layout,
+        const gchar *username)
+{
+    gchar *hash = NULL, *path = NULL;
+
+    if (!prefix || !username) {
+        return NULL;
+    }
+
+    if (!layout || g_strcmp0 (layout, "flat") == 0) {
+        return g_strdup_printf ("%s/%s", prefix, username);
+    }
+
+    /* md5 is used for a well spread, stable prefix which can be computed
+     * with standard tools; it has nothing to do with security here */
+    hash = g_compute_checksum_for_string (G_CHECKSUM_MD5, username, -1);
+    if (g_strcmp0 (layout, "hash2") == 0) {
+        path = g_strdup_printf ("%s/%.2s/%s", prefix, hash, username);
+    } else if (g_strcmp0 (layout, "hash2x2") == 0) {
+        path = g_strdup_printf ("%s/%.2s/%.2s/%s", prefix, hash, hash + 2,
+                username);
+    } else {
+        WARN ("Unknown home dir layout '%s', using flat", layout);
+        path = g_strdup_printf ("%s/%s", prefix, username);
+    }
+    g_free (hash);
+
+    return path;
+}
+
+/*
+ * The skeleton directory is scanned once into a manifest of its entries
+ * (paths, modes, symlink targets and extended attributes), which is kept
+ * until the skeleton changes: inotify watches on its directories tell when,
+ * or if those can not be set up, the change times of the entries are
+ * compared. A home directory is then created by replaying the manifest: the
+ * directories are made first, the files are copied on a small thread pool
+ * (reflinked when the file system supports it, otherwise copied with
+ * copy_file_range or read/write), and the attributes of the directories are
+ * set last, deepest first, so that read-only directories can be filled in.
+ */
+#define GUM_SKEL_COPY_THREADS 4
+#define GUM_SKEL_COPY_BUFSIZE (64 * 1024)
+#define GUM_SKEL_WATCH_EVENTS (IN_ATTRIB | IN_CREATE | IN_DELETE | \
+        IN_DELETE_SELF | IN_MOVE_SELF | IN_MOVED_FROM | IN_MOVED_TO)
+
+typedef struct {
+    gchar *name;
+    gchar *value;
+    gsize size;
+} GumSkelXattr;
+
+typedef struct {
+    gchar *path; /* relative to the skeleton dir */
+    mode_t mode;
+    ino_t ino;
+    struct timespec ctime;
+    gchar *target;
+    GArray *xattrs;
+} GumSkelEntry;
+
+typedef struct {
+    gint ref_count;
+    gchar *skel_dir;
+    GArray *entries; /* parents before children, the skeleton dir first */
+    gint inotify_fd;
+} GumSkelManifest;
+
+typedef struct {
+    GThreadPool *pool;
+    GMutex mutex;
+    GCond cond;
+    guint pending;
+    gboolean failed;
+    gint src_fd;
+    gint dest_fd;
+    const gchar *dest;
+    uid_t uid;
+    gid_t gid;
+    gchar *smack_label;
+} GumSkelCopy;
+
+static GumSkelManifest *skel_manifest = NULL;
+static GMutex skel_mutex;
+
+static void
+_skel_xattr_clear (
+        gpointer data)
+{
+    GumSkelXattr *xattr = (GumSkelXattr *) data;
+    g_free (xattr->name);
+    g_free (xattr->value);
+}
+
+static void
+_skel_entry_clear (
+        gpointer data)
+{
+    GumSkelEntry *entry = (GumSkelEntry *) data;
+    g_free (entry->path);
+    g_free (entry->target);
+    if (entry->xattrs) g_array_unref (entry->xattrs);
+}
+
+static GArray *
+_skel_read_xattrs (
+        gint fd)
+{
+    GArray *xattrs = NULL;
+#if defined(HAVE_LLISTXATTR) && \
+    defined(HAVE_LGETXATTR) && \
+    defined(HAVE_LSETXATTR)
+    ssize_t attrs_size = 0, size = 0;
+    gchar *names = NULL, *name = NULL;
+    GumSkelXattr xattr;
+
+    attrs_size = flistxattr (fd, NULL, 0);
+    if (attrs_size <= 0)
+        return NULL;
+
+    names = g_new0 (gchar, attrs_size + 1);
+    attrs_size = flistxattr (fd, names, attrs_size);
+    for (name = names; attrs_size > 0 && name < names + attrs_size;
+         name = strchr (name, '\0') + 1) {
+        if (name[0] == '\0' ||
+            (size = fgetxattr (fd, name, NULL, 0)) <= 0)
+            continue;
+        xattr.value = g_malloc (size);
+        if ((size = fgetxattr (fd, name, xattr.value, size)) <= 0) {
+            g_free (xattr.value);
+            continue;
+        }
+        if (!xattrs) {
+            xattrs = g_array_new (FALSE, FALSE, sizeof (GumSkelXattr));
+            g_array_set_clear_func (xattrs, _skel_xattr_clear);
+        }
+        xattr.name = g_strdup (name);
+        xattr.size = size;
+        g_array_append_val (xattrs, xattr);
+    }
+    g_free (names);
+#endif
+    return xattrs;
+}
+
+static GumSkelManifest *
+_skel_manifest_ref (
+        GumSkelManifest *manifest)
+{
+    g_atomic_int_inc (&manifest->ref_count);
+    return manifest;
+}
+
+static void
+_skel_manifest_unref (
+        GumSkelManifest *manifest)
+{
+    if (!g_atomic_int_dec_and_test (&manifest->ref_count))
+        return;
+
+    if (manifest->inotify_fd >= 0) close (manifest->inotify_fd);
+    g_array_unref (manifest->entries);
+    g_free (manifest->skel_dir);
+    g_slice_free (GumSkelManifest, manifest);
+}
+
+static void
+_skel_manifest_watch (
+        GumSkelManifest *manifest,
+        const gchar *path)
+{
+    gchar *full_path = NULL;
+
+    if (manifest->inotify_fd < 0)
+        return;
+
+    full_path = g_build_filename (manifest->skel_dir, path, NULL);
+    if (inotify_add_watch (manifest->inotify_fd, full_path,
+            GUM_SKEL_WATCH_EVENTS) < 0) {
+        WARN ("Unable to watch %s (%s), checking change times instead",
+                full_path, g_strerror (errno));
+        close (manifest->inotify_fd);
+        manifest->inotify_fd = -1;
+    }
+    g_free (full_path);
+}
+
+static gboolean
+_skel_manifest_add (
+        GumSkelManifest *manifest,
+        gint dir_fd,
+        const gchar *name,
+        const gchar *path,
+        gint *fd)
+{
+    GumSkelEntry entry;
+    struct stat st;
+    gchar target[PATH_MAX];
+    ssize_t len = 0;
+
+    memset (&entry, 0, sizeof (GumSkelEntry));
+    *fd = -1;
+    if (fstatat (dir_fd, name, &st, AT_SYMLINK_NOFOLLOW) < 0)
+        return FALSE;
+
+    if (S_ISLNK (st.st_mode)) {
+        len = readlinkat (dir_fd, name, target, sizeof (target) - 1);
+        if (len < 0) return FALSE;
+        entry.target = g_strndup (target, len);
+    } else if (S_ISDIR (st.st_mode) || S_ISREG (st.st_mode)) {
+        *fd = openat (dir_fd, name, O_RDONLY | O_NOFOLLOW | O_CLOEXEC |
+                (S_ISDIR (st.st_mode) ? O_DIRECTORY : 0));
+        if (*fd < 0) return FALSE;
+        entry.xattrs = _skel_read_xattrs (*fd);
+    } else {
+        DBG ("skip special file %s", path);
+        return TRUE;
+    }
+
+    entry.path = g_strdup (path);
+    entry.mode = st.st_mode;
+    entry.ino = st.st_ino;
+    entry.ctime = st.st_ctim;
+    g_array_append_val (manifest->entries, entry);
+    return TRUE;
+}
+
+static gboolean
+_skel_manifest_scan (
+        GumSkelManifest *manifest,
+        gint dir_fd,
+        const gchar *dir_path)
+{
+    DIR *dp = NULL;
+    struct dirent *ent = NULL;
+    gchar *path = NULL;
+    gint fd = -1;
+    gboolean ok = TRUE;
+
+    _skel_manifest_watch (manifest, dir_path);
+    if (!(dp = fdopendir (dir_fd))) {
+        close (dir_fd);
+        return FALSE;
+    }
+
+    while (ok && (ent = readdir (dp))) {
+        if (g_strcmp0 (ent->d_name, ".") == 0 ||
+            g_strcmp0 (ent->d_name, "..") == 0)
+            continue;
+
+        path = g_build_filename (dir_path, ent->d_name, NULL);
+        ok = _skel_manifest_add (manifest, dirfd (dp), ent->d_name, path, &fd);
+        if (ok && fd >= 0) {
+            if (S_ISDIR (g_array_index (manifest->entries, GumSkelEntry,
+                    manifest->entries->len - 1).mode))
+                ok = _skel_manifest_scan (manifest, fd, path);
+            else
+                close (fd);
+        }
+        g_free (path);
+    }
+    closedir (dp);
+    return ok;
+}
+
+static GumSkelManifest *
+_skel_manifest_new (
+        const gchar *skel_dir)
+{
+    GumSkelManifest *manifest = g_slice_new0 (GumSkelManifest);
+    gint fd = -1;
+    gboolean ok = FALSE;
+
+    DBG ("scan skeleton directory %s", skel_dir);
+    manifest->ref_count = 1;
+    manifest->skel_dir = g_strdup (skel_dir);
+    manifest->entries = g_array_new (FALSE, FALSE, sizeof (GumSkelEntry));
+    g_array_set_clear_func (manifest->entries, _skel_entry_clear);
+    manifest->inotify_fd = inotify_init1 (IN_NONBLOCK | IN_CLOEXEC);
+
+    /* the directory itself is "." so that the paths are relative to it */
+    ok = _skel_manifest_add (manifest, AT_FDCWD, skel_dir, ".", &fd) &&
+         fd >= 0 && S_ISDIR (g_array_index (manifest->entries, GumSkelEntry,
+                 0).mode);
+    if (ok) {
+        ok = _skel_manifest_scan (manifest, fd, ".");
+    } else if (fd >= 0) {
+        close (fd);
+    }
+
+    if (!ok) {
+        WARN ("Unable to scan skeleton directory %s: %s", skel_dir,
+                g_strerror (errno));
+        _skel_manifest_unref (manifest);
+        return NULL;
+    }
+    return manifest;
+}
+
+static gboolean
+_skel_manifest_is_valid (
+        GumSkelManifest *manifest)
+{
+    gchar buf[sizeof (struct inotify_event) + NAME_MAX + 1];
+    GumSkelEntry *entry = NULL;
+    struct stat st;
+    gboolean valid = TRUE;
+    gint fd = -1;
+    guint i;
+
+    if (manifest->inotify_fd >= 0) {
+        return read (manifest->inotify_fd, buf, sizeof (buf)) < 0 &&
+               errno == EAGAIN;
+    }
+
+    /* a new or removed entry changes the change time of its directory */
+    if ((fd = open (manifest->skel_dir,
+            O_RDONLY | O_DIRECTORY | O_CLOEXEC)) < 0)
+        return FALSE;
+    for (i = 0; valid && i < manifest->entries->len; i++) {
+        entry = &g_array_index (manifest->entries, GumSkelEntry, i);
+        valid = fstatat (fd, entry->path, &st, AT_SYMLINK_NOFOLLOW) == 0 &&
+                st.st_ino == entry->ino && st.st_mode == entry->mode &&
+                st.st_ctim.tv_sec == entry->ctime.tv_sec &&
+                st.st_ctim.tv_nsec == entry->ctime.tv_nsec;
+    }
+    close (fd);
+    return valid;
+}
+
+static GumSkelManifest *
+_skel_manifest_get (
+        const gchar *skel_dir)
+{
+    GumSkelManifest *manifest = NULL;
+
+    g_mutex_lock (&skel_mutex);
+    if (skel_manifest &&
+        (g_strcmp0 (skel_manifest->skel_dir, skel_dir) != 0 ||
+         !_skel_manifest_is_valid (skel_manifest))) {
+        _skel_manifest_unref (skel_manifest);
+        skel_manifest = NULL;
+    }
+    if (!skel_manifest)
+        skel_manifest = _skel_manifest_new (skel_dir);
+    if (skel_manifest)
+        manifest = _skel_manifest_ref (skel_manifest);
+    g_mutex_unlock (&skel_mutex);
+
+    return manifest;
+}
+
+static gboolean
+_skel_set_attrs (
+        GumSkelCopy *copy,
+        const GumSkelEntry *entry,
+        gint fd)
+{
+#if defined(HAVE_LSETXATTR)
+    GumSkelXattr *xattr = NULL;
+    guint i;
+
+    if (copy->smack_label &&
+        fsetxattr (fd, XATTR_NAME_SMACK, copy->smack_label,
+                strlen (copy->smack_label), 0) != 0) {
+        return FALSE;
+    }
+    for (i = 0; entry->xattrs && i < entry->xattrs->len; i++) {
+        xattr = &g_array_index (entry->xattrs, GumSkelXattr, i);
+        if (fsetxattr (fd, xattr->name, xattr->value, xattr->size, 0) != 0)
+            return FALSE;
+    }
+#endif
+    return fchmod (fd, entry->mode & 07777) == 0 &&
+           fchown (fd, copy->uid, copy->gid) == 0;
+}
+
 static gboolean
-_copy_dir_recursively (
+_copy_fd_data (
+        gint src_fd,
+        gint dest_fd)
+{
+    gchar *buf = NULL;
+    ssize_t n = 0, written = 0, w = 0;
+
+#ifdef FICLONE
+    if (ioctl (dest_fd, FICLONE, src_fd) == 0)
+        return TRUE;
+#endif
+
+#ifdef HAVE_COPY_FILE_RANGE
+    /* the file offsets are advanced, so the fallback carries on from there */
+    while ((n = copy_file_range (src_fd, NULL, dest_fd, NULL, G_MAXINT32,
+            0)) != 0) {
+        if (n > 0 || errno == EINTR) continue;
+        if (errno != ENOSYS && errno != EXDEV && errno != EINVAL &&
+            errno != EOPNOTSUPP && errno != EBADF)
+            return FALSE;
+        break;
+    }
+    if (n == 0)
+        return TRUE;
+#endif
+
+    buf = g_malloc (GUM_SKEL_COPY_BUFSIZE);
+    while ((n = read (src_fd, buf, GUM_SKEL_COPY_BUFSIZE)) != 0) {
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+        for (written = 0; written < n; written += w) {
+            w = write (dest_fd, buf + written, n - written);
+            if (w < 0) {
+                if (errno == EINTR) { w = 0; continue; }
+                n = -1;
+                break;
+            }
+        }
+        if (n < 0) break;
+    }
+    g_free (buf);
+    return n == 0;
+}
+
+static gboolean
+_skel_copy_entry (
+        GumSkelCopy *copy,
+        const GumSkelEntry *entry)
+{
+    gint src_fd = -1, dest_fd = -1;
+    gboolean ok = FALSE;
+
+    if (S_ISLNK (entry->mode)) {
+        DBG ("copy symlink %s", entry->path);
+        unlinkat (copy->dest_fd, entry->path, 0);
+        ok = symlinkat (entry->target, copy->dest_fd, entry->path) == 0 &&
+             fchownat (copy->dest_fd, entry->path, copy->uid, copy->gid,
+                     AT_SYMLINK_NOFOLLOW) == 0;
+#if defined(HAVE_LSETXATTR)
+        if (ok && copy->smack_label) {
+            /* there is no fd based call for the link itself */
+            gchar *path = g_build_filename (copy->dest, entry->path, NULL);
+            ok = lsetxattr (path, XATTR_NAME_SMACK, copy->smack_label,
+                    strlen (copy->smack_label), 0) == 0;
+            g_free (path);
+        }
+#endif
+        return ok;
+    }
+
+    DBG ("copy file %s", entry->path);
+    src_fd = openat (copy->src_fd, entry->path,
+            O_RDONLY | O_NOFOLLOW | O_CLOEXEC);
+    dest_fd = openat (copy->dest_fd, entry->path,
+            O_WRONLY | O_CREAT | O_TRUNC | O_NOFOLLOW | O_CLOEXEC, 0600);
+    ok = src_fd >= 0 && dest_fd >= 0 &&
+         _copy_fd_data (src_fd, dest_fd) &&
+         _skel_set_attrs (copy, entry, dest_fd);
+    if (src_fd >= 0) close (src_fd);
+    if (dest_fd >= 0) close (dest_fd);
+    return ok;
+}
+
+static void
+_skel_copy_worker (
+        gpointer data,
+        gpointer user_data)
+{
+    const GumSkelEntry *entry = (const GumSkelEntry *) data;
+    GumSkelCopy *copy = (GumSkelCopy *) user_data;
+    gboolean failed = FALSE;
+
+    g_mutex_lock (&copy->mutex);
+    failed = copy->failed;
+    g_mutex_unlock (&copy->mutex);
+
+    if (!failed && !_skel_copy_entry (copy, entry)) {
+        WARN ("File copy failure %s: %s", entry->path, g_strerror (errno));
+        failed = TRUE;
+    }
+
+    g_mutex_lock (&copy->mutex);
+    if (failed) copy->failed = TRUE;
+    if (--copy->pending == 0) g_cond_signal (&copy->cond);
+    g_mutex_unlock (&copy->mutex);
+}
+
+static gboolean
+_copy_skel_dir (
         const gchar *src,
         const gchar *dest,
         uid_t uid,
@@ -704,12 +1401,14 @@ _copy_dir_recursively (
         guint umask,
         GError **error)
 {
-    gboolean retval = TRUE;
-    gboolean stop = FALSE;
-    const gchar *src_fname = NULL;
-    gchar *src_filepath = NULL, *dest_filepath = NULL;
-    GDir *src_dir = NULL;
-    struct stat stat_entry;
+    GumSkelManifest *manifest = NULL;
+    GumSkelEntry *entry = NULL;
+    GumSkelCopy copy;
+    GumConfig *config = NULL;
+    const gchar *smack_label = NULL;
+    gboolean ok = TRUE;
+    gint fd = -1;
+    guint i;
 
     if (!src || !dest) {
         GUM_RETURN_WITH_ERROR (GUM_ERROR_HOME_DIR_COPY_FAILURE,
@@ -717,82 +1416,91 @@ _copy_dir_recursively (
     }
 
     DBG ("copy directory %s -> %s", src, dest);
-    src_dir = g_dir_open (src, 0, NULL);
-    if (!src_dir) {
+    memset (&copy, 0, sizeof (GumSkelCopy));
+    copy.src_fd = open (src, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    copy.dest_fd = open (dest, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (copy.src_fd < 0 || copy.dest_fd < 0 ||
+        !(manifest = _skel_manifest_get (src))) {
+        if (copy.src_fd >= 0) close (copy.src_fd);
+        if (copy.dest_fd >= 0) close (copy.dest_fd);
         GUM_RETURN_WITH_ERROR (GUM_ERROR_HOME_DIR_COPY_FAILURE,
                 "Invalid source directory path", error, FALSE);
     }
 
-    while ((src_fname = g_dir_read_name (src_dir))) {
-        GError *err = NULL;
-        GFile *src_file = NULL, *dest_file = NULL;
-
-        src_filepath = g_build_filename (src, src_fname, NULL);
-        stop = (lstat(src_filepath, &stat_entry) != 0);
-        if (stop) goto _free_data;
-
-        dest_filepath = g_build_filename (dest, src_fname, NULL);
-        src_file = g_file_new_for_path (src_filepath);
-        dest_file = g_file_new_for_path (dest_filepath);
-
-        if (S_ISDIR (stat_entry.st_mode)) {
-            DBG ("copy directory %s", src_filepath);
-            gint mode = GUM_PERM & ~umask;
-            g_mkdir_with_parents (dest_filepath, mode);
-            stop = !_set_smack64_attr (dest_filepath,
-                    GUM_CONFIG_GENERAL_SMACK64_USER_FILES);
-            if (!stop)
-                stop = !_copy_dir_recursively (src_filepath, dest_filepath, uid,
-                    gid, umask, NULL);
-        } else {
-            DBG ("copy file %s", src_filepath);
-            if (!g_file_copy (src_file, dest_file,
-                    G_FILE_COPY_OVERWRITE | G_FILE_COPY_NOFOLLOW_SYMLINKS, NULL,
-                    NULL, NULL, &err)) {
-                WARN("File copy failure error %d:%s", err ? err->code : 0,
-                        err ? err->message : "");
-                if (err) g_error_free (err);
-                stop = TRUE;
-                goto _free_data;
-            }
-            stop = !_set_smack64_attr (dest_filepath,
-                    GUM_CONFIG_GENERAL_SMACK64_USER_FILES);
+    g_mutex_init (&copy.mutex);
+    g_cond_init (&copy.cond);
+    copy.dest = dest;
+    copy.uid = uid;
+    copy.gid = gid;
+    config = gum_config_new (NULL);
+    smack_label = gum_config_get_string (config,
+            GUM_CONFIG_GENERAL_SMACK64_USER_FILES);
+    if (smack_label && smack_label[0] != '\0')
+        copy.smack_label = g_strdup (smack_label);
+    g_object_unref (config);
+
+    /* the directories, parents first */
+    for (i = 1; ok && i < manifest->entries->len; i++) {
+        entry = &g_array_index (manifest->entries, GumSkelEntry, i);
+        if (S_ISDIR (entry->mode) &&
+            mkdirat (copy.dest_fd, entry->path, GUM_PERM & ~umask) < 0 &&
+            errno != EEXIST) {
+            WARN ("Unable to create %s: %s", entry->path, g_strerror (errno));
+            ok = FALSE;
         }
-        if (!stop) stop = !_copy_file_attributes (src_filepath, dest_filepath);
-        if (!stop) stop = (chown (dest_filepath, uid, gid) < 0);
-
-_free_data:
-        g_free (src_filepath);
-        g_free (dest_filepath);
-        GUM_OBJECT_UNREF (src_file);
-        GUM_OBJECT_UNREF (dest_file);
-        if (stop) {
-            GUM_SET_ERROR (GUM_ERROR_HOME_DIR_COPY_FAILURE,
-                    "Home directory copy failure", error, retval, FALSE);
-            break;
+    }
+
+    /* the files; without a pool they are copied right away */
+    copy.pool = ok ? g_thread_pool_new (_skel_copy_worker, &copy,
+            GUM_SKEL_COPY_THREADS, FALSE, NULL) : NULL;
+    for (i = 1; ok && i < manifest->entries->len; i++) {
+        entry = &g_array_index (manifest->entries, GumSkelEntry, i);
+        if (S_ISDIR (entry->mode)) continue;
+        g_mutex_lock (&copy.mutex);
+        copy.pending++;
+        g_mutex_unlock (&copy.mutex);
+        if (copy.pool)
+            g_thread_pool_push (copy.pool, entry, NULL);
+        else
+            _skel_copy_worker (entry, &copy);
+    }
+    g_mutex_lock (&copy.mutex);
+    while (copy.pending > 0)
+        g_cond_wait (&copy.cond, &copy.mutex);
+    ok = ok && !copy.failed;
+    g_mutex_unlock (&copy.mutex);
+    if (copy.pool) g_thread_pool_free (copy.pool, FALSE, TRUE);
+
+    /* the directory attributes, children first */
+    for (i = manifest->entries->len; ok && i-- > 0; ) {
+        entry = &g_array_index (manifest->entries, GumSkelEntry, i);
+        if (!S_ISDIR (entry->mode)) continue;
+        fd = openat (copy.dest_fd, entry->path,
+                O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+        ok = fd >= 0 && _skel_set_attrs (&copy, entry, fd);
+        if (!ok) {
+            WARN ("Unable to set attributes of %s: %s", entry->path,
+                    g_strerror (errno));
         }
+        if (fd >= 0) close (fd);
     }
 
-    g_dir_close (src_dir);
-    return retval;
+    close (copy.src_fd);
+    close (copy.dest_fd);
+    g_mutex_clear (&copy.mutex);
+    g_cond_clear (&copy.cond);
+    g_free (copy.smack_label);
+    _skel_manifest_unref (manifest);
+
+    if (!ok) {
+        GUM_RETURN_WITH_ERROR (GUM_ERROR_HOME_DIR_COPY_FAILURE,
+                "Home directory copy failure", error, FALSE);
+    }
+    return TRUE;
 }
 
-/**
- * gum_file_create_home_dir:
- * @home_dir: path to the user home directory
- * @uid: id of the user
- * @gid: group id of the user
- * @umask: the umask to be used for setting the mode of the files/directories
- * @error: (transfer none): the #GError which is set in case of an error
- *
- * Creates the home directory of the user. All the files from the
- * #GUM_CONFIG_GENERAL_SKEL_DIR are copied (recursively) to the user home
- * directory.
- *
- * Returns: TRUE if successful, FALSE otherwise and @error is set.
- */
-gboolean
-gum_file_create_home_dir (
+static gboolean
+_create_home_dir (
         const gchar *home_dir,
         uid_t uid,
         gid_t gid,
@@ -815,7 +1523,21 @@ gum_file_create_home_dir (
         g_object_unref (config);
 
         if (!g_file_test (home_dir, G_FILE_TEST_EXISTS)) {
-            g_mkdir_with_parents (home_dir, mode);
+            /* the parents (e.g. the hashed layout subdirectories) are shared
+             * by the users, so they do not get the home directory mode */
+            gchar *parent = g_path_get_dirname (home_dir);
+            struct stat sb;
+            g_mkdir_with_parents (parent, GUM_PERM & ~022);
+            /* with a hashed layout, do not nest into the home directory of
+             * a user whose name is the same as a hash prefix */
+            if (lstat (parent, &sb) != 0 || !S_ISDIR (sb.st_mode) ||
+                (sb.st_uid != 0 && sb.st_uid != geteuid ())) {
+                g_free (parent);
+                GUM_RETURN_WITH_ERROR (GUM_ERROR_HOME_DIR_CREATE_FAILURE,
+                        "Invalid home directory parent", error, FALSE);
+            }
+            g_free (parent);
+            g_mkdir (home_dir, mode);
         }
 
         if (!g_file_test (home_dir, G_FILE_TEST_IS_DIR)) {
@@ -829,11 +1551,6 @@ gum_file_create_home_dir (
                      "Unable to set smack64 home dir attr", error, FALSE);
         }
 
-        if (!_copy_file_attributes (skel_dir, home_dir)) {
-            GUM_RETURN_WITH_ERROR (GUM_ERROR_FILE_ATTRIBUTE,
-                    "Unable to get/set dir attributes", error, FALSE);
-        }
-
         /* when run in test mode, user may not exist */
 #ifdef ENABLE_TESTS
         uid = getuid ();
@@ -844,13 +1561,99 @@ gum_file_create_home_dir (
                     "Home directory chown failure", error, FALSE);
         }
 
-        retval = _copy_dir_recursively (skel_dir, home_dir, uid, gid, umask,
-                error);
+        /* this sets the attributes of the skeleton dir on the home dir too */
+        retval = _copy_skel_dir (skel_dir, home_dir, uid, gid, umask, error);
 	}
 
 	return retval;
 }
 
+/**
+ * gum_file_create_home_dir:
+ * @home_dir: path to the user home directory
+ * @uid: id of the user
+ * @gid: group id of the user
+ * @umask: the umask to be used for setting the mode of the files/directories
+ * @error: (transfer none): the #GError which is set in case of an error
+ *
+ * Creates the home directory of the user. All the files from the
+ * #GUM_CONFIG_GENERAL_SKEL_DIR are copied (recursively) to the user home
+ * directory. The skeleton directory is scanned on first use and the result
+ * is reused until the skeleton directory changes.
+ *
+ * Returns: TRUE if successful, FALSE otherwise and @error is set.
+ */
+gboolean
+gum_file_create_home_dir (
+        const gchar *home_dir,
+        uid_t uid,
+        gid_t gid,
+        guint umask,
+        GError **error)
+{
+    gint64 start = g_get_monotonic_time ();
+    gboolean retval = FALSE;
+
+    GUM_TRACE3 (home_dir_create__start, home_dir, uid, gid);
+    retval = _create_home_dir (home_dir, uid, gid, umask, error);
+    gum_stats_record (GUM_STATS_PHASE_HOME_DIR, start, !retval);
+    GUM_TRACE3 (home_dir_create__done, home_dir, uid, retval);
+    return retval;
+}
+
+static gboolean
+_remove_tree_at (
+        gint parent_fd,
+        const gchar *name)
+{
+    DIR *dp = NULL;
+    struct dirent *ent = NULL;
+    gboolean ok = TRUE;
+    gint fd = -1;
+
+    if (unlinkat (parent_fd, name, 0) == 0 || errno == ENOENT)
+        return TRUE;
+    if (errno != EISDIR && errno != EPERM)
+        return FALSE;
+
+    fd = openat (parent_fd, name,
+            O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+    if (fd < 0 || !(dp = fdopendir (fd))) {
+        if (fd >= 0) close (fd);
+        return FALSE;
+    }
+    while (ok && (ent = readdir (dp))) {
+        if (g_strcmp0 (ent->d_name, ".") == 0 ||
+            g_strcmp0 (ent->d_name, "..") == 0) {
+            continue;
+        }
+        ok = _remove_tree_at (dirfd (dp), ent->d_name);
+    }
+    closedir (dp);
+
+    return ok && unlinkat (parent_fd, name, AT_REMOVEDIR) == 0;
+}
+
+static gboolean
+_delete_dir_recursively (
+        const gchar *dir,
+        GError **error)
+{
+    struct stat sent;
+
+    if (!dir || lstat (dir, &sent) != 0) {
+        GUM_RETURN_WITH_ERROR (GUM_ERROR_HOME_DIR_DELETE_FAILURE,
+                "Invalid home directory path", error, FALSE);
+    }
+
+    if (!_remove_tree_at (AT_FDCWD, dir)) {
+        GUM_RETURN_WITH_ERROR (GUM_ERROR_HOME_DIR_DELETE_FAILURE,
+                "Unable to delete home directory", error, FALSE);
+    }
+
+    return TRUE;
+}
+
 /**
  * gum_file_delete_home_dir:
  * @dir: (transfer none): the path to the directory
@@ -865,48 +1668,150 @@ gum_file_delete_home_dir (
         const gchar *dir,
         GError **error)
 {
-    GDir* gdir = NULL;
-    struct stat sent;
+    gint64 start = g_get_monotonic_time ();
+    gboolean retval = FALSE;
+
+    GUM_TRACE1 (home_dir_delete__start, dir);
+    retval = _delete_dir_recursively (dir, error);
+    gum_stats_record (GUM_STATS_PHASE_HOME_DIR, start, !retval);
+    GUM_TRACE2 (home_dir_delete__done, dir, retval);
+    return retval;
+}
+
+/**
+ * gum_file_trash_home_dir:
+ * @dir: (transfer none): the path to the directory
+ * @trash_dir: (transfer none): the path to the trash directory, which is
+ * created if needed
+ * @error: (transfer none): the #GError which is set in case of an error
+ *
+ * Moves the directory atomically into the trash directory, under a unique
+ * name, to be deleted later on with #gum_file_empty_trash_dir. The trash
+ * directory has to be on the same file system as the directory.
+ *
+ * Returns: TRUE if successful, FALSE otherwise and @error is set.
+ */
+gboolean
+gum_file_trash_home_dir (
+        const gchar *dir,
+        const gchar *trash_dir,
+        GError **error)
+{
+    gint64 start = g_get_monotonic_time ();
+    gchar *base = NULL, *path = NULL;
+    gboolean retval = FALSE;
+    guint i;
 
-    if (!dir || !(gdir = g_dir_open(dir, 0, NULL))) {
+    if (!dir || !trash_dir) {
         GUM_RETURN_WITH_ERROR (GUM_ERROR_HOME_DIR_DELETE_FAILURE,
                 "Invalid home directory path", error, FALSE);
     }
 
-    const gchar *fname = NULL;
-    gint retval = 0;
-    gchar *filepath = NULL;
-    while ((fname = g_dir_read_name (gdir)) != NULL) {
-        if (g_strcmp0 (fname, ".") == 0 ||
-            g_strcmp0 (fname, "..") == 0) {
+    if (g_mkdir (trash_dir, 0700) != 0 && errno != EEXIST) {
+        GUM_RETURN_WITH_ERROR (GUM_ERROR_HOME_DIR_DELETE_FAILURE,
+                "Unable to create trash directory", error, FALSE);
+    }
+
+    base = g_path_get_basename (dir);
+    for (i = 0; !retval && i < 16; i++) {
+        path = g_strdup_printf ("%s%c%s.%" G_GINT64_FORMAT ".%u", trash_dir,
+                G_DIR_SEPARATOR, base, g_get_real_time (), i);
+        retval = (rename (dir, path) == 0);
+        g_free (path);
+        if (!retval && errno != EEXIST && errno != ENOTEMPTY) break;
+    }
+    g_free (base);
+    gum_stats_record (GUM_STATS_PHASE_HOME_DIR, start, !retval);
+
+    if (!retval) {
+        GUM_RETURN_WITH_ERROR (GUM_ERROR_HOME_DIR_DELETE_FAILURE,
+                "Unable to move home directory to trash", error, FALSE);
+    }
+    return TRUE;
+}
+
+/* runs in the child process of gum_file_empty_trash_dir: only plain system
+ * calls from here on, as other threads of the parent may have held locks */
+static gint
+_empty_dir (
+        const gchar *dir)
+{
+    DIR *dp = NULL;
+    struct dirent *ent = NULL;
+    gint ret = 0;
+    gint fd = -1;
+
+    fd = open (dir, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+    if (fd < 0 && errno == ENOENT) {
+        return 0;
+    }
+    if (fd < 0 || !(dp = fdopendir (fd))) {
+        if (fd >= 0) close (fd);
+        return 1;
+    }
+
+    while ((ent = readdir (dp))) {
+        if (g_strcmp0 (ent->d_name, ".") == 0 ||
+            g_strcmp0 (ent->d_name, "..") == 0) {
             continue;
         }
-        retval = -1;
-        filepath = g_build_filename (dir, fname, NULL);
-        if (filepath) {
-            retval = lstat(filepath, &sent);
-            if (retval == 0) {
-                /* recurse the directory */
-                if (S_ISDIR (sent.st_mode)) {
-                    retval = (gint)!gum_file_delete_home_dir (filepath, error);
-                } else {
-                    retval = g_remove (filepath);
-                }
-            }
-            g_free (filepath);
-        }
-        if (retval != 0) {
-            g_dir_close (gdir);
-            GUM_RETURN_WITH_ERROR (GUM_ERROR_HOME_DIR_DELETE_FAILURE,
-                "Unable to delete files in the directory", error, FALSE);
+        if (!_remove_tree_at (dirfd (dp), ent->d_name)) {
+            ret = 1;
         }
     }
-    g_dir_close (gdir);
+    closedir (dp);
+
+    return ret;
+}
+
+/**
+ * gum_file_empty_trash_dir:
+ * @trash_dir: (transfer none): the path to the trash directory
+ * @error: (transfer none): the #GError which is set in case of an error
+ *
+ * Deletes everything in the trash directory, recursively. A missing trash
+ * directory is empty. The deletion is done by a child process, which gains
+ * the privileges needed to delete home directories of other users for itself
+ * only. The trashed directories are not referenced by any database, so the
+ * database is not locked meanwhile.
+ *
+ * Returns: TRUE if successful, FALSE otherwise and @error is set.
+ */
+gboolean
+gum_file_empty_trash_dir (
+        const gchar *trash_dir,
+        GError **error)
+{
+    pid_t pid = -1;
+    gint status = 0;
+    gint ret = 0;
+
+    if (!trash_dir) {
+        GUM_RETURN_WITH_ERROR (GUM_ERROR_HOME_DIR_DELETE_FAILURE,
+                "Invalid trash directory path", error, FALSE);
+    }
 
-    if (g_remove (dir) != 0) {
+    pid = fork ();
+    if (pid < 0) {
         GUM_RETURN_WITH_ERROR (GUM_ERROR_HOME_DIR_DELETE_FAILURE,
-                "Unable to delete home directory", error, FALSE);
+                "Unable to start trash deletion", error, FALSE);
+    }
+    if (pid == 0) {
+        /* fails if not privileged at all e.g. when testing */
+        ret = seteuid (0);
+        (void) ret;
+        _exit (_empty_dir (trash_dir));
     }
 
-	return TRUE;
+    while (waitpid (pid, &status, 0) < 0) {
+        if (errno != EINTR) {
+            status = -1;
+            break;
+        }
+    }
+    if (status == -1 || !WIFEXITED (status) || WEXITSTATUS (status) != 0) {
+        GUM_RETURN_WITH_ERROR (GUM_ERROR_HOME_DIR_DELETE_FAILURE,
+                "Unable to empty trash directory", error, FALSE);
+    }
+    return TRUE;
 }
@@ -24,15 +24,18 @@
  */
 #include "config.h"
 
-#include <shadow.h>
 #include <errno.h>
+#include <fcntl.h>
 #include <string.h>
 #include <unistd.h>
+#include <sys/stat.h>
 #include <sys/types.h>
 
 #include "common/gum-lock.h"
 #include "common/gum-utils.h"
 #include "common/gum-log.h"
+#include "common/gum-stats.h"
+#include "common/gum-trace.h"
 
 /**
  * SECTION:gum-lock
@@ -48,6 +51,12 @@
  * Locking and unlocking the database is disabled for when testing is enabled
  * as tests are run on dummy databases.
  *
+ * The lock is the one taken by lckpwdf (3), and so by shadow-utils, but when
+ * it is held by another process it is polled with an increasing backoff, for
+ * at most the time set with gum_lock_pwdf_set_timeout, instead of waited for
+ * with an alarm signal. The time spent waiting for and holding the lock, and
+ * the number of acquisitions that found it held, are recorded in #GumStats.
+ *
  * |[
  *   //return value must be checked if the lock succeed or not.
  *   gboolean ret = gum_lock_pwdf_lock ();
@@ -57,7 +66,88 @@
  * ]|
  */
 
+/* same file as lckpwdf (3) */
+#define GUM_LOCK_PWDF_FILE          "/etc/.pwd.lock"
+#define GUM_LOCK_BACKOFF_MIN        1000    /* usecs */
+#define GUM_LOCK_BACKOFF_MAX        100000  /* usecs */
+
+/* guards the counter only: the daemon reads the database from several
+ * threads, each taking the lock for the time of its read */
+static GMutex count_lock;
 static gint lock_count = 0;
+static guint lock_timeout = GUM_LOCK_PWDF_TIMEOUT_DEFAULT;
+#ifndef ENABLE_TESTS
+static gint lock_fd = -1;
+static gint64 lock_time = 0;
+
+static gint
+_acquire (void)
+{
+    struct flock fl;
+    gint64 start = g_get_monotonic_time ();
+    gint64 deadline = start + (gint64) lock_timeout * 1000;
+    gint64 now = 0;
+    gulong backoff = GUM_LOCK_BACKOFF_MIN;
+    gboolean contended = FALSE;
+    gint fd = -1;
+
+    fd = open (GUM_LOCK_PWDF_FILE, O_WRONLY | O_CREAT | O_CLOEXEC,
+            S_IRUSR | S_IWUSR);
+    if (fd < 0) {
+        DBG ("pwd lock file open failed %s", strerror (errno));
+        gum_stats_record (GUM_STATS_PHASE_LOCK_WAIT, start, TRUE);
+        return -1;
+    }
+
+    memset (&fl, 0, sizeof (fl));
+    fl.l_type = F_WRLCK;
+    fl.l_whence = SEEK_SET;
+    while (fcntl (fd, F_SETLK, &fl) < 0) {
+        if (errno == EINTR)
+            continue;
+        if (errno != EACCES && errno != EAGAIN) {
+            DBG ("pwd lock failed %s", strerror (errno));
+            goto _fail;
+        }
+        /* held by another process e.g. shadow-utils */
+        contended = TRUE;
+        now = g_get_monotonic_time ();
+        if (now >= deadline) {
+            WARN ("pwd lock not released within %u ms", lock_timeout);
+            goto _fail;
+        }
+        g_usleep (MIN ((gint64) backoff, deadline - now));
+        backoff = MIN (backoff * 2, GUM_LOCK_BACKOFF_MAX);
+    }
+
+    gum_stats_record (GUM_STATS_PHASE_LOCK_WAIT, start, FALSE);
+    if (contended)
+        gum_stats_record (GUM_STATS_LOCK_CONTENDED, start, FALSE);
+    return fd;
+
+_fail:
+    close (fd);
+    gum_stats_record (GUM_STATS_PHASE_LOCK_WAIT, start, TRUE);
+    if (contended)
+        gum_stats_record (GUM_STATS_LOCK_CONTENDED, start, TRUE);
+    return -1;
+}
+#endif
+
+/**
+ * gum_lock_pwdf_set_timeout:
+ * @timeout: time in milliseconds
+ *
+ * Sets how long gum_lock_pwdf_lock waits for the lock to be released when it
+ * is held by another process. 0 means giving up at once. Default is
+ * #GUM_LOCK_PWDF_TIMEOUT_DEFAULT.
+ */
+void
+gum_lock_pwdf_set_timeout (
+        guint timeout)
+{
+    lock_timeout = timeout;
+}
 
 /**
  * gum_lock_pwdf_lock:
@@ -68,23 +158,34 @@ static gint lock_count = 0;
  * the same number of times as that of lock. Locking and unlocking the database
  * is disabled for when testing is enabled as tests are run on dummy databases.
  *
+ * If the lock is held by another process, it is waited for at most the time
+ * set with gum_lock_pwdf_set_timeout. The counter is shared by the threads of
+ * the process, the lock is only released when all of them unlocked it.
+ *
  * Returns: TRUE if successful, FALSE otherwise.
  */
 gboolean
 gum_lock_pwdf_lock ()
 {
+    g_mutex_lock (&count_lock);
+    GUM_TRACE1 (lock__start, lock_count);
     if (lock_count == 0) {
         /* when run in test mode, normal user may not have privileges to get
          * the lock */
 #ifndef ENABLE_TESTS
         gum_utils_gain_privileges ();
-        if (lckpwdf () < 0) {
-            DBG ("pwd lock failed %s", strerror (errno));
+        lock_fd = _acquire ();
+        if (lock_fd < 0) {
+            GUM_TRACE2 (lock__done, lock_count, FALSE);
+            g_mutex_unlock (&count_lock);
             return FALSE;
         }
+        lock_time = g_get_monotonic_time ();
 #endif
     }
     lock_count++;
+    GUM_TRACE2 (lock__done, lock_count, TRUE);
+    g_mutex_unlock (&count_lock);
     return TRUE;
 }
 
@@ -103,20 +204,31 @@ gum_lock_pwdf_lock ()
 gboolean
 gum_lock_pwdf_unlock ()
 {
+    g_mutex_lock (&count_lock);
     if (lock_count > 0) {
     	lock_count--;
     	if (lock_count == 0) {
 #ifndef ENABLE_TESTS
-    	    if (ulckpwdf () < 0) {
+    	    /* closing the file releases the lock */
+    	    if (close (lock_fd) < 0) {
     	        DBG ("pwd unlock failed %s", strerror (errno));
+    	        lock_fd = -1;
+    	        GUM_TRACE2 (unlock, lock_count, FALSE);
+    	        g_mutex_unlock (&count_lock);
     	        return FALSE;
     	    }
+    	    lock_fd = -1;
+    	    gum_stats_record (GUM_STATS_PHASE_LOCK_HOLD, lock_time, FALSE);
     	    gum_utils_drop_privileges ();
 #endif
     	}
     } else if (lock_count <= 0) {
+    	GUM_TRACE2 (unlock, lock_count, FALSE);
+    	g_mutex_unlock (&count_lock);
     	return FALSE;
     }
 
+    GUM_TRACE2 (unlock, lock_count, TRUE);
+    g_mutex_unlock (&count_lock);
     return TRUE;
 }
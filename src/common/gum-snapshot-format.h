@@ -0,0 +1,112 @@
+/* vi: set et sw=4 ts=4 cino=t0,(0: */
+/* -*- Mode: C; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+/*
+ * This file is part of gum
+ *
+ * Copyright (C) 2013 Intel Corporation.
+ *
+ * Contact: Imran Zaman <imran.zaman@intel.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+
+#ifndef __GUM_SNAPSHOT_FORMAT_H_
+#define __GUM_SNAPSHOT_FORMAT_H_
+
+#include <stdint.h>
+
+/*
+ * Layout of the snapshot file written by #GumSnapshot. Shared with the NSS
+ * module, which reads the file without GLib, so only plain C types are used
+ * here.
+ *
+ * All offsets are in bytes from the start of the file; indexes are open
+ * addressing tables of 'slots' entries holding record index + 1 (0 for an
+ * empty slot). String offsets are relative to the string area, which starts
+ * with an empty string and ends with a NUL.
+ */
+
+#define GUM_SNAPSHOT_MAGIC   0x534d5547     /* "GUMS" in host byte order */
+#define GUM_SNAPSHOT_VERSION 2
+
+typedef struct {
+    uint64_t dev;
+    uint64_t ino;
+    uint64_t size;
+    int64_t mtime_sec;
+    int64_t mtime_nsec;
+} GumSnapshotStamp;
+
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t generation;
+    uint32_t size;
+    uint32_t n_users;
+    uint32_t n_groups;
+    uint32_t user_slots;
+    uint32_t group_slots;
+    uint32_t users;
+    uint32_t groups;
+    uint32_t uid_index;
+    uint32_t username_index;
+    uint32_t gid_index;
+    uint32_t groupname_index;
+    uint32_t strings;
+    uint32_t strings_size;
+    uint32_t reserved;
+    GumSnapshotStamp passwd_stamp;
+    GumSnapshotStamp group_stamp;
+} GumSnapshotHeader;
+
+typedef struct {
+    uint32_t uid;
+    uint32_t gid;
+    uint32_t name;
+    uint32_t gecos;
+    uint32_t dir;
+    uint32_t shell;
+} GumSnapshotUser;
+
+typedef struct {
+    uint32_t gid;
+    uint32_t name;
+    uint32_t n_members;
+    uint32_t members;       /* n_members consecutive strings */
+} GumSnapshotGroup;
+
+static inline uint32_t
+gum_snapshot_hash_id (
+        uint32_t id)
+{
+    uint32_t h = id * 2654435761U;
+    return h ^ (h >> 16);
+}
+
+static inline uint32_t
+gum_snapshot_hash_name (
+        const char *name)
+{
+    /* FNV-1a */
+    uint32_t h = 2166136261U;
+    for (; *name; name++) {
+        h ^= (unsigned char) *name;
+        h *= 16777619U;
+    }
+    return h;
+}
+
+#endif /* __GUM_SNAPSHOT_FORMAT_H_ */
@@ -0,0 +1,1050 @@
+/* vi: set et sw=4 ts=4 cino=t0,(0: */
+/* -*- Mode: C; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+/*
+ * This file is part of gum
+ *
+ * Copyright (C) 2013 Intel Corporation.
+ *
+ * Contact: Imran Zaman <imran.zaman@intel.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+#include "config.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <glib/gstdio.h>
+
+#include "common/gum-snapshot.h"
+#include "common/gum-snapshot-format.h"
+#include "common/gum-log.h"
+#include "common/gum-error.h"
+
+/**
+ * SECTION:gum-snapshot
+ * @short_description: Read-only snapshot of the user/group database
+ * @title: Gum Snapshot
+ * @include: gum/common/gum-snapshot.h
+ *
+ * A snapshot is an immutable copy of the public parts of the passwd and
+ * group files (no secrets), laid out in a single file together with hash
+ * indexes by uid, user name, gid and group name. Readers map the file and
+ * look entries up without any locking or parsing; the writer never modifies
+ * a published snapshot but replaces it atomically with a new file, so a
+ * reader can tell that its copy is out of date when the mapped file has been
+ * unlinked. The snapshot also records the identity of the passwd and group
+ * files it was taken from, so that readers which do not go through gumd can
+ * detect changes made to the files by other tools.
+ *
+ * |[
+ *   struct passwd pwd;
+ *   gchar buf[1024];
+ *   GumSnapshot *snapshot = gum_snapshot_new_from_file (path, NULL);
+ *
+ *   if (snapshot && gum_snapshot_getpwuid (snapshot, 0, &pwd, buf,
+ *           sizeof (buf)) == 0) {
+ *      // use pwd
+ *   }
+ *   gum_snapshot_unref (snapshot);
+ * ]|
+ */
+
+/**
+ * GumSnapshot:
+ *
+ * Opaque structure for the snapshot.
+ */
+
+#define GUM_SNAPSHOT_PERM    0644
+
+struct _GumSnapshot
+{
+    gint ref_count;
+    gint fd;
+    const guint8 *data;
+    gsize size;
+    const GumSnapshotHeader *header;
+    const GumSnapshotUser *users;
+    const GumSnapshotGroup *groups;
+    const guint32 *uid_index;
+    const guint32 *username_index;
+    const guint32 *gid_index;
+    const guint32 *groupname_index;
+    const gchar *strings;
+};
+
+static guint32
+_index_slots (
+        guint32 n_entries)
+{
+    /* keep the tables at most half full */
+    guint32 slots = 8;
+    while (slots < n_entries * 2)
+        slots <<= 1;
+    return slots;
+}
+
+static void
+_index_add_id (
+        guint32 *index,
+        guint32 mask,
+        const guint32 *keys,
+        guint32 rec)
+{
+    guint32 i = gum_snapshot_hash_id (keys[rec]) & mask;
+    while (index[i]) {
+        /* first entry wins, as with a sequential scan of the file */
+        if (keys[index[i] - 1] == keys[rec])
+            return;
+        i = (i + 1) & mask;
+    }
+    index[i] = rec + 1;
+}
+
+static void
+_index_add_name (
+        guint32 *index,
+        guint32 mask,
+        const gchar *strings,
+        const guint32 *keys,
+        guint32 rec)
+{
+    const gchar *name = strings + keys[rec];
+    guint32 i = gum_snapshot_hash_name (name) & mask;
+    while (index[i]) {
+        if (g_strcmp0 (strings + keys[index[i] - 1], name) == 0)
+            return;
+        i = (i + 1) & mask;
+    }
+    index[i] = rec + 1;
+}
+
+static guint32
+_add_string (
+        GByteArray *strings,
+        const gchar *str)
+{
+    guint32 offset = 0;
+    if (!str || str[0] == '\0')
+        return 0;
+    offset = strings->len;
+    g_byte_array_append (strings, (const guint8 *) str, strlen (str) + 1);
+    return offset;
+}
+
+static gboolean
+_write_all (
+        gint fd,
+        gconstpointer data,
+        gsize len)
+{
+    const guint8 *p = data;
+    while (len > 0) {
+        ssize_t n = write (fd, p, len);
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            return FALSE;
+        }
+        p += n;
+        len -= n;
+    }
+    return TRUE;
+}
+
+static void
+_set_stamp (
+        GumSnapshotStamp *stamp,
+        const struct stat *st)
+{
+    stamp->dev = st->st_dev;
+    stamp->ino = st->st_ino;
+    stamp->size = st->st_size;
+    stamp->mtime_sec = st->st_mtim.tv_sec;
+    stamp->mtime_nsec = st->st_mtim.tv_nsec;
+}
+
+static gboolean
+_match_stamp (
+        const GumSnapshotStamp *stamp,
+        const gchar *path)
+{
+    struct stat st;
+    GumSnapshotStamp current;
+
+    if (!path || stat (path, &st) != 0)
+        return FALSE;
+    memset (&current, 0, sizeof (current));
+    _set_stamp (&current, &st);
+    return memcmp (stamp, &current, sizeof (current)) == 0;
+}
+
+static gboolean
+_read_users (
+        const gchar *passwd_file,
+        GArray *users,
+        GByteArray *strings,
+        GumSnapshotStamp *stamp,
+        GError **error)
+{
+    struct passwd *pent = NULL;
+    struct stat st;
+    FILE *fp = NULL;
+
+    if (!passwd_file || !(fp = fopen (passwd_file, "r"))) {
+        GUM_RETURN_WITH_ERROR (GUM_ERROR_FILE_OPEN,
+                "Unable to open passwd file", error, FALSE);
+    }
+    if (fstat (fileno (fp), &st) == 0)
+        _set_stamp (stamp, &st);
+    while ((pent = fgetpwent (fp)) != NULL) {
+        GumSnapshotUser user;
+        user.uid = pent->pw_uid;
+        user.gid = pent->pw_gid;
+        user.name = _add_string (strings, pent->pw_name);
+        user.gecos = _add_string (strings, pent->pw_gecos);
+        user.dir = _add_string (strings, pent->pw_dir);
+        user.shell = _add_string (strings, pent->pw_shell);
+        g_array_append_val (users, user);
+    }
+    fclose (fp);
+    return TRUE;
+}
+
+static gboolean
+_read_groups (
+        const gchar *group_file,
+        GArray *groups,
+        GByteArray *strings,
+        GumSnapshotStamp *stamp,
+        GError **error)
+{
+    struct group *gent = NULL;
+    struct stat st;
+    FILE *fp = NULL;
+
+    if (!group_file || !(fp = fopen (group_file, "r"))) {
+        GUM_RETURN_WITH_ERROR (GUM_ERROR_FILE_OPEN,
+                "Unable to open group file", error, FALSE);
+    }
+    if (fstat (fileno (fp), &st) == 0)
+        _set_stamp (stamp, &st);
+    while ((gent = fgetgrent (fp)) != NULL) {
+        GumSnapshotGroup group;
+        gchar **mem = NULL;
+        group.gid = gent->gr_gid;
+        group.name = _add_string (strings, gent->gr_name);
+        group.n_members = 0;
+        group.members = 0;
+        for (mem = gent->gr_mem; mem && *mem; mem++) {
+            /* empty names cannot be stored consecutively */
+            if ((*mem)[0] == '\0')
+                continue;
+            if (group.n_members == 0)
+                group.members = strings->len;
+            _add_string (strings, *mem);
+            group.n_members++;
+        }
+        g_array_append_val (groups, group);
+    }
+    fclose (fp);
+    return TRUE;
+}
+
+/**
+ * gum_snapshot_write:
+ * @path: (transfer none): path of the snapshot file
+ * @passwd_file: (transfer none): path to the passwd file
+ * @group_file: (transfer none): path to the group file
+ * @generation: generation of the database the files are at
+ * @error: (transfer none): the #GError which is set in case of an error
+ *
+ * Writes a snapshot of the passwd and group files to @path. The snapshot is
+ * written to a temporary file which then replaces @path atomically, so
+ * readers either see the previous snapshot or the new one. Callers have to
+ * make sure the files are not modified while the snapshot is written.
+ *
+ * Returns: TRUE if successful, FALSE otherwise and @error is set.
+ */
+gboolean
+gum_snapshot_write (
+        const gchar *path,
+        const gchar *passwd_file,
+        const gchar *group_file,
+        guint64 generation,
+        GError **error)
+{
+    GumSnapshotHeader header;
+    GArray *users = NULL;
+    GArray *groups = NULL;
+    GByteArray *strings = NULL;
+    guint32 *keys = NULL;
+    guint32 *user_index[2] = { NULL, NULL };
+    guint32 *group_index[2] = { NULL, NULL };
+    guint64 size = 0;
+    gchar *dir = NULL;
+    gchar *tmp_path = NULL;
+    gint fd = -1;
+    guint32 i;
+    gboolean created = FALSE;
+    gboolean ok = FALSE;
+
+    if (!path) {
+        GUM_RETURN_WITH_ERROR (GUM_ERROR_INVALID_INPUT,
+                "Invalid snapshot path", error, FALSE);
+    }
+
+    users = g_array_new (FALSE, FALSE, sizeof (GumSnapshotUser));
+    groups = g_array_new (FALSE, FALSE, sizeof (GumSnapshotGroup));
+    strings = g_byte_array_new ();
+    g_byte_array_append (strings, (const guint8 *) "", 1);
+
+    memset (&header, 0, sizeof (header));
+    if (!_read_users (passwd_file, users, strings, &header.passwd_stamp,
+            error) ||
+        !_read_groups (group_file, groups, strings, &header.group_stamp,
+            error)) {
+        goto _finished;
+    }
+
+    header.magic = GUM_SNAPSHOT_MAGIC;
+    header.version = GUM_SNAPSHOT_VERSION;
+    header.generation = generation;
+    header.n_users = users->len;
+    header.n_groups = groups->len;
+    header.user_slots = _index_slots (users->len);
+    header.group_slots = _index_slots (groups->len);
+
+    size = sizeof (header);
+    header.users = size;
+    size += (guint64) users->len * sizeof (GumSnapshotUser);
+    header.groups = size;
+    size += (guint64) groups->len * sizeof (GumSnapshotGroup);
+    header.uid_index = size;
+    size += (guint64) header.user_slots * sizeof (guint32);
+    header.username_index = size;
+    size += (guint64) header.user_slots * sizeof (guint32);
+    header.gid_index = size;
+    size += (guint64) header.group_slots * sizeof (guint32);
+    header.groupname_index = size;
+    size += (guint64) header.group_slots * sizeof (guint32);
+    header.strings = size;
+    header.strings_size = strings->len;
+    size += strings->len;
+    if (size > G_MAXUINT32) {
+        GUM_SET_ERROR (GUM_ERROR_FILE_WRITE, "Snapshot too large", error,
+                ok, FALSE);
+        goto _finished;
+    }
+    header.size = size;
+
+    keys = g_new (guint32, MAX (users->len, groups->len) + 1);
+    user_index[0] = g_new0 (guint32, header.user_slots);
+    user_index[1] = g_new0 (guint32, header.user_slots);
+    for (i = 0; i < users->len; i++)
+        keys[i] = g_array_index (users, GumSnapshotUser, i).uid;
+    for (i = 0; i < users->len; i++)
+        _index_add_id (user_index[0], header.user_slots - 1, keys, i);
+    for (i = 0; i < users->len; i++)
+        keys[i] = g_array_index (users, GumSnapshotUser, i).name;
+    for (i = 0; i < users->len; i++)
+        _index_add_name (user_index[1], header.user_slots - 1,
+                (const gchar *) strings->data, keys, i);
+
+    group_index[0] = g_new0 (guint32, header.group_slots);
+    group_index[1] = g_new0 (guint32, header.group_slots);
+    for (i = 0; i < groups->len; i++)
+        keys[i] = g_array_index (groups, GumSnapshotGroup, i).gid;
+    for (i = 0; i < groups->len; i++)
+        _index_add_id (group_index[0], header.group_slots - 1, keys, i);
+    for (i = 0; i < groups->len; i++)
+        keys[i] = g_array_index (groups, GumSnapshotGroup, i).name;
+    for (i = 0; i < groups->len; i++)
+        _index_add_name (group_index[1], header.group_slots - 1,
+                (const gchar *) strings->data, keys, i);
+
+    dir = g_path_get_dirname (path);
+    if (g_mkdir_with_parents (dir, 0755) != 0) {
+        GUM_SET_ERROR (GUM_ERROR_FILE_OPEN,
+                "Unable to create snapshot directory", error, ok, FALSE);
+        goto _finished;
+    }
+
+    tmp_path = g_strdup_printf ("%s.XXXXXX", path);
+    fd = g_mkstemp_full (tmp_path, O_RDWR | O_CLOEXEC, GUM_SNAPSHOT_PERM);
+    if (fd < 0) {
+        GUM_SET_ERROR (GUM_ERROR_FILE_OPEN,
+                "Unable to create snapshot file", error, ok, FALSE);
+        goto _finished;
+    }
+    created = TRUE;
+
+    if (fchmod (fd, GUM_SNAPSHOT_PERM) != 0 ||
+        !_write_all (fd, &header, sizeof (header)) ||
+        !_write_all (fd, users->data,
+                users->len * sizeof (GumSnapshotUser)) ||
+        !_write_all (fd, groups->data,
+                groups->len * sizeof (GumSnapshotGroup)) ||
+        !_write_all (fd, user_index[0],
+                header.user_slots * sizeof (guint32)) ||
+        !_write_all (fd, user_index[1],
+                header.user_slots * sizeof (guint32)) ||
+        !_write_all (fd, group_index[0],
+                header.group_slots * sizeof (guint32)) ||
+        !_write_all (fd, group_index[1],
+                header.group_slots * sizeof (guint32)) ||
+        !_write_all (fd, strings->data, strings->len)) {
+        GUM_SET_ERROR (GUM_ERROR_FILE_WRITE,
+                "Unable to write snapshot file", error, ok, FALSE);
+        goto _finished;
+    }
+
+    if (close (fd) != 0) {
+        fd = -1;
+        GUM_SET_ERROR (GUM_ERROR_FILE_WRITE,
+                "Unable to write snapshot file", error, ok, FALSE);
+        goto _finished;
+    }
+    fd = -1;
+
+    if (g_rename (tmp_path, path) != 0) {
+        GUM_SET_ERROR (GUM_ERROR_FILE_MOVE,
+                "Unable to replace snapshot file", error, ok, FALSE);
+        goto _finished;
+    }
+    ok = TRUE;
+
+_finished:
+    if (fd >= 0)
+        close (fd);
+    if (!ok && created)
+        g_unlink (tmp_path);
+    g_free (tmp_path);
+    g_free (dir);
+    g_free (keys);
+    g_free (user_index[0]);
+    g_free (user_index[1]);
+    g_free (group_index[0]);
+    g_free (group_index[1]);
+    g_byte_array_unref (strings);
+    g_array_unref (groups);
+    g_array_unref (users);
+
+    return ok;
+}
+
+static gboolean
+_check_range (
+        gsize size,
+        guint32 offset,
+        guint32 count,
+        gsize elem_size)
+{
+    return (offset % sizeof (guint32)) == 0 &&
+           (guint64) offset + (guint64) count * elem_size <= size;
+}
+
+static gboolean
+_is_power_of_two (
+        guint32 n)
+{
+    return n != 0 && (n & (n - 1)) == 0;
+}
+
+static gboolean
+_validate (
+        GumSnapshot *self)
+{
+    const GumSnapshotHeader *h = self->header;
+
+    return h->magic == GUM_SNAPSHOT_MAGIC &&
+           h->version == GUM_SNAPSHOT_VERSION &&
+           h->size == self->size &&
+           _is_power_of_two (h->user_slots) &&
+           _is_power_of_two (h->group_slots) &&
+           h->n_users < h->user_slots &&
+           h->n_groups < h->group_slots &&
+           _check_range (self->size, h->users, h->n_users,
+                   sizeof (GumSnapshotUser)) &&
+           _check_range (self->size, h->groups, h->n_groups,
+                   sizeof (GumSnapshotGroup)) &&
+           _check_range (self->size, h->uid_index, h->user_slots,
+                   sizeof (guint32)) &&
+           _check_range (self->size, h->username_index, h->user_slots,
+                   sizeof (guint32)) &&
+           _check_range (self->size, h->gid_index, h->group_slots,
+                   sizeof (guint32)) &&
+           _check_range (self->size, h->groupname_index, h->group_slots,
+                   sizeof (guint32)) &&
+           h->strings_size > 0 &&
+           (guint64) h->strings + h->strings_size <= self->size &&
+           self->data[h->strings + h->strings_size - 1] == '\0';
+}
+
+/**
+ * gum_snapshot_new_from_fd:
+ * @fd: file descriptor of the snapshot file
+ * @error: (transfer none): the #GError which is set in case of an error
+ *
+ * Maps the snapshot file read-only. The snapshot takes the ownership of @fd,
+ * which is closed in case of an error as well.
+ *
+ * Returns: (transfer full): the #GumSnapshot if successful, NULL otherwise
+ * and @error is set. Free with gum_snapshot_unref.
+ */
+GumSnapshot *
+gum_snapshot_new_from_fd (
+        gint fd,
+        GError **error)
+{
+    GumSnapshot *self = NULL;
+    struct stat st;
+    gpointer data = NULL;
+
+    if (fd < 0) {
+        GUM_RETURN_WITH_ERROR (GUM_ERROR_INVALID_INPUT,
+                "Invalid snapshot file descriptor", error, NULL);
+    }
+
+    if (fstat (fd, &st) != 0 ||
+        st.st_size < (off_t) sizeof (GumSnapshotHeader) ||
+        st.st_size > G_MAXUINT32 ||
+        (data = mmap (NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0)) ==
+                MAP_FAILED) {
+        close (fd);
+        GUM_RETURN_WITH_ERROR (GUM_ERROR_FILE_OPEN,
+                "Unable to map snapshot file", error, NULL);
+    }
+
+    self = g_slice_new0 (GumSnapshot);
+    self->ref_count = 1;
+    self->fd = fd;
+    self->data = data;
+    self->size = st.st_size;
+    self->header = data;
+
+    if (!_validate (self)) {
+        gum_snapshot_unref (self);
+        GUM_RETURN_WITH_ERROR (GUM_ERROR_FILE_ATTRIBUTE,
+                "Invalid snapshot file", error, NULL);
+    }
+
+    self->users = (const GumSnapshotUser *)
+            (self->data + self->header->users);
+    self->groups = (const GumSnapshotGroup *)
+            (self->data + self->header->groups);
+    self->uid_index = (const guint32 *)
+            (self->data + self->header->uid_index);
+    self->username_index = (const guint32 *)
+            (self->data + self->header->username_index);
+    self->gid_index = (const guint32 *)
+            (self->data + self->header->gid_index);
+    self->groupname_index = (const guint32 *)
+            (self->data + self->header->groupname_index);
+    self->strings = (const gchar *) (self->data + self->header->strings);
+
+    return self;
+}
+
+/**
+ * gum_snapshot_new_from_file:
+ * @path: (transfer none): path of the snapshot file
+ * @error: (transfer none): the #GError which is set in case of an error
+ *
+ * Opens and maps the snapshot file read-only.
+ *
+ * Returns: (transfer full): the #GumSnapshot if successful, NULL otherwise
+ * and @error is set. Free with gum_snapshot_unref.
+ */
+GumSnapshot *
+gum_snapshot_new_from_file (
+        const gchar *path,
+        GError **error)
+{
+    gint fd = -1;
+
+    if (!path || (fd = open (path, O_RDONLY | O_CLOEXEC)) < 0) {
+        GUM_RETURN_WITH_ERROR (GUM_ERROR_FILE_OPEN,
+                "Unable to open snapshot file", error, NULL);
+    }
+    return gum_snapshot_new_from_fd (fd, error);
+}
+
+/**
+ * gum_snapshot_ref:
+ * @self: (transfer none): the #GumSnapshot
+ *
+ * Increments the reference count of the snapshot.
+ *
+ * Returns: (transfer full): the #GumSnapshot
+ */
+GumSnapshot *
+gum_snapshot_ref (
+        GumSnapshot *self)
+{
+    g_return_val_if_fail (self != NULL, NULL);
+
+    g_atomic_int_inc (&self->ref_count);
+    return self;
+}
+
+/**
+ * gum_snapshot_unref:
+ * @self: (transfer full): the #GumSnapshot
+ *
+ * Decrements the reference count of the snapshot. The snapshot is unmapped
+ * when the count drops to 0.
+ */
+void
+gum_snapshot_unref (
+        GumSnapshot *self)
+{
+    if (!self || !g_atomic_int_dec_and_test (&self->ref_count))
+        return;
+
+    munmap ((gpointer) self->data, self->size);
+    close (self->fd);
+    g_slice_free (GumSnapshot, self);
+}
+
+/**
+ * gum_snapshot_get_generation:
+ * @self: (transfer none): the #GumSnapshot
+ *
+ * Gets the generation of the database the snapshot was taken at.
+ *
+ * Returns: the generation
+ */
+guint64
+gum_snapshot_get_generation (
+        GumSnapshot *self)
+{
+    g_return_val_if_fail (self != NULL, 0);
+
+    return self->header->generation;
+}
+
+/**
+ * gum_snapshot_is_current:
+ * @self: (transfer none): the #GumSnapshot
+ *
+ * Checks that the snapshot has not been replaced by a newer one since it was
+ * opened.
+ *
+ * Returns: TRUE if the snapshot is still the published one, FALSE otherwise.
+ */
+gboolean
+gum_snapshot_is_current (
+        GumSnapshot *self)
+{
+    struct stat st;
+
+    g_return_val_if_fail (self != NULL, FALSE);
+
+    /* a replaced snapshot has been unlinked by the rename */
+    return fstat (self->fd, &st) == 0 && st.st_nlink > 0;
+}
+
+/**
+ * gum_snapshot_is_in_sync:
+ * @self: (transfer none): the #GumSnapshot
+ * @passwd_file: (transfer none): path to the passwd file
+ * @group_file: (transfer none): path to the group file
+ *
+ * Checks that @passwd_file and @group_file are still the very files the
+ * snapshot was taken from, i.e. that neither has been replaced or modified
+ * since, by gumd or any other tool.
+ *
+ * Returns: TRUE if the snapshot reflects the files, FALSE otherwise.
+ */
+gboolean
+gum_snapshot_is_in_sync (
+        GumSnapshot *self,
+        const gchar *passwd_file,
+        const gchar *group_file)
+{
+    g_return_val_if_fail (self != NULL, FALSE);
+
+    return _match_stamp (&self->header->passwd_stamp, passwd_file) &&
+           _match_stamp (&self->header->group_stamp, group_file);
+}
+
+static const gchar *
+_string (
+        GumSnapshot *self,
+        guint32 offset)
+{
+    if (offset >= self->header->strings_size)
+        return NULL;
+    return self->strings + offset;
+}
+
+static const GumSnapshotUser *
+_find_user_by_uid (
+        GumSnapshot *self,
+        uid_t uid)
+{
+    guint32 mask = self->header->user_slots - 1;
+    guint32 i = gum_snapshot_hash_id (uid) & mask;
+    guint32 n, slot;
+
+    for (n = 0; n <= mask; n++, i = (i + 1) & mask) {
+        slot = self->uid_index[i];
+        if (slot == 0 || slot > self->header->n_users)
+            break;
+        if (self->users[slot - 1].uid == uid)
+            return &self->users[slot - 1];
+    }
+    return NULL;
+}
+
+static const GumSnapshotUser *
+_find_user_by_name (
+        GumSnapshot *self,
+        const gchar *name)
+{
+    guint32 mask = self->header->user_slots - 1;
+    guint32 i = gum_snapshot_hash_name (name) & mask;
+    guint32 n, slot;
+
+    for (n = 0; n <= mask; n++, i = (i + 1) & mask) {
+        slot = self->username_index[i];
+        if (slot == 0 || slot > self->header->n_users)
+            break;
+        if (g_strcmp0 (_string (self, self->users[slot - 1].name), name) == 0)
+            return &self->users[slot - 1];
+    }
+    return NULL;
+}
+
+static const GumSnapshotGroup *
+_find_group_by_gid (
+        GumSnapshot *self,
+        gid_t gid)
+{
+    guint32 mask = self->header->group_slots - 1;
+    guint32 i = gum_snapshot_hash_id (gid) & mask;
+    guint32 n, slot;
+
+    for (n = 0; n <= mask; n++, i = (i + 1) & mask) {
+        slot = self->gid_index[i];
+        if (slot == 0 || slot > self->header->n_groups)
+            break;
+        if (self->groups[slot - 1].gid == gid)
+            return &self->groups[slot - 1];
+    }
+    return NULL;
+}
+
+static const GumSnapshotGroup *
+_find_group_by_name (
+        GumSnapshot *self,
+        const gchar *name)
+{
+    guint32 mask = self->header->group_slots - 1;
+    guint32 i = gum_snapshot_hash_name (name) & mask;
+    guint32 n, slot;
+
+    for (n = 0; n <= mask; n++, i = (i + 1) & mask) {
+        slot = self->groupname_index[i];
+        if (slot == 0 || slot > self->header->n_groups)
+            break;
+        if (g_strcmp0 (_string (self, self->groups[slot - 1].name),
+                name) == 0)
+            return &self->groups[slot - 1];
+    }
+    return NULL;
+}
+
+static gchar *
+_copy_string (
+        gchar **buf,
+        const gchar *str)
+{
+    gchar *copy = *buf;
+    gsize len = strlen (str) + 1;
+    memcpy (copy, str, len);
+    *buf += len;
+    return copy;
+}
+
+static gint
+_fill_passwd (
+        GumSnapshot *self,
+        const GumSnapshotUser *user,
+        struct passwd *pwd,
+        gchar *buf,
+        gsize buflen)
+{
+    const gchar *name, *gecos, *dir, *shell;
+
+    if (!user)
+        return ENOENT;
+
+    name = _string (self, user->name);
+    gecos = _string (self, user->gecos);
+    dir = _string (self, user->dir);
+    shell = _string (self, user->shell);
+    if (!name || !gecos || !dir || !shell)
+        return EIO;
+
+    if (strlen (name) + strlen (gecos) + strlen (dir) + strlen (shell) + 6 >
+            buflen)
+        return ERANGE;
+
+    pwd->pw_name = _copy_string (&buf, name);
+    pwd->pw_passwd = _copy_string (&buf, "x");
+    pwd->pw_uid = user->uid;
+    pwd->pw_gid = user->gid;
+    pwd->pw_gecos = _copy_string (&buf, gecos);
+    pwd->pw_dir = _copy_string (&buf, dir);
+    pwd->pw_shell = _copy_string (&buf, shell);
+
+    return 0;
+}
+
+static gint
+_fill_group (
+        GumSnapshot *self,
+        const GumSnapshotGroup *group,
+        struct group *grp,
+        gchar *buf,
+        gsize buflen)
+{
+    const gchar *name = NULL;
+    const gchar *members = NULL;
+    gsize align = 0;
+    gsize members_len = 0;
+    gsize offset = 0;
+    guint32 i;
+
+    if (!group)
+        return ENOENT;
+
+    name = _string (self, group->name);
+    if (!name)
+        return EIO;
+
+    if (group->n_members > 0) {
+        members = _string (self, group->members);
+        if (!members || group->n_members > self->header->strings_size)
+            return EIO;
+        for (i = 0, offset = group->members; i < group->n_members; i++) {
+            if (offset >= self->header->strings_size)
+                return EIO;
+            offset += strlen (self->strings + offset) + 1;
+        }
+        members_len = offset - group->members;
+    }
+
+    align = (- (guintptr) buf) & (sizeof (gchar *) - 1);
+    if (align + (group->n_members + 1) * sizeof (gchar *) + strlen (name) +
+            members_len + 3 > buflen)
+        return ERANGE;
+
+    grp->gr_mem = (gchar **) (buf + align);
+    buf += align + (group->n_members + 1) * sizeof (gchar *);
+    grp->gr_name = _copy_string (&buf, name);
+    grp->gr_passwd = _copy_string (&buf, "x");
+    grp->gr_gid = group->gid;
+    if (members_len > 0) {
+        memcpy (buf, members, members_len);
+    }
+    for (i = 0; i < group->n_members; i++) {
+        grp->gr_mem[i] = buf;
+        buf += strlen (buf) + 1;
+    }
+    grp->gr_mem[group->n_members] = NULL;
+
+    return 0;
+}
+
+/**
+ * gum_snapshot_getpwuid:
+ * @self: (transfer none): the #GumSnapshot
+ * @uid: user id
+ * @pwd: (transfer none): passwd structure to be filled in
+ * @buf: (transfer none): buffer for the strings @pwd points to
+ * @buflen: size of @buf
+ *
+ * Looks the user up by uid, in the manner of getpwuid_r. The password field
+ * is always set to "x" as the snapshot holds no secrets.
+ *
+ * Returns: 0 if found, ENOENT if there is no such user, ERANGE if @buf is
+ * too small, EIO if the snapshot is corrupt.
+ */
+gint
+gum_snapshot_getpwuid (
+        GumSnapshot *self,
+        uid_t uid,
+        struct passwd *pwd,
+        gchar *buf,
+        gsize buflen)
+{
+    g_return_val_if_fail (self != NULL && pwd != NULL, EINVAL);
+
+    return _fill_passwd (self, _find_user_by_uid (self, uid), pwd, buf,
+            buflen);
+}
+
+/**
+ * gum_snapshot_getpwnam:
+ * @self: (transfer none): the #GumSnapshot
+ * @username: (transfer none): name of the user
+ * @pwd: (transfer none): passwd structure to be filled in
+ * @buf: (transfer none): buffer for the strings @pwd points to
+ * @buflen: size of @buf
+ *
+ * Looks the user up by name, in the manner of getpwnam_r.
+ *
+ * Returns: 0 if found, ENOENT if there is no such user, ERANGE if @buf is
+ * too small, EIO if the snapshot is corrupt.
+ */
+gint
+gum_snapshot_getpwnam (
+        GumSnapshot *self,
+        const gchar *username,
+        struct passwd *pwd,
+        gchar *buf,
+        gsize buflen)
+{
+    g_return_val_if_fail (self != NULL && pwd != NULL, EINVAL);
+
+    if (!username)
+        return ENOENT;
+    return _fill_passwd (self, _find_user_by_name (self, username), pwd, buf,
+            buflen);
+}
+
+/**
+ * gum_snapshot_getpwent:
+ * @self: (transfer none): the #GumSnapshot
+ * @index: position of the user in the snapshot, starting from 0
+ * @pwd: (transfer none): passwd structure to be filled in
+ * @buf: (transfer none): buffer for the strings @pwd points to
+ * @buflen: size of @buf
+ *
+ * Gets the user at @index, in the order of the passwd file. Used to
+ * enumerate all the users in the manner of getpwent_r.
+ *
+ * Returns: 0 if found, ENOENT if @index is past the last user, ERANGE if
+ * @buf is too small, EIO if the snapshot is corrupt.
+ */
+gint
+gum_snapshot_getpwent (
+        GumSnapshot *self,
+        guint32 index,
+        struct passwd *pwd,
+        gchar *buf,
+        gsize buflen)
+{
+    g_return_val_if_fail (self != NULL && pwd != NULL, EINVAL);
+
+    return _fill_passwd (self, index < self->header->n_users ?
+            &self->users[index] : NULL, pwd, buf, buflen);
+}
+
+/**
+ * gum_snapshot_getgrgid:
+ * @self: (transfer none): the #GumSnapshot
+ * @gid: group id
+ * @grp: (transfer none): group structure to be filled in
+ * @buf: (transfer none): buffer for the member list and strings @grp points
+ * to
+ * @buflen: size of @buf
+ *
+ * Looks the group up by gid, in the manner of getgrgid_r.
+ *
+ * Returns: 0 if found, ENOENT if there is no such group, ERANGE if @buf is
+ * too small, EIO if the snapshot is corrupt.
+ */
+gint
+gum_snapshot_getgrgid (
+        GumSnapshot *self,
+        gid_t gid,
+        struct group *grp,
+        gchar *buf,
+        gsize buflen)
+{
+    g_return_val_if_fail (self != NULL && grp != NULL, EINVAL);
+
+    return _fill_group (self, _find_group_by_gid (self, gid), grp, buf,
+            buflen);
+}
+
+/**
+ * gum_snapshot_getgrnam:
+ * @self: (transfer none): the #GumSnapshot
+ * @groupname: (transfer none): name of the group
+ * @grp: (transfer none): group structure to be filled in
+ * @buf: (transfer none): buffer for the member list and strings @grp points
+ * to
+ * @buflen: size of @buf
+ *
+ * Looks the group up by name, in the manner of getgrnam_r.
+ *
+ * Returns: 0 if found, ENOENT if there is no such group, ERANGE if @buf is
+ * too small, EIO if the snapshot is corrupt.
+ */
+gint
+gum_snapshot_getgrnam (
+        GumSnapshot *self,
+        const gchar *groupname,
+        struct group *grp,
+        gchar *buf,
+        gsize buflen)
+{
+    g_return_val_if_fail (self != NULL && grp != NULL, EINVAL);
+
+    if (!groupname)
+        return ENOENT;
+    return _fill_group (self, _find_group_by_name (self, groupname), grp,
+            buf, buflen);
+}
+
+/**
+ * gum_snapshot_getgrent:
+ * @self: (transfer none): the #GumSnapshot
+ * @index: position of the group in the snapshot, starting from 0
+ * @grp: (transfer none): group structure to be filled in
+ * @buf: (transfer none): buffer for the member list and strings @grp points
+ * to
+ * @buflen: size of @buf
+ *
+ * Gets the group at @index, in the order of the group file. Used to
+ * enumerate all the groups in the manner of getgrent_r.
+ *
+ * Returns: 0 if found, ENOENT if @index is past the last group, ERANGE if
+ * @buf is too small, EIO if the snapshot is corrupt.
+ */
+gint
+gum_snapshot_getgrent (
+        GumSnapshot *self,
+        guint32 index,
+        struct group *grp,
+        gchar *buf,
+        gsize buflen)
+{
+    g_return_val_if_fail (self != NULL && grp != NULL, EINVAL);
+
+    return _fill_group (self, index < self->header->n_groups ?
+            &self->groups[index] : NULL, grp, buf, buflen);
+}
@@ -0,0 +1,286 @@
+/* vi: set et sw=4 ts=4 cino=t0,(0: */
+/* -*- Mode: C; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+/*
+ * This file is part of gum
+ *
+ * Copyright (C) 2013 Intel Corporation.
+ *
+ * Contact: Imran Zaman <imran.zaman@intel.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+
+#include "config.h"
+
+#include "common/gum-stats.h"
+
+/**
+ * SECTION:gum-stats
+ * @short_description: Call counts and latency histograms of the operations
+ * @title: Gum Stats
+ * @include: gum/common/gum-stats.h
+ *
+ * Keeps the number of calls, the number of failed calls and a latency
+ * histogram for each named operation, e.g. a D-Bus method, a daemon
+ * operation or one of the phases (GUM_STATS_PHASE_*) operations are made of.
+ * Stats are process wide and always enabled: recording is a lookup under a
+ * shared lock followed by a few atomic increments.
+ *
+ * Latencies are kept in microseconds in log-linear buckets, i.e. each power of
+ * two is split in 8 buckets, so that any value is known within 12.5% from 1us
+ * up to ~12 days.
+ *
+ * |[
+ *   gint64 start = g_get_monotonic_time ();
+ *   gboolean ok = do_something ();
+ *   gum_stats_record ("something", start, !ok);
+ * ]|
+ */
+
+#define GUM_STATS_SUB_BITS      3
+#define GUM_STATS_SUB_COUNT     (1 << GUM_STATS_SUB_BITS)
+#define GUM_STATS_MAX_EXPONENT  39
+#define GUM_STATS_N_BUCKETS     \
+    ((GUM_STATS_MAX_EXPONENT - GUM_STATS_SUB_BITS + 2) * GUM_STATS_SUB_COUNT)
+
+typedef struct {
+    guint64 calls;
+    guint64 errors;
+    guint64 total;
+    guint64 max;
+    guint64 buckets[GUM_STATS_N_BUCKETS];
+} GumStatsMetric;
+
+static GRWLock stats_lock;
+static GHashTable *stats = NULL;    /* (name:GumStatsMetric) */
+
+static guint
+_bucket_index (
+        guint64 value)
+{
+    guint exponent = 0;
+
+    if (value < GUM_STATS_SUB_COUNT)
+        return (guint) value;
+
+    exponent = 63 - __builtin_clzll (value);
+    if (exponent > GUM_STATS_MAX_EXPONENT)
+        return GUM_STATS_N_BUCKETS - 1;
+
+    return (exponent - GUM_STATS_SUB_BITS + 1) * GUM_STATS_SUB_COUNT +
+            ((value >> (exponent - GUM_STATS_SUB_BITS)) &
+                    (GUM_STATS_SUB_COUNT - 1));
+}
+
+static guint64
+_bucket_upper_bound (
+        guint index)
+{
+    guint shift = 0;
+    guint64 sub = 0;
+
+    if (index < GUM_STATS_SUB_COUNT)
+        return index;
+
+    shift = index / GUM_STATS_SUB_COUNT - 1;
+    sub = GUM_STATS_SUB_COUNT + index % GUM_STATS_SUB_COUNT;
+    return ((sub + 1) << shift) - 1;
+}
+
+static GumStatsMetric *
+_get_metric (
+        const gchar *name)
+{
+    GumStatsMetric *metric = NULL;
+
+    g_rw_lock_reader_lock (&stats_lock);
+    if (stats)
+        metric = g_hash_table_lookup (stats, name);
+    g_rw_lock_reader_unlock (&stats_lock);
+    if (metric)
+        return metric;
+
+    g_rw_lock_writer_lock (&stats_lock);
+    if (!stats) {
+        /* metrics live as long as the process, reset only zeroes them */
+        stats = g_hash_table_new_full (g_str_hash, g_str_equal, g_free,
+                g_free);
+    }
+    metric = g_hash_table_lookup (stats, name);
+    if (!metric) {
+        metric = g_new0 (GumStatsMetric, 1);
+        g_hash_table_insert (stats, g_strdup (name), metric);
+    }
+    g_rw_lock_writer_unlock (&stats_lock);
+
+    return metric;
+}
+
+static guint64
+_percentile (
+        const guint64 *buckets,
+        guint64 count,
+        guint64 max,
+        guint percent)
+{
+    guint64 rank = (count * percent + 99) / 100;
+    guint64 seen = 0;
+    guint i;
+
+    if (count == 0)
+        return 0;
+
+    for (i = 0; i < GUM_STATS_N_BUCKETS; i++) {
+        seen += buckets[i];
+        if (seen >= rank)
+            return MIN (_bucket_upper_bound (i), max);
+    }
+    return max;
+}
+
+static GVariant *
+_metric_to_variant (
+        GumStatsMetric *metric)
+{
+    GVariantBuilder builder;
+    guint64 buckets[GUM_STATS_N_BUCKETS];
+    guint64 count = 0, max = 0;
+    guint i;
+
+    g_variant_builder_init (&builder, G_VARIANT_TYPE ("a(tt)"));
+    for (i = 0; i < GUM_STATS_N_BUCKETS; i++) {
+        buckets[i] = __atomic_load_n (&metric->buckets[i], __ATOMIC_RELAXED);
+        if (buckets[i] == 0)
+            continue;
+        count += buckets[i];
+        g_variant_builder_add (&builder, "(tt)", _bucket_upper_bound (i),
+                buckets[i]);
+    }
+    max = __atomic_load_n (&metric->max, __ATOMIC_RELAXED);
+
+    /* percentiles are computed from the buckets copied above rather than
+     * from the call counter, which may have moved on meanwhile */
+    return g_variant_new ("(ttttttta(tt))",
+            __atomic_load_n (&metric->calls, __ATOMIC_RELAXED),
+            __atomic_load_n (&metric->errors, __ATOMIC_RELAXED),
+            __atomic_load_n (&metric->total, __ATOMIC_RELAXED),
+            max,
+            _percentile (buckets, count, max, 50),
+            _percentile (buckets, count, max, 90),
+            _percentile (buckets, count, max, 99),
+            &builder);
+}
+
+/**
+ * gum_stats_record:
+ * @name: (transfer none): name of the operation
+ * @start_time: monotonic time the operation started at, as returned by
+ * g_get_monotonic_time()
+ * @failed: whether the operation failed
+ *
+ * Records a call to the operation @name, which took from @start_time until
+ * now. Can be called from any thread.
+ */
+void
+gum_stats_record (
+        const gchar *name,
+        gint64 start_time,
+        gboolean failed)
+{
+    GumStatsMetric *metric = NULL;
+    gint64 now = g_get_monotonic_time ();
+    guint64 elapsed = now > start_time ? (guint64) (now - start_time) : 0;
+    guint64 max = 0;
+
+    g_return_if_fail (name != NULL);
+
+    metric = _get_metric (name);
+
+    __atomic_fetch_add (&metric->calls, 1, __ATOMIC_RELAXED);
+    if (failed)
+        __atomic_fetch_add (&metric->errors, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add (&metric->total, elapsed, __ATOMIC_RELAXED);
+    __atomic_fetch_add (&metric->buckets[_bucket_index (elapsed)], 1,
+            __ATOMIC_RELAXED);
+
+    max = __atomic_load_n (&metric->max, __ATOMIC_RELAXED);
+    while (elapsed > max && !__atomic_compare_exchange_n (&metric->max, &max,
+            elapsed, TRUE, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+        ;
+}
+
+/**
+ * gum_stats_to_variant:
+ *
+ * Gets the stats of all the operations recorded since the start or the last
+ * reset, as a #GVariant of type a{s(ttttttta(tt))}: operation name mapped to
+ * the number of calls, number of failed calls, total, maximum, median, 90th
+ * and 99th percentile of the latency in microseconds, and the non-empty
+ * histogram buckets as (upper bound in microseconds, count) pairs. Percentiles
+ * are the upper bounds of the buckets they fall in.
+ *
+ * Returns: (transfer floating): the stats
+ */
+GVariant *
+gum_stats_to_variant (void)
+{
+    GVariantBuilder builder;
+    GList *names = NULL, *name = NULL;
+
+    g_variant_builder_init (&builder, GUM_STATS_VARIANT_TYPE);
+
+    g_rw_lock_reader_lock (&stats_lock);
+    if (stats)
+        names = g_list_sort (g_hash_table_get_keys (stats),
+                (GCompareFunc) g_strcmp0);
+    for (name = names; name; name = g_list_next (name)) {
+        g_variant_builder_add (&builder, "{s@(ttttttta(tt))}",
+                (const gchar *) name->data,
+                _metric_to_variant (g_hash_table_lookup (stats, name->data)));
+    }
+    g_rw_lock_reader_unlock (&stats_lock);
+    g_list_free (names);
+
+    return g_variant_builder_end (&builder);
+}
+
+/**
+ * gum_stats_reset:
+ *
+ * Zeroes the stats of all the operations. Calls in progress while resetting
+ * may be partially accounted for.
+ */
+void
+gum_stats_reset (void)
+{
+    GHashTableIter iter;
+    GumStatsMetric *metric = NULL;
+    guint i;
+
+    g_rw_lock_reader_lock (&stats_lock);
+    if (stats) {
+        g_hash_table_iter_init (&iter, stats);
+        while (g_hash_table_iter_next (&iter, NULL, (gpointer *) &metric)) {
+            __atomic_store_n (&metric->calls, 0, __ATOMIC_RELAXED);
+            __atomic_store_n (&metric->errors, 0, __ATOMIC_RELAXED);
+            __atomic_store_n (&metric->total, 0, __ATOMIC_RELAXED);
+            __atomic_store_n (&metric->max, 0, __ATOMIC_RELAXED);
+            for (i = 0; i < GUM_STATS_N_BUCKETS; i++)
+                __atomic_store_n (&metric->buckets[i], 0, __ATOMIC_RELAXED);
+        }
+    }
+    g_rw_lock_reader_unlock (&stats_lock);
+}
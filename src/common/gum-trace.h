@@ -0,0 +1,89 @@
+/* vi: set et sw=4 ts=4 cino=t0,(0: */
+/* -*- Mode: C; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+/*
+ * This file is part of gum
+ *
+ * Copyright (C) 2013 Intel Corporation.
+ *
+ * Contact: Imran Zaman <imran.zaman@intel.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+
+#ifndef __GUM_TRACE_H_
+#define __GUM_TRACE_H_
+
+#include "config.h"
+
+/*
+ * Static tracepoints (USDT) for perf, bpftrace and SystemTap, compiled in only
+ * when <sys/sdt.h> is available. A probe not being traced costs a nop plus the
+ * evaluation of its arguments, which are therefore kept cheap.
+ *
+ * All the probes are of the 'gum' provider ('__' in the names reads as '-' in
+ * SystemTap):
+ *
+ *   lock__start (count)                  lock__done (count, ok)
+ *   unlock (count, ok)
+ *   file_update__start (path, op)        file_update__done (path, op, ok,
+ *                                                           bytes)
+ *   crypt__start (algo)                  crypt__done (algo, ok)
+ *   script__start (path, arg1)           script__done (path, arg1, status)
+ *   home_dir_create__start (path, uid,   home_dir_create__done (path, uid,
+ *                           gid)                                ok)
+ *   home_dir_delete__start (path)        home_dir_delete__done (path, ok)
+ *   daemon_op__start (op, id)            daemon_op__done (op, id, ok)
+ *   daemon_member_op__start (op, gid,    daemon_member_op__done (op, gid,
+ *                            uid)                                uid, ok)
+ *   dbus_call__start (method, serial)    dbus_call__done (method, serial,
+ *                                                         failed, usecs)
+ *
+ * 'op' of file_update is a #GumOpType, 'bytes' the size of the file written.
+ * 'id' of daemon_op is the uid or gid of the account; for addUser and
+ * addGroup it is only known once added, so their start probe passes 0 and
+ * only the done probe carries the new id (0 as well on failure). The script
+ * 'arg1' is the name of the user or group passed to the script.
+ * daemon_member_op traces group membership changes of user 'uid'.
+ * D-Bus calls are traced from their arrival until their reply is sent, the
+ * 'method' being named as in the stats, e.g. "dbus.UserService.getUser".
+ *
+ * e.g. bpftrace -e 'usdt:/usr/lib/libgum-common.so:gum:file_update__done
+ *          { @bytes = hist(arg3); }'
+ */
+
+#ifdef HAVE_SYS_SDT_H
+
+#include <sys/sdt.h>
+
+#define GUM_TRACE1(probe, a1) \
+    DTRACE_PROBE1 (gum, probe, a1)
+#define GUM_TRACE2(probe, a1, a2) \
+    DTRACE_PROBE2 (gum, probe, a1, a2)
+#define GUM_TRACE3(probe, a1, a2, a3) \
+    DTRACE_PROBE3 (gum, probe, a1, a2, a3)
+#define GUM_TRACE4(probe, a1, a2, a3, a4) \
+    DTRACE_PROBE4 (gum, probe, a1, a2, a3, a4)
+
+#else
+
+#define GUM_TRACE1(probe, a1)
+#define GUM_TRACE2(probe, a1, a2)
+#define GUM_TRACE3(probe, a1, a2, a3)
+#define GUM_TRACE4(probe, a1, a2, a3, a4)
+
+#endif
+
+#endif /* __GUM_TRACE_H_ */
@@ -24,11 +24,15 @@
  * 02110-1301 USA
  */
 
+#include "config.h"
+
 #include <stdio.h>
 #include <string.h>
 #include <time.h>
 #include <fcntl.h>
 #include <unistd.h>
+#include <errno.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <sys/wait.h>
@@ -36,6 +40,9 @@
 #include "common/gum-utils.h"
 #include "common/gum-log.h"
 #include "common/gum-config.h"
+#include "common/gum-error.h"
+#include "common/gum-stats.h"
+#include "common/gum-trace.h"
 
 /**
  * SECTION:gum-utils
@@ -183,9 +190,11 @@ _run_script (const gchar *script_dir,
         return;
     }
 
+    GUM_TRACE2 (script__start, script, args[1]);
     ret = g_spawn_sync (NULL, args, NULL,
             G_SPAWN_STDOUT_TO_DEV_NULL | G_SPAWN_STDERR_TO_DEV_NULL, NULL,
             NULL, NULL, NULL, &status, &error);
+    GUM_TRACE3 (script__done, script, args[1], ret ? status : -1);
     if (!ret) {
         WARN ("g_spawn failed as retval %d and status %d", ret, status);
     }
@@ -267,6 +276,7 @@ _free_data:
     }
 
     gchar* tmp = args[0];
+    gint64 start = g_get_monotonic_time ();
     scripts_iter = g_sequence_get_begin_iter (scripts);
     while (!g_sequence_iter_is_end (scripts_iter)) {
         args[0] = (gchar *)g_sequence_get (scripts_iter);
@@ -274,6 +284,8 @@ _free_data:
         scripts_iter = g_sequence_iter_next (scripts_iter);
     }
     args[0] = tmp;
+    /* failing scripts are only warned about */
+    gum_stats_record (GUM_STATS_PHASE_SCRIPTS, start, FALSE);
     g_sequence_free (scripts);
     g_strfreev (args);
     g_free (script_dir);
@@ -353,3 +365,144 @@ gum_utils_run_group_scripts (
     /* ownership of 'args' is transferred to _run_scripts */
     return _run_scripts (script_dir, args);;
 }
+
+#ifdef HAVE_MEMFD_CREATE
+#define GUM_UTILS_SEALS (F_SEAL_SEAL | F_SEAL_SHRINK | F_SEAL_GROW | \
+        F_SEAL_WRITE)
+#endif
+
+/**
+ * gum_utils_variant_to_fd:
+ * @variant: (transfer none): the #GVariant to be serialized
+ * @error: (transfer none): the #GError which is set in case of an error
+ *
+ * Serializes @variant into an anonymous memory file which is then sealed
+ * against any modification, so that it can be passed to another process
+ * and mapped there (see gum_utils_variant_new_from_fd) instead of being
+ * copied into a D-Bus message. The file holds the serialized data of the
+ * variant in host byte order (as returned by g_variant_get_data) and
+ * nothing else.
+ *
+ * Returns: the file descriptor if successful, -1 otherwise and @error is
+ * set.
+ */
+gint
+gum_utils_variant_to_fd (
+        GVariant *variant,
+        GError **error)
+{
+#ifdef HAVE_MEMFD_CREATE
+    const guint8 *data = NULL;
+    gsize size = 0;
+    gint fd = -1;
+    ssize_t n = 0;
+
+    g_return_val_if_fail (variant != NULL, -1);
+
+    fd = memfd_create ("gum-variant", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+    if (fd < 0) {
+        GUM_RETURN_WITH_ERROR (GUM_ERROR_FILE_OPEN,
+                "Unable to create memory file", error, -1);
+    }
+
+    data = g_variant_get_data (variant);
+    size = g_variant_get_size (variant);
+    while (size > 0) {
+        n = write (fd, data, size);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            break;
+        data += n;
+        size -= n;
+    }
+
+    if (size > 0 || fcntl (fd, F_ADD_SEALS, GUM_UTILS_SEALS) != 0) {
+        close (fd);
+        GUM_RETURN_WITH_ERROR (GUM_ERROR_FILE_WRITE,
+                "Unable to write memory file", error, -1);
+    }
+
+    return fd;
+#else
+    GUM_RETURN_WITH_ERROR (GUM_ERROR_FILE_OPEN,
+            "Sealed memory files not supported", error, -1);
+#endif
+}
+
+#ifdef HAVE_MEMFD_CREATE
+typedef struct {
+    gpointer data;
+    gsize size;
+} _mapping_t;
+
+static void
+_unmap (
+        gpointer data)
+{
+    _mapping_t *mapping = (_mapping_t *) data;
+    munmap (mapping->data, mapping->size);
+    g_slice_free (_mapping_t, mapping);
+}
+#endif
+
+/**
+ * gum_utils_variant_new_from_fd:
+ * @fd: file descriptor of a file written by gum_utils_variant_to_fd
+ * @type: (transfer none): the type of the serialized #GVariant
+ * @error: (transfer none): the #GError which is set in case of an error
+ *
+ * Maps the sealed memory file and creates a #GVariant of @type backed
+ * directly by the mapping, without copying the data. Files which are not
+ * sealed against modification are rejected. @fd can be closed once the
+ * function returns.
+ *
+ * Returns: (transfer full): the #GVariant if successful, NULL otherwise
+ * and @error is set.
+ */
+GVariant *
+gum_utils_variant_new_from_fd (
+        gint fd,
+        const GVariantType *type,
+        GError **error)
+{
+#ifdef HAVE_MEMFD_CREATE
+    _mapping_t *mapping = NULL;
+    struct stat st;
+    gint seals = 0;
+    gpointer data = NULL;
+
+    g_return_val_if_fail (type != NULL, NULL);
+
+    /* the sender must not be able to change or truncate the mapping under
+     * our feet */
+    seals = fcntl (fd, F_GET_SEALS);
+    if (seals < 0 || (seals & GUM_UTILS_SEALS) != GUM_UTILS_SEALS) {
+        GUM_RETURN_WITH_ERROR (GUM_ERROR_FILE_ATTRIBUTE,
+                "Memory file is not sealed", error, NULL);
+    }
+
+    if (fstat (fd, &st) != 0) {
+        GUM_RETURN_WITH_ERROR (GUM_ERROR_FILE_OPEN,
+                "Unable to map memory file", error, NULL);
+    }
+    if (st.st_size == 0)
+        return g_variant_ref_sink (g_variant_new_from_data (type, NULL, 0,
+                FALSE, NULL, NULL));
+
+    data = mmap (NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    if (data == MAP_FAILED) {
+        GUM_RETURN_WITH_ERROR (GUM_ERROR_FILE_OPEN,
+                "Unable to map memory file", error, NULL);
+    }
+    mapping = g_slice_new (_mapping_t);
+    mapping->data = data;
+    mapping->size = st.st_size;
+
+    return g_variant_ref_sink (g_variant_new_from_data (type, data,
+            st.st_size, FALSE, _unmap, mapping));
+#else
+    GUM_RETURN_WITH_ERROR (GUM_ERROR_FILE_OPEN,
+            "Sealed memory files not supported", error, NULL);
+#endif
+}
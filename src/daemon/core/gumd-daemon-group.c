@@ -40,6 +40,7 @@
 #include "common/gum-log.h"
 #include "common/gum-error.h"
 #include "common/gum-utils.h"
+#include "common/gum-stats.h"
 
 struct _GumdDaemonGroupPrivate
 {
@@ -414,6 +415,8 @@ _set_gid (
         GError **error)
 {
     gid_t gid = GUM_GROUP_INVALID_GID;
+    gint64 start = 0;
+    gboolean found = FALSE;
     if (!gum_validate_name (self->priv->group->gr_name, error)) {
         return FALSE;
     }
@@ -425,7 +428,10 @@ _set_gid (
                 "Group already exists", error, FALSE);
     }
 
-    if (!_find_free_gid (self, preferred_gid, &gid)){
+    start = g_get_monotonic_time ();
+    found = _find_free_gid (self, preferred_gid, &gid);
+    gum_stats_record (GUM_STATS_PHASE_ID_ALLOC, start, !found);
+    if (!found) {
         GUM_RETURN_WITH_ERROR (GUM_ERROR_GROUP_GID_NOT_AVAILABLE,
                 "GID not available", error, FALSE);
     }
@@ -766,6 +772,22 @@ gumd_daemon_group_new (
             config, NULL));
 }
 
+GumdDaemonGroup *
+gumd_daemon_group_copy (
+        GumdDaemonGroup *self)
+{
+    GumdDaemonGroup *copy = NULL;
+
+    g_return_val_if_fail (self && GUMD_IS_DAEMON_GROUP (self), NULL);
+
+    copy = gumd_daemon_group_new (self->priv->config);
+    copy->priv->group_type = self->priv->group_type;
+    _copy_group_struct (self->priv->group, copy->priv->group);
+    _copy_gshadow_struct (self->priv->gshadow, copy->priv->gshadow, FALSE);
+
+    return copy;
+}
+
 GumdDaemonGroup *
 gumd_daemon_group_new_by_gid (
         gid_t gid,
@@ -1206,6 +1228,7 @@ gboolean
 gumd_daemon_group_delete_user_membership (
         GumConfig *config,
         const gchar *user_name,
+        GArray *gids,
         GError **error)
 {
     gboolean retval = TRUE;
@@ -1254,6 +1277,9 @@ gumd_daemon_group_delete_user_membership (
                         error, retval, FALSE);
                 break;
             }
+            if (gids) {
+                g_array_append_val (gids, gent->gr_gid);
+            }
 
         } else if (putgrent (gent, dup_file) < 0) {
             GUM_SET_ERROR (GUM_ERROR_FILE_WRITE, "File write failure",
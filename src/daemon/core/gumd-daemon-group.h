@@ -72,6 +72,10 @@ GumdDaemonGroup *
 gumd_daemon_group_new (
         GumConfig *config);
 
+GumdDaemonGroup *
+gumd_daemon_group_copy (
+        GumdDaemonGroup *self);
+
 GumdDaemonGroup *
 gumd_daemon_group_new_by_gid (
         gid_t gid,
@@ -116,6 +120,7 @@ gboolean
 gumd_daemon_group_delete_user_membership (
         GumConfig *config,
         const gchar *user_name,
+        GArray *gids,
         GError **error);
 
 gid_t
@@ -32,10 +32,13 @@
 #include <gio/gio.h>
 #include <sys/stat.h>
 #include <errno.h>
+#include <unistd.h>
 #include <glib/gprintf.h>
 #include <glib/gstdio.h>
 
 #include "gumd-daemon-user.h"
+#include "gumd-home-reaper.h"
+#include "gumd-login1.h"
 #include "gumd-daemon-group.h"
 #include "common/gum-lock.h"
 #include "common/gum-crypt.h"
@@ -46,6 +49,8 @@
 #include "common/gum-log.h"
 #include "common/gum-error.h"
 #include "common/gum-utils.h"
+#include "common/gum-stats.h"
+#include "common/gum-dbus.h"
 
 struct _userinfo {
     char *icon;
@@ -835,6 +840,8 @@ _set_uid (
         GError **error)
 {
     uid_t uid = GUM_USER_INVALID_UID;
+    gint64 start = 0;
+    gboolean found = FALSE;
     if (!_set_daemon_user_name (self, error)) {
         return FALSE;
     }
@@ -846,17 +853,22 @@ _set_uid (
                 "User already exists", error, FALSE);
     }
 
-    if (!_find_free_uid (self, &uid)){
+    start = g_get_monotonic_time ();
+    found = _find_free_uid (self, &uid);
+    gum_stats_record (GUM_STATS_PHASE_ID_ALLOC, start, !found);
+    if (!found) {
         GUM_RETURN_WITH_ERROR (GUM_ERROR_USER_UID_NOT_AVAILABLE,
                 "UID not available", error, FALSE);
     }
     _set_uid_property (self, uid);
 
     if (_get_usertype_from_gecos (self->priv->pw) != GUM_USERTYPE_SYSTEM)  {
-        gchar *dir = g_strdup_printf ("%s/%s",
+        gchar *dir = gum_file_get_home_dir_path (
                 gum_config_get_string (self->priv->config,
                         GUM_CONFIG_GENERAL_HOME_DIR_PREF),
-                        self->priv->pw->pw_name);
+                gum_config_get_string (self->priv->config,
+                        GUM_CONFIG_GENERAL_HOME_DIR_LAYOUT),
+                self->priv->pw->pw_name);
         _set_homedir_property (self, dir);
         g_free (dir);
     }
@@ -1156,9 +1168,11 @@ _update_shadow_entry (
     return TRUE;
 }
 
+/* new_gid is set if the user's own group had to be created */
 gboolean
 _set_group (
         GumdDaemonUser *self,
+        gid_t *new_gid,
         GError **error)
 {
     gboolean group_exists = FALSE;
@@ -1192,6 +1206,9 @@ _set_group (
                 (gid_t)self->priv->pw->pw_uid, &gid, error))) {
             goto _finished;
         }
+        if (new_gid) {
+            *new_gid = gid;
+        }
     } else {
         gid = grp->gr_gid;
         group_exists = TRUE;
@@ -1204,13 +1221,16 @@ _finished:
     return group_exists;
 }
 
+/* gids of the groups joined are appended to member_gids, if not NULL */
 gboolean
 _set_default_groups (
         GumdDaemonUser *self,
+        GArray *member_gids,
         GError **error)
 {
     gboolean added = TRUE;
     gchar **def_groupsv = NULL;
+    gid_t gid = GUM_GROUP_INVALID_GID;
 
     GumUserType ut = _get_usertype_from_gecos (self->priv->pw);
     if (ut == GUM_USERTYPE_SYSTEM)
@@ -1232,6 +1252,10 @@ _set_default_groups (
                         NULL);
                 added = gumd_daemon_group_add_member (agroup,
                         self->priv->pw->pw_uid, FALSE, error);
+                if (added && member_gids) {
+                    g_object_get (G_OBJECT (agroup), "gid", &gid, NULL);
+                    g_array_append_val (member_gids, gid);
+                }
                 g_object_unref (agroup);
                 if (!added) {
                     WARN ("Failed to set group : %s", def_groupsv[ind]);
@@ -1272,7 +1296,7 @@ _delete_home_dir (
         return TRUE;
     }
 
-    return gum_file_delete_home_dir (self->priv->pw->pw_dir, error);
+    return gumd_home_reaper_delete_home_dir (self->priv->pw->pw_dir, error);
 }
 
 gboolean
@@ -1540,97 +1564,6 @@ _copy_passwd_data (
     return TRUE;
 }
 
-gboolean
-_is_user_logged_in (
-        GDBusProxy *proxy,
-        uid_t uid)
-{
-    GError *error = NULL;
-    gboolean loggedin = FALSE;
-    GVariant *res = NULL;
-    res = g_dbus_proxy_call_sync (proxy, "ListSessions",
-                    g_variant_new ("()"), G_DBUS_CALL_FLAGS_NONE, -1,
-                    NULL, &error);
-    if (res) {
-        uid_t c_uid;
-        GVariantIter *iter = NULL;
-
-        g_variant_get (res, "(a(susso))", &iter);
-        g_variant_unref (res);
-
-        while (g_variant_iter_next (iter, "(susso)", NULL, &c_uid, NULL, NULL,
-                NULL)) {
-            if (c_uid == uid) {
-                DBG ("user %d is logged in", uid);
-                loggedin = TRUE;
-                break;
-            }
-        }
-        g_variant_iter_free (iter);
-    }
-
-    if (error) g_error_free (error);
-
-    return loggedin;
-}
-
-gboolean
-_terminate_user (
-        uid_t uid)
-{
-    gboolean retval = TRUE;
-
-    /* when run in test mode, separate dbus-daemon is started. consequently no
-     * system dbus services are available */
-    /* TODO: In case where systemd does not exist (e.g. ubuntu), termination of
-     * user-to-be-deleted sessions is required */
-
-#if USE_SYSTEMD && !defined(ENABLE_TESTS)
-    GError *error = NULL;
-    GDBusProxy *proxy = NULL;
-    GVariant *res = NULL;
-
-    GDBusConnection *connection = g_bus_get_sync (G_BUS_TYPE_SYSTEM, NULL,
-            &error);
-    if (error) goto _finished;
-
-    proxy = g_dbus_proxy_new_sync (connection,
-        G_DBUS_PROXY_FLAGS_DO_NOT_LOAD_PROPERTIES, NULL,
-        "org.freedesktop.login1", //destination
-        "/org/freedesktop/login1", //path
-        "org.freedesktop.login1.Manager", //interface
-        NULL, &error);
-    if (error) goto _finished;
-
-    if (_is_user_logged_in (proxy, uid)) {
-
-        res = g_dbus_proxy_call_sync (proxy, "TerminateUser",
-                g_variant_new ("(u)", uid), G_DBUS_CALL_FLAGS_NONE, -1,
-                NULL, &error);
-        if (res) g_variant_unref (res);
-        /* seems some bug in systemd as it terminates all the sessions,
-         * and sends userremoved signal but still spits out the error;
-         * so it need to be verified by checking again whether the user is
-         * still logged in or not */
-        if (!_is_user_logged_in (proxy, uid) && error) {
-            g_error_free (error);
-            error = NULL;
-        }
-    }
-
-_finished:
-    if (error) {
-        DBG ("failed to terminate user: %s", error->message);
-        g_error_free (error);
-        retval = FALSE;
-    }
-    if (proxy) g_object_unref (proxy);
-    if (connection) g_object_unref (connection);
-#endif
-
-    return retval;
-}
-
 GumdDaemonUser *
 gumd_daemon_user_new (
         GumConfig *config)
@@ -1639,6 +1572,31 @@ gumd_daemon_user_new (
             config, NULL));
 }
 
+GumdDaemonUser *
+gumd_daemon_user_copy (
+        GumdDaemonUser *self)
+{
+    GumdDaemonUser *copy = NULL;
+    struct passwd *pw = NULL;
+
+    g_return_val_if_fail (self && GUMD_IS_DAEMON_USER (self), NULL);
+
+    copy = gumd_daemon_user_new (self->priv->config);
+    pw = copy->priv->pw;
+    pw->pw_name = g_strdup (self->priv->pw->pw_name);
+    pw->pw_passwd = g_strdup (self->priv->pw->pw_passwd);
+    pw->pw_uid = self->priv->pw->pw_uid;
+    pw->pw_gid = self->priv->pw->pw_gid;
+    pw->pw_gecos = g_strdup (self->priv->pw->pw_gecos);
+    pw->pw_dir = g_strdup (self->priv->pw->pw_dir);
+    pw->pw_shell = g_strdup (self->priv->pw->pw_shell);
+    _copy_shadow_struct (self->priv->shadow, copy->priv->shadow, FALSE);
+    copy->priv->info->icon = g_strdup (self->priv->info->icon);
+    copy->priv->nick_name = g_strdup (self->priv->nick_name);
+
+    return copy;
+}
+
 GumdDaemonUser *
 gumd_daemon_user_new_by_uid (
         uid_t uid,
@@ -1683,10 +1641,26 @@ gumd_daemon_user_new_by_name (
     return usr;
 }
 
+/*
+ * Adding and deleting a user is split in steps, so that the daemon only
+ * keeps its database lock for the steps writing the database files: the home
+ * directory, the scripts and the sessions can take long and are dealt with
+ * in between. gumd_daemon_user_add and gumd_daemon_user_delete run all the
+ * steps in turn.
+ */
+
+/*
+ * Writes the passwd, shadow and group entries of a new user: first step of
+ * gumd_daemon_user_add, followed by gumd_daemon_user_finish_add. The gid of
+ * the user's own group is returned in new_gid if it was created, and the
+ * default groups joined are appended to member_gids; both can be NULL.
+ */
 gboolean
-gumd_daemon_user_add (
+gumd_daemon_user_add_entries (
         GumdDaemonUser *self,
         uid_t *uid,
+        gid_t *new_gid,
+        GArray *member_gids,
         GError **error)
 {
     GumUserType usertype = GUM_USERTYPE_NONE;
@@ -1704,8 +1678,6 @@ gumd_daemon_user_add (
      *** set secret, name, etc
      ** update passwd file
      ** update shadow file
-     ** set home dir
-     *** copy skel files and set permissions
      * unlock db
      */
     usertype = _get_usertype_from_gecos (self->priv->pw);
@@ -1735,7 +1707,7 @@ gumd_daemon_user_add (
         return FALSE;
     }
 
-    if (!_set_group (self, error) ||
+    if (!_set_group (self, new_gid, error) ||
         !_set_shadow_data (self, error)) {
         gum_lock_pwdf_unlock ();
         return FALSE;
@@ -1755,17 +1727,39 @@ gumd_daemon_user_add (
 
     _add_userinfo(self);
 
-    _set_default_groups (self, error);
+    _set_default_groups (self, member_gids, error);
+
+    if (uid) {
+        *uid = self->priv->pw->pw_uid;
+    }
+
+    gum_lock_pwdf_unlock ();
+    return TRUE;
+}
+
+/*
+ * Creates the home directory of a user added with
+ * gumd_daemon_user_add_entries and runs the useradd scripts.
+ */
+gboolean
+gumd_daemon_user_finish_add (
+        GumdDaemonUser *self,
+        GError **error)
+{
+    gchar *ut = NULL;
+    DBG ("");
+
+    /* for the privileges */
+    if (!gum_lock_pwdf_lock ()) {
+        GUM_RETURN_WITH_ERROR (GUM_ERROR_DB_ALREADY_LOCKED,
+                "Database already locked", error, FALSE);
+    }
 
     if (!_create_home_dir (self, error)) {
         gum_lock_pwdf_unlock ();
         return FALSE;
     }
 
-    if (uid) {
-        *uid = self->priv->pw->pw_uid;
-    }
-
     const gchar *scrip_dir = USERADD_SCRIPT_DIR;
 #   ifdef ENABLE_DEBUG
     const gchar *env_val = g_getenv("UM_USERADD_DIR");
@@ -1773,7 +1767,7 @@ gumd_daemon_user_add (
         scrip_dir = env_val;
 #   endif
 
-    gchar *ut = gum_string_utils_get_string (self->priv->pw->pw_gecos, ",",
+    ut = gum_string_utils_get_string (self->priv->pw->pw_gecos, ",",
                     GECOS_FIELD_USERTYPE);
     gum_utils_run_user_scripts (scrip_dir, self->priv->pw->pw_name,
             self->priv->pw->pw_uid, self->priv->pw->pw_gid,
@@ -1785,22 +1779,38 @@ gumd_daemon_user_add (
 }
 
 gboolean
-gumd_daemon_user_delete (
+gumd_daemon_user_add (
         GumdDaemonUser *self,
-        gboolean rem_home_dir,
+        uid_t *uid,
         GError **error)
 {
-	DBG ("");
+    return gumd_daemon_user_add_entries (self, uid, NULL, NULL, error) &&
+           gumd_daemon_user_finish_add (self, error);
+}
 
-    /* lock db
-     ** update passwd and shadow data structures
-     ** update passwd file
-     ** update shadow file
-     ** delete user from groups
-     ** delete home dir (if asked)
-     * unlock db
-     */
-    gboolean lock = TRUE;
+static gboolean
+_set_shadow_lock (
+        GumdDaemonUser *self,
+        gboolean lock)
+{
+    return gum_file_update (G_OBJECT (self), GUM_OPTYPE_MODIFY,
+            (GumFileUpdateCB)_lock_shadow_entry,
+            gum_config_get_string (self->priv->config,
+            GUM_CONFIG_GENERAL_SHADOW_FILE), &lock, NULL);
+}
+
+/*
+ * Checks the user can be deleted and locks it from logging in: first step of
+ * gumd_daemon_user_delete, followed by gumd_daemon_user_logout (or
+ * gumd_daemon_user_logout_async) and gumd_daemon_user_delete_entries, or
+ * gumd_daemon_user_cancel_delete.
+ */
+gboolean
+gumd_daemon_user_prepare_delete (
+        GumdDaemonUser *self,
+        GError **error)
+{
+	DBG ("");
 
     if (!gum_lock_pwdf_lock ()) {
         GUM_RETURN_WITH_ERROR (GUM_ERROR_DB_ALREADY_LOCKED,
@@ -1827,27 +1837,43 @@ gumd_daemon_user_delete (
     }
 
     /* lock the user */
-    if (!gum_file_update (G_OBJECT (self), GUM_OPTYPE_MODIFY,
-            (GumFileUpdateCB)_lock_shadow_entry,
-            gum_config_get_string (self->priv->config,
-            GUM_CONFIG_GENERAL_SHADOW_FILE), &lock, NULL)) {
+    if (!_set_shadow_lock (self, TRUE)) {
         gum_lock_pwdf_unlock ();
         GUM_RETURN_WITH_ERROR (GUM_ERROR_USER_LOCK_FAILURE,
                 "unable to lock user to login", error, FALSE);
     }
 
-    if (!_terminate_user (self->priv->pw->pw_uid)) {
-        /* unlock the user */
-        lock = FALSE;
-        if (!gum_file_update (G_OBJECT (self), GUM_OPTYPE_MODIFY,
-                    (GumFileUpdateCB)_lock_shadow_entry,
-                    gum_config_get_string (self->priv->config,
-                    GUM_CONFIG_GENERAL_SHADOW_FILE), &lock, NULL)) {
-            WARN("Failed to unlock shadow entry");
-        }
-        gum_lock_pwdf_unlock ();
-        GUM_RETURN_WITH_ERROR (GUM_ERROR_USER_SESSION_TERM_FAILURE,
-                "unable to terminate user active sessions", error, FALSE);
+    gum_lock_pwdf_unlock ();
+    return TRUE;
+}
+
+/*
+ * Unlocks a user locked by gumd_daemon_user_prepare_delete, which is not
+ * deleted after all.
+ */
+void
+gumd_daemon_user_cancel_delete (
+        GumdDaemonUser *self)
+{
+    if (!gum_lock_pwdf_lock ()) {
+        WARN ("Database already locked");
+        return;
+    }
+    if (!_set_shadow_lock (self, FALSE)) {
+        WARN("Failed to unlock shadow entry");
+    }
+    gum_lock_pwdf_unlock ();
+}
+
+static gboolean
+_run_userdel_scripts (
+        GumdDaemonUser *self,
+        GError **error)
+{
+    /* for the privileges */
+    if (!gum_lock_pwdf_lock ()) {
+        GUM_RETURN_WITH_ERROR (GUM_ERROR_DB_ALREADY_LOCKED,
+                "Database already locked", error, FALSE);
     }
 
     const gchar *scrip_dir = USERDEL_SCRIPT_DIR;
@@ -1861,6 +1887,110 @@ gumd_daemon_user_delete (
             self->priv->pw->pw_uid, self->priv->pw->pw_gid,
             self->priv->pw->pw_dir, NULL);
 
+    gum_lock_pwdf_unlock ();
+    return TRUE;
+}
+
+/*
+ * Terminates the sessions of a user locked by gumd_daemon_user_prepare_delete
+ * and runs the userdel scripts.
+ */
+gboolean
+gumd_daemon_user_logout (
+        GumdDaemonUser *self,
+        GError **error)
+{
+    DBG ("");
+
+    if (!gumd_login1_terminate_user (self->priv->pw->pw_uid)) {
+        GUM_RETURN_WITH_ERROR (GUM_ERROR_USER_SESSION_TERM_FAILURE,
+                "unable to terminate user active sessions", error, FALSE);
+    }
+
+    return _run_userdel_scripts (self, error);
+}
+
+typedef struct {
+    GumdDaemonUser *user;
+    GumdDaemonUserLogoutCb callback;
+    gpointer user_data;
+} GumdDaemonUserLogout;
+
+static void
+_on_user_sessions_terminated (
+        uid_t uid,
+        gboolean terminated,
+        gpointer user_data)
+{
+    GumdDaemonUserLogout *logout = user_data;
+    GError *error = NULL;
+
+    if (!terminated) {
+        WARN ("unable to terminate active sessions of user %u", uid);
+        error = GUM_GET_ERROR_FOR_ID (GUM_ERROR_USER_SESSION_TERM_FAILURE,
+                "unable to terminate user active sessions");
+    } else {
+        _run_userdel_scripts (logout->user, &error);
+    }
+
+    logout->callback (logout->user, error, logout->user_data);
+
+    if (error) g_error_free (error);
+    g_object_unref (logout->user);
+    g_slice_free (GumdDaemonUserLogout, logout);
+}
+
+/*
+ * Same as gumd_daemon_user_logout, but returns before the sessions are gone;
+ * callback is called once they are and the scripts have been run, or on
+ * failure.
+ */
+void
+gumd_daemon_user_logout_async (
+        GumdDaemonUser *self,
+        GumdDaemonUserLogoutCb callback,
+        gpointer user_data)
+{
+    GumdDaemonUserLogout *logout = NULL;
+
+    DBG ("");
+
+    logout = g_slice_new0 (GumdDaemonUserLogout);
+    logout->user = g_object_ref (self);
+    logout->callback = callback;
+    logout->user_data = user_data;
+    gumd_login1_terminate_user_async (self->priv->pw->pw_uid,
+            _on_user_sessions_terminated, logout);
+}
+
+/*
+ * Deletes the passwd, shadow and group entries of a user prepared with
+ * gumd_daemon_user_prepare_delete. The user is unlocked again if its entries
+ * can not be deleted. The gid of the user's own group is returned in
+ * deleted_gid if it was deleted, and the groups left are appended to
+ * member_gids; both can be NULL.
+ */
+gboolean
+gumd_daemon_user_delete_entries (
+        GumdDaemonUser *self,
+        gid_t *deleted_gid,
+        GArray *member_gids,
+        GError **error)
+{
+	DBG ("");
+
+    /* lock db
+     ** update passwd and shadow data structures
+     ** update passwd file
+     ** update shadow file
+     ** delete user from groups
+     * unlock db
+     */
+    if (!gum_lock_pwdf_lock ()) {
+        GUM_RETURN_WITH_ERROR (GUM_ERROR_DB_ALREADY_LOCKED,
+                "Database already locked", error, FALSE);
+    }
+
     _delete_userinfo(self);
 
     if (!gum_file_update (G_OBJECT (self), GUM_OPTYPE_DELETE,
@@ -1873,25 +2003,26 @@ gumd_daemon_user_delete (
             GUM_CONFIG_GENERAL_SHADOW_FILE), NULL, error)) {
 
         /* unlock the user */
-        lock = FALSE;
-        if (!gum_file_update (G_OBJECT (self), GUM_OPTYPE_MODIFY,
-                    (GumFileUpdateCB)_lock_shadow_entry,
-                    gum_config_get_string (self->priv->config,
-                    GUM_CONFIG_GENERAL_SHADOW_FILE), &lock, NULL)) {
+        if (!_set_shadow_lock (self, FALSE)) {
             WARN("Failed to unlock shadow entry");
         }
         gum_lock_pwdf_unlock ();
         return FALSE;
     }
 
-    if (!_delete_group (self, error) ||
-        !gumd_daemon_group_delete_user_membership (self->priv->config,
-                        self->priv->pw->pw_name, error)) {
+    if (!_delete_group (self, error)) {
         gum_lock_pwdf_unlock ();
         return FALSE;
     }
+    /* the group is kept if it is the primary group of another user */
+    if (deleted_gid && !gum_file_getgrgid (self->priv->pw->pw_gid,
+            gum_config_get_string (self->priv->config,
+                    GUM_CONFIG_GENERAL_GROUP_FILE))) {
+        *deleted_gid = self->priv->pw->pw_gid;
+    }
 
-    if (rem_home_dir && !_delete_home_dir (self, error)) {
+    if (!gumd_daemon_group_delete_user_membership (self->priv->config,
+                        self->priv->pw->pw_name, member_gids, error)) {
         gum_lock_pwdf_unlock ();
         return FALSE;
     }
@@ -1900,6 +2031,48 @@ gumd_daemon_user_delete (
     return TRUE;
 }
 
+/*
+ * Deletes the home directory of a user deleted with
+ * gumd_daemon_user_delete_entries.
+ */
+gboolean
+gumd_daemon_user_delete_home_dir (
+        GumdDaemonUser *self,
+        GError **error)
+{
+    gboolean deleted = FALSE;
+
+    /* for the privileges */
+    if (!gum_lock_pwdf_lock ()) {
+        GUM_RETURN_WITH_ERROR (GUM_ERROR_DB_ALREADY_LOCKED,
+                "Database already locked", error, FALSE);
+    }
+    deleted = _delete_home_dir (self, error);
+    gum_lock_pwdf_unlock ();
+
+    return deleted;
+}
+
+gboolean
+gumd_daemon_user_delete (
+        GumdDaemonUser *self,
+        gboolean rem_home_dir,
+        GError **error)
+{
+    if (!gumd_daemon_user_prepare_delete (self, error))
+        return FALSE;
+
+    if (!gumd_daemon_user_logout (self, error)) {
+        gumd_daemon_user_cancel_delete (self);
+        return FALSE;
+    }
+
+    if (!gumd_daemon_user_delete_entries (self, NULL, NULL, error))
+        return FALSE;
+
+    return !rem_home_dir || gumd_daemon_user_delete_home_dir (self, error);
+}
+
 static void
 _update_gecos_field (
         struct passwd *src,
@@ -2087,10 +2260,66 @@ gumd_daemon_user_get_uid_by_name (
     return uid;
 }
 
-GVariant *
-gumd_daemon_user_get_user_list (
+static void
+_add_record_string (
+        GVariantBuilder *builder,
+        const gchar *key,
+        const gchar *value)
+{
+    g_variant_builder_add (builder, "{sv}", key,
+            g_variant_new_string (value ? value : ""));
+}
+
+static void
+_add_record_gecos_field (
+        GVariantBuilder *builder,
+        const gchar *key,
+        struct passwd *pent,
+        guint field)
+{
+    gchar *str = gum_string_utils_get_string (pent->pw_gecos, ",", field);
+    _add_record_string (builder, key, str);
+    g_free (str);
+}
+
+/* user's properties, with the names and types of the DBus user object, as
+ * the daemon user object would have loaded them (see _copy_passwd_data).
+ * Only what passwd holds is included: the fields kept in the userinfo files
+ * (e.g. icon) are left for the client to fetch with the user object, so that
+ * listing users does not open a file per user */
+static GVariant *
+_passwd_to_record (
+        struct passwd *pent)
+{
+    GVariantBuilder builder;
+
+    g_variant_builder_init (&builder, G_VARIANT_TYPE_VARDICT);
+    g_variant_builder_add (&builder, "{sv}", "uid",
+            g_variant_new_uint32 (pent->pw_uid));
+    g_variant_builder_add (&builder, "{sv}", "gid",
+            g_variant_new_uint32 (pent->pw_gid));
+    g_variant_builder_add (&builder, "{sv}", "usertype",
+            g_variant_new_uint16 (_get_usertype_from_gecos (pent)));
+    _add_record_string (&builder, "username", pent->pw_name);
+    _add_record_string (&builder, "secret", pent->pw_passwd);
+    _add_record_gecos_field (&builder, "realname", pent,
+            GECOS_FIELD_REALNAME);
+    _add_record_gecos_field (&builder, "office", pent, GECOS_FIELD_OFFICE);
+    _add_record_gecos_field (&builder, "officephone", pent,
+            GECOS_FIELD_OFFICEPHONE);
+    _add_record_gecos_field (&builder, "homephone", pent,
+            GECOS_FIELD_HOMEPHONE);
+    _add_record_string (&builder, "homedir", pent->pw_dir);
+    _add_record_string (&builder, "shell", pent->pw_shell);
+
+    return g_variant_builder_end (&builder);
+}
+
+static GVariant *
+_get_user_list (
         const gchar *const *types,
         GumConfig *config,
+        gboolean records,
         GError **error)
 {
     GVariantBuilder builder;
@@ -2134,8 +2363,9 @@ gumd_daemon_user_get_user_list (
     sys_uid_max = (uid_t) gum_config_get_uint (config,
             GUM_CONFIG_GENERAL_SYS_UID_MAX, GUM_USER_INVALID_UID);
 
-    g_variant_builder_init (&builder, (const GVariantType *)"au");
-    while ((pent = fgetpwent (fp)) != NULL) {
+    g_variant_builder_init (&builder, records ?
+            G_VARIANT_TYPE ("aa{sv}") : G_VARIANT_TYPE ("au"));
+    while ((pent = gum_file_getpwent (fp)) != NULL) {
         /* If type is an empty string, all users are fetched. User type is
          * first compared with usertype in gecos field. If gecos field for
          * usertype does not exist, then all the users are considered as
@@ -2148,7 +2378,11 @@ gumd_daemon_user_get_user_list (
                 ut = GUM_USERTYPE_SYSTEM;
         }
         if (ut & in_types) {
-            g_variant_builder_add (&builder, "u", pent->pw_uid);
+            if (records)
+                g_variant_builder_add_value (&builder,
+                        _passwd_to_record (pent));
+            else
+                g_variant_builder_add (&builder, "u", pent->pw_uid);
         }
         pent = NULL;
     }
@@ -2158,3 +2392,255 @@ gumd_daemon_user_get_user_list (
     gum_lock_pwdf_unlock ();
     return users;
 }
+
+GVariant *
+gumd_daemon_user_get_user_list (
+        const gchar *const *types,
+        GumConfig *config,
+        GError **error)
+{
+    return _get_user_list (types, config, FALSE, error);
+}
+
+GVariant *
+gumd_daemon_user_get_user_records (
+        const gchar *const *types,
+        GumConfig *config,
+        GError **error)
+{
+    return _get_user_list (types, config, TRUE, error);
+}
+
+typedef struct {
+    GumConfig *config;
+    const gchar *prefix;
+    const gchar *layout;
+    GHashTable *logged_in;  /* uids, NULL if not known */
+    guint moved;
+} GumdHomeDirMigration;
+
+static gboolean
+_is_default_home_dir (
+        const gchar *home_dir,
+        const gchar *prefix,
+        const gchar *username)
+{
+    static const gchar *layouts[] = { "flat", "hash2", "hash2x2", NULL };
+    gboolean found = FALSE;
+    gchar *path = NULL;
+    gint i;
+
+    for (i = 0; !found && layouts[i]; i++) {
+        path = gum_file_get_home_dir_path (prefix, layouts[i], username);
+        found = (g_strcmp0 (path, home_dir) == 0);
+        g_free (path);
+    }
+    return found;
+}
+
+static gboolean
+_migrate_home_dir (
+        GumConfig *config,
+        const gchar *old_path,
+        const gchar *new_path)
+{
+    struct stat sb;
+    gchar *old_dir = NULL, *new_dir = NULL, *parent = NULL;
+    gboolean moved = FALSE;
+
+    /* the paths in passwd are the ones seen from within the sysroot */
+    old_dir = gum_config_prepend_sysroot (config, old_path);
+    new_dir = gum_config_prepend_sysroot (config, new_path);
+
+    if (lstat (old_dir, &sb) != 0) {
+        /* nothing to move, e.g. when a previous migration has been
+         * interrupted before writing the passwd file */
+        moved = TRUE;
+        goto _finished;
+    }
+    if (lstat (new_dir, &sb) == 0) {
+        WARN ("Not moving home dir %s, %s already exists", old_dir,
+                new_dir);
+        goto _finished;
+    }
+
+    parent = g_path_get_dirname (new_dir);
+    g_mkdir_with_parents (parent, 0755);
+    if (lstat (parent, &sb) != 0 || !S_ISDIR (sb.st_mode) ||
+        (sb.st_uid != 0 && sb.st_uid != geteuid ())) {
+        WARN ("Not moving home dir %s, %s is not a shared directory",
+                old_dir, parent);
+        goto _finished;
+    }
+    GUM_STR_FREE (parent);
+    if (rename (old_dir, new_dir) != 0) {
+        WARN ("Unable to move home dir %s to %s: %s", old_dir, new_dir,
+                g_strerror (errno));
+        goto _finished;
+    }
+    moved = TRUE;
+
+    /* drop the subdirectory of the previous layout once empty */
+    parent = g_path_get_dirname (old_dir);
+    while (rmdir (parent) == 0) {
+        gchar *tmp = g_path_get_dirname (parent);
+        g_free (parent);
+        parent = tmp;
+    }
+
+_finished:
+    g_free (parent);
+    g_free (old_dir);
+    g_free (new_dir);
+    return moved;
+}
+
+static gboolean
+_migrate_passwd_entries (
+        GObject *object,
+        GumOpType op,
+        FILE *source_file,
+        FILE *dup_file,
+        gpointer user_data,
+        GError **error)
+{
+    GumdHomeDirMigration *migration = (GumdHomeDirMigration *) user_data;
+    struct passwd *entry = NULL;
+    gchar *new_dir = NULL, *old_dir = NULL;
+
+    while ((entry = fgetpwent (source_file)) != NULL) {
+        old_dir = NULL;
+        new_dir = NULL;
+        if (_get_usertype_from_gecos (entry) != GUM_USERTYPE_SYSTEM &&
+            _is_default_home_dir (entry->pw_dir, migration->prefix,
+                    entry->pw_name)) {
+            new_dir = gum_file_get_home_dir_path (migration->prefix,
+                    migration->layout, entry->pw_name);
+        }
+        if (new_dir && migration->logged_in &&
+            g_hash_table_contains (migration->logged_in,
+                    GUINT_TO_POINTER (entry->pw_uid))) {
+            WARN ("Not moving home dir %s, %s is logged in", entry->pw_dir,
+                    entry->pw_name);
+            GUM_STR_FREE (new_dir);
+        }
+        if (new_dir && g_strcmp0 (new_dir, entry->pw_dir) != 0 &&
+            _migrate_home_dir (migration->config, entry->pw_dir, new_dir)) {
+            DBG ("Moved home dir %s to %s", entry->pw_dir, new_dir);
+            old_dir = entry->pw_dir;
+            entry->pw_dir = new_dir;
+            migration->moved++;
+        }
+
+        if (putpwent (entry, dup_file) < 0) {
+            if (old_dir) entry->pw_dir = old_dir;
+            g_free (new_dir);
+            GUM_RETURN_WITH_ERROR (GUM_ERROR_FILE_WRITE,
+                    "File write failure", error, FALSE);
+        }
+        if (old_dir) entry->pw_dir = old_dir;
+        g_free (new_dir);
+    }
+
+    return TRUE;
+}
+
+/* gumd caches the users: it is found by the owner of its bus name, or in
+ * P2P mode by its socket accepting connections */
+static gboolean
+_is_daemon_running (void)
+{
+    GDBusConnection *connection = NULL;
+    gboolean running = FALSE;
+#ifdef GUM_BUS_TYPE_P2P
+    gchar *address = g_strdup_printf (GUM_DBUS_ADDRESS,
+            g_get_user_runtime_dir ());
+
+    connection = g_dbus_connection_new_for_address_sync (address,
+            G_DBUS_CONNECTION_FLAGS_AUTHENTICATION_CLIENT, NULL, NULL, NULL);
+    running = (connection != NULL);
+    g_free (address);
+#else
+    GVariant *reply = NULL;
+
+    connection = g_bus_get_sync (GUM_BUS_TYPE, NULL, NULL);
+    if (connection) {
+        reply = g_dbus_connection_call_sync (connection,
+                GUM_DBUS_FREEDESKTOP_SERVICE, GUM_DBUS_FREEDESKTOP_PATH,
+                GUM_DBUS_FREEDESKTOP_INTERFACE, "NameHasOwner",
+                g_variant_new ("(s)", GUM_SERVICE), G_VARIANT_TYPE ("(b)"),
+                G_DBUS_CALL_FLAGS_NONE, -1, NULL, NULL);
+        if (reply) {
+            g_variant_get (reply, "(b)", &running);
+            g_variant_unref (reply);
+        }
+    }
+#endif
+    if (connection) g_object_unref (connection);
+    return running;
+}
+
+/*
+ * Moves the home directories which are at their default location for
+ * another layout to the one set in #GUM_CONFIG_GENERAL_HOME_DIR_LAYOUT,
+ * and updates the passwd file in one go. Home directories set explicitly
+ * elsewhere are left as they are. When the config has a sysroot, the paths
+ * in passwd are kept relative to it. Without a sysroot, the migration is
+ * refused with #GUM_ERROR_DAEMON_RUNNING while gumd is running, as it caches
+ * the users, and the home directories of the users logged in are left where
+ * they are, to be moved by a later migration.
+ */
+gboolean
+gumd_daemon_user_migrate_home_dirs (
+        GumConfig *config,
+        guint *moved,
+        GError **error)
+{
+    GumdHomeDirMigration migration;
+    gchar *sysroot = NULL;
+    gboolean retval = FALSE;
+
+    g_return_val_if_fail (config != NULL, FALSE);
+
+    g_object_get (G_OBJECT (config), "sysroot", &sysroot, NULL);
+    if (sysroot) {
+        gsize len = strlen (sysroot);
+        while (len > 0 && sysroot[len - 1] == G_DIR_SEPARATOR)
+            sysroot[--len] = '\0';
+        if (len == 0) GUM_STR_FREE (sysroot);
+    }
+    if (!sysroot && _is_daemon_running ()) {
+        g_free (sysroot);
+        GUM_RETURN_WITH_ERROR (GUM_ERROR_DAEMON_RUNNING,
+                "gumd is running", error, FALSE);
+    }
+
+    migration.config = config;
+    migration.logged_in = sysroot ? NULL : gumd_login1_get_logged_in_users ();
+    migration.prefix = gum_config_get_string (config,
+            GUM_CONFIG_GENERAL_HOME_DIR_PREF);
+    migration.layout = gum_config_get_string (config,
+            GUM_CONFIG_GENERAL_HOME_DIR_LAYOUT);
+    migration.moved = 0;
+
+    /* the config prepends the sysroot, but the paths stored in passwd are
+     * the ones seen from within the sysroot */
+    if (migration.prefix && sysroot &&
+        g_str_has_prefix (migration.prefix, sysroot))
+        migration.prefix += strlen (sysroot);
+    g_free (sysroot);
+
+    if (!gum_lock_pwdf_lock ()) {
+        if (migration.logged_in) g_hash_table_unref (migration.logged_in);
+        GUM_RETURN_WITH_ERROR (GUM_ERROR_DB_ALREADY_LOCKED,
+                "Database already locked", error, FALSE);
+    }
+    retval = gum_file_update (G_OBJECT (config), GUM_OPTYPE_MODIFY,
+            _migrate_passwd_entries, gum_config_get_string (config,
+                    GUM_CONFIG_GENERAL_PASSWD_FILE), &migration, error);
+    gum_lock_pwdf_unlock ();
+    if (migration.logged_in) g_hash_table_unref (migration.logged_in);
+
+    if (moved) *moved = migration.moved;
+    return retval;
+}
@@ -49,6 +49,13 @@ typedef struct _GumdDaemonUser GumdDaemonUser;
 typedef struct _GumdDaemonUserClass GumdDaemonUserClass;
 typedef struct _GumdDaemonUserPrivate GumdDaemonUserPrivate;
 
+/* called once gumd_daemon_user_logout_async is done; error is NULL on
+ * success */
+typedef void (*GumdDaemonUserLogoutCb) (
+        GumdDaemonUser *self,
+        const GError *error,
+        gpointer user_data);
+
 struct _GumdDaemonUser
 {
     GObject parent;
@@ -69,6 +76,10 @@ GumdDaemonUser *
 gumd_daemon_user_new (
         GumConfig *config);
 
+GumdDaemonUser *
+gumd_daemon_user_copy (
+        GumdDaemonUser *self);
+
 GumdDaemonUser *
 gumd_daemon_user_new_by_uid (
         uid_t uid,
@@ -91,6 +102,51 @@ gumd_daemon_user_delete (
         gboolean rem_home_dir,
         GError **error);
 
+gboolean
+gumd_daemon_user_add_entries (
+        GumdDaemonUser *self,
+        uid_t *uid,
+        gid_t *new_gid,
+        GArray *member_gids,
+        GError **error);
+
+gboolean
+gumd_daemon_user_finish_add (
+        GumdDaemonUser *self,
+        GError **error);
+
+gboolean
+gumd_daemon_user_prepare_delete (
+        GumdDaemonUser *self,
+        GError **error);
+
+void
+gumd_daemon_user_cancel_delete (
+        GumdDaemonUser *self);
+
+gboolean
+gumd_daemon_user_logout (
+        GumdDaemonUser *self,
+        GError **error);
+
+void
+gumd_daemon_user_logout_async (
+        GumdDaemonUser *self,
+        GumdDaemonUserLogoutCb callback,
+        gpointer user_data);
+
+gboolean
+gumd_daemon_user_delete_entries (
+        GumdDaemonUser *self,
+        gid_t *deleted_gid,
+        GArray *member_gids,
+        GError **error);
+
+gboolean
+gumd_daemon_user_delete_home_dir (
+        GumdDaemonUser *self,
+        GError **error);
+
 gboolean
 gumd_daemon_user_update (
         GumdDaemonUser *self,
@@ -107,6 +163,18 @@ gumd_daemon_user_get_user_list (
         GumConfig *config,
         GError **error);
 
+GVariant *
+gumd_daemon_user_get_user_records (
+        const gchar *const *types,
+        GumConfig *config,
+        GError **error);
+
+gboolean
+gumd_daemon_user_migrate_home_dirs (
+        GumConfig *config,
+        guint *moved,
+        GError **error);
+
 G_END_DECLS
 
 #endif /* __GUMD_DAEMON_USER_H_ */
@@ -23,17 +23,144 @@
  * 02110-1301 USA
  */
 
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <grp.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
 #include "common/gum-defines.h"
+#include "common/gum-lock.h"
 #include "common/gum-log.h"
 #include "common/gum-error.h"
+#include "common/gum-snapshot.h"
+#include "common/gum-stats.h"
+#include "common/gum-trace.h"
 
 #include "gumd-daemon.h"
 
+#define GUMD_DAEMON_CACHE_SIZE_DEFAULT       64
+#define GUMD_DAEMON_CACHE_TIMEOUT_DEFAULT    300
+
+#define GUMD_DAEMON_STATS_DB_LOCK_WAIT       "daemon.dbLockWait"
+
+/* milliseconds to wait for further writes before publishing the snapshot */
+#define GUMD_DAEMON_SNAPSHOT_DELAY           100
+
+/* identifies a version of a database file, to notice edits made behind the
+ * daemon's back */
+typedef struct {
+    dev_t dev;
+    ino_t ino;
+    off_t size;
+    struct timespec mtime;
+} GumdDaemonFileStamp;
+
+#define GUMD_DAEMON_CACHE_DB_FILES           2
+
+typedef GObject * (*GumdDaemonCopyFunc) (
+        GObject *object);
+
+typedef struct {
+    guint id;
+    GObject *object;
+    gint64 last_access;
+} GumdDaemonCacheEntry;
+
+/* least recently used cache of user/group objects: the queue is ordered by
+ * last access (most recent at head) and the index maps id to its queue link,
+ * so that lookup, promotion and removal are all O(1). The cache has its own
+ * lock as hits are served without taking the database lock.
+ * Cached objects are private copies which are never modified: callers get
+ * their own copy, so that uncommitted edits are never seen by other clients.
+ * The whole cache is dropped once one of the database files it was filled
+ * from has been changed by someone else than the daemon */
+typedef struct {
+    GMutex lock;
+    GHashTable *index;
+    GQueue lru;
+    guint capacity;
+    gint64 max_age;
+    GumdDaemonCopyFunc copy;
+    GumConfig *config;
+    const gchar *db_file_keys[GUMD_DAEMON_CACHE_DB_FILES];
+    GumdDaemonFileStamp db_stamps[GUMD_DAEMON_CACHE_DB_FILES];
+} GumdDaemonCache;
+
+#define GUMD_DAEMON_NEGATIVE_CACHE_SIZE_DEFAULT 1024
+
+/* failed lookups by name and id; valid only as long as neither the daemon
+ * generation nor the database file it was filled from have changed. Has its
+ * own lock as reads only share the database lock */
+typedef struct {
+    GMutex lock;
+    GHashTable *names;
+    GHashTable *ids;
+    guint capacity;
+    const gchar *db_file_key;
+    guint64 generation;
+    GumdDaemonFileStamp db_stamp;
+} GumdDaemonMissCache;
+
+typedef GObject * (*GumdDaemonLoadFunc) (
+        GumdDaemon *self,
+        gconstpointer data,
+        GError **error);
+
+#define GUMD_DAEMON_CHANGE_LOG_SIZE_DEFAULT 256
+
+static const gchar *const member_fields[] = { "members", NULL };
+
+typedef struct {
+    guint64 generation;
+    GumdDaemonChangeOp op;
+    guint id;
+    gchar **fields;
+} GumdDaemonChange;
+
+/* bounded log of the most recent changes, oldest at head. The log holds every
+ * change made after generation 'complete'. Only used with the database lock
+ * held */
+typedef struct {
+    GQueue records;
+    guint capacity;
+    guint64 complete;
+} GumdDaemonChangeLog;
+
+/* a load in progress; identical loads wait for and share its result */
+typedef struct {
+    gint ref_count;
+    gboolean done;
+    GObject *object;
+    GError *error;
+    GCond cond;
+} GumdDaemonFlight;
+
+/* database files whose stamps tell external edits apart from the daemon's */
+static const gchar *const db_file_keys[] = {
+    GUM_CONFIG_GENERAL_PASSWD_FILE,
+    GUM_CONFIG_GENERAL_SHADOW_FILE,
+    GUM_CONFIG_GENERAL_GROUP_FILE,
+    GUM_CONFIG_GENERAL_GSHADOW_FILE
+};
+
 struct _GumdDaemonPrivate
 {
     GumConfig *config;
-    GHashTable *users;
-    GHashTable *groups;
+    GumdDaemonCache *users;
+    GumdDaemonCache *groups;
+    GumdDaemonMissCache *user_misses;
+    GumdDaemonMissCache *group_misses;
+    GumdDaemonChangeLog *user_changes;
+    GumdDaemonChangeLog *group_changes;
+    guint64 generation;
+    guint64 snapshot_generation;    /* 0 if no snapshot published yet */
+    GSource *publish_source;        /* pending snapshot publish */
+    GumdDaemonFileStamp db_stamps[G_N_ELEMENTS (db_file_keys)];
+    GRWLock db_lock;        /* shared by reads, exclusive for writes */
+    GMutex flight_lock;
+    GHashTable *flights;
 };
 
 G_DEFINE_TYPE (GumdDaemon, gumd_daemon, G_TYPE_OBJECT)
@@ -57,54 +184,826 @@ enum {
 static guint signals[SIG_MAX];
 
 static gboolean
-_compare_by_pointer (
-        gpointer key,
-        gpointer value,
-        gpointer dead_object)
+_db_files_changed (
+        GumdDaemon *self);
+
+static void
+_check_db_files (
+        GumdDaemon *self);
+
+/* for writes, which exclude any other read or write. The lock is not
+ * recursive */
+static void
+_write_lock_db (
+        GumdDaemon *self)
 {
-    return value == dead_object;
+    gint64 start = g_get_monotonic_time ();
+
+    g_rw_lock_writer_lock (&self->priv->db_lock);
+    gum_stats_record (GUMD_DAEMON_STATS_DB_LOCK_WAIT, start, FALSE);
+    _check_db_files (self);
+}
+
+static void
+_write_unlock_db (
+        GumdDaemon *self)
+{
+    g_rw_lock_writer_unlock (&self->priv->db_lock);
 }
 
+/* for reads, which run in parallel with each other. Reads must not change
+ * anything but the caches, which have locks of their own */
 static void
-_on_user_disposed (
-        gpointer data,
+_read_lock_db (
+        GumdDaemon *self)
+{
+    gint64 start = g_get_monotonic_time ();
+
+    g_rw_lock_reader_lock (&self->priv->db_lock);
+    if (_db_files_changed (self)) {
+        /* resetting the change logs is a write */
+        g_rw_lock_reader_unlock (&self->priv->db_lock);
+        g_rw_lock_writer_lock (&self->priv->db_lock);
+        _check_db_files (self);
+        g_rw_lock_writer_unlock (&self->priv->db_lock);
+        g_rw_lock_reader_lock (&self->priv->db_lock);
+    }
+    gum_stats_record (GUMD_DAEMON_STATS_DB_LOCK_WAIT, start, FALSE);
+}
+
+static void
+_read_unlock_db (
+        GumdDaemon *self)
+{
+    g_rw_lock_reader_unlock (&self->priv->db_lock);
+}
+
+/* stamp is zeroed if the file can not be stat'ed */
+static void
+_file_stamp_read (
+        GumConfig *config,
+        const gchar *db_file_key,
+        GumdDaemonFileStamp *stamp)
+{
+    struct stat sb;
+
+    memset (stamp, 0, sizeof (GumdDaemonFileStamp));
+    if (stat (gum_config_get_string (config, db_file_key), &sb) == 0) {
+        stamp->dev = sb.st_dev;
+        stamp->ino = sb.st_ino;
+        stamp->size = sb.st_size;
+        stamp->mtime = sb.st_mtim;
+    }
+}
+
+static gboolean
+_file_stamp_equal (
+        const GumdDaemonFileStamp *a,
+        const GumdDaemonFileStamp *b)
+{
+    return a->dev == b->dev &&
+           a->ino == b->ino &&
+           a->size == b->size &&
+           a->mtime.tv_sec == b->mtime.tv_sec &&
+           a->mtime.tv_nsec == b->mtime.tv_nsec;
+}
+
+static GObject *
+_copy_user (
         GObject *object)
 {
-    GumdDaemon *daemon = GUMD_DAEMON (data);
+    return G_OBJECT (gumd_daemon_user_copy (GUMD_DAEMON_USER (object)));
+}
 
-    DBG ("daemon %p user %p disposed", daemon, object);
-    g_hash_table_foreach_remove (daemon->priv->users, _compare_by_pointer,
-            object);
+static GObject *
+_copy_group (
+        GObject *object)
+{
+    return G_OBJECT (gumd_daemon_group_copy (GUMD_DAEMON_GROUP (object)));
 }
 
+static GumdDaemonCache *
+_cache_new (
+        gint capacity,
+        gint max_age,
+        GumdDaemonCopyFunc copy,
+        GumConfig *config,
+        const gchar *db_file_key,
+        const gchar *shadow_file_key)
+{
+    GumdDaemonCache *cache = g_slice_new0 (GumdDaemonCache);
+    guint i;
+
+    g_mutex_init (&cache->lock);
+    cache->index = g_hash_table_new (g_direct_hash, g_direct_equal);
+    g_queue_init (&cache->lru);
+    cache->capacity = capacity > 0 ? (guint) capacity : 0;
+    cache->max_age = max_age > 0 ? (gint64) max_age * G_USEC_PER_SEC : 0;
+    cache->copy = copy;
+    cache->config = config;
+    cache->db_file_keys[0] = db_file_key;
+    cache->db_file_keys[1] = shadow_file_key;
+    for (i = 0; i < GUMD_DAEMON_CACHE_DB_FILES; i++) {
+        _file_stamp_read (config, cache->db_file_keys[i],
+                &cache->db_stamps[i]);
+    }
+
+    return cache;
+}
+
+static void
+_cache_remove_link (
+        GumdDaemonCache *cache,
+        GList *link)
+{
+    GumdDaemonCacheEntry *entry = (GumdDaemonCacheEntry *) link->data;
+
+    g_hash_table_remove (cache->index, GUINT_TO_POINTER (entry->id));
+    g_queue_delete_link (&cache->lru, link);
+    GUM_OBJECT_UNREF (entry->object);
+    g_slice_free (GumdDaemonCacheEntry, entry);
+}
+
+static void
+_cache_remove (
+        GumdDaemonCache *cache,
+        guint id)
+{
+    GList *link = NULL;
+
+    g_mutex_lock (&cache->lock);
+    link = g_hash_table_lookup (cache->index, GUINT_TO_POINTER (id));
+    if (link) {
+        _cache_remove_link (cache, link);
+    }
+    g_mutex_unlock (&cache->lock);
+}
+
+static void
+_cache_clear_locked (
+        GumdDaemonCache *cache)
+{
+    GList *link = NULL;
+
+    while ((link = g_queue_peek_tail_link (&cache->lru)) != NULL) {
+        _cache_remove_link (cache, link);
+    }
+}
+
+static void
+_cache_clear (
+        GumdDaemonCache *cache)
+{
+    g_mutex_lock (&cache->lock);
+    _cache_clear_locked (cache);
+    g_mutex_unlock (&cache->lock);
+}
+
+/* drops all entries if a database file has been changed since the cache last
+ * looked, i.e. not by the daemon itself (see _cache_restamp) */
 static void
-_on_group_disposed (
-        gpointer data,
+_cache_validate (
+        GumdDaemonCache *cache)
+{
+    GumdDaemonFileStamp stamps[GUMD_DAEMON_CACHE_DB_FILES];
+    guint i;
+
+    if (cache->capacity == 0)
+        return;
+
+    for (i = 0; i < GUMD_DAEMON_CACHE_DB_FILES; i++) {
+        _file_stamp_read (cache->config, cache->db_file_keys[i], &stamps[i]);
+    }
+
+    g_mutex_lock (&cache->lock);
+    for (i = 0; i < GUMD_DAEMON_CACHE_DB_FILES; i++) {
+        if (!_file_stamp_equal (&stamps[i], &cache->db_stamps[i]))
+            break;
+    }
+    if (i < GUMD_DAEMON_CACHE_DB_FILES) {
+        DBG ("database changed externally, dropping %u cache entries",
+                g_queue_get_length (&cache->lru));
+        _cache_clear_locked (cache);
+        memcpy (cache->db_stamps, stamps, sizeof (stamps));
+    }
+    g_mutex_unlock (&cache->lock);
+}
+
+/* takes note of the daemon's own writes, which are reflected in the cache
+ * entry by entry. Called with the database lock held */
+static void
+_cache_restamp (
+        GumdDaemonCache *cache)
+{
+    GumdDaemonFileStamp stamps[GUMD_DAEMON_CACHE_DB_FILES];
+    guint i;
+
+    for (i = 0; i < GUMD_DAEMON_CACHE_DB_FILES; i++) {
+        _file_stamp_read (cache->config, cache->db_file_keys[i], &stamps[i]);
+    }
+
+    g_mutex_lock (&cache->lock);
+    memcpy (cache->db_stamps, stamps, sizeof (stamps));
+    g_mutex_unlock (&cache->lock);
+}
+
+static void
+_cache_free (
+        GumdDaemonCache *cache)
+{
+    _cache_clear (cache);
+    g_hash_table_unref (cache->index);
+    g_mutex_clear (&cache->lock);
+    g_slice_free (GumdDaemonCache, cache);
+}
+
+static void
+_cache_expire (
+        GumdDaemonCache *cache,
+        gint64 now)
+{
+    GList *link = NULL;
+    GumdDaemonCacheEntry *entry = NULL;
+
+    if (cache->max_age == 0)
+        return;
+
+    /* tail holds the least recently accessed entry */
+    while ((link = g_queue_peek_tail_link (&cache->lru)) != NULL) {
+        entry = (GumdDaemonCacheEntry *) link->data;
+        if (now - entry->last_access < cache->max_age)
+            break;
+        DBG ("cache entry %u expired", entry->id);
+        _cache_remove_link (cache, link);
+    }
+}
+
+/* returns the cached object itself, which must not be modified; see
+ * _cache_get_copy */
+static GObject *
+_cache_lookup (
+        GumdDaemonCache *cache,
+        guint id)
+{
+    gint64 now = g_get_monotonic_time ();
+    GumdDaemonCacheEntry *entry = NULL;
+    GList *link = NULL;
+    GObject *object = NULL;
+
+    _cache_validate (cache);
+
+    g_mutex_lock (&cache->lock);
+    _cache_expire (cache, now);
+
+    link = g_hash_table_lookup (cache->index, GUINT_TO_POINTER (id));
+    if (link) {
+        entry = (GumdDaemonCacheEntry *) link->data;
+        entry->last_access = now;
+        g_queue_unlink (&cache->lru, link);
+        g_queue_push_head_link (&cache->lru, link);
+        object = g_object_ref (entry->object);
+    }
+    g_mutex_unlock (&cache->lock);
+
+    return object;
+}
+
+static void
+_cache_insert (
+        GumdDaemonCache *cache,
+        guint id,
+        GObject *object)
+{
+    GumdDaemonCacheEntry *entry = NULL;
+    GList *link = NULL;
+
+    if (cache->capacity == 0)
+        return;
+
+    entry = g_slice_new0 (GumdDaemonCacheEntry);
+    entry->id = id;
+    entry->object = cache->copy (object);
+    entry->last_access = g_get_monotonic_time ();
+
+    g_mutex_lock (&cache->lock);
+    link = g_hash_table_lookup (cache->index, GUINT_TO_POINTER (id));
+    if (link) {
+        _cache_remove_link (cache, link);
+    }
+    g_queue_push_head (&cache->lru, entry);
+    g_hash_table_insert (cache->index, GUINT_TO_POINTER (id),
+            g_queue_peek_head_link (&cache->lru));
+
+    while (g_queue_get_length (&cache->lru) > cache->capacity) {
+        _cache_remove_link (cache, g_queue_peek_tail_link (&cache->lru));
+    }
+    g_mutex_unlock (&cache->lock);
+}
+
+/* consumes the reference on object, which may be shared, and returns a copy
+ * owned by the caller */
+static GObject *
+_cache_get_copy (
+        GumdDaemonCache *cache,
         GObject *object)
 {
-    GumdDaemon *daemon = GUMD_DAEMON (data);
+    GObject *copy = NULL;
 
-    DBG ("daemon %p group %p disposed", daemon, object);
-    g_hash_table_foreach_remove (daemon->priv->groups, _compare_by_pointer,
-            object);
+    if (object) {
+        copy = cache->copy (object);
+        g_object_unref (object);
+    }
+    return copy;
+}
+
+static GumdDaemonMissCache *
+_miss_cache_new (
+        gint capacity,
+        const gchar *db_file_key)
+{
+    GumdDaemonMissCache *cache = g_slice_new0 (GumdDaemonMissCache);
+
+    g_mutex_init (&cache->lock);
+    cache->names = g_hash_table_new_full (g_str_hash, g_str_equal, g_free,
+            NULL);
+    cache->ids = g_hash_table_new (g_direct_hash, g_direct_equal);
+    cache->capacity = capacity > 0 ? (guint) capacity : 0;
+    cache->db_file_key = db_file_key;
+
+    return cache;
 }
 
 static void
-_clear_user_weak_ref (
-        gpointer uid,
-        gpointer user,
-        gpointer user_data)
+_miss_cache_free (
+        GumdDaemonMissCache *cache)
+{
+    g_hash_table_unref (cache->names);
+    g_hash_table_unref (cache->ids);
+    g_mutex_clear (&cache->lock);
+    g_slice_free (GumdDaemonMissCache, cache);
+}
+
+static void
+_miss_cache_clear (
+        GumdDaemonMissCache *cache)
+{
+    g_hash_table_remove_all (cache->names);
+    g_hash_table_remove_all (cache->ids);
+}
+
+/* drops remembered misses if the database changed since they were recorded,
+ * either through the daemon (generation) or behind its back (file stat).
+ * Called with the cache lock held */
+static void
+_miss_cache_validate (
+        GumdDaemonMissCache *cache,
+        GumConfig *config,
+        guint64 generation)
+{
+    GumdDaemonFileStamp stamp;
+
+    if (cache->capacity == 0)
+        return;
+
+    _file_stamp_read (config, cache->db_file_key, &stamp);
+    if (stamp.ino == 0) {
+        _miss_cache_clear (cache);
+        cache->db_stamp = stamp;
+        return;
+    }
+
+    if (cache->generation != generation ||
+        !_file_stamp_equal (&cache->db_stamp, &stamp)) {
+        _miss_cache_clear (cache);
+        cache->generation = generation;
+        cache->db_stamp = stamp;
+    }
+}
+
+/* name is ignored if NULL */
+static gboolean
+_miss_cache_has (
+        GumdDaemonMissCache *cache,
+        GumConfig *config,
+        guint64 generation,
+        const gchar *name,
+        guint id)
+{
+    gboolean found = FALSE;
+
+    g_mutex_lock (&cache->lock);
+    _miss_cache_validate (cache, config, generation);
+    if (name)
+        found = g_hash_table_contains (cache->names, name);
+    else
+        found = g_hash_table_contains (cache->ids, GUINT_TO_POINTER (id));
+    g_mutex_unlock (&cache->lock);
+
+    return found;
+}
+
+static void
+_miss_cache_add_name (
+        GumdDaemonMissCache *cache,
+        const gchar *name)
+{
+    if (cache->capacity == 0 || !name)
+        return;
+
+    g_mutex_lock (&cache->lock);
+    if (g_hash_table_size (cache->names) >= cache->capacity)
+        g_hash_table_remove_all (cache->names);
+    g_hash_table_add (cache->names, g_strdup (name));
+    g_mutex_unlock (&cache->lock);
+}
+
+static void
+_miss_cache_add_id (
+        GumdDaemonMissCache *cache,
+        guint id)
 {
-    g_object_weak_unref (G_OBJECT(user), _on_user_disposed, user_data);
+    if (cache->capacity == 0)
+        return;
+
+    g_mutex_lock (&cache->lock);
+    if (g_hash_table_size (cache->ids) >= cache->capacity)
+        g_hash_table_remove_all (cache->ids);
+    g_hash_table_add (cache->ids, GUINT_TO_POINTER (id));
+    g_mutex_unlock (&cache->lock);
+}
+
+static GumdDaemonChangeLog *
+_change_log_new (
+        gint capacity,
+        guint64 generation)
+{
+    GumdDaemonChangeLog *log = g_slice_new0 (GumdDaemonChangeLog);
+
+    g_queue_init (&log->records);
+    log->capacity = capacity > 0 ? (guint) capacity : 0;
+    log->complete = generation;
+
+    return log;
 }
 
 static void
-_clear_group_weak_ref (
-        gpointer gid,
-        gpointer group,
+_change_free (
+        GumdDaemonChange *change)
+{
+    g_strfreev (change->fields);
+    g_slice_free (GumdDaemonChange, change);
+}
+
+static void
+_change_log_free (
+        GumdDaemonChangeLog *log)
+{
+    g_queue_foreach (&log->records, (GFunc)_change_free, NULL);
+    g_queue_clear (&log->records);
+    g_slice_free (GumdDaemonChangeLog, log);
+}
+
+/* takes ownership of fields */
+static void
+_change_log_add (
+        GumdDaemonChangeLog *log,
+        guint64 generation,
+        GumdDaemonChangeOp op,
+        guint id,
+        gchar **fields)
+{
+    GumdDaemonChange *change = g_slice_new0 (GumdDaemonChange);
+
+    change->generation = generation;
+    change->op = op;
+    change->id = id;
+    change->fields = fields;
+    g_queue_push_tail (&log->records, change);
+
+    while (g_queue_get_length (&log->records) > log->capacity) {
+        change = (GumdDaemonChange *) g_queue_pop_head (&log->records);
+        log->complete = change->generation;
+        _change_free (change);
+    }
+}
+
+/* changes the log cannot describe; clients have to refetch everything */
+static void
+_change_log_reset (
+        GumdDaemonChangeLog *log,
+        guint64 generation)
+{
+    g_queue_foreach (&log->records, (GFunc)_change_free, NULL);
+    g_queue_clear (&log->records);
+    log->complete = generation;
+}
+
+static GVariant *
+_change_log_get_since (
+        GumdDaemonChangeLog *log,
+        guint64 since,
+        guint64 generation,
+        gboolean *resync)
+{
+    GVariantBuilder builder;
+    GList *link = NULL;
+    GumdDaemonChange *change = NULL;
+    const gchar *const empty[] = { NULL };
+
+    g_variant_builder_init (&builder, G_VARIANT_TYPE ("a(tuuas)"));
+
+    /* older than the log or not handed out by this daemon instance */
+    *resync = since < log->complete || since > generation;
+    if (*resync) {
+        return g_variant_builder_end (&builder);
+    }
+
+    /* newest records are at the tail */
+    for (link = g_queue_peek_tail_link (&log->records); link != NULL;
+         link = g_list_previous (link)) {
+        change = (GumdDaemonChange *) link->data;
+        if (change->generation <= since)
+            break;
+    }
+    link = link ? g_list_next (link) : g_queue_peek_head_link (&log->records);
+
+    for ( ; link != NULL; link = g_list_next (link)) {
+        change = (GumdDaemonChange *) link->data;
+        g_variant_builder_add (&builder, "(tuu^as)", change->generation,
+                (guint32) change->op, (guint32) change->id,
+                change->fields ? change->fields : (gchar **) empty);
+    }
+
+    return g_variant_builder_end (&builder);
+}
+
+/* names of the readable properties that differ between two objects of the
+ * same type, or NULL if unknown */
+static gchar **
+_changed_fields (
+        GObject *old_object,
+        GObject *new_object)
+{
+    GParamSpec **pspecs = NULL;
+    guint n_pspecs = 0, i = 0;
+    GPtrArray *fields = NULL;
+
+    if (!old_object || !new_object)
+        return NULL;
+
+    fields = g_ptr_array_new ();
+    pspecs = g_object_class_list_properties (G_OBJECT_GET_CLASS (new_object),
+            &n_pspecs);
+    for (i = 0; i < n_pspecs; i++) {
+        GValue old_value = G_VALUE_INIT;
+        GValue new_value = G_VALUE_INIT;
+
+        if (!(pspecs[i]->flags & G_PARAM_READABLE) ||
+            G_TYPE_IS_OBJECT (pspecs[i]->value_type))
+            continue;
+
+        g_value_init (&old_value, pspecs[i]->value_type);
+        g_value_init (&new_value, pspecs[i]->value_type);
+        g_object_get_property (old_object, pspecs[i]->name, &old_value);
+        g_object_get_property (new_object, pspecs[i]->name, &new_value);
+        if (g_param_values_cmp (pspecs[i], &old_value, &new_value) != 0) {
+            g_ptr_array_add (fields, g_strdup (pspecs[i]->name));
+        }
+        g_value_unset (&old_value);
+        g_value_unset (&new_value);
+    }
+    g_free (pspecs);
+    g_ptr_array_add (fields, NULL);
+
+    return (gchar **) g_ptr_array_free (fields, FALSE);
+}
+
+static void
+_flight_unref (
+        GumdDaemonFlight *flight)
+{
+    if (--flight->ref_count > 0)
+        return;
+
+    GUM_OBJECT_UNREF (flight->object);
+    g_clear_error (&flight->error);
+    g_cond_clear (&flight->cond);
+    g_slice_free (GumdDaemonFlight, flight);
+}
+
+/* runs load() unless an identical load (same key) is already in progress, in
+ * which case the caller waits for and shares that load's result */
+static GObject *
+_load_once (
+        GumdDaemon *self,
+        const gchar *key,
+        GumdDaemonLoadFunc load,
+        gconstpointer data,
+        GError **error)
+{
+    GumdDaemonFlight *flight = NULL;
+    GObject *object = NULL;
+    GError *load_error = NULL;
+
+    g_mutex_lock (&self->priv->flight_lock);
+    flight = g_hash_table_lookup (self->priv->flights, key);
+    if (flight) {
+        DBG ("joining in-flight load '%s'", key);
+        flight->ref_count++;
+        while (!flight->done)
+            g_cond_wait (&flight->cond, &self->priv->flight_lock);
+        if (flight->object)
+            object = g_object_ref (flight->object);
+        else if (flight->error)
+            g_propagate_error (error, g_error_copy (flight->error));
+        _flight_unref (flight);
+        g_mutex_unlock (&self->priv->flight_lock);
+        return object;
+    }
+
+    flight = g_slice_new0 (GumdDaemonFlight);
+    flight->ref_count = 1;
+    g_cond_init (&flight->cond);
+    g_hash_table_insert (self->priv->flights, g_strdup (key), flight);
+    g_mutex_unlock (&self->priv->flight_lock);
+
+    _read_lock_db (self);
+    object = load (self, data, &load_error);
+    _read_unlock_db (self);
+
+    g_mutex_lock (&self->priv->flight_lock);
+    g_hash_table_remove (self->priv->flights, key);
+    if (object)
+        flight->object = g_object_ref (object);
+    if (load_error)
+        flight->error = g_error_copy (load_error);
+    flight->done = TRUE;
+    g_cond_broadcast (&flight->cond);
+    _flight_unref (flight);
+    g_mutex_unlock (&self->priv->flight_lock);
+
+    if (load_error)
+        g_propagate_error (error, load_error);
+
+    return object;
+}
+
+/* called with the database lock held */
+static gboolean
+_publish_snapshot (
+        GumdDaemon *self,
+        GError **error)
+{
+    const gchar *path = gum_config_get_string (self->priv->config,
+            GUM_CONFIG_GENERAL_SNAPSHOT_FILE);
+
+    if (!path || path[0] == '\0') {
+        GUM_RETURN_WITH_ERROR (GUM_ERROR_FILE_OPEN,
+                "Database snapshot is disabled", error, FALSE);
+    }
+
+    if (self->priv->snapshot_generation == self->priv->generation)
+        return TRUE;
+
+    if (!gum_snapshot_write (path,
+            gum_config_get_string (self->priv->config,
+                    GUM_CONFIG_GENERAL_PASSWD_FILE),
+            gum_config_get_string (self->priv->config,
+                    GUM_CONFIG_GENERAL_GROUP_FILE),
+            self->priv->generation, error)) {
+        return FALSE;
+    }
+    self->priv->snapshot_generation = self->priv->generation;
+
+    return TRUE;
+}
+
+static gboolean
+_publish_snapshot_cb (
         gpointer user_data)
 {
-    g_object_weak_unref (G_OBJECT(group), _on_group_disposed, user_data);
+    GumdDaemon *self = GUMD_DAEMON (user_data);
+    GError *error = NULL;
+
+    g_rw_lock_writer_lock (&self->priv->db_lock);
+    g_source_unref (self->priv->publish_source);
+    self->priv->publish_source = NULL;
+    if (!_publish_snapshot (self, &error)) {
+        WARN ("Failed to publish database snapshot: %s", error->message);
+        g_error_free (error);
+    }
+    _write_unlock_db (self);
+
+    return G_SOURCE_REMOVE;
+}
+
+/* takes note of the daemon's own writes to the database files. Called with
+ * the database lock held for writing */
+static void
+_restamp (
+        GumdDaemon *self)
+{
+    guint i;
+
+    _cache_restamp (self->priv->users);
+    _cache_restamp (self->priv->groups);
+    for (i = 0; i < G_N_ELEMENTS (db_file_keys); i++) {
+        _file_stamp_read (self->priv->config, db_file_keys[i],
+                &self->priv->db_stamps[i]);
+    }
+}
+
+/* called with the database lock held for writing */
+static void
+_bump_generation (
+        GumdDaemon *self)
+{
+    const gchar *path = NULL;
+
+    self->priv->generation++;
+    _restamp (self);
+
+    /* replace the snapshot once one is in use, even if published by another
+     * (e.g. offline) instance. Writing it is linear in the size of the
+     * database, so a burst of writes is published at once when it is over;
+     * clients meanwhile notice the snapshot is stale and ask the daemon */
+    path = gum_config_get_string (self->priv->config,
+            GUM_CONFIG_GENERAL_SNAPSHOT_FILE);
+    if (path && path[0] != '\0' && !self->priv->publish_source &&
+        (self->priv->snapshot_generation ||
+         g_file_test (path, G_FILE_TEST_EXISTS))) {
+        self->priv->publish_source = g_timeout_source_new (
+                GUMD_DAEMON_SNAPSHOT_DELAY);
+        g_source_set_callback (self->priv->publish_source,
+                _publish_snapshot_cb, self, NULL);
+        g_source_attach (self->priv->publish_source, NULL);
+    }
+}
+
+/* called with the database lock held. Files no longer matching the stamps
+ * taken at the last write were edited behind the daemon's back */
+static gboolean
+_db_files_changed (
+        GumdDaemon *self)
+{
+    GumdDaemonFileStamp stamp;
+    guint i;
+
+    for (i = 0; i < G_N_ELEMENTS (db_file_keys); i++) {
+        _file_stamp_read (self->priv->config, db_file_keys[i], &stamp);
+        if (!_file_stamp_equal (&stamp, &self->priv->db_stamps[i]))
+            return TRUE;
+    }
+    return FALSE;
+}
+
+/* called with the database lock held for writing. External edits can not be
+ * described by the change logs: clients have to refetch everything */
+static void
+_check_db_files (
+        GumdDaemon *self)
+{
+    if (!_db_files_changed (self))
+        return;
+
+    DBG ("database files modified externally");
+    _bump_generation (self);
+    _change_log_reset (self->priv->user_changes, self->priv->generation);
+    _change_log_reset (self->priv->group_changes, self->priv->generation);
+}
+
+/* logs the groups a user write added, deleted or changed the members of, and
+ * drops them from the cache. Called with the database lock held for writing */
+static void
+_log_group_changes (
+        GumdDaemon *self,
+        gid_t added_gid,
+        gid_t deleted_gid,
+        GArray *member_gids)
+{
+    gid_t gid = GUM_GROUP_INVALID_GID;
+    guint i;
+
+    if (added_gid != GUM_GROUP_INVALID_GID) {
+        _change_log_add (self->priv->group_changes, self->priv->generation,
+                GUMD_DAEMON_CHANGE_ADDED, added_gid, NULL);
+    }
+
+    for (i = 0; i < member_gids->len; i++) {
+        gid = g_array_index (member_gids, gid_t, i);
+        if (gid == added_gid || gid == deleted_gid)
+            continue;
+        _cache_remove (self->priv->groups, gid);
+        _change_log_add (self->priv->group_changes, self->priv->generation,
+                GUMD_DAEMON_CHANGE_UPDATED, gid,
+                g_strdupv ((gchar **) member_fields));
+    }
+
+    if (deleted_gid != GUM_GROUP_INVALID_GID) {
+        _cache_remove (self->priv->groups, deleted_gid);
+        _change_log_add (self->priv->group_changes, self->priv->generation,
+                GUMD_DAEMON_CHANGE_DELETED, deleted_gid, NULL);
+    }
 }
 
 static GObject*
@@ -131,19 +1030,53 @@ static void
 _dispose (GObject *object)
 {
     GumdDaemon *self = GUMD_DAEMON(object);
+    GError *error = NULL;
+
+    /* do not leave a stale snapshot behind */
+    g_rw_lock_writer_lock (&self->priv->db_lock);
+    if (self->priv->publish_source) {
+        g_source_destroy (self->priv->publish_source);
+        g_source_unref (self->priv->publish_source);
+        self->priv->publish_source = NULL;
+        if (!_publish_snapshot (self, &error)) {
+            WARN ("Failed to publish database snapshot: %s", error->message);
+            g_error_free (error);
+        }
+    }
+    _write_unlock_db (self);
 
     if (self->priv->users) {
-        g_hash_table_foreach (self->priv->users, _clear_user_weak_ref, self);
-        g_hash_table_unref (self->priv->users);
+        _cache_free (self->priv->users);
         self->priv->users = NULL;
     }
 
     if (self->priv->groups) {
-        g_hash_table_foreach (self->priv->groups, _clear_group_weak_ref, self);
-        g_hash_table_unref (self->priv->groups);
+        _cache_free (self->priv->groups);
         self->priv->groups = NULL;
     }
 
+    GUM_HASHTABLE_UNREF (self->priv->flights);
+
+    if (self->priv->user_misses) {
+        _miss_cache_free (self->priv->user_misses);
+        self->priv->user_misses = NULL;
+    }
+
+    if (self->priv->group_misses) {
+        _miss_cache_free (self->priv->group_misses);
+        self->priv->group_misses = NULL;
+    }
+
+    if (self->priv->user_changes) {
+        _change_log_free (self->priv->user_changes);
+        self->priv->user_changes = NULL;
+    }
+
+    if (self->priv->group_changes) {
+        _change_log_free (self->priv->group_changes);
+        self->priv->group_changes = NULL;
+    }
+
     GUM_OBJECT_UNREF (self->priv->config);
 
     G_OBJECT_CLASS (gumd_daemon_parent_class)->dispose (object);
@@ -152,6 +1085,11 @@ _dispose (GObject *object)
 static void
 _finalize (GObject *object)
 {
+    GumdDaemon *self = GUMD_DAEMON(object);
+
+    g_rw_lock_clear (&self->priv->db_lock);
+    g_mutex_clear (&self->priv->flight_lock);
+
     G_OBJECT_CLASS (gumd_daemon_parent_class)->finalize (object);
 }
 
@@ -159,12 +1097,56 @@ static void
 gumd_daemon_init (
         GumdDaemon *self)
 {
+    gint cache_timeout = 0;
+    gint miss_size = 0;
+    gint log_size = 0;
+    guint i;
+
     self->priv = GUMD_DAEMON_PRIV (self);
     self->priv->config = gum_config_new (NULL);
-    self->priv->users = g_hash_table_new_full (g_direct_hash, g_direct_equal,
-            NULL, NULL);
-    self->priv->groups = g_hash_table_new_full (g_direct_hash, g_direct_equal,
-            NULL, NULL);
+
+    cache_timeout = gum_config_get_int (self->priv->config,
+            GUM_CONFIG_DBUS_CACHE_TIMEOUT, GUMD_DAEMON_CACHE_TIMEOUT_DEFAULT);
+    self->priv->users = _cache_new (gum_config_get_int (self->priv->config,
+            GUM_CONFIG_DBUS_USER_CACHE_SIZE, GUMD_DAEMON_CACHE_SIZE_DEFAULT),
+            cache_timeout, _copy_user, self->priv->config,
+            GUM_CONFIG_GENERAL_PASSWD_FILE, GUM_CONFIG_GENERAL_SHADOW_FILE);
+    self->priv->groups = _cache_new (gum_config_get_int (self->priv->config,
+            GUM_CONFIG_DBUS_GROUP_CACHE_SIZE, GUMD_DAEMON_CACHE_SIZE_DEFAULT),
+            cache_timeout, _copy_group, self->priv->config,
+            GUM_CONFIG_GENERAL_GROUP_FILE, GUM_CONFIG_GENERAL_GSHADOW_FILE);
+
+    miss_size = gum_config_get_int (self->priv->config,
+            GUM_CONFIG_DBUS_NEGATIVE_CACHE_SIZE,
+            GUMD_DAEMON_NEGATIVE_CACHE_SIZE_DEFAULT);
+    self->priv->user_misses = _miss_cache_new (miss_size,
+            GUM_CONFIG_GENERAL_PASSWD_FILE);
+    self->priv->group_misses = _miss_cache_new (miss_size,
+            GUM_CONFIG_GENERAL_GROUP_FILE);
+    /* start from the wall clock, so that generations handed out by an
+     * earlier daemon instance are never mistaken for current ones */
+    self->priv->generation = (guint64) g_get_real_time ();
+
+    log_size = gum_config_get_int (self->priv->config,
+            GUM_CONFIG_DBUS_CHANGE_LOG_SIZE,
+            GUMD_DAEMON_CHANGE_LOG_SIZE_DEFAULT);
+    self->priv->user_changes = _change_log_new (log_size,
+            self->priv->generation);
+    self->priv->group_changes = _change_log_new (log_size,
+            self->priv->generation);
+
+    gum_lock_pwdf_set_timeout (gum_config_get_uint (self->priv->config,
+            GUM_CONFIG_GENERAL_LOCK_TIMEOUT, GUM_LOCK_PWDF_TIMEOUT_DEFAULT));
+
+    for (i = 0; i < G_N_ELEMENTS (db_file_keys); i++) {
+        _file_stamp_read (self->priv->config, db_file_keys[i],
+                &self->priv->db_stamps[i]);
+    }
+
+    g_rw_lock_init (&self->priv->db_lock);
+    g_mutex_init (&self->priv->flight_lock);
+    self->priv->flights = g_hash_table_new_full (g_str_hash, g_str_equal,
+            g_free, NULL);
 }
 
 static void
@@ -244,27 +1226,114 @@ gumd_daemon_class_init (
             G_TYPE_UINT);
 }
 
-GumdDaemon *
-gumd_daemon_new ()
+GumdDaemon *
+gumd_daemon_new ()
+{
+    return GUMD_DAEMON (g_object_new (GUMD_TYPE_DAEMON, NULL));
+}
+
+guint
+gumd_daemon_get_timeout (
+        GumdDaemon *self)
+{
+    return gum_config_get_int (self->priv->config,
+        GUM_CONFIG_DBUS_DAEMON_TIMEOUT, 0);
+}
+
+GumConfig *
+gumd_daemon_get_config (
+        GumdDaemon *self)
+{
+    g_return_val_if_fail (self != NULL && self->priv != NULL, NULL);
+
+    return self->priv->config;
+}
+
+gboolean
+gumd_daemon_clear_user_cache (
+        GumdDaemon *self,
+        GError **error)
+{
+    if (!self || !GUMD_IS_DAEMON (self)) {
+        GUM_RETURN_WITH_ERROR (GUM_ERROR_INVALID_INPUT,
+                "Daemon object is not valid", error, FALSE);
+    }
+
+    _cache_clear (self->priv->users);
+    return TRUE;
+}
+
+gboolean
+gumd_daemon_clear_group_cache (
+        GumdDaemon *self,
+        GError **error)
+{
+    if (!self || !GUMD_IS_DAEMON (self)) {
+        GUM_RETURN_WITH_ERROR (GUM_ERROR_INVALID_INPUT,
+                "Daemon object is not valid", error, FALSE);
+    }
+
+    _cache_clear (self->priv->groups);
+    return TRUE;
+}
+
+static GObject *
+_load_user (
+        GumdDaemon *self,
+        gconstpointer data,
+        GError **error)
 {
-    return GUMD_DAEMON (g_object_new (GUMD_TYPE_DAEMON, NULL));
-}
+    uid_t uid = (uid_t) GPOINTER_TO_UINT (data);
+    GumdDaemonUser *user = NULL;
 
-guint
-gumd_daemon_get_timeout (
-        GumdDaemon *self)
-{
-    return gum_config_get_int (self->priv->config,
-        GUM_CONFIG_DBUS_DAEMON_TIMEOUT, 0);
+    if (_miss_cache_has (self->priv->user_misses, self->priv->config,
+            self->priv->generation, NULL, uid)) {
+        GUM_RETURN_WITH_ERROR (GUM_ERROR_USER_NOT_FOUND, "User not found", error,
+                NULL);
+    }
+
+    user = gumd_daemon_user_new_by_uid (uid, self->priv->config);
+    if (!user) {
+        _miss_cache_add_id (self->priv->user_misses, uid);
+        GUM_RETURN_WITH_ERROR (GUM_ERROR_USER_NOT_FOUND, "User not found", error,
+                NULL);
+    }
+
+    _cache_insert (self->priv->users, uid, G_OBJECT (user));
+
+    return G_OBJECT (user);
 }
 
-GumConfig *
-gumd_daemon_get_config (
-        GumdDaemon *self)
+static GObject *
+_load_user_by_name (
+        GumdDaemon *self,
+        gconstpointer data,
+        GError **error)
 {
-    g_return_val_if_fail (self != NULL && self->priv != NULL, NULL);
+    const gchar *username = (const gchar *) data;
+    uid_t uid = GUM_USER_INVALID_UID;
+    GObject *user = NULL;
 
-    return self->priv->config;
+    if (username && _miss_cache_has (self->priv->user_misses,
+            self->priv->config, self->priv->generation, username, 0)) {
+        GUM_RETURN_WITH_ERROR (GUM_ERROR_USER_NOT_FOUND, "User not found", error,
+                NULL);
+    }
+
+    uid = gumd_daemon_user_get_uid_by_name (username, self->priv->config);
+    if (uid == GUM_USER_INVALID_UID) {
+        _miss_cache_add_name (self->priv->user_misses, username);
+        GUM_RETURN_WITH_ERROR (GUM_ERROR_USER_NOT_FOUND, "User not found", error,
+                NULL);
+    }
+
+    /* already holding the database lock: load directly rather than waiting
+     * on another thread's flight, as a writer may be queued for the lock */
+    user = _cache_lookup (self->priv->users, uid);
+    if (user) {
+        return user;
+    }
+    return _load_user (self, GUINT_TO_POINTER (uid), error);
 }
 
 GumdDaemonUser *
@@ -274,27 +1343,23 @@ gumd_daemon_get_user (
         GError **error)
 {
     GumdDaemonUser *user = NULL;
+    gchar *key = NULL;
+
     if (!self || !GUMD_IS_DAEMON (self)) {
         GUM_RETURN_WITH_ERROR (GUM_ERROR_INVALID_INPUT,
                 "Daemon object is not valid", error, NULL);
     }
 
-    user = GUMD_DAEMON_USER (g_hash_table_lookup (self->priv->users,
-            GUINT_TO_POINTER(uid)));
-    if (user) {
-        return GUMD_DAEMON_USER (g_object_ref (user));
-    }
-
-    user = gumd_daemon_user_new_by_uid (uid, self->priv->config);
+    user = (GumdDaemonUser *) _cache_lookup (self->priv->users, uid);
     if (!user) {
-        GUM_RETURN_WITH_ERROR (GUM_ERROR_USER_NOT_FOUND, "User not found", error,
-                NULL);
+        key = g_strdup_printf ("uid:%u", uid);
+        user = (GumdDaemonUser *) _load_once (self, key, _load_user,
+                GUINT_TO_POINTER (uid), error);
+        g_free (key);
     }
 
-    g_hash_table_insert (self->priv->users, GUINT_TO_POINTER(uid), user);
-    g_object_weak_ref (G_OBJECT (user), _on_user_disposed, self);
-
-    return user;
+    return (GumdDaemonUser *) _cache_get_copy (self->priv->users,
+            G_OBJECT (user));
 }
 
 GumdDaemonUser *
@@ -303,19 +1368,21 @@ gumd_daemon_get_user_by_name (
         const gchar *username,
         GError **error)
 {
-    uid_t uid = GUM_USER_INVALID_UID;
+    GumdDaemonUser *user = NULL;
+    gchar *key = NULL;
+
     if (!self || !GUMD_IS_DAEMON (self)) {
         GUM_RETURN_WITH_ERROR (GUM_ERROR_INVALID_INPUT,
                 "Daemon object is not valid", error, NULL);
     }
 
-    uid = gumd_daemon_user_get_uid_by_name (username, self->priv->config);
-    if (uid == GUM_USER_INVALID_UID) {
-        GUM_RETURN_WITH_ERROR (GUM_ERROR_USER_NOT_FOUND, "User not found", error,
-                NULL);
-    }
+    key = g_strdup_printf ("username:%s", username);
+    user = (GumdDaemonUser *) _load_once (self, key, _load_user_by_name,
+            username, error);
+    g_free (key);
 
-    return gumd_daemon_get_user (self, uid, error);
+    return (GumdDaemonUser *) _cache_get_copy (self->priv->users,
+            G_OBJECT (user));
 }
 
 gboolean
@@ -325,22 +1392,117 @@ gumd_daemon_add_user (
         GError **error)
 {
     uid_t uid = GUM_USER_INVALID_UID;
+    gboolean ok = FALSE;
+    gint64 start = g_get_monotonic_time ();
+    gid_t new_gid = GUM_GROUP_INVALID_GID;
+    GArray *member_gids = NULL;
 
     if (!self || !GUMD_IS_DAEMON (self) || !user) {
         GUM_RETURN_WITH_ERROR (GUM_ERROR_INVALID_INPUT,
                 "Daemon/usr object not valid", error, FALSE);
     }
 
-    if (!gumd_daemon_user_add (user, &uid, error)) {
+    GUM_TRACE2 (daemon_op__start, "addUser", 0);
+    member_gids = g_array_new (FALSE, FALSE, sizeof (gid_t));
+    _write_lock_db (self);
+    /* even a failed write may have touched the database */
+    ok = gumd_daemon_user_add_entries (user, &uid, &new_gid, member_gids,
+            error);
+    _bump_generation (self);
+    if (ok) {
+        _cache_insert (self->priv->users, uid, G_OBJECT (user));
+        _change_log_add (self->priv->user_changes, self->priv->generation,
+                GUMD_DAEMON_CHANGE_ADDED, uid, NULL);
+    }
+    /* user's own group and default group memberships */
+    _log_group_changes (self, new_gid, GUM_GROUP_INVALID_GID, member_gids);
+    _write_unlock_db (self);
+    g_array_unref (member_gids);
+
+    /* home directory and scripts do not touch the database */
+    if (ok) {
+        ok = gumd_daemon_user_finish_add (user, error);
+    }
+    gum_stats_record ("daemon.addUser", start, !ok);
+    GUM_TRACE3 (daemon_op__done, "addUser", ok ? uid : 0, ok);
+    if (!ok) {
         return FALSE;
     }
 
-    if (!g_hash_table_lookup (self->priv->users, GUINT_TO_POINTER(uid))) {
-        g_hash_table_insert (self->priv->users, GUINT_TO_POINTER(uid), user);
-        g_object_weak_ref (G_OBJECT (user), _on_user_disposed, self);
-        g_signal_emit (self, signals[SIG_USER_ADDED], 0, uid);
+    g_signal_emit (self, signals[SIG_USER_ADDED], 0, uid);
+
+    return TRUE;
+}
+
+/* locks the user's shadow entry against logins, before its sessions are
+ * terminated */
+static gboolean
+_prepare_delete_user (
+        GumdDaemon *self,
+        GumdDaemonUser *user,
+        GError **error)
+{
+    gboolean ok = FALSE;
+
+    _write_lock_db (self);
+    ok = gumd_daemon_user_prepare_delete (user, error);
+    _restamp (self);
+    _write_unlock_db (self);
+    return ok;
+}
+
+/* deletes the user once logged out, or unlocks it again */
+static gboolean
+_finish_delete_user (
+        GumdDaemon *self,
+        GumdDaemonUser *user,
+        uid_t uid,
+        gboolean rem_home_dir,
+        gint64 start,
+        gboolean logged_out,
+        GError **error)
+{
+    gboolean ok = logged_out;
+    gid_t deleted_gid = GUM_GROUP_INVALID_GID;
+    GArray *member_gids = NULL;
+
+    if (!ok) {
+        _write_lock_db (self);
+        gumd_daemon_user_cancel_delete (user);
+        _restamp (self);
+        _write_unlock_db (self);
+    }
+
+    if (ok) {
+        member_gids = g_array_new (FALSE, FALSE, sizeof (gid_t));
+        _write_lock_db (self);
+        ok = gumd_daemon_user_delete_entries (user, &deleted_gid, member_gids,
+                error);
+        _bump_generation (self);
+        if (ok) {
+            _cache_remove (self->priv->users, uid);
+            _change_log_add (self->priv->user_changes,
+                    self->priv->generation, GUMD_DAEMON_CHANGE_DELETED, uid,
+                    NULL);
+        }
+        /* user's group and memberships are gone as well */
+        _log_group_changes (self, GUM_GROUP_INVALID_GID, deleted_gid,
+                member_gids);
+        _write_unlock_db (self);
+        g_array_unref (member_gids);
     }
 
+    if (ok && rem_home_dir) {
+        ok = gumd_daemon_user_delete_home_dir (user, error);
+    }
+    gum_stats_record ("daemon.deleteUser", start, !ok);
+    GUM_TRACE3 (daemon_op__done, "deleteUser", uid, ok);
+    if (!ok) {
+        return FALSE;
+    }
+    if (uid != GUM_USER_INVALID_UID) {
+        g_signal_emit (self, signals[SIG_USER_DELETED], 0, uid);
+    }
     return TRUE;
 }
 
@@ -352,6 +1514,8 @@ gumd_daemon_delete_user (
         GError **error)
 {
     uid_t uid = GUM_USER_INVALID_UID;
+    gboolean ok = FALSE;
+    gint64 start = g_get_monotonic_time ();
 
     if (!self || !GUMD_IS_DAEMON (self) || !user) {
         GUM_RETURN_WITH_ERROR (GUM_ERROR_INVALID_INPUT,
@@ -359,14 +1523,102 @@ gumd_daemon_delete_user (
     }
 
     g_object_get (G_OBJECT (user), "uid", &uid, NULL);
-    if (!gumd_daemon_user_delete (user, rem_home_dir, error)) {
-        return FALSE;
+    GUM_TRACE2 (daemon_op__start, "deleteUser", uid);
+    ok = _prepare_delete_user (self, user, error);
+
+    /* sessions and scripts do not need the database */
+    if (ok) {
+        ok = _finish_delete_user (self, user, uid, rem_home_dir, start,
+                gumd_daemon_user_logout (user, error), error);
+    } else {
+        gum_stats_record ("daemon.deleteUser", start, TRUE);
+        GUM_TRACE3 (daemon_op__done, "deleteUser", uid, FALSE);
     }
-    /* user will be removed from cache when it is disposed off */
-    if (uid != GUM_USER_INVALID_UID) {
-        g_signal_emit (self, signals[SIG_USER_DELETED], 0, uid);
+    return ok;
+}
+
+typedef struct {
+    GumdDaemon *daemon;
+    uid_t uid;
+    gboolean rem_home_dir;
+    gint64 start;
+    GumdDaemonDeleteUserCb callback;
+    gpointer user_data;
+} GumdDaemonDeleteUserOp;
+
+static void
+_on_user_logged_out (
+        GumdDaemonUser *user,
+        const GError *logout_error,
+        gpointer user_data)
+{
+    GumdDaemonDeleteUserOp *op = user_data;
+    GError *error = logout_error ? g_error_copy (logout_error) : NULL;
+
+    _finish_delete_user (op->daemon, user, op->uid, op->rem_home_dir,
+            op->start, error == NULL, error ? NULL : &error);
+    op->callback (op->daemon, user, error, op->user_data);
+
+    if (error) g_error_free (error);
+    g_object_unref (op->daemon);
+    g_slice_free (GumdDaemonDeleteUserOp, op);
+}
+
+/**
+ * gumd_daemon_delete_user_async:
+ * @self: #GumdDaemon object
+ * @user: the #GumdDaemonUser to delete
+ * @rem_home_dir: whether to delete the home directory as well
+ * @callback: called once the user is deleted, or failed to be
+ * @user_data: user data passed to @callback
+ *
+ * Same as gumd_daemon_delete_user, but the sessions of the user are waited
+ * for without blocking, and without holding the database lock, so that other
+ * requests are served meanwhile. @callback is called from the thread default
+ * main context, or before returning if the user is known to have no
+ * sessions.
+ */
+void
+gumd_daemon_delete_user_async (
+        GumdDaemon *self,
+        GumdDaemonUser *user,
+        gboolean rem_home_dir,
+        GumdDaemonDeleteUserCb callback,
+        gpointer user_data)
+{
+    GumdDaemonDeleteUserOp *op = NULL;
+    GError *error = NULL;
+    gint64 start = g_get_monotonic_time ();
+    uid_t uid = GUM_USER_INVALID_UID;
+
+    g_return_if_fail (callback != NULL);
+
+    if (!self || !GUMD_IS_DAEMON (self) || !user) {
+        error = GUM_GET_ERROR_FOR_ID (GUM_ERROR_INVALID_INPUT,
+                "Daemon/user object not valid");
+        callback (self, user, error, user_data);
+        g_error_free (error);
+        return;
     }
-    return TRUE;
+
+    g_object_get (G_OBJECT (user), "uid", &uid, NULL);
+    GUM_TRACE2 (daemon_op__start, "deleteUser", uid);
+    if (!_prepare_delete_user (self, user, &error)) {
+        gum_stats_record ("daemon.deleteUser", start, TRUE);
+        GUM_TRACE3 (daemon_op__done, "deleteUser", uid, FALSE);
+        callback (self, user, error, user_data);
+        g_error_free (error);
+        return;
+    }
+
+    op = g_slice_new0 (GumdDaemonDeleteUserOp);
+    op->daemon = g_object_ref (self);
+    op->uid = uid;
+    op->rem_home_dir = rem_home_dir;
+    op->start = start;
+    op->callback = callback;
+    op->user_data = user_data;
+    gumd_daemon_user_logout_async (user, _on_user_logged_out, op);
 }
 
 gboolean
@@ -376,17 +1628,41 @@ gumd_daemon_update_user (
         GError **error)
 {
     uid_t uid = GUM_USER_INVALID_UID;
+    GumdDaemonUser *old_user = NULL;
+    gboolean ok = FALSE;
+    gint64 start = g_get_monotonic_time ();
 
     if (!self || !GUMD_IS_DAEMON (self) || !user) {
         GUM_RETURN_WITH_ERROR (GUM_ERROR_INVALID_INPUT,
                 "Daemon/user object not valid", error, FALSE);
     }
 
-    if (!gumd_daemon_user_update (user, error)) {
+    g_object_get (G_OBJECT (user), "uid", &uid, NULL);
+    GUM_TRACE2 (daemon_op__start, "updateUser", uid);
+    _write_lock_db (self);
+    /* reread the stored entry to find out what changed */
+    if (uid != GUM_USER_INVALID_UID) {
+        old_user = gumd_daemon_user_new_by_uid (uid, self->priv->config);
+    }
+    ok = gumd_daemon_user_update (user, error);
+    _bump_generation (self);
+    if (!ok) {
+        /* do not hand out unsaved changes to other clients */
+        _cache_remove (self->priv->users, uid);
+    } else if (uid != GUM_USER_INVALID_UID) {
+        _cache_insert (self->priv->users, uid, G_OBJECT (user));
+        _change_log_add (self->priv->user_changes, self->priv->generation,
+                GUMD_DAEMON_CHANGE_UPDATED, uid,
+                _changed_fields (G_OBJECT (old_user), G_OBJECT (user)));
+    }
+    _write_unlock_db (self);
+    gum_stats_record ("daemon.updateUser", start, !ok);
+    GUM_TRACE3 (daemon_op__done, "updateUser", uid, ok);
+    GUM_OBJECT_UNREF (old_user);
+    if (!ok) {
         return FALSE;
     }
 
-    g_object_get (G_OBJECT (user), "uid", &uid, NULL);
     if (uid != GUM_USER_INVALID_UID) {
         g_signal_emit (self, signals[SIG_USER_UPDATED], 0, uid);
     }
@@ -399,12 +1675,118 @@ gumd_daemon_get_user_list (
         const gchar *const *types,
         GError **error)
 {
+    GVariant *users = NULL;
+
+    if (!self || !GUMD_IS_DAEMON (self)) {
+        GUM_RETURN_WITH_ERROR (GUM_ERROR_INVALID_INPUT,
+                "Daemon object is not valid", error, NULL);
+    }
+
+    _read_lock_db (self);
+    users = gumd_daemon_user_get_user_list (types, self->priv->config, error);
+    _read_unlock_db (self);
+
+    return users;
+}
+
+GVariant *
+gumd_daemon_get_user_records (
+        GumdDaemon *self,
+        const gchar *const *types,
+        GError **error)
+{
+    GVariant *users = NULL;
+
+    if (!self || !GUMD_IS_DAEMON (self)) {
+        GUM_RETURN_WITH_ERROR (GUM_ERROR_INVALID_INPUT,
+                "Daemon object is not valid", error, NULL);
+    }
+
+    _read_lock_db (self);
+    users = gumd_daemon_user_get_user_records (types, self->priv->config,
+            error);
+    _read_unlock_db (self);
+
+    return users;
+}
+
+GVariant *
+gumd_daemon_get_user_changes (
+        GumdDaemon *self,
+        guint64 since,
+        guint64 *generation,
+        gboolean *resync,
+        GError **error)
+{
+    GVariant *changes = NULL;
+
     if (!self || !GUMD_IS_DAEMON (self)) {
         GUM_RETURN_WITH_ERROR (GUM_ERROR_INVALID_INPUT,
                 "Daemon object is not valid", error, NULL);
     }
 
-    return gumd_daemon_user_get_user_list (types, self->priv->config, error);
+    _read_lock_db (self);
+    *generation = self->priv->generation;
+    changes = _change_log_get_since (self->priv->user_changes, since,
+            self->priv->generation, resync);
+    _read_unlock_db (self);
+
+    return changes;
+}
+
+gint
+gumd_daemon_get_snapshot_fd (
+        GumdDaemon *self,
+        guint64 *generation,
+        GError **error)
+{
+    gint fd = -1;
+
+    if (!self || !GUMD_IS_DAEMON (self)) {
+        GUM_RETURN_WITH_ERROR (GUM_ERROR_INVALID_INPUT,
+                "Daemon object is not valid", error, -1);
+    }
+
+    _write_lock_db (self);
+    if (_publish_snapshot (self, error)) {
+        fd = open (gum_config_get_string (self->priv->config,
+                GUM_CONFIG_GENERAL_SNAPSHOT_FILE), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) {
+            GUM_SET_ERROR (GUM_ERROR_FILE_OPEN,
+                    "Unable to open database snapshot", error, fd, -1);
+        } else if (generation) {
+            *generation = self->priv->snapshot_generation;
+        }
+    }
+    _write_unlock_db (self);
+
+    return fd;
+}
+
+gboolean
+gumd_daemon_publish_snapshot (
+        GumdDaemon *self,
+        GError **error)
+{
+    const gchar *path = NULL;
+    gboolean ret = TRUE;
+
+    if (!self || !GUMD_IS_DAEMON (self)) {
+        GUM_RETURN_WITH_ERROR (GUM_ERROR_INVALID_INPUT,
+                "Daemon object is not valid", error, FALSE);
+    }
+
+    /* nothing to do if disabled */
+    path = gum_config_get_string (self->priv->config,
+            GUM_CONFIG_GENERAL_SNAPSHOT_FILE);
+    if (!path || path[0] == '\0')
+        return TRUE;
+
+    _write_lock_db (self);
+    ret = _publish_snapshot (self, error);
+    _write_unlock_db (self);
+
+    return ret;
 }
 
 guint
@@ -415,6 +1797,64 @@ gumd_daemon_get_user_timeout (
         GUM_CONFIG_DBUS_USER_TIMEOUT, 0);
 }
 
+static GObject *
+_load_group (
+        GumdDaemon *self,
+        gconstpointer data,
+        GError **error)
+{
+    gid_t gid = (gid_t) GPOINTER_TO_UINT (data);
+    GumdDaemonGroup *group = NULL;
+
+    if (_miss_cache_has (self->priv->group_misses, self->priv->config,
+            self->priv->generation, NULL, gid)) {
+        GUM_RETURN_WITH_ERROR (GUM_ERROR_GROUP_NOT_FOUND, "Group not found",
+                error, NULL);
+    }
+
+    group = gumd_daemon_group_new_by_gid (gid, self->priv->config);
+    if (!group) {
+        _miss_cache_add_id (self->priv->group_misses, gid);
+        GUM_RETURN_WITH_ERROR (GUM_ERROR_GROUP_NOT_FOUND, "Group not found",
+                error, NULL);
+    }
+
+    _cache_insert (self->priv->groups, gid, G_OBJECT (group));
+
+    return G_OBJECT (group);
+}
+
+static GObject *
+_load_group_by_name (
+        GumdDaemon *self,
+        gconstpointer data,
+        GError **error)
+{
+    const gchar *groupname = (const gchar *) data;
+    gid_t gid = GUM_GROUP_INVALID_GID;
+    GObject *group = NULL;
+
+    if (groupname && _miss_cache_has (self->priv->group_misses,
+            self->priv->config, self->priv->generation, groupname, 0)) {
+        GUM_RETURN_WITH_ERROR (GUM_ERROR_GROUP_NOT_FOUND, "Group not found",
+                error, NULL);
+    }
+
+    gid = gumd_daemon_group_get_gid_by_name (groupname, self->priv->config);
+    if (gid == GUM_GROUP_INVALID_GID) {
+        _miss_cache_add_name (self->priv->group_misses, groupname);
+        GUM_RETURN_WITH_ERROR (GUM_ERROR_GROUP_NOT_FOUND, "Group not found",
+                error, NULL);
+    }
+
+    /* see _load_user_by_name () */
+    group = _cache_lookup (self->priv->groups, gid);
+    if (group) {
+        return group;
+    }
+    return _load_group (self, GUINT_TO_POINTER (gid), error);
+}
+
 GumdDaemonGroup *
 gumd_daemon_get_group (
         GumdDaemon *self,
@@ -422,27 +1862,23 @@ gumd_daemon_get_group (
         GError **error)
 {
     GumdDaemonGroup *group = NULL;
+    gchar *key = NULL;
+
     if (!self || !GUMD_IS_DAEMON (self)) {
         GUM_RETURN_WITH_ERROR (GUM_ERROR_INVALID_INPUT,
                 "Daemon object is not valid", error, NULL);
     }
 
-    group = GUMD_DAEMON_GROUP (g_hash_table_lookup (self->priv->groups,
-            GUINT_TO_POINTER(gid)));
-    if (group) {
-        return GUMD_DAEMON_GROUP (g_object_ref (group));
-    }
-
-    group = gumd_daemon_group_new_by_gid (gid, self->priv->config);
+    group = (GumdDaemonGroup *) _cache_lookup (self->priv->groups, gid);
     if (!group) {
-        GUM_RETURN_WITH_ERROR (GUM_ERROR_GROUP_NOT_FOUND, "Group not found", error,
-                FALSE);
+        key = g_strdup_printf ("gid:%u", gid);
+        group = (GumdDaemonGroup *) _load_once (self, key, _load_group,
+                GUINT_TO_POINTER (gid), error);
+        g_free (key);
     }
 
-    g_hash_table_insert (self->priv->groups, GUINT_TO_POINTER(gid), group);
-    g_object_weak_ref (G_OBJECT (group), _on_group_disposed, self);
-
-    return group;
+    return (GumdDaemonGroup *) _cache_get_copy (self->priv->groups,
+            G_OBJECT (group));
 }
 
 GumdDaemonGroup *
@@ -451,19 +1887,21 @@ gumd_daemon_get_group_by_name (
         const gchar *groupname,
         GError **error)
 {
-    gid_t gid = GUM_GROUP_INVALID_GID;
+    GumdDaemonGroup *group = NULL;
+    gchar *key = NULL;
+
     if (!self || !GUMD_IS_DAEMON (self)) {
         GUM_RETURN_WITH_ERROR (GUM_ERROR_INVALID_INPUT,
                 "Daemon object is not valid", error, NULL);
     }
 
-    gid = gumd_daemon_group_get_gid_by_name (groupname, self->priv->config);
-    if (gid == GUM_GROUP_INVALID_GID) {
-        GUM_RETURN_WITH_ERROR (GUM_ERROR_GROUP_NOT_FOUND, "User not found", error,
-                NULL);
-    }
+    key = g_strdup_printf ("groupname:%s", groupname);
+    group = (GumdDaemonGroup *) _load_once (self, key, _load_group_by_name,
+            groupname, error);
+    g_free (key);
 
-    return gumd_daemon_get_group (self, gid, error);
+    return (GumdDaemonGroup *) _cache_get_copy (self->priv->groups,
+            G_OBJECT (group));
 }
 
 gboolean
@@ -473,20 +1911,32 @@ gumd_daemon_add_group (
         GError **error)
 {
     gid_t gid = GUM_GROUP_INVALID_GID;
+    gboolean ok = FALSE;
+    gint64 start = g_get_monotonic_time ();
 
     if (!self || !GUMD_IS_DAEMON (self) || !group) {
         GUM_RETURN_WITH_ERROR (GUM_ERROR_INVALID_INPUT,
                 "Daemon/usr object not valid", error, FALSE);
     }
 
-    if (!gumd_daemon_group_add (group, GUM_GROUP_INVALID_GID, &gid, error)) {
+    GUM_TRACE2 (daemon_op__start, "addGroup", 0);
+    _write_lock_db (self);
+    ok = gumd_daemon_group_add (group, GUM_GROUP_INVALID_GID, &gid, error);
+    _bump_generation (self);
+    if (ok) {
+        _cache_insert (self->priv->groups, gid, G_OBJECT (group));
+        _change_log_add (self->priv->group_changes, self->priv->generation,
+                GUMD_DAEMON_CHANGE_ADDED, gid, NULL);
+    }
+    _write_unlock_db (self);
+    gum_stats_record ("daemon.addGroup", start, !ok);
+    GUM_TRACE3 (daemon_op__done, "addGroup", ok ? gid : 0, ok);
+    if (!ok) {
         return FALSE;
     }
 
-    if (!g_hash_table_lookup (self->priv->groups, GUINT_TO_POINTER(gid))) {
-        g_hash_table_insert (self->priv->groups, GUINT_TO_POINTER(gid), group);
-        g_object_weak_ref (G_OBJECT (group), _on_group_disposed, self);
-    }
+    g_signal_emit (self, signals[SIG_GROUP_ADDED], 0, gid);
+
     return TRUE;
 }
 
@@ -497,6 +1947,8 @@ gumd_daemon_delete_group (
         GError **error)
 {
     gid_t gid = GUM_GROUP_INVALID_GID;
+    gboolean ok = FALSE;
+    gint64 start = g_get_monotonic_time ();
 
     if (!self || !GUMD_IS_DAEMON (self) || !group) {
         GUM_RETURN_WITH_ERROR (GUM_ERROR_INVALID_INPUT,
@@ -504,10 +1956,21 @@ gumd_daemon_delete_group (
     }
 
     g_object_get (G_OBJECT (group), "gid", &gid, NULL);
-    if (!gumd_daemon_group_delete (group, error)) {
+    GUM_TRACE2 (daemon_op__start, "deleteGroup", gid);
+    _write_lock_db (self);
+    ok = gumd_daemon_group_delete (group, error);
+    _bump_generation (self);
+    if (ok) {
+        _cache_remove (self->priv->groups, gid);
+        _change_log_add (self->priv->group_changes, self->priv->generation,
+                GUMD_DAEMON_CHANGE_DELETED, gid, NULL);
+    }
+    _write_unlock_db (self);
+    gum_stats_record ("daemon.deleteGroup", start, !ok);
+    GUM_TRACE3 (daemon_op__done, "deleteGroup", gid, ok);
+    if (!ok) {
         return FALSE;
     }
-    /* group will be removed from cache when it is disposed off */
     if (gid != GUM_GROUP_INVALID_GID) {
         g_signal_emit (self, signals[SIG_GROUP_DELETED], 0, gid);
     }
@@ -521,17 +1984,41 @@ gumd_daemon_update_group (
         GError **error)
 {
     gid_t gid = GUM_GROUP_INVALID_GID;
+    GumdDaemonGroup *old_group = NULL;
+    gboolean ok = FALSE;
+    gint64 start = g_get_monotonic_time ();
 
     if (!self || !GUMD_IS_DAEMON (self) || !group) {
         GUM_RETURN_WITH_ERROR (GUM_ERROR_INVALID_INPUT,
                 "Daemon/group object not valid", error, FALSE);
     }
 
-    if (!gumd_daemon_group_update (group, error)) {
+    g_object_get (G_OBJECT (group), "gid", &gid, NULL);
+    GUM_TRACE2 (daemon_op__start, "updateGroup", gid);
+    _write_lock_db (self);
+    /* see gumd_daemon_update_user () */
+    if (gid != GUM_GROUP_INVALID_GID) {
+        old_group = gumd_daemon_group_new_by_gid (gid, self->priv->config);
+    }
+    ok = gumd_daemon_group_update (group, error);
+    _bump_generation (self);
+    if (!ok) {
+        /* do not hand out unsaved changes to other clients */
+        _cache_remove (self->priv->groups, gid);
+    } else if (gid != GUM_GROUP_INVALID_GID) {
+        _cache_insert (self->priv->groups, gid, G_OBJECT (group));
+        _change_log_add (self->priv->group_changes, self->priv->generation,
+                GUMD_DAEMON_CHANGE_UPDATED, gid,
+                _changed_fields (G_OBJECT (old_group), G_OBJECT (group)));
+    }
+    _write_unlock_db (self);
+    gum_stats_record ("daemon.updateGroup", start, !ok);
+    GUM_TRACE3 (daemon_op__done, "updateGroup", gid, ok);
+    GUM_OBJECT_UNREF (old_group);
+    if (!ok) {
         return FALSE;
     }
 
-    g_object_get (G_OBJECT (group), "gid", &gid, NULL);
     if (gid != GUM_GROUP_INVALID_GID) {
         g_signal_emit (self, signals[SIG_GROUP_UPDATED], 0, gid);
     }
@@ -546,15 +2033,40 @@ gumd_daemon_add_group_member (
         gboolean add_as_admin,
         GError **error)
 {
+    gid_t gid = GUM_GROUP_INVALID_GID;
+    gboolean ok = FALSE;
+    gint64 start = g_get_monotonic_time ();
+
     if (!self || !GUMD_IS_DAEMON (self) || !group) {
         GUM_RETURN_WITH_ERROR (GUM_ERROR_INVALID_INPUT,
                 "Daemon/group object not valid", error, FALSE);
     }
 
-    if (!gumd_daemon_group_add_member (group, uid, add_as_admin, error)) {
+    g_object_get (G_OBJECT (group), "gid", &gid, NULL);
+    GUM_TRACE3 (daemon_member_op__start, "addGroupMember", gid, uid);
+    _write_lock_db (self);
+    ok = gumd_daemon_group_add_member (group, uid, add_as_admin, error);
+    _bump_generation (self);
+    if (ok) {
+        if (gid != GUM_GROUP_INVALID_GID) {
+            /* only the membership got written: the object may hold other,
+             * uncommitted edits */
+            _cache_remove (self->priv->groups, gid);
+            _change_log_add (self->priv->group_changes,
+                    self->priv->generation, GUMD_DAEMON_CHANGE_UPDATED, gid,
+                    g_strdupv ((gchar **) member_fields));
+        }
+    }
+    _write_unlock_db (self);
+    gum_stats_record ("daemon.addGroupMember", start, !ok);
+    GUM_TRACE4 (daemon_member_op__done, "addGroupMember", gid, uid, ok);
+    if (!ok) {
         return FALSE;
     }
 
+    if (gid != GUM_GROUP_INVALID_GID) {
+        g_signal_emit (self, signals[SIG_GROUP_UPDATED], 0, gid);
+    }
     return TRUE;
 }
 
@@ -565,18 +2077,67 @@ gumd_daemon_delete_group_member (
         uid_t uid,
         GError **error)
 {
+    gid_t gid = GUM_GROUP_INVALID_GID;
+    gboolean ok = FALSE;
+    gint64 start = g_get_monotonic_time ();
+
     if (!self || !GUMD_IS_DAEMON (self) || !group) {
         GUM_RETURN_WITH_ERROR (GUM_ERROR_INVALID_INPUT,
                 "Daemon/group object not valid", error, FALSE);
     }
 
-    if (!gumd_daemon_group_delete_member (group, uid, error)) {
+    g_object_get (G_OBJECT (group), "gid", &gid, NULL);
+    GUM_TRACE3 (daemon_member_op__start, "deleteGroupMember", gid, uid);
+    _write_lock_db (self);
+    ok = gumd_daemon_group_delete_member (group, uid, error);
+    _bump_generation (self);
+    if (ok) {
+        if (gid != GUM_GROUP_INVALID_GID) {
+            /* only the membership got written: the object may hold other,
+             * uncommitted edits */
+            _cache_remove (self->priv->groups, gid);
+            _change_log_add (self->priv->group_changes,
+                    self->priv->generation, GUMD_DAEMON_CHANGE_UPDATED, gid,
+                    g_strdupv ((gchar **) member_fields));
+        }
+    }
+    _write_unlock_db (self);
+    gum_stats_record ("daemon.deleteGroupMember", start, !ok);
+    GUM_TRACE4 (daemon_member_op__done, "deleteGroupMember", gid, uid, ok);
+    if (!ok) {
         return FALSE;
     }
 
+    if (gid != GUM_GROUP_INVALID_GID) {
+        g_signal_emit (self, signals[SIG_GROUP_UPDATED], 0, gid);
+    }
     return TRUE;
 }
 
+GVariant *
+gumd_daemon_get_group_changes (
+        GumdDaemon *self,
+        guint64 since,
+        guint64 *generation,
+        gboolean *resync,
+        GError **error)
+{
+    GVariant *changes = NULL;
+
+    if (!self || !GUMD_IS_DAEMON (self)) {
+        GUM_RETURN_WITH_ERROR (GUM_ERROR_INVALID_INPUT,
+                "Daemon object is not valid", error, NULL);
+    }
+
+    _read_lock_db (self);
+    *generation = self->priv->generation;
+    changes = _change_log_get_since (self->priv->group_changes, since,
+            self->priv->generation, resync);
+    _read_unlock_db (self);
+
+    return changes;
+}
+
 guint
 gumd_daemon_get_group_timeout (
         GumdDaemon *self)
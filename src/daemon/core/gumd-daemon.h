@@ -49,6 +49,21 @@ G_BEGIN_DECLS
 
 typedef struct _GumdDaemonPrivate GumdDaemonPrivate;
 
+/* operations recorded in the user and group change logs */
+typedef enum {
+    GUMD_DAEMON_CHANGE_ADDED = 1,
+    GUMD_DAEMON_CHANGE_DELETED,
+    GUMD_DAEMON_CHANGE_UPDATED
+} GumdDaemonChangeOp;
+
+/* called once gumd_daemon_delete_user_async is done; error is NULL on
+ * success */
+typedef void (*GumdDaemonDeleteUserCb) (
+        GumdDaemon *self,
+        GumdDaemonUser *user,
+        const GError *error,
+        gpointer user_data);
+
 struct _GumdDaemon
 {
     GObject parent;
@@ -73,6 +88,11 @@ gumd_daemon_clear_user_cache (
         GumdDaemon *self,
         GError **error);
 
+gboolean
+gumd_daemon_clear_group_cache (
+        GumdDaemon *self,
+        GError **error);
+
 guint
 gumd_daemon_get_timeout (
         GumdDaemon *self) G_GNUC_CONST;
@@ -106,6 +126,14 @@ gumd_daemon_delete_user (
         gboolean rem_home_dir,
         GError **error);
 
+void
+gumd_daemon_delete_user_async (
+        GumdDaemon *self,
+        GumdDaemonUser *user,
+        gboolean rem_home_dir,
+        GumdDaemonDeleteUserCb callback,
+        gpointer user_data);
+
 gboolean
 gumd_daemon_update_user (
         GumdDaemon *self,
@@ -118,6 +146,31 @@ gumd_daemon_get_user_list (
         const gchar *const *types,
         GError **error);
 
+GVariant *
+gumd_daemon_get_user_records (
+        GumdDaemon *self,
+        const gchar *const *types,
+        GError **error);
+
+GVariant *
+gumd_daemon_get_user_changes (
+        GumdDaemon *self,
+        guint64 since,
+        guint64 *generation,
+        gboolean *resync,
+        GError **error);
+
+gint
+gumd_daemon_get_snapshot_fd (
+        GumdDaemon *self,
+        guint64 *generation,
+        GError **error);
+
+gboolean
+gumd_daemon_publish_snapshot (
+        GumdDaemon *self,
+        GError **error);
+
 guint
 gumd_daemon_get_user_timeout (
         GumdDaemon *self) G_GNUC_CONST;
@@ -167,6 +220,14 @@ gumd_daemon_delete_group_member (
         uid_t uid,
         GError **error);
 
+GVariant *
+gumd_daemon_get_group_changes (
+        GumdDaemon *self,
+        guint64 since,
+        guint64 *generation,
+        gboolean *resync,
+        GError **error);
+
 guint
 gumd_daemon_get_group_timeout (
         GumdDaemon *self) G_GNUC_CONST;
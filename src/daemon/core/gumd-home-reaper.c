@@ -0,0 +1,220 @@
+/* vi: set et sw=4 ts=4 cino=t0,(0: */
+/* -*- Mode: C; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+/*
+ * This file is part of gumd
+ *
+ * Copyright (C) 2013 Intel Corporation.
+ *
+ * Contact: Imran Zaman <imran.zaman@intel.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+
+#include "config.h"
+
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <sys/resource.h>
+
+#include "gumd-home-reaper.h"
+#include "common/gum-file.h"
+#include "common/gum-log.h"
+#include "common/gum-error.h"
+
+/*
+ * Deleting a home directory takes time proportional to its contents, which
+ * used to be spent with the databases locked and the client waiting. Instead
+ * the home directory is renamed into a trash directory under the home
+ * directory prefix, which is atomic and cheap, and a background thread
+ * empties the trash with idle I/O and CPU priority. Whatever is left in the
+ * trash when the daemon stops is removed by the next one. The trash is
+ * emptied by a child process with its own privileges, which inherits the
+ * priority of the thread, so that the database is not locked meanwhile.
+ *
+ * The rename can only be done on the same file system; home directories
+ * elsewhere, and all of them when the reaper is not running (e.g. in
+ * offline mode), are deleted synchronously as before.
+ */
+
+#define GUMD_HOME_REAPER_IOPRIO_WHO_PROCESS  1
+#define GUMD_HOME_REAPER_IOPRIO_CLASS_IDLE   3
+#define GUMD_HOME_REAPER_IOPRIO_CLASS_SHIFT  13
+
+static GThread *reaper = NULL;
+static GMutex reaper_mutex;
+static GCond reaper_cond;
+static gboolean reaper_pending = FALSE;
+static gboolean reaper_stopping = FALSE;
+static gchar *trash_dir = NULL;
+
+static void
+_set_idle_priority (void)
+{
+#ifdef SYS_ioprio_set
+    /* applies to the calling thread only */
+    if (syscall (SYS_ioprio_set, GUMD_HOME_REAPER_IOPRIO_WHO_PROCESS, 0,
+            GUMD_HOME_REAPER_IOPRIO_CLASS_IDLE <<
+            GUMD_HOME_REAPER_IOPRIO_CLASS_SHIFT) != 0) {
+        DBG ("Unable to set idle io priority");
+    }
+#endif
+#ifdef SYS_gettid
+    if (setpriority (PRIO_PROCESS, (id_t) syscall (SYS_gettid), 19) != 0) {
+        DBG ("Unable to set nice value");
+    }
+#endif
+}
+
+static gpointer
+_reap (
+        gpointer data)
+{
+    GError *error = NULL;
+
+    _set_idle_priority ();
+
+    g_mutex_lock (&reaper_mutex);
+    while (!reaper_stopping) {
+        if (!reaper_pending) {
+            g_cond_wait (&reaper_cond, &reaper_mutex);
+            continue;
+        }
+        reaper_pending = FALSE;
+        g_mutex_unlock (&reaper_mutex);
+
+        DBG ("Emptying trash %s", trash_dir);
+        if (!gum_file_empty_trash_dir (trash_dir, &error)) {
+            WARN ("%s", error->message);
+            g_clear_error (&error);
+        }
+
+        g_mutex_lock (&reaper_mutex);
+    }
+    g_mutex_unlock (&reaper_mutex);
+
+    return NULL;
+}
+
+static void
+_kick (void)
+{
+    g_mutex_lock (&reaper_mutex);
+    reaper_pending = TRUE;
+    g_cond_signal (&reaper_cond);
+    g_mutex_unlock (&reaper_mutex);
+}
+
+/**
+ * gumd_home_reaper_start:
+ * @config: (transfer none): the #GumConfig object
+ *
+ * Starts the thread deleting the trashed home directories, and empties the
+ * trash left over from a previous run. The trash directory is
+ * #GUMD_HOME_REAPER_TRASH_DIR under #GUM_CONFIG_GENERAL_HOME_DIR_PREF.
+ *
+ * Returns: TRUE if the reaper is running, FALSE otherwise
+ */
+gboolean
+gumd_home_reaper_start (
+        GumConfig *config)
+{
+    GError *error = NULL;
+
+    if (reaper) {
+        return TRUE;
+    }
+    g_return_val_if_fail (config != NULL, FALSE);
+
+    trash_dir = g_build_filename (gum_config_get_string (config,
+            GUM_CONFIG_GENERAL_HOME_DIR_PREF), GUMD_HOME_REAPER_TRASH_DIR,
+            NULL);
+    reaper_stopping = FALSE;
+    reaper_pending = TRUE;
+
+    reaper = g_thread_try_new ("gumd-home-reaper", _reap, NULL, &error);
+    if (!reaper) {
+        WARN ("Unable to start home reaper: %s", error->message);
+        g_error_free (error);
+        g_free (trash_dir);
+        trash_dir = NULL;
+        return FALSE;
+    }
+    return TRUE;
+}
+
+/**
+ * gumd_home_reaper_stop:
+ *
+ * Stops the reaper thread, waiting for the directory being deleted if any.
+ * The rest of the trash is left for the next start.
+ */
+void
+gumd_home_reaper_stop (void)
+{
+    if (!reaper) {
+        return;
+    }
+
+    g_mutex_lock (&reaper_mutex);
+    reaper_stopping = TRUE;
+    g_cond_signal (&reaper_cond);
+    g_mutex_unlock (&reaper_mutex);
+
+    g_thread_join (reaper);
+    reaper = NULL;
+    g_free (trash_dir);
+    trash_dir = NULL;
+}
+
+/**
+ * gumd_home_reaper_is_running:
+ *
+ * Returns: TRUE if the reaper thread is running, FALSE otherwise
+ */
+gboolean
+gumd_home_reaper_is_running (void)
+{
+    return reaper != NULL;
+}
+
+/**
+ * gumd_home_reaper_delete_home_dir:
+ * @home_dir: (transfer none): the path to the home directory
+ * @error: (transfer none): the #GError which is set in case of an error
+ *
+ * Moves the home directory to the trash to be deleted in the background, or
+ * deletes it right away when that is not possible.
+ *
+ * Returns: TRUE if successful, FALSE otherwise and @error is set.
+ */
+gboolean
+gumd_home_reaper_delete_home_dir (
+        const gchar *home_dir,
+        GError **error)
+{
+    GError *trash_error = NULL;
+
+    if (reaper) {
+        if (gum_file_trash_home_dir (home_dir, trash_dir, &trash_error)) {
+            _kick ();
+            return TRUE;
+        }
+        DBG ("%s, deleting %s in place", trash_error->message, home_dir);
+        g_error_free (trash_error);
+    }
+
+    return gum_file_delete_home_dir (home_dir, error);
+}
@@ -0,0 +1,53 @@
+/* vi: set et sw=4 ts=4 cino=t0,(0: */
+/* -*- Mode: C; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+/*
+ * This file is part of gumd
+ *
+ * Copyright (C) 2013 Intel Corporation.
+ *
+ * Contact: Imran Zaman <imran.zaman@intel.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+
+#ifndef __GUMD_HOME_REAPER_H_
+#define __GUMD_HOME_REAPER_H_
+
+#include <glib.h>
+#include <common/gum-config.h>
+
+G_BEGIN_DECLS
+
+#define GUMD_HOME_REAPER_TRASH_DIR ".gumd-trash"
+
+gboolean
+gumd_home_reaper_start (
+        GumConfig *config);
+
+void
+gumd_home_reaper_stop (void);
+
+gboolean
+gumd_home_reaper_is_running (void);
+
+gboolean
+gumd_home_reaper_delete_home_dir (
+        const gchar *home_dir,
+        GError **error);
+
+G_END_DECLS
+
+#endif /* __GUMD_HOME_REAPER_H_ */
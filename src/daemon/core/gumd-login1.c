@@ -0,0 +1,642 @@
+/* vi: set et sw=4 ts=4 cino=t0,(0: */
+/* -*- Mode: C; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+/*
+ * This file is part of gumd
+ *
+ * Copyright (C) 2013 Intel Corporation.
+ *
+ * Contact: Imran Zaman <imran.zaman@intel.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+
+#include "config.h"
+
+#include <gio/gio.h>
+
+#include "gumd-login1.h"
+#include "common/gum-log.h"
+
+/*
+ * Client of the systemd-logind session manager, used to terminate the
+ * sessions of the users being deleted and to tell which users are logged
+ * in. Once started, a single proxy is kept
+ * along with the list of sessions (session id -> uid), which is fetched
+ * when logind appears on the bus and then kept up to date from its
+ * SessionNew and SessionRemoved signals. Deleting a user who is not logged
+ * in then costs no bus traffic. Otherwise TerminateUser is called, and the
+ * sessions listed again once it replies, as systemd may report an error even
+ * though the sessions are gone; the termination only succeeds if the user
+ * has no session left. gumd_login1_terminate_user_async does so without
+ * blocking other requests meanwhile.
+ *
+ * The user is locked before the termination, so no new session can be
+ * opened meanwhile. When the client is not started (e.g. in offline mode)
+ * or not connected yet, a proxy is created for the termination.
+ *
+ * When run in test mode, a separate dbus-daemon is started, consequently no
+ * system dbus services are available and termination is skipped.
+ */
+
+#define GUMD_LOGIN1_NAME       "org.freedesktop.login1"
+#define GUMD_LOGIN1_PATH       "/org/freedesktop/login1"
+#define GUMD_LOGIN1_INTERFACE  "org.freedesktop.login1.Manager"
+
+#if USE_SYSTEMD && !defined(ENABLE_TESTS)
+
+static GMutex login1_mutex;
+static GDBusProxy *login1 = NULL;
+static GCancellable *login1_cancellable = NULL;
+static GHashTable *sessions = NULL;
+static gboolean sessions_valid = FALSE;
+static guint sessions_serial = 0;
+
+typedef struct {
+    GDBusProxy *proxy;
+    uid_t uid;
+    gboolean terminating;   /* TerminateUser has been called */
+    GumdLogin1TerminateCb callback;
+    gpointer user_data;
+} GumdLogin1Termination;
+
+static gboolean
+_has_sessions (
+        GHashTable *table,
+        uid_t uid)
+{
+    GHashTableIter iter;
+    gpointer value = NULL;
+
+    g_hash_table_iter_init (&iter, table);
+    while (g_hash_table_iter_next (&iter, NULL, &value)) {
+        if (GPOINTER_TO_UINT (value) == uid)
+            return TRUE;
+    }
+    return FALSE;
+}
+
+static GHashTable *
+_parse_sessions (
+        GVariant *reply)
+{
+    GHashTable *table = NULL;
+    GVariantIter *iter = NULL;
+    const gchar *id = NULL;
+    uid_t uid;
+
+    table = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+    g_variant_get (reply, "(a(susso))", &iter);
+    while (g_variant_iter_next (iter, "(&su&s&s&o)", &id, &uid, NULL, NULL,
+            NULL)) {
+        g_hash_table_insert (table, g_strdup (id), GUINT_TO_POINTER (uid));
+    }
+    g_variant_iter_free (iter);
+
+    return table;
+}
+
+static void
+_on_sessions_listed (
+        GObject *source,
+        GAsyncResult *result,
+        gpointer user_data)
+{
+    GError *error = NULL;
+    GVariant *reply = NULL;
+    GHashTable *table = NULL;
+
+    reply = g_dbus_proxy_call_finish (G_DBUS_PROXY (source), result, &error);
+    if (reply) {
+        table = _parse_sessions (reply);
+        g_variant_unref (reply);
+    } else if (g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED)) {
+        g_error_free (error);
+        return;
+    } else {
+        DBG ("failed to list sessions: %s", error->message);
+        g_error_free (error);
+    }
+
+    /* only the latest listing is applied */
+    g_mutex_lock (&login1_mutex);
+    if (login1 && GPOINTER_TO_UINT (user_data) == sessions_serial) {
+        sessions_valid = (table != NULL);
+        if (table) {
+            g_hash_table_unref (sessions);
+            sessions = table;
+            table = NULL;
+        }
+    }
+    g_mutex_unlock (&login1_mutex);
+
+    if (table) g_hash_table_unref (table);
+}
+
+static void
+_list_sessions (void)
+{
+    guint serial;
+
+    /* until the reply, every user is considered logged in */
+    g_mutex_lock (&login1_mutex);
+    serial = ++sessions_serial;
+    sessions_valid = FALSE;
+    g_mutex_unlock (&login1_mutex);
+
+    g_dbus_proxy_call (login1, "ListSessions", g_variant_new ("()"),
+            G_DBUS_CALL_FLAGS_NONE, -1, login1_cancellable,
+            _on_sessions_listed, GUINT_TO_POINTER (serial));
+}
+
+static void
+_on_login1_signal (
+        GDBusProxy *proxy,
+        gchar *sender_name,
+        gchar *signal_name,
+        GVariant *parameters,
+        gpointer user_data)
+{
+    const gchar *id = NULL;
+
+    if (g_strcmp0 (signal_name, "SessionNew") == 0) {
+        /* the signal does not tell whose session it is */
+        _list_sessions ();
+    } else if (g_strcmp0 (signal_name, "SessionRemoved") == 0 &&
+            g_variant_is_of_type (parameters, G_VARIANT_TYPE ("(so)"))) {
+        g_variant_get (parameters, "(&s&o)", &id, NULL);
+        g_mutex_lock (&login1_mutex);
+        g_hash_table_remove (sessions, id);
+        g_mutex_unlock (&login1_mutex);
+    }
+}
+
+static void
+_on_login1_owner_changed (
+        GObject *object,
+        GParamSpec *pspec,
+        gpointer user_data)
+{
+    gchar *owner = g_dbus_proxy_get_name_owner (G_DBUS_PROXY (object));
+
+    if (owner) {
+        DBG ("login1 appeared as %s", owner);
+        _list_sessions ();
+        g_free (owner);
+        return;
+    }
+
+    DBG ("login1 vanished");
+    g_mutex_lock (&login1_mutex);
+    sessions_serial++;
+    sessions_valid = FALSE;
+    g_hash_table_remove_all (sessions);
+    g_mutex_unlock (&login1_mutex);
+}
+
+static void
+_on_proxy_ready (
+        GObject *source,
+        GAsyncResult *result,
+        gpointer user_data)
+{
+    GError *error = NULL;
+    GDBusProxy *proxy = NULL;
+
+    proxy = g_dbus_proxy_new_for_bus_finish (result, &error);
+    if (!proxy) {
+        if (!g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED)) {
+            WARN ("failed to connect to login1: %s", error->message);
+        }
+        g_error_free (error);
+        return;
+    }
+
+    g_signal_connect (proxy, "g-signal", G_CALLBACK (_on_login1_signal),
+            NULL);
+    g_signal_connect (proxy, "notify::g-name-owner",
+            G_CALLBACK (_on_login1_owner_changed), NULL);
+
+    g_mutex_lock (&login1_mutex);
+    login1 = proxy;
+    sessions = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+    g_mutex_unlock (&login1_mutex);
+
+    _list_sessions ();
+}
+
+static GHashTable *
+_list_sessions_sync (
+        GDBusProxy *proxy)
+{
+    GVariant *res = NULL;
+    GHashTable *table = NULL;
+
+    res = g_dbus_proxy_call_sync (proxy, "ListSessions",
+                    g_variant_new ("()"), G_DBUS_CALL_FLAGS_NONE, -1,
+                    NULL, NULL);
+    if (res) {
+        table = _parse_sessions (res);
+        g_variant_unref (res);
+    }
+    return table;
+}
+
+/* a user whose sessions can not be listed, e.g. without logind, is not
+ * considered logged in */
+static gboolean
+_is_user_logged_in (
+        GDBusProxy *proxy,
+        uid_t uid)
+{
+    GHashTable *table = NULL;
+    gboolean loggedin = FALSE;
+
+    table = _list_sessions_sync (proxy);
+    if (table) {
+        loggedin = _has_sessions (table, uid);
+        g_hash_table_unref (table);
+    }
+
+    return loggedin;
+}
+
+static gboolean
+_terminate_user_sync (
+        GDBusProxy *proxy,
+        uid_t uid)
+{
+    gboolean retval = TRUE;
+    GError *error = NULL;
+    GVariant *res = NULL;
+    GHashTable *table = NULL;
+
+    if (proxy) {
+        g_object_ref (proxy);
+    } else {
+        proxy = g_dbus_proxy_new_for_bus_sync (G_BUS_TYPE_SYSTEM,
+            G_DBUS_PROXY_FLAGS_DO_NOT_LOAD_PROPERTIES, NULL,
+            GUMD_LOGIN1_NAME, GUMD_LOGIN1_PATH, GUMD_LOGIN1_INTERFACE,
+            NULL, &error);
+        if (error) goto _finished;
+    }
+
+    if (_is_user_logged_in (proxy, uid)) {
+        DBG ("user %d is logged in", uid);
+        res = g_dbus_proxy_call_sync (proxy, "TerminateUser",
+                g_variant_new ("(u)", uid), G_DBUS_CALL_FLAGS_NONE, -1,
+                NULL, &error);
+        if (res) g_variant_unref (res);
+        /* seems some bug in systemd as it terminates all the sessions,
+         * and sends userremoved signal but still spits out the error;
+         * so it need to be verified by checking again whether the user is
+         * still logged in or not */
+        if (error) {
+            DBG ("terminate user %u: %s", uid, error->message);
+            g_clear_error (&error);
+        }
+        table = _list_sessions_sync (proxy);
+        retval = (table && !_has_sessions (table, uid));
+        if (table) g_hash_table_unref (table);
+    }
+
+_finished:
+    if (error) {
+        DBG ("failed to terminate user: %s", error->message);
+        g_error_free (error);
+        retval = FALSE;
+    }
+    if (proxy) g_object_unref (proxy);
+
+    return retval;
+}
+
+static void
+_termination_done (
+        GumdLogin1Termination *termination,
+        gboolean terminated)
+{
+    if (!terminated) {
+        DBG ("user %u is still logged in", termination->uid);
+    }
+    termination->callback (termination->uid, terminated,
+            termination->user_data);
+    if (termination->proxy) g_object_unref (termination->proxy);
+    g_slice_free (GumdLogin1Termination, termination);
+}
+
+static void
+_terminate (
+        GumdLogin1Termination *termination);
+
+/* the sessions are listed before the termination when they are not known,
+ * and after it to tell whether it succeeded */
+static void
+_on_termination_sessions_listed (
+        GObject *source,
+        GAsyncResult *result,
+        gpointer user_data)
+{
+    GumdLogin1Termination *termination = user_data;
+    GError *error = NULL;
+    GVariant *reply = NULL;
+    GHashTable *table = NULL;
+    gboolean logged_in = FALSE;
+
+    reply = g_dbus_proxy_call_finish (G_DBUS_PROXY (source), result, &error);
+    if (reply) {
+        table = _parse_sessions (reply);
+        logged_in = _has_sessions (table, termination->uid);
+        g_hash_table_unref (table);
+        g_variant_unref (reply);
+    } else {
+        DBG ("failed to list sessions: %s", error->message);
+        g_error_free (error);
+    }
+
+    if (termination->terminating) {
+        _termination_done (termination, reply && !logged_in);
+    } else if (logged_in) {
+        _terminate (termination);
+    } else {
+        _termination_done (termination, TRUE);
+    }
+}
+
+static void
+_list_termination_sessions (
+        GumdLogin1Termination *termination)
+{
+    g_dbus_proxy_call (termination->proxy, "ListSessions",
+            g_variant_new ("()"), G_DBUS_CALL_FLAGS_NONE, -1, NULL,
+            _on_termination_sessions_listed, termination);
+}
+
+static void
+_on_user_terminated (
+        GObject *source,
+        GAsyncResult *result,
+        gpointer user_data)
+{
+    GumdLogin1Termination *termination = user_data;
+    GError *error = NULL;
+    GVariant *reply = NULL;
+
+    /* systemd may spit out an error even though the sessions have been
+     * terminated, and the user removed signal sent, so whether the user is
+     * still logged in is checked in any case */
+    reply = g_dbus_proxy_call_finish (G_DBUS_PROXY (source), result, &error);
+    if (reply) {
+        g_variant_unref (reply);
+    } else {
+        DBG ("terminate user %u: %s", termination->uid, error->message);
+        g_error_free (error);
+    }
+
+    _list_termination_sessions (termination);
+}
+
+static void
+_terminate (
+        GumdLogin1Termination *termination)
+{
+    DBG ("terminating user %d", termination->uid);
+    termination->terminating = TRUE;
+    g_dbus_proxy_call (termination->proxy, "TerminateUser",
+            g_variant_new ("(u)", termination->uid), G_DBUS_CALL_FLAGS_NONE,
+            -1, NULL, _on_user_terminated, termination);
+}
+
+static void
+_on_termination_proxy_ready (
+        GObject *source,
+        GAsyncResult *result,
+        gpointer user_data)
+{
+    GumdLogin1Termination *termination = user_data;
+    GError *error = NULL;
+
+    termination->proxy = g_dbus_proxy_new_for_bus_finish (result, &error);
+    if (!termination->proxy) {
+        DBG ("failed to connect to login1: %s", error->message);
+        g_error_free (error);
+        _termination_done (termination, FALSE);
+        return;
+    }
+    _list_termination_sessions (termination);
+}
+
+#endif
+
+/**
+ * gumd_login1_start:
+ *
+ * Connects to logind in the background and starts tracking the sessions.
+ * Needs the main loop of the thread default main context to run.
+ */
+void
+gumd_login1_start (void)
+{
+#if USE_SYSTEMD && !defined(ENABLE_TESTS)
+    if (login1_cancellable) {
+        return;
+    }
+
+    login1_cancellable = g_cancellable_new ();
+    g_dbus_proxy_new_for_bus (G_BUS_TYPE_SYSTEM,
+            G_DBUS_PROXY_FLAGS_DO_NOT_LOAD_PROPERTIES, NULL, GUMD_LOGIN1_NAME,
+            GUMD_LOGIN1_PATH, GUMD_LOGIN1_INTERFACE, login1_cancellable,
+            _on_proxy_ready, NULL);
+#endif
+}
+
+/**
+ * gumd_login1_stop:
+ *
+ * Disconnects from logind; the terminations in progress are not waited for.
+ */
+void
+gumd_login1_stop (void)
+{
+#if USE_SYSTEMD && !defined(ENABLE_TESTS)
+    GDBusProxy *proxy = NULL;
+
+    if (!login1_cancellable) {
+        return;
+    }
+    g_cancellable_cancel (login1_cancellable);
+    g_object_unref (login1_cancellable);
+    login1_cancellable = NULL;
+
+    g_mutex_lock (&login1_mutex);
+    proxy = login1;
+    login1 = NULL;
+    if (sessions) {
+        g_hash_table_unref (sessions);
+        sessions = NULL;
+    }
+    sessions_valid = FALSE;
+    g_mutex_unlock (&login1_mutex);
+
+    if (proxy) {
+        g_signal_handlers_disconnect_by_func (proxy, _on_login1_signal,
+                NULL);
+        g_signal_handlers_disconnect_by_func (proxy,
+                _on_login1_owner_changed, NULL);
+        g_object_unref (proxy);
+    }
+#endif
+}
+
+/**
+ * gumd_login1_terminate_user:
+ * @uid: the uid of the user
+ *
+ * Terminates the sessions of the user, if any, and waits until they are
+ * gone. Once the client is connected, logind is only called if the user has
+ * sessions.
+ *
+ * Returns: TRUE if the user has no session left, FALSE otherwise
+ */
+gboolean
+gumd_login1_terminate_user (
+        uid_t uid)
+{
+#if USE_SYSTEMD && !defined(ENABLE_TESTS)
+    GDBusProxy *proxy = NULL;
+    gboolean logged_in = TRUE;
+    gboolean retval = TRUE;
+
+    g_mutex_lock (&login1_mutex);
+    if (login1) {
+        proxy = g_object_ref (login1);
+        if (sessions_valid)
+            logged_in = _has_sessions (sessions, uid);
+    }
+    g_mutex_unlock (&login1_mutex);
+
+    if (logged_in) {
+        retval = _terminate_user_sync (proxy, uid);
+    }
+    if (proxy) g_object_unref (proxy);
+
+    return retval;
+#else
+    return TRUE;
+#endif
+}
+
+/**
+ * gumd_login1_terminate_user_async:
+ * @uid: the uid of the user
+ * @callback: called once the sessions are gone, or failed to be
+ * @user_data: user data passed to @callback
+ *
+ * Terminates the sessions of the user, if any, as
+ * gumd_login1_terminate_user, without blocking. @callback is called from the
+ * thread default main context, or before returning if the user is known to
+ * have no sessions.
+ */
+void
+gumd_login1_terminate_user_async (
+        uid_t uid,
+        GumdLogin1TerminateCb callback,
+        gpointer user_data)
+{
+#if USE_SYSTEMD && !defined(ENABLE_TESTS)
+    GumdLogin1Termination *termination = NULL;
+    gboolean known = FALSE;
+    gboolean logged_in = TRUE;
+
+    termination = g_slice_new0 (GumdLogin1Termination);
+    termination->uid = uid;
+    termination->callback = callback;
+    termination->user_data = user_data;
+
+    g_mutex_lock (&login1_mutex);
+    if (login1) {
+        termination->proxy = g_object_ref (login1);
+        known = sessions_valid;
+        if (known)
+            logged_in = _has_sessions (sessions, uid);
+    }
+    g_mutex_unlock (&login1_mutex);
+
+    if (!termination->proxy) {
+        g_dbus_proxy_new_for_bus (G_BUS_TYPE_SYSTEM,
+                G_DBUS_PROXY_FLAGS_DO_NOT_LOAD_PROPERTIES, NULL,
+                GUMD_LOGIN1_NAME, GUMD_LOGIN1_PATH, GUMD_LOGIN1_INTERFACE,
+                NULL, _on_termination_proxy_ready, termination);
+    } else if (!known) {
+        _list_termination_sessions (termination);
+    } else if (logged_in) {
+        _terminate (termination);
+    } else {
+        _termination_done (termination, TRUE);
+    }
+#else
+    callback (uid, TRUE, user_data);
+#endif
+}
+
+/**
+ * gumd_login1_get_logged_in_users:
+ *
+ * Gets the users who have sessions, from the tracked sessions once the
+ * client is connected, or else by asking logind synchronously.
+ *
+ * Returns: (transfer full): set of the uids (GUINT_TO_POINTER) of the users
+ * logged in, or NULL if the sessions are not known, e.g. when logind is not
+ * available
+ */
+GHashTable *
+gumd_login1_get_logged_in_users (void)
+{
+    GHashTable *uids = NULL;
+#if USE_SYSTEMD && !defined(ENABLE_TESTS)
+    GHashTable *table = NULL;
+    GDBusProxy *proxy = NULL;
+    GHashTableIter iter;
+    gpointer value = NULL;
+
+    g_mutex_lock (&login1_mutex);
+    if (login1 && sessions_valid)
+        table = g_hash_table_ref (sessions);
+    g_mutex_unlock (&login1_mutex);
+
+    if (!table) {
+        proxy = g_dbus_proxy_new_for_bus_sync (G_BUS_TYPE_SYSTEM,
+                G_DBUS_PROXY_FLAGS_DO_NOT_LOAD_PROPERTIES, NULL,
+                GUMD_LOGIN1_NAME, GUMD_LOGIN1_PATH, GUMD_LOGIN1_INTERFACE,
+                NULL, NULL);
+        if (!proxy)
+            return NULL;
+        table = _list_sessions_sync (proxy);
+        g_object_unref (proxy);
+        if (!table)
+            return NULL;
+    }
+
+    uids = g_hash_table_new (g_direct_hash, g_direct_equal);
+    g_mutex_lock (&login1_mutex);
+    g_hash_table_iter_init (&iter, table);
+    while (g_hash_table_iter_next (&iter, NULL, &value))
+        g_hash_table_add (uids, value);
+    g_mutex_unlock (&login1_mutex);
+    g_hash_table_unref (table);
+#endif
+
+    return uids;
+}
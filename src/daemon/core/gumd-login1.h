@@ -0,0 +1,61 @@
+/* vi: set et sw=4 ts=4 cino=t0,(0: */
+/* -*- Mode: C; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+/*
+ * This file is part of gumd
+ *
+ * Copyright (C) 2013 Intel Corporation.
+ *
+ * Contact: Imran Zaman <imran.zaman@intel.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+
+#ifndef __GUMD_LOGIN1_H_
+#define __GUMD_LOGIN1_H_
+
+#include <sys/types.h>
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/* called once the sessions of the user are gone, or failed to be */
+typedef void (*GumdLogin1TerminateCb) (
+        uid_t uid,
+        gboolean terminated,
+        gpointer user_data);
+
+void
+gumd_login1_start (void);
+
+void
+gumd_login1_stop (void);
+
+gboolean
+gumd_login1_terminate_user (
+        uid_t uid);
+
+void
+gumd_login1_terminate_user_async (
+        uid_t uid,
+        GumdLogin1TerminateCb callback,
+        gpointer user_data);
+
+GHashTable *
+gumd_login1_get_logged_in_users (void);
+
+G_END_DECLS
+
+#endif /* __GUMD_LOGIN1_H_ */
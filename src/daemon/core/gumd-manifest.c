@@ -0,0 +1,1032 @@
+/* vi: set et sw=4 ts=4 cino=t0,(0: */
+/* -*- Mode: C; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+/*
+ * This file is part of gumd
+ *
+ * Copyright (C) 2013 Intel Corporation.
+ *
+ * Contact: Imran Zaman <imran.zaman@intel.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "gumd-manifest.h"
+#include "common/gum-file.h"
+#include "common/gum-validate.h"
+#include "common/gum-crypt.h"
+#include "common/gum-lock.h"
+#include "common/gum-string-utils.h"
+#include "common/gum-defines.h"
+#include "common/gum-log.h"
+#include "common/gum-error.h"
+#include "common/gum-user-types.h"
+#include "common/gum-group-types.h"
+
+/*
+ * A manifest describes the users and groups to be provisioned, typically into
+ * a sysroot when building an image, as a key file with one section per
+ * group and per user:
+ *
+ *   [Group developers]
+ *   Type=user                  (system or user; mandatory)
+ *   Gid=3000                   (optional, allocated otherwise)
+ *   Secret=...                 (optional, plain text)
+ *   SecretHash=...             (optional, already encrypted)
+ *
+ *   [User alice]
+ *   Type=normal                (system, admin, guest, normal or security)
+ *   Uid=2001                   (optional, allocated otherwise)
+ *   RealName=Alice             (optional, also Office, OfficePhone and
+ *                               HomePhone)
+ *   HomeDir=/home/alice        (optional, relative to the sysroot)
+ *   Shell=/bin/sh              (optional)
+ *   Secret=... or SecretHash=...
+ *   Groups=developers;video    (optional, supplementary groups)
+ *   AdminGroups=developers     (optional, groups administered by the user)
+ *
+ * The manifest is applied in one go instead of one operation per user or
+ * group: the passwd, shadow, group and gshadow files are read once, ids are
+ * allocated in a single pass over the in-memory databases and each file that
+ * changed is written once. Users and groups are added following the same
+ * rules as gumd (id ranges, user private groups, default groups and
+ * secrets), except that the useradd/groupadd scripts are not run.
+ *
+ * Users and groups which already exist are left as they are, and members are
+ * only added to groups they are not part of, so applying a manifest again
+ * does not modify any file. For the output to also be reproducible when
+ * applied on a fresh sysroot, the secrets have to be given with SecretHash
+ * and the password change date is taken from SOURCE_DATE_EPOCH when set.
+ * Home directories are created after all the files are written; when that
+ * is deferred, it is done for the existing users as well by the next apply.
+ */
+
+#define GUMD_DAY (24L*3600L)
+
+#define GUMD_MANIFEST_GROUP_SECTION "Group "
+#define GUMD_MANIFEST_USER_SECTION "User "
+
+typedef struct {
+    gchar *line;    /* verbatim line, without the newline */
+    gchar *name;    /* NULL if the line is not an entry */
+    guint id;       /* uid or gid, G_MAXUINT if not applicable */
+} GumdManifestEntry;
+
+typedef struct {
+    const gchar *path;
+    guint id_field;
+    GPtrArray *entries;     /* existing entries, in file order */
+    GPtrArray *added;       /* new entries */
+    GHashTable *names;      /* name -> GumdManifestEntry */
+    GHashTable *ids;        /* ids in use */
+    GHashTable *cursors;    /* range start -> next id to try */
+    gboolean changed;
+} GumdManifestDb;
+
+typedef struct {
+    const gchar *section;
+    gchar *name;
+    uid_t uid;
+    gid_t gid;
+    gchar *home_dir;
+    GumUserType type;
+    gboolean added;
+} GumdManifestUser;
+
+typedef struct {
+    GumConfig *config;
+    GKeyFile *key_file;
+    gchar *sysroot;
+    glong lstchg;
+    GumdManifestDb passwd;
+    GumdManifestDb shadow;
+    GumdManifestDb group;
+    GumdManifestDb gshadow;
+    GPtrArray *users;
+} GumdManifest;
+
+static void
+_free_entry (
+        GumdManifestEntry *entry)
+{
+    if (entry) {
+        g_free (entry->line);
+        g_free (entry->name);
+        g_free (entry);
+    }
+}
+
+static void
+_free_user (
+        GumdManifestUser *user)
+{
+    if (user) {
+        g_free (user->name);
+        g_free (user->home_dir);
+        g_free (user);
+    }
+}
+
+static GumdManifestEntry *
+_new_entry (
+        const gchar *line,
+        guint id_field)
+{
+    GumdManifestEntry *entry = g_new0 (GumdManifestEntry, 1);
+    gchar **fields = NULL;
+    gchar *end = NULL;
+    guint64 id = 0;
+
+    entry->line = g_strdup (line);
+    entry->id = G_MAXUINT;
+
+    /* comments and NIS entries are kept as they are */
+    if (line[0] == '\0' || line[0] == '#' || line[0] == '+' || line[0] == '-')
+        return entry;
+
+    fields = g_strsplit (line, ":", -1);
+    if (fields[0][0] != '\0') {
+        entry->name = g_strdup (fields[0]);
+        if (id_field > 0 && g_strv_length (fields) > id_field) {
+            id = g_ascii_strtoull (fields[id_field], &end, 10);
+            if (end != fields[id_field] && *end == '\0' && id < G_MAXUINT)
+                entry->id = (guint) id;
+        }
+    }
+    g_strfreev (fields);
+
+    return entry;
+}
+
+static void
+_index_entry (
+        GumdManifestDb *db,
+        GumdManifestEntry *entry)
+{
+    if (!entry->name)
+        return;
+
+    if (!g_hash_table_lookup (db->names, entry->name))
+        g_hash_table_insert (db->names, entry->name, entry);
+    if (entry->id != G_MAXUINT)
+        g_hash_table_add (db->ids, GUINT_TO_POINTER (entry->id));
+}
+
+static void
+_clear_db (
+        GumdManifestDb *db)
+{
+    if (db->names) g_hash_table_unref (db->names);
+    if (db->ids) g_hash_table_unref (db->ids);
+    if (db->cursors) g_hash_table_unref (db->cursors);
+    if (db->entries) g_ptr_array_unref (db->entries);
+    if (db->added) g_ptr_array_unref (db->added);
+    memset (db, 0, sizeof (GumdManifestDb));
+}
+
+static gboolean
+_load_db (
+        GumdManifestDb *db,
+        const gchar *path,
+        guint id_field,
+        GError **error)
+{
+    gchar *contents = NULL;
+    gchar **lines = NULL;
+    guint ind = 0;
+
+    db->path = path;
+    db->id_field = id_field;
+    db->entries = g_ptr_array_new_with_free_func (
+            (GDestroyNotify)_free_entry);
+    db->added = g_ptr_array_new_with_free_func ((GDestroyNotify)_free_entry);
+    db->names = g_hash_table_new (g_str_hash, g_str_equal);
+    db->ids = g_hash_table_new (g_direct_hash, g_direct_equal);
+    db->cursors = g_hash_table_new (g_direct_hash, g_direct_equal);
+
+    if (!path || !g_file_get_contents (path, &contents, NULL, NULL)) {
+        GUM_RETURN_WITH_ERROR (GUM_ERROR_FILE_OPEN,
+                "Unable to read database file", error, FALSE);
+    }
+
+    lines = g_strsplit (contents, "\n", -1);
+    g_free (contents);
+    for (ind = 0; lines[ind]; ind++) {
+        GumdManifestEntry *entry = NULL;
+
+        /* the last line is empty when the file ends with a newline */
+        if (lines[ind][0] == '\0' && !lines[ind + 1])
+            break;
+        entry = _new_entry (lines[ind], id_field);
+        g_ptr_array_add (db->entries, entry);
+        _index_entry (db, entry);
+    }
+    g_strfreev (lines);
+
+    return TRUE;
+}
+
+static void
+_add_entry (
+        GumdManifestDb *db,
+        gchar *line)
+{
+    GumdManifestEntry *entry = _new_entry (line, db->id_field);
+
+    g_free (line);
+    g_ptr_array_add (db->added, entry);
+    _index_entry (db, entry);
+    db->changed = TRUE;
+}
+
+static gint
+_compare_entries (
+        gconstpointer a,
+        gconstpointer b)
+{
+    const GumdManifestEntry *ea = *((GumdManifestEntry **) a);
+    const GumdManifestEntry *eb = *((GumdManifestEntry **) b);
+
+    return (ea->id > eb->id) - (ea->id < eb->id);
+}
+
+static gboolean
+_write_line (
+        const gchar *line,
+        FILE *dup_file,
+        GError **error)
+{
+    if (fputs (line, dup_file) < 0 || fputc ('\n', dup_file) < 0) {
+        GUM_RETURN_WITH_ERROR (GUM_ERROR_FILE_WRITE, "File write failure",
+                error, FALSE);
+    }
+    return TRUE;
+}
+
+static gboolean
+_write_db_entries (
+        GObject *object,
+        GumOpType op,
+        FILE *source_file,
+        FILE *dup_file,
+        gpointer user_data,
+        GError **error)
+{
+    GumdManifestDb *db = (GumdManifestDb *) user_data;
+    GumdManifestEntry *entry = NULL, *new_entry = NULL;
+    guint ind = 0, added = 0;
+
+    /* same as gumd, new passwd and group entries are inserted before the
+     * first entry with a greater id, whereas the shadow entries are appended.
+     * The source file is not read again: the db is locked since it was
+     * loaded */
+    if (db->id_field > 0)
+        g_ptr_array_sort (db->added, _compare_entries);
+
+    for (ind = 0; ind < db->entries->len; ind++) {
+        entry = g_ptr_array_index (db->entries, ind);
+        while (db->id_field > 0 && entry->id != G_MAXUINT &&
+               added < db->added->len) {
+            new_entry = g_ptr_array_index (db->added, added);
+            if (new_entry->id >= entry->id)
+                break;
+            if (!_write_line (new_entry->line, dup_file, error))
+                return FALSE;
+            added++;
+        }
+        if (!_write_line (entry->line, dup_file, error))
+            return FALSE;
+    }
+
+    for (; added < db->added->len; added++) {
+        new_entry = g_ptr_array_index (db->added, added);
+        if (!_write_line (new_entry->line, dup_file, error))
+            return FALSE;
+    }
+
+    return TRUE;
+}
+
+static gboolean
+_save_db (
+        GumdManifestDb *db,
+        GError **error)
+{
+    if (!db->changed)
+        return TRUE;
+
+    return gum_file_update (NULL, GUM_OPTYPE_MODIFY,
+            (GumFileUpdateCB)_write_db_entries, db->path, db, error);
+}
+
+static gboolean
+_find_free_id (
+        GumdManifestDb *db,
+        guint min,
+        guint max,
+        guint *id)
+{
+    gpointer cursor = NULL;
+    guint tmp_id = min;
+
+    if (min >= max)
+        return FALSE;
+
+    /* ids are only ever taken, so the ones before the last allocation in the
+     * range need not be checked again */
+    if (g_hash_table_lookup_extended (db->cursors, GUINT_TO_POINTER (min),
+            NULL, &cursor))
+        tmp_id = GPOINTER_TO_UINT (cursor);
+
+    for (; tmp_id <= max && tmp_id != G_MAXUINT; tmp_id++) {
+        if (!g_hash_table_contains (db->ids, GUINT_TO_POINTER (tmp_id))) {
+            g_hash_table_insert (db->cursors, GUINT_TO_POINTER (min),
+                    GUINT_TO_POINTER (tmp_id + 1));
+            *id = tmp_id;
+            return TRUE;
+        }
+    }
+    return FALSE;
+}
+
+static gboolean
+_append_to_field (
+        GumdManifestEntry *entry,
+        guint field,
+        const gchar *value)
+{
+    gchar **fields = g_strsplit (entry->line, ":", -1);
+    gchar *str = NULL;
+    gboolean appended = FALSE;
+
+    if (g_strv_length (fields) > field &&
+        !gum_string_utils_search_string (fields[field], ",", value)) {
+        str = fields[field][0] == '\0' ? g_strdup (value) :
+                g_strconcat (fields[field], ",", value, NULL);
+        g_free (fields[field]);
+        fields[field] = str;
+
+        g_free (entry->line);
+        entry->line = g_strjoinv (":", fields);
+        appended = TRUE;
+    }
+    g_strfreev (fields);
+
+    return appended;
+}
+
+static gboolean
+_get_secret (
+        GumdManifest *self,
+        const gchar *section,
+        const gchar *default_secret,
+        gchar **hash,
+        GError **error)
+{
+    gchar *secret = NULL;
+
+    *hash = g_key_file_get_string (self->key_file, section, "SecretHash",
+            NULL);
+    if (*hash) {
+        if (!gum_validate_db_string_entry (*hash, error)) {
+            GUM_STR_FREE (*hash);
+            return FALSE;
+        }
+        return TRUE;
+    }
+
+    secret = g_key_file_get_string (self->key_file, section, "Secret", NULL);
+    if (!secret) {
+        *hash = g_strdup (default_secret);
+        return TRUE;
+    }
+
+    *hash = gum_crypt_encrypt_secret (secret, gum_config_get_string (
+            self->config, GUM_CONFIG_GENERAL_ENCRYPT_METHOD));
+    memset (secret, 0, strlen (secret));
+    g_free (secret);
+    if (!*hash) {
+        GUM_RETURN_WITH_ERROR (GUM_ERROR_USER_SECRET_ENCRYPT_FAILURE,
+                "Secret encryption failed.", error, FALSE);
+    }
+    return TRUE;
+}
+
+static gboolean
+_get_id (
+        GumdManifest *self,
+        const gchar *section,
+        const gchar *key,
+        guint *id,
+        GError **error)
+{
+    gchar *str = NULL, *end = NULL;
+    guint64 value = 0;
+
+    str = g_key_file_get_string (self->key_file, section, key, NULL);
+    if (!str)
+        return TRUE;
+
+    value = g_ascii_strtoull (str, &end, 10);
+    if (end == str || *end != '\0' || value >= G_MAXUINT) {
+        g_free (str);
+        GUM_RETURN_WITH_ERROR (GUM_ERROR_INVALID_INPUT, "Invalid id", error,
+                FALSE);
+    }
+    g_free (str);
+    *id = (guint) value;
+    return TRUE;
+}
+
+static gboolean
+_add_group (
+        GumdManifest *self,
+        const gchar *name,
+        GumGroupType type,
+        gid_t preferred_gid,
+        const gchar *secret,
+        gid_t *gid,
+        GError **error)
+{
+    guint gid_min, gid_max;
+
+    if (!gum_validate_name (name, error))
+        return FALSE;
+
+    if (g_hash_table_lookup (self->group.names, name)) {
+        GUM_RETURN_WITH_ERROR (GUM_ERROR_GROUP_ALREADY_EXISTS,
+                "Group already exists", error, FALSE);
+    }
+
+    if (type == GUM_GROUPTYPE_SYSTEM) {
+        gid_min = gum_config_get_uint (self->config,
+                GUM_CONFIG_GENERAL_SYS_GID_MIN, G_MAXUINT);
+        gid_max = gum_config_get_uint (self->config,
+                GUM_CONFIG_GENERAL_SYS_GID_MAX, G_MAXUINT);
+    } else {
+        gid_min = gum_config_get_uint (self->config,
+                GUM_CONFIG_GENERAL_GID_MIN, G_MAXUINT);
+        gid_max = gum_config_get_uint (self->config,
+                GUM_CONFIG_GENERAL_GID_MAX, G_MAXUINT);
+    }
+
+    if (preferred_gid != GUM_GROUP_INVALID_GID &&
+        !g_hash_table_contains (self->group.ids,
+                GUINT_TO_POINTER (preferred_gid))) {
+        *gid = preferred_gid;
+    } else if (!_find_free_id (&self->group, gid_min, gid_max, gid)) {
+        GUM_RETURN_WITH_ERROR (GUM_ERROR_GROUP_GID_NOT_AVAILABLE,
+                "GID not available", error, FALSE);
+    }
+
+    if (!secret)
+        secret = (type == GUM_GROUPTYPE_SYSTEM) ? "*" : "!";
+
+    _add_entry (&self->group, g_strdup_printf ("%s:x:%u:", name, *gid));
+    _add_entry (&self->gshadow, g_strdup_printf ("%s:%s::", name, secret));
+
+    return TRUE;
+}
+
+static gboolean
+_apply_group (
+        GumdManifest *self,
+        const gchar *section,
+        GError **error)
+{
+    const gchar *name = section + strlen (GUMD_MANIFEST_GROUP_SECTION);
+    gchar *str = NULL, *secret = NULL;
+    GumGroupType type = GUM_GROUPTYPE_NONE;
+    guint gid = GUM_GROUP_INVALID_GID;
+    gboolean added = FALSE;
+
+    if (g_hash_table_lookup (self->group.names, name)) {
+        DBG ("Group %s already exists", name);
+        return TRUE;
+    }
+
+    str = g_key_file_get_string (self->key_file, section, "Type", NULL);
+    if (g_strcmp0 (str, "system") == 0)
+        type = GUM_GROUPTYPE_SYSTEM;
+    else if (g_strcmp0 (str, "user") == 0)
+        type = GUM_GROUPTYPE_USER;
+    g_free (str);
+    if (type == GUM_GROUPTYPE_NONE) {
+        GUM_RETURN_WITH_ERROR (GUM_ERROR_GROUP_INVALID_GROUP_TYPE,
+                "Invalid group type", error, FALSE);
+    }
+
+    if (!_get_id (self, section, "Gid", &gid, error))
+        return FALSE;
+    if (gid != GUM_GROUP_INVALID_GID &&
+        g_hash_table_contains (self->group.ids, GUINT_TO_POINTER (gid))) {
+        GUM_RETURN_WITH_ERROR (GUM_ERROR_GROUP_GID_NOT_AVAILABLE,
+                "GID not available", error, FALSE);
+    }
+
+    if (!_get_secret (self, section, NULL, &secret, error))
+        return FALSE;
+
+    added = _add_group (self, name, type, gid, secret, &gid, error);
+    g_free (secret);
+
+    return added;
+}
+
+static gboolean
+_get_field (
+        GumdManifest *self,
+        const gchar *section,
+        const gchar *key,
+        const gchar *default_value,
+        gchar **value,
+        GError **error)
+{
+    *value = g_key_file_get_string (self->key_file, section, key, NULL);
+    if (!*value) {
+        *value = g_strdup (default_value);
+        return TRUE;
+    }
+
+    if (!gum_validate_db_string_entry (*value, error)) {
+        GUM_STR_FREE (*value);
+        return FALSE;
+    }
+    return TRUE;
+}
+
+static gchar *
+_format_days (
+        glong days)
+{
+    /* same as putspent, -1 is written as an empty field */
+    return days == -1 ? g_strdup ("") : g_strdup_printf ("%ld", days);
+}
+
+static gchar *
+_get_default_home_dir (
+        GumdManifest *self,
+        const gchar *name)
+{
+    const gchar *prefix = gum_config_get_string (self->config,
+            GUM_CONFIG_GENERAL_HOME_DIR_PREF);
+
+    /* the config prepends the sysroot, but the path stored in passwd has to
+     * be the one seen from within the sysroot */
+    if (prefix && self->sysroot && g_str_has_prefix (prefix, self->sysroot))
+        prefix += strlen (self->sysroot);
+
+    return gum_file_get_home_dir_path (prefix, gum_config_get_string (
+            self->config, GUM_CONFIG_GENERAL_HOME_DIR_LAYOUT), name);
+}
+
+static gboolean
+_set_primary_group (
+        GumdManifest *self,
+        GumdManifestUser *user,
+        GError **error)
+{
+    const gchar *primary_gname = NULL;
+    GumdManifestEntry *entry = NULL;
+
+    primary_gname = gum_config_get_string (self->config,
+            GUM_CONFIG_GENERAL_USR_PRIMARY_GRPNAME);
+    if (primary_gname &&
+        (entry = g_hash_table_lookup (self->group.names, primary_gname)) &&
+        entry->id != G_MAXUINT) {
+        user->gid = entry->id;
+        return TRUE;
+    }
+
+    return _add_group (self, primary_gname ? primary_gname : user->name,
+            (user->type == GUM_USERTYPE_SYSTEM) ? GUM_GROUPTYPE_SYSTEM :
+                    GUM_GROUPTYPE_USER, (gid_t) user->uid, NULL, &user->gid,
+            error);
+}
+
+static gboolean
+_add_user (
+        GumdManifest *self,
+        const gchar *section,
+        GumdManifestUser *user,
+        GError **error)
+{
+    static const gchar *keys[] = {
+        "RealName", "Office", "OfficePhone", "HomePhone"
+    };
+    gchar *fields[G_N_ELEMENTS (keys) + 2] = { NULL };
+    gchar *days[4] = { NULL };
+    gchar *gecos = NULL, *shell = NULL, *secret = NULL;
+    guint uid_min, uid_max, ind;
+    gboolean added = FALSE;
+
+    if (user->type == GUM_USERTYPE_SYSTEM) {
+        uid_min = gum_config_get_uint (self->config,
+                GUM_CONFIG_GENERAL_SYS_UID_MIN, GUM_USER_INVALID_UID);
+        uid_max = gum_config_get_uint (self->config,
+                GUM_CONFIG_GENERAL_SYS_UID_MAX, GUM_USER_INVALID_UID);
+    } else if (user->type == GUM_USERTYPE_SECURITY) {
+        uid_min = gum_config_get_uint (self->config,
+                GUM_CONFIG_GENERAL_SEC_UID_MIN, GUM_USER_INVALID_UID);
+        uid_max = gum_config_get_uint (self->config,
+                GUM_CONFIG_GENERAL_SEC_UID_MAX, GUM_USER_INVALID_UID);
+    } else {
+        uid_min = gum_config_get_uint (self->config,
+                GUM_CONFIG_GENERAL_UID_MIN, GUM_USER_INVALID_UID);
+        uid_max = gum_config_get_uint (self->config,
+                GUM_CONFIG_GENERAL_UID_MAX, GUM_USER_INVALID_UID);
+    }
+
+    user->uid = GUM_USER_INVALID_UID;
+    if (!_get_id (self, section, "Uid", &user->uid, error))
+        return FALSE;
+    if (user->uid != GUM_USER_INVALID_UID) {
+        if (g_hash_table_contains (self->passwd.ids,
+                GUINT_TO_POINTER (user->uid))) {
+            GUM_RETURN_WITH_ERROR (GUM_ERROR_USER_UID_NOT_AVAILABLE,
+                    "UID not available", error, FALSE);
+        }
+    } else if (!_find_free_id (&self->passwd, uid_min, uid_max, &user->uid)) {
+        GUM_RETURN_WITH_ERROR (GUM_ERROR_USER_UID_NOT_AVAILABLE,
+                "UID not available", error, FALSE);
+    }
+
+    /* gecos: realname,officelocation,officephone,homephone,usertype */
+    for (ind = 0; ind < G_N_ELEMENTS (keys); ind++) {
+        if (!_get_field (self, section, keys[ind], ind == 0 ? user->name : "",
+                &fields[ind], error))
+            goto _finished;
+    }
+    fields[ind] = g_strdup (gum_user_type_to_string (user->type));
+    gecos = g_strjoinv (",", fields);
+
+    if (g_key_file_has_key (self->key_file, section, "HomeDir", NULL)) {
+        if (!_get_field (self, section, "HomeDir", NULL, &user->home_dir,
+                error))
+            goto _finished;
+    } else if (user->type != GUM_USERTYPE_SYSTEM) {
+        user->home_dir = _get_default_home_dir (self, user->name);
+    }
+
+    if (!_get_field (self, section, "Shell", gum_config_get_string (
+            self->config, user->type == GUM_USERTYPE_SECURITY ?
+                    GUM_CONFIG_GENERAL_SEC_SHELL : GUM_CONFIG_GENERAL_SHELL),
+            &shell, error))
+        goto _finished;
+
+    if (!_get_secret (self, section, user->type == GUM_USERTYPE_SYSTEM ? "*" :
+            (user->type == GUM_USERTYPE_GUEST ? "" : "!"), &secret, error))
+        goto _finished;
+
+    if (!_set_primary_group (self, user, error))
+        goto _finished;
+
+    _add_entry (&self->passwd, g_strdup_printf ("%s:x:%u:%u:%s:%s:%s",
+            user->name, user->uid, user->gid, gecos,
+            user->home_dir ? user->home_dir : "", shell ? shell : ""));
+
+    /* inactive days, expiry date and the reserved flag are not set */
+    days[0] = _format_days (self->lstchg);
+    days[1] = _format_days (gum_config_get_int (self->config,
+            GUM_CONFIG_GENERAL_PASS_MIN_DAYS, -1));
+    days[2] = _format_days (gum_config_get_int (self->config,
+            GUM_CONFIG_GENERAL_PASS_MAX_DAYS, -1));
+    days[3] = _format_days (gum_config_get_int (self->config,
+            GUM_CONFIG_GENERAL_PASS_WARN_AGE, -1));
+    _add_entry (&self->shadow, g_strdup_printf ("%s:%s:%s:%s:%s:%s:::",
+            user->name, secret, days[0], days[1], days[2], days[3]));
+    added = TRUE;
+
+_finished:
+    for (ind = 0; ind < G_N_ELEMENTS (fields); ind++)
+        g_free (fields[ind]);
+    for (ind = 0; ind < G_N_ELEMENTS (days); ind++)
+        g_free (days[ind]);
+    g_free (gecos);
+    g_free (shell);
+    if (secret) memset (secret, 0, strlen (secret));
+    g_free (secret);
+    return added;
+}
+
+static gboolean
+_apply_user (
+        GumdManifest *self,
+        const gchar *section,
+        GError **error)
+{
+    GumdManifestUser *user = g_new0 (GumdManifestUser, 1);
+    GumdManifestEntry *entry = NULL;
+    gchar **fields = NULL;
+    gchar *str = NULL;
+    gboolean added = FALSE;
+
+    user->section = section;
+    user->name = g_strdup (section + strlen (GUMD_MANIFEST_USER_SECTION));
+    user->uid = GUM_USER_INVALID_UID;
+    user->gid = GUM_GROUP_INVALID_GID;
+
+    str = g_key_file_get_string (self->key_file, section, "Type", NULL);
+    user->type = gum_user_type_from_string (str);
+    g_free (str);
+
+    if ((entry = g_hash_table_lookup (self->passwd.names, user->name))) {
+        DBG ("User %s already exists", user->name);
+        fields = g_strsplit (entry->line, ":", 7);
+        if (g_strv_length (fields) == 7) {
+            user->uid = entry->id;
+            user->gid = (gid_t) g_ascii_strtoull (fields[3], NULL, 10);
+            user->home_dir = g_strdup (fields[5]);
+        }
+        g_strfreev (fields);
+        g_ptr_array_add (self->users, user);
+        return TRUE;
+    }
+
+    if (!gum_validate_name (user->name, error))
+        goto _finished;
+
+    if (user->type == GUM_USERTYPE_NONE) {
+        GUM_SET_ERROR (GUM_ERROR_USER_INVALID_USER_TYPE, "Invalid user type",
+                error, added, FALSE);
+        goto _finished;
+    }
+
+    added = _add_user (self, section, user, error);
+
+_finished:
+    if (added) {
+        user->added = TRUE;
+        g_ptr_array_add (self->users, user);
+    } else {
+        _free_user (user);
+    }
+    return added;
+}
+
+static gboolean
+_add_member (
+        GumdManifest *self,
+        const gchar *group_name,
+        const gchar *user_name,
+        gboolean add_as_admin,
+        GError **error)
+{
+    GumdManifestEntry *entry = NULL;
+
+    /* group: group_name:password:GID:user_list */
+    entry = g_hash_table_lookup (self->group.names, group_name);
+    if (!entry) {
+        GUM_RETURN_WITH_ERROR (GUM_ERROR_GROUP_NOT_FOUND, "Group not found",
+                error, FALSE);
+    }
+    if (_append_to_field (entry, 3, user_name))
+        self->group.changed = TRUE;
+
+    /* gshadow: group_name:encrypted_password:administrators:members */
+    entry = g_hash_table_lookup (self->gshadow.names, group_name);
+    if (entry) {
+        if (_append_to_field (entry, 3, user_name))
+            self->gshadow.changed = TRUE;
+        if (add_as_admin && _append_to_field (entry, 2, user_name))
+            self->gshadow.changed = TRUE;
+    }
+
+    return TRUE;
+}
+
+static gboolean
+_apply_memberships (
+        GumdManifest *self,
+        GumdManifestUser *user,
+        GError **error)
+{
+    const gchar *def_groups = NULL;
+    gchar **groups = NULL;
+    gboolean added = TRUE;
+    guint ind;
+
+    /* default groups are only set for the users added, same as gumd */
+    if (user->added && user->type != GUM_USERTYPE_SYSTEM) {
+        def_groups = gum_config_get_string (self->config,
+                user->type == GUM_USERTYPE_ADMIN ?
+                        GUM_CONFIG_GENERAL_DEF_ADMIN_GROUPS :
+                        GUM_CONFIG_GENERAL_DEF_USR_GROUPS);
+        groups = def_groups ? g_strsplit (def_groups, ",", -1) : NULL;
+        for (ind = 0; groups && groups[ind]; ind++) {
+            if (groups[ind][0] != '\0' &&
+                !_add_member (self, groups[ind], user->name, FALSE, NULL)) {
+                WARN ("Failed to set group : %s", groups[ind]);
+            }
+        }
+        g_strfreev (groups);
+    }
+
+    groups = g_key_file_get_string_list (self->key_file, user->section,
+            "Groups", NULL, NULL);
+    for (ind = 0; added && groups && groups[ind]; ind++)
+        added = _add_member (self, groups[ind], user->name, FALSE, error);
+    g_strfreev (groups);
+
+    groups = g_key_file_get_string_list (self->key_file, user->section,
+            "AdminGroups", NULL, NULL);
+    for (ind = 0; added && groups && groups[ind]; ind++)
+        added = _add_member (self, groups[ind], user->name, TRUE, error);
+    g_strfreev (groups);
+
+    return added;
+}
+
+static gboolean
+_create_home_dirs (
+        GumdManifest *self,
+        GError **error)
+{
+    GumdManifestUser *user = NULL;
+    gchar *home_dir = NULL;
+    gboolean created = TRUE;
+    guint umask, ind;
+
+    umask = gum_config_get_uint (self->config, GUM_CONFIG_GENERAL_UMASK,
+            GUM_UMASK);
+
+    /* existing home directories are left untouched */
+    for (ind = 0; created && ind < self->users->len; ind++) {
+        user = g_ptr_array_index (self->users, ind);
+        if (user->type == GUM_USERTYPE_NONE ||
+            user->type == GUM_USERTYPE_SYSTEM ||
+            user->uid == GUM_USER_INVALID_UID ||
+            !user->home_dir || user->home_dir[0] == '\0')
+            continue;
+
+        home_dir = gum_config_prepend_sysroot (self->config, user->home_dir);
+        created = gum_file_create_home_dir (home_dir, user->uid, user->gid,
+                umask, error);
+        g_free (home_dir);
+    }
+
+    return created;
+}
+
+static glong
+_get_last_change (void)
+{
+    const gchar *epoch = g_getenv ("SOURCE_DATE_EPOCH");
+    gint64 now = 0;
+    glong days = 0;
+
+    /* reproducible builds define the time to be used instead of the
+     * current one */
+    if (epoch)
+        now = g_ascii_strtoll (epoch, NULL, 10);
+    else
+        now = (gint64) time ((time_t *) 0);
+
+    days = (glong) (now / GUMD_DAY);
+    /* Better disable aging than requiring a password change */
+    return days == 0 ? -1 : days;
+}
+
+/**
+ * gumd_manifest_apply:
+ * @config: (transfer none): the #GumConfig object
+ * @manifest_file: (transfer none): path to the manifest key file
+ * @create_home_dirs: whether to create the home directories of the users
+ * @error: (transfer none): the #GError which is set in case of an error
+ *
+ * Adds the users, groups and group memberships described in the manifest
+ * file which do not exist yet to the user/group database of @config, which
+ * can be a sysroot. Each database file is read and written at most once.
+ *
+ * Returns: TRUE if successful, FALSE otherwise and @error is set.
+ */
+gboolean
+gumd_manifest_apply (
+        GumConfig *config,
+        const gchar *manifest_file,
+        gboolean create_home_dirs,
+        GError **error)
+{
+    GumdManifest manifest;
+    GumdManifest *self = &manifest;
+    gchar **sections = NULL;
+    gboolean retval = FALSE;
+    guint ind;
+
+    g_return_val_if_fail (GUM_IS_CONFIG (config), FALSE);
+    g_return_val_if_fail (manifest_file != NULL, FALSE);
+
+    memset (self, 0, sizeof (GumdManifest));
+    self->config = config;
+    self->key_file = g_key_file_new ();
+    self->users = g_ptr_array_new_with_free_func ((GDestroyNotify)_free_user);
+    self->lstchg = _get_last_change ();
+
+    g_object_get (G_OBJECT (config), "sysroot", &self->sysroot, NULL);
+    if (self->sysroot) {
+        gsize len = strlen (self->sysroot);
+        while (len > 0 && self->sysroot[len - 1] == G_DIR_SEPARATOR)
+            self->sysroot[--len] = '\0';
+        if (len == 0) GUM_STR_FREE (self->sysroot);
+    }
+
+    if (!g_key_file_load_from_file (self->key_file, manifest_file,
+            G_KEY_FILE_NONE, NULL)) {
+        GUM_SET_ERROR (GUM_ERROR_INVALID_INPUT, "Unable to load manifest",
+                error, retval, FALSE);
+        goto _finished;
+    }
+
+    sections = g_key_file_get_groups (self->key_file, NULL);
+    for (ind = 0; sections[ind]; ind++) {
+        if (!g_str_has_prefix (sections[ind], GUMD_MANIFEST_GROUP_SECTION) &&
+            !g_str_has_prefix (sections[ind], GUMD_MANIFEST_USER_SECTION)) {
+            GUM_SET_ERROR (GUM_ERROR_INVALID_INPUT,
+                    "Invalid manifest section", error, retval, FALSE);
+            goto _finished;
+        }
+    }
+
+    if (!gum_lock_pwdf_lock ()) {
+        GUM_SET_ERROR (GUM_ERROR_DB_ALREADY_LOCKED, "Database already locked",
+                error, retval, FALSE);
+        goto _finished;
+    }
+
+    if (!_load_db (&self->passwd, gum_config_get_string (config,
+            GUM_CONFIG_GENERAL_PASSWD_FILE), 2, error) ||
+        !_load_db (&self->shadow, gum_config_get_string (config,
+            GUM_CONFIG_GENERAL_SHADOW_FILE), 0, error) ||
+        !_load_db (&self->group, gum_config_get_string (config,
+            GUM_CONFIG_GENERAL_GROUP_FILE), 2, error) ||
+        !_load_db (&self->gshadow, gum_config_get_string (config,
+            GUM_CONFIG_GENERAL_GSHADOW_FILE), 0, error))
+        goto _unlock;
+
+    /* groups go first so that the users can be made members of them */
+    for (ind = 0; sections[ind]; ind++) {
+        if (g_str_has_prefix (sections[ind], GUMD_MANIFEST_GROUP_SECTION) &&
+            !_apply_group (self, sections[ind], error))
+            goto _unlock;
+    }
+
+    for (ind = 0; sections[ind]; ind++) {
+        if (g_str_has_prefix (sections[ind], GUMD_MANIFEST_USER_SECTION) &&
+            !_apply_user (self, sections[ind], error))
+            goto _unlock;
+    }
+
+    for (ind = 0; ind < self->users->len; ind++) {
+        if (!_apply_memberships (self, g_ptr_array_index (self->users, ind),
+                error))
+            goto _unlock;
+    }
+
+    DBG ("%u users and %u groups added", self->passwd.added->len,
+            self->group.added->len);
+
+    if (!_save_db (&self->group, error) ||
+        !_save_db (&self->gshadow, error) ||
+        !_save_db (&self->passwd, error) ||
+        !_save_db (&self->shadow, error))
+        goto _unlock;
+
+    retval = TRUE;
+
+_unlock:
+    gum_lock_pwdf_unlock ();
+
+    if (retval && create_home_dirs)
+        retval = _create_home_dirs (self, error);
+
+_finished:
+    _clear_db (&self->passwd);
+    _clear_db (&self->shadow);
+    _clear_db (&self->group);
+    _clear_db (&self->gshadow);
+    g_ptr_array_unref (self->users);
+    g_strfreev (sections);
+    g_key_file_free (self->key_file);
+    g_free (self->sysroot);
+
+    return retval;
+}
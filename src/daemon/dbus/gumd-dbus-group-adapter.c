@@ -29,6 +29,7 @@
 #include "common/gum-error.h"
 
 #include "gumd-dbus-group-adapter.h"
+#include "gumd-dbus-scheduler.h"
 #include "daemon/core/gumd-daemon.h"
 
 enum
@@ -50,6 +51,7 @@ struct _GumdDbusGroupAdapterPrivate
     GumDbusGroup *dbus_group;
     const gchar *prop_name_in_change;
     GumdDaemon *daemon;
+    GumdDbusScheduler *scheduler;
 };
 
 G_DEFINE_TYPE (GumdDbusGroupAdapter, gumd_dbus_group_adapter, \
@@ -116,6 +118,7 @@ _dispose (
     GumdDbusGroupAdapter *self = GUMD_DBUS_GROUP_ADAPTER (object);
 
     GUM_OBJECT_UNREF (self->priv->daemon);
+    GUM_OBJECT_UNREF (self->priv->scheduler);
     GUM_OBJECT_UNREF (self->priv->group);
 
     if (self->priv->dbus_group) {
@@ -246,17 +249,16 @@ _sync_group_properties(
     g_free (properties);
 }
 
-static gboolean
-_handle_add_group (
+static void
+_add_group (
         GumdDbusGroupAdapter *self,
-        GDBusMethodInvocation *invocation,
-        gpointer user_data)
+        GDBusMethodInvocation *invocation)
 {
     GError *error = NULL;
     gboolean rval = FALSE;
     gid_t gid = GUM_GROUP_INVALID_GID;
 
-    g_return_val_if_fail (self && GUMD_IS_DBUS_GROUP_ADAPTER(self), FALSE);
+    g_return_if_fail (self && GUMD_IS_DBUS_GROUP_ADAPTER(self));
 
     gum_disposable_set_auto_dispose (GUM_DISPOSABLE (self), FALSE);
 
@@ -276,19 +278,28 @@ _handle_add_group (
     }
 
     gum_disposable_set_auto_dispose (GUM_DISPOSABLE (self), TRUE);
-    return TRUE;
 }
 
 static gboolean
-_handle_delete_group (
+_handle_add_group (
         GumdDbusGroupAdapter *self,
         GDBusMethodInvocation *invocation,
-        gboolean rem_home_dir,
         gpointer user_data)
+{
+    gumd_dbus_scheduler_push (self->priv->scheduler, GUMD_DBUS_REQUEST_WRITE,
+            G_OBJECT (self), invocation,
+            (GumdDbusSchedulerFunc)_add_group);
+    return TRUE;
+}
+
+static void
+_delete_group (
+        GumdDbusGroupAdapter *self,
+        GDBusMethodInvocation *invocation)
 {
     GError *error = NULL;
 
-    g_return_val_if_fail (self && GUMD_IS_DBUS_GROUP_ADAPTER(self), FALSE);
+    g_return_if_fail (self && GUMD_IS_DBUS_GROUP_ADAPTER(self));
 
     gum_disposable_set_auto_dispose (GUM_DISPOSABLE (self), FALSE);
 
@@ -304,20 +315,30 @@ _handle_delete_group (
         g_error_free (error);
         gum_disposable_set_auto_dispose (GUM_DISPOSABLE (self), TRUE);
     }
-
-    return TRUE;
 }
 
 static gboolean
-_handle_update_group (
+_handle_delete_group (
         GumdDbusGroupAdapter *self,
         GDBusMethodInvocation *invocation,
+        gboolean rem_home_dir,
         gpointer user_data)
+{
+    gumd_dbus_scheduler_push (self->priv->scheduler, GUMD_DBUS_REQUEST_WRITE,
+            G_OBJECT (self), invocation,
+            (GumdDbusSchedulerFunc)_delete_group);
+    return TRUE;
+}
+
+static void
+_update_group (
+        GumdDbusGroupAdapter *self,
+        GDBusMethodInvocation *invocation)
 {
     GError *error = NULL;
     gboolean rval = FALSE;
 
-    g_return_val_if_fail (self && GUMD_IS_DBUS_GROUP_ADAPTER(self), FALSE);
+    g_return_if_fail (self && GUMD_IS_DBUS_GROUP_ADAPTER(self));
 
     gum_disposable_set_auto_dispose (GUM_DISPOSABLE (self), FALSE);
 
@@ -336,22 +357,34 @@ _handle_update_group (
     }
 
     gum_disposable_set_auto_dispose (GUM_DISPOSABLE (self), TRUE);
-
-    return TRUE;
 }
 
 static gboolean
-_handle_add_group_member (
+_handle_update_group (
         GumdDbusGroupAdapter *self,
         GDBusMethodInvocation *invocation,
-        guint32 uid,
-        gboolean add_as_admin,
         gpointer user_data)
 {
+    gumd_dbus_scheduler_push (self->priv->scheduler, GUMD_DBUS_REQUEST_WRITE,
+            G_OBJECT (self), invocation,
+            (GumdDbusSchedulerFunc)_update_group);
+    return TRUE;
+}
+
+static void
+_add_group_member (
+        GumdDbusGroupAdapter *self,
+        GDBusMethodInvocation *invocation)
+{
+    guint32 uid = GUM_USER_INVALID_UID;
+    gboolean add_as_admin = FALSE;
     GError *error = NULL;
     gboolean rval = FALSE;
 
-    g_return_val_if_fail (self && GUMD_IS_DBUS_GROUP_ADAPTER(self), FALSE);
+    g_return_if_fail (self && GUMD_IS_DBUS_GROUP_ADAPTER(self));
+
+    g_variant_get (g_dbus_method_invocation_get_parameters (invocation),
+            "(ub)", &uid, &add_as_admin);
 
     gum_disposable_set_auto_dispose (GUM_DISPOSABLE (self), FALSE);
 
@@ -371,21 +404,35 @@ _handle_add_group_member (
     }
 
     gum_disposable_set_auto_dispose (GUM_DISPOSABLE (self), TRUE);
-
-    return TRUE;
 }
 
 static gboolean
-_handle_delete_group_member (
+_handle_add_group_member (
         GumdDbusGroupAdapter *self,
         GDBusMethodInvocation *invocation,
         guint32 uid,
+        gboolean add_as_admin,
         gpointer user_data)
 {
+    gumd_dbus_scheduler_push (self->priv->scheduler, GUMD_DBUS_REQUEST_WRITE,
+            G_OBJECT (self), invocation,
+            (GumdDbusSchedulerFunc)_add_group_member);
+    return TRUE;
+}
+
+static void
+_delete_group_member (
+        GumdDbusGroupAdapter *self,
+        GDBusMethodInvocation *invocation)
+{
+    guint32 uid = GUM_USER_INVALID_UID;
     GError *error = NULL;
     gboolean rval = FALSE;
 
-    g_return_val_if_fail (self && GUMD_IS_DBUS_GROUP_ADAPTER(self), FALSE);
+    g_return_if_fail (self && GUMD_IS_DBUS_GROUP_ADAPTER(self));
+
+    g_variant_get (g_dbus_method_invocation_get_parameters (invocation),
+            "(u)", &uid);
 
     gum_disposable_set_auto_dispose (GUM_DISPOSABLE (self), FALSE);
 
@@ -405,7 +452,18 @@ _handle_delete_group_member (
     }
 
     gum_disposable_set_auto_dispose (GUM_DISPOSABLE (self), TRUE);
+}
 
+static gboolean
+_handle_delete_group_member (
+        GumdDbusGroupAdapter *self,
+        GDBusMethodInvocation *invocation,
+        guint32 uid,
+        gpointer user_data)
+{
+    gumd_dbus_scheduler_push (self->priv->scheduler, GUMD_DBUS_REQUEST_WRITE,
+            G_OBJECT (self), invocation,
+            (GumdDbusSchedulerFunc)_delete_group_member);
     return TRUE;
 }
 
@@ -420,6 +478,7 @@ gumd_dbus_group_adapter_init (
     self->priv->dbus_group = gum_dbus_group_skeleton_new ();
     self->priv->prop_name_in_change = NULL;
     self->priv->daemon = gumd_daemon_new ();
+    self->priv->scheduler = gumd_dbus_scheduler_new ();
 }
 
 GumdDbusGroupAdapter *
@@ -26,11 +26,13 @@
 #include "config.h"
 #include "common/gum-log.h"
 #include "common/gum-error.h"
+#include "common/gum-config.h"
 #include "common/gum-dbus.h"
 #include "common/gum-defines.h"
 #include "common/gum-string-utils.h"
 
 #include "gumd-dbus-group-service-adapter.h"
+#include "gumd-dbus-scheduler.h"
 #include "gumd-dbus-group-adapter.h"
 
 enum
@@ -46,6 +48,8 @@ enum
 
 static GParamSpec *properties[N_PROPERTIES];
 
+#define GUMD_DBUS_CHANGE_SIGNAL_DELAY_DEFAULT 100
+
 typedef struct
 {
     gchar *peer_name;
@@ -58,9 +62,17 @@ struct _GumdDbusGroupServiceAdapterPrivate
     GDBusConnection *connection;
     GumDbusGroupService *dbus_group_service;
     GumdDaemon *daemon;
+    GumdDbusScheduler *scheduler;
     GumdDbusServerBusType  dbus_server_type;
+    GMutex cache_lock; /* guards peer_groups and caller_watchers */
     GList *peer_groups;
     GHashTable *caller_watchers; //(dbus_caller:watcher_id)
+    gboolean threaded_reads;
+    GMainContext *context;
+    GMutex batch_lock;  /* guards the pending groupsChanged batch */
+    GHashTable *batch;  //(gid:GumdDaemonChangeOp)
+    GSource *batch_source;
+    guint batch_delay;
 };
 
 G_DEFINE_TYPE (GumdDbusGroupServiceAdapter, gumd_dbus_group_service_adapter, \
@@ -90,6 +102,13 @@ _handle_get_group_by_name (
         const gchar *groupname,
         gpointer group_data);
 
+static gboolean
+_handle_get_changes_since (
+        GumdDbusGroupServiceAdapter *self,
+        GDBusMethodInvocation *invocation,
+        guint64 since,
+        gpointer group_data);
+
 static void
 _on_dbus_group_adapter_disposed (
         gpointer data,
@@ -146,6 +165,126 @@ _get_property (
     }
 }
 
+static GVariant *
+_ids_to_variant (
+        GArray *ids)
+{
+    return g_variant_new_fixed_array (G_VARIANT_TYPE_UINT32, ids->data,
+            ids->len, sizeof (guint32));
+}
+
+static gboolean
+_flush_changes (
+        gpointer group_data)
+{
+    GumdDbusGroupServiceAdapter *self = GUMD_DBUS_GROUP_SERVICE_ADAPTER (
+            group_data);
+    GHashTable *batch = NULL;
+    GHashTableIter iter;
+    gpointer key = NULL, value = NULL;
+    GArray *added = NULL, *updated = NULL, *removed = NULL;
+    guint32 id = 0;
+
+    g_mutex_lock (&self->priv->batch_lock);
+    batch = self->priv->batch;
+    self->priv->batch = NULL;
+    if (self->priv->batch_source) {
+        g_source_unref (self->priv->batch_source);
+        self->priv->batch_source = NULL;
+    }
+    g_mutex_unlock (&self->priv->batch_lock);
+
+    /* changes cancelled each other out */
+    if (!batch || g_hash_table_size (batch) == 0) {
+        GUM_HASHTABLE_UNREF (batch);
+        return FALSE;
+    }
+
+    added = g_array_new (FALSE, FALSE, sizeof (guint32));
+    updated = g_array_new (FALSE, FALSE, sizeof (guint32));
+    removed = g_array_new (FALSE, FALSE, sizeof (guint32));
+    g_hash_table_iter_init (&iter, batch);
+    while (g_hash_table_iter_next (&iter, &key, &value)) {
+        id = GPOINTER_TO_UINT (key);
+        switch (GPOINTER_TO_UINT (value)) {
+            case GUMD_DAEMON_CHANGE_ADDED:
+                g_array_append_val (added, id);
+                break;
+            case GUMD_DAEMON_CHANGE_DELETED:
+                g_array_append_val (removed, id);
+                break;
+            default:
+                g_array_append_val (updated, id);
+        }
+    }
+    g_hash_table_unref (batch);
+
+    DBG ("groups changed: %u added, %u updated, %u removed", added->len,
+            updated->len, removed->len);
+    gum_dbus_group_service_emit_groups_changed (self->priv->dbus_group_service,
+            _ids_to_variant (added), _ids_to_variant (updated),
+            _ids_to_variant (removed));
+
+    g_array_free (added, TRUE);
+    g_array_free (updated, TRUE);
+    g_array_free (removed, TRUE);
+
+    return FALSE;
+}
+
+/* daemon signals may come from any thread; the batch is flushed from the
+ * context the adapter was created in */
+static void
+_queue_change (
+        GumdDbusGroupServiceAdapter *self,
+        GumdDaemonChangeOp op,
+        guint id)
+{
+    guint old_op = 0, new_op = 0;
+
+    g_mutex_lock (&self->priv->batch_lock);
+    if (self->priv->batch_delay == 0) {
+        g_mutex_unlock (&self->priv->batch_lock);
+        return;
+    }
+
+    if (!self->priv->batch) {
+        self->priv->batch = g_hash_table_new (g_direct_hash, g_direct_equal);
+    }
+
+    /* fold the change into what is already pending for this group */
+    old_op = GPOINTER_TO_UINT (g_hash_table_lookup (self->priv->batch,
+            GUINT_TO_POINTER (id)));
+    switch (op) {
+        case GUMD_DAEMON_CHANGE_ADDED:
+            /* id reused within the window */
+            new_op = old_op == GUMD_DAEMON_CHANGE_DELETED ?
+                    GUMD_DAEMON_CHANGE_UPDATED : GUMD_DAEMON_CHANGE_ADDED;
+            break;
+        case GUMD_DAEMON_CHANGE_DELETED:
+            new_op = old_op == GUMD_DAEMON_CHANGE_ADDED ?
+                    0 : GUMD_DAEMON_CHANGE_DELETED;
+            break;
+        default:
+            new_op = old_op ? old_op : GUMD_DAEMON_CHANGE_UPDATED;
+    }
+    if (new_op) {
+        g_hash_table_insert (self->priv->batch, GUINT_TO_POINTER (id),
+                GUINT_TO_POINTER (new_op));
+    } else {
+        g_hash_table_remove (self->priv->batch, GUINT_TO_POINTER (id));
+    }
+
+    if (!self->priv->batch_source) {
+        self->priv->batch_source = g_timeout_source_new (
+                self->priv->batch_delay);
+        g_source_set_callback (self->priv->batch_source, _flush_changes, self,
+                NULL);
+        g_source_attach (self->priv->batch_source, self->priv->context);
+    }
+    g_mutex_unlock (&self->priv->batch_lock);
+}
+
 static void
 _on_group_added (
         GObject *object,
@@ -156,6 +295,7 @@ _on_group_added (
             group_data);
     gum_dbus_group_service_emit_group_added (self->priv->dbus_group_service,
             gid);
+    _queue_change (self, GUMD_DAEMON_CHANGE_ADDED, gid);
 }
 
 static void
@@ -168,6 +308,7 @@ _on_group_deleted (
             group_data);
     gum_dbus_group_service_emit_group_deleted (self->priv->dbus_group_service,
             gid);
+    _queue_change (self, GUMD_DAEMON_CHANGE_DELETED, gid);
 }
 
 static void
@@ -180,6 +321,7 @@ _on_group_updated (
             group_data);
     gum_dbus_group_service_emit_group_updated (self->priv->dbus_group_service,
             gid);
+    _queue_change (self, GUMD_DAEMON_CHANGE_UPDATED, gid);
 }
 
 static PeerGroupService *
@@ -246,6 +388,22 @@ _dispose (
             _on_group_updated, self);
 
     GUM_OBJECT_UNREF (self->priv->daemon);
+    GUM_OBJECT_UNREF (self->priv->scheduler);
+
+    g_mutex_lock (&self->priv->batch_lock);
+    self->priv->batch_delay = 0;
+    if (self->priv->batch_source) {
+        g_source_destroy (self->priv->batch_source);
+        g_source_unref (self->priv->batch_source);
+        self->priv->batch_source = NULL;
+    }
+    GUM_HASHTABLE_UNREF (self->priv->batch);
+    g_mutex_unlock (&self->priv->batch_lock);
+
+    if (self->priv->context) {
+        g_main_context_unref (self->priv->context);
+        self->priv->context = NULL;
+    }
 
     if (self->priv->dbus_group_service) {
         g_dbus_interface_skeleton_unexport (G_DBUS_INTERFACE_SKELETON (
@@ -285,6 +443,8 @@ _finalize (
         g_list_free (self->priv->peer_groups);
         self->priv->peer_groups = NULL;
     }
+    g_mutex_clear (&self->priv->cache_lock);
+    g_mutex_clear (&self->priv->batch_lock);
 
     G_OBJECT_CLASS (gumd_dbus_group_service_adapter_parent_class)->finalize (
             object);
@@ -337,7 +497,15 @@ gumd_dbus_group_service_adapter_init (GumdDbusGroupServiceAdapter *self)
 
     self->priv->connection = 0;
     self->priv->daemon = NULL;
+    self->priv->scheduler = gumd_dbus_scheduler_new ();
+    g_mutex_init (&self->priv->cache_lock);
     self->priv->peer_groups = NULL;
+    self->priv->threaded_reads = FALSE;
+    self->priv->context = g_main_context_ref_thread_default ();
+    g_mutex_init (&self->priv->batch_lock);
+    self->priv->batch = NULL;
+    self->priv->batch_source = NULL;
+    self->priv->batch_delay = 0;
     self->priv->dbus_group_service = gum_dbus_group_service_skeleton_new ();
     self->priv->caller_watchers = g_hash_table_new_full (g_str_hash,
             g_str_equal, g_free, (GDestroyNotify)g_bus_unwatch_name);
@@ -380,6 +548,7 @@ _on_bus_name_lost (
     peer_group.peer_name = (gchar *)peer_name;
     peer_group.dbus_group = NULL;
     peer_group.group_service = self;
+    g_mutex_lock (&self->priv->cache_lock);
     g_list_foreach (self->priv->peer_groups, (GFunc)_clear_cache_for_peer_name,
             (gpointer)&peer_group);
 
@@ -388,6 +557,7 @@ _on_bus_name_lost (
     if (g_list_length (self->priv->peer_groups) == 0) {
         gum_disposable_set_auto_dispose (GUM_DISPOSABLE (self), TRUE);
     }
+    g_mutex_unlock (&self->priv->cache_lock);
 }
 
 static void
@@ -442,12 +612,14 @@ _on_dbus_group_adapter_disposed (
 
     peer_group.dbus_group = GUMD_DBUS_GROUP_ADAPTER (object);
     peer_group.group_service = self;
+    g_mutex_lock (&self->priv->cache_lock);
     g_list_foreach (self->priv->peer_groups, (GFunc)_clear_cache_for_group,
             (gpointer)&peer_group);
 
     if (g_list_length (self->priv->peer_groups) == 0) {
         gum_disposable_set_auto_dispose (GUM_DISPOSABLE (self), TRUE);
     }
+    g_mutex_unlock (&self->priv->cache_lock);
 }
 
 static gchar *
@@ -482,6 +654,7 @@ _create_and_cache_dbus_group (
                     connection, group,
                     gumd_daemon_get_group_timeout (self->priv->daemon));
 
+    g_mutex_lock (&self->priv->cache_lock);
     /* keep alive till this group object gets disposed */
     if (g_list_length (self->priv->peer_groups) == 0)
         gum_disposable_set_auto_dispose (GUM_DISPOSABLE (self), FALSE);
@@ -494,8 +667,77 @@ _create_and_cache_dbus_group (
 
     /* watchers used for msg-bus only */
     _add_bus_name_watcher (self, dbus_group, invocation);
+    g_mutex_unlock (&self->priv->cache_lock);
 
-    return dbus_group;
+    return g_object_ref (dbus_group);
+}
+
+typedef void (*GumdDbusGroupCompleteFunc) (
+        GumDbusGroupService *object,
+        GDBusMethodInvocation *invocation,
+        const gchar *object_path);
+
+typedef struct {
+    GumdDbusGroupServiceAdapter *self;
+    GumdDaemonGroup *group;
+    GDBusMethodInvocation *invocation;
+    GumdDbusGroupCompleteFunc complete;
+} GumdDbusGroupExport;
+
+static GumdDbusGroupAdapter *
+_get_dbus_group_from_cache (
+        GumdDbusGroupServiceAdapter *self,
+        GDBusMethodInvocation *invocation,
+        gid_t gid);
+
+static gboolean
+_export_dbus_group (
+        gpointer data)
+{
+    GumdDbusGroupExport *export = (GumdDbusGroupExport *) data;
+    GumdDbusGroupServiceAdapter *self = export->self;
+    GumdDbusGroupAdapter *dbus_group = NULL;
+    gid_t gid = GUM_GROUP_INVALID_GID;
+
+    /* another request may have exported it meanwhile */
+    g_object_get (G_OBJECT (export->group), "gid", &gid, NULL);
+    dbus_group = _get_dbus_group_from_cache (self, export->invocation, gid);
+    if (dbus_group) {
+        g_object_unref (export->group);
+    } else {
+        dbus_group = _create_and_cache_dbus_group (self, export->group,
+                export->invocation);
+    }
+    export->complete (self->priv->dbus_group_service, export->invocation,
+            gumd_dbus_group_adapter_get_object_path (dbus_group));
+    g_object_unref (dbus_group);
+
+    gum_disposable_set_auto_dispose (GUM_DISPOSABLE (self), TRUE);
+    g_object_unref (self);
+    g_slice_free (GumdDbusGroupExport, export);
+
+    return G_SOURCE_REMOVE;
+}
+
+/*
+ * Completes the invocation with the object path of the group's adapter, which
+ * is created if need be, from the context the service adapter belongs to.
+ * Takes over the group and re-enables auto dispose once done.
+ */
+static void
+_complete_with_dbus_group (
+        GumdDbusGroupServiceAdapter *self,
+        GumdDaemonGroup *group,
+        GDBusMethodInvocation *invocation,
+        GumdDbusGroupCompleteFunc complete)
+{
+    GumdDbusGroupExport *export = g_slice_new0 (GumdDbusGroupExport);
+
+    export->self = g_object_ref (self);
+    export->group = group;
+    export->invocation = invocation;
+    export->complete = complete;
+    g_main_context_invoke (self->priv->context, _export_dbus_group, export);
 }
 
 static GumdDbusGroupAdapter *
@@ -506,7 +748,7 @@ _get_dbus_group_from_cache (
 {
     GumdDbusGroupAdapter *dbus_group = NULL;
     PeerGroupService *peer_group = NULL;
-    GList *list = self->priv->peer_groups;
+    GList *list = NULL;
     gchar *peer_name = NULL;
     gboolean delete_later = FALSE;
 
@@ -516,7 +758,9 @@ _get_dbus_group_from_cache (
 
     peer_name = _get_sender (self, invocation);
     DBG ("peername:%s uid %u", peer_name, gid);
-    for ( ; list != NULL; list = g_list_next (list)) {
+    g_mutex_lock (&self->priv->cache_lock);
+    for (list = self->priv->peer_groups; list != NULL;
+         list = g_list_next (list)) {
         peer_group = (PeerGroupService *) list->data;
         if (g_strcmp0 (peer_name, peer_group->peer_name) == 0 &&
             gumd_dbus_group_adapter_get_gid (peer_group->dbus_group) == gid) {
@@ -524,27 +768,26 @@ _get_dbus_group_from_cache (
             g_object_get (G_OBJECT (peer_group->dbus_group), "delete-later",
                     &delete_later, NULL);
             if (!delete_later) {
-                dbus_group = peer_group->dbus_group;
+                dbus_group = g_object_ref (peer_group->dbus_group);
                 break;
             }
         }
     }
+    g_mutex_unlock (&self->priv->cache_lock);
     g_free (peer_name);
 
     return dbus_group;
 }
 
-static gboolean
-_handle_create_new_group (
+static void
+_create_new_group (
         GumdDbusGroupServiceAdapter *self,
-        GDBusMethodInvocation *invocation,
-        gpointer group_data)
+        GDBusMethodInvocation *invocation)
 {
     GumdDaemonGroup *group = NULL;
     GError *error = NULL;
 
-    g_return_val_if_fail (self && GUMD_IS_DBUS_GROUP_SERVICE_ADAPTER(self),
-            FALSE);
+    g_return_if_fail (self && GUMD_IS_DBUS_GROUP_SERVICE_ADAPTER(self));
 
     gum_disposable_set_auto_dispose (GUM_DISPOSABLE (self), FALSE);
 
@@ -555,39 +798,60 @@ _handle_create_new_group (
         gum_dbus_group_service_complete_create_new_group (
                 self->priv->dbus_group_service, invocation,
                 gumd_dbus_group_adapter_get_object_path (dbus_group));
+        g_object_unref (dbus_group);
     } else {
         g_dbus_method_invocation_return_gerror (invocation, error);
         g_error_free (error);
     }
     gum_disposable_set_auto_dispose (GUM_DISPOSABLE (self), TRUE);
-    
-    return TRUE;
 }
 
 static gboolean
-_handle_get_group (
+_handle_create_new_group (
         GumdDbusGroupServiceAdapter *self,
         GDBusMethodInvocation *invocation,
-        guint32 gid,
         gpointer group_data)
 {
+    /* only an object is created here, the write token is charged when
+     * the group is added */
+    if (gumd_dbus_scheduler_admit (self->priv->scheduler,
+            GUMD_DBUS_LIMIT_CREATE, invocation)) {
+        gumd_dbus_scheduler_push (self->priv->scheduler,
+                GUMD_DBUS_REQUEST_READ, G_OBJECT (self), invocation,
+                (GumdDbusSchedulerFunc)_create_new_group);
+    }
+    return TRUE;
+}
+
+static void
+_get_group (
+        GumdDbusGroupServiceAdapter *self,
+        GDBusMethodInvocation *invocation)
+{
+    guint32 gid = GUM_GROUP_INVALID_GID;
     GumdDaemonGroup *group = NULL;
     GError *error = NULL;
     GumdDbusGroupAdapter *dbus_group = NULL;
 
+    g_variant_get (g_dbus_method_invocation_get_parameters (invocation),
+            "(u)", &gid);
+
     gum_disposable_set_auto_dispose (GUM_DISPOSABLE (self), FALSE);
 
     dbus_group = _get_dbus_group_from_cache (self, invocation, gid);
     if (!dbus_group) {
     	group = gumd_daemon_get_group (self->priv->daemon, (gid_t)gid, &error);
     	if (group) {
-    		dbus_group = _create_and_cache_dbus_group (self, group, invocation);
+            _complete_with_dbus_group (self, group, invocation,
+                    gum_dbus_group_service_complete_get_group);
+            return;
     	}
     }
 
     if (dbus_group) {
         gum_dbus_group_service_complete_get_group (self->priv->dbus_group_service,
                 invocation, gumd_dbus_group_adapter_get_object_path (dbus_group));
+        g_object_unref (dbus_group);
     } else {
         if (!error) {
             error = GUM_GET_ERROR_FOR_ID (GUM_ERROR_GROUP_NOT_FOUND,
@@ -598,32 +862,55 @@ _handle_get_group (
     }
 
     gum_disposable_set_auto_dispose (GUM_DISPOSABLE (self), TRUE);
-
-    return TRUE;
 }
 
 static gboolean
-_handle_get_group_by_name (
+_handle_get_group (
         GumdDbusGroupServiceAdapter *self,
         GDBusMethodInvocation *invocation,
-        const gchar *groupname,
+        guint32 gid,
         gpointer group_data)
 {
+    if (self->priv->threaded_reads) {
+        /* already running in a GDBus worker thread */
+        g_object_ref (self);
+        _get_group (self, invocation);
+        g_object_unref (self);
+    } else {
+        gumd_dbus_scheduler_push (self->priv->scheduler,
+                GUMD_DBUS_REQUEST_READ, G_OBJECT (self), invocation,
+                (GumdDbusSchedulerFunc)_get_group);
+    }
+    return TRUE;
+}
+
+static void
+_get_group_by_name (
+        GumdDbusGroupServiceAdapter *self,
+        GDBusMethodInvocation *invocation)
+{
+    const gchar *groupname = NULL;
     GumdDaemonGroup *group = NULL;
     GError *error = NULL;
     GumdDbusGroupAdapter *dbus_group = NULL;
     gid_t gid = GUM_GROUP_INVALID_GID;
 
-    gum_disposable_set_auto_dispose (GUM_DISPOSABLE (self), FALSE);
+    g_variant_get (g_dbus_method_invocation_get_parameters (invocation),
+            "(&s)", &groupname);
 
-    gid = gumd_daemon_group_get_gid_by_name (groupname, gumd_daemon_get_config (
-    		self->priv->daemon));
+    gum_disposable_set_auto_dispose (GUM_DISPOSABLE (self), FALSE);
 
-    dbus_group = _get_dbus_group_from_cache (self, invocation, gid);
-    if (!dbus_group) {
-        group = gumd_daemon_get_group (self->priv->daemon, (gid_t)gid, &error);
-        if (group) {
-            dbus_group = _create_and_cache_dbus_group (self, group, invocation);
+    group = gumd_daemon_get_group_by_name (self->priv->daemon, groupname,
+            &error);
+    if (group) {
+        g_object_get (G_OBJECT (group), "gid", &gid, NULL);
+        dbus_group = _get_dbus_group_from_cache (self, invocation, gid);
+        if (dbus_group) {
+            g_object_unref (group);
+        } else {
+            _complete_with_dbus_group (self, group, invocation,
+                    gum_dbus_group_service_complete_get_group_by_name);
+            return;
         }
     }
 
@@ -631,6 +918,7 @@ _handle_get_group_by_name (
         gum_dbus_group_service_complete_get_group_by_name (
         		self->priv->dbus_group_service, invocation,
         		gumd_dbus_group_adapter_get_object_path (dbus_group));
+        g_object_unref (dbus_group);
     } else {
         if (!error) {
             error = GUM_GET_ERROR_FOR_ID (GUM_ERROR_GROUP_NOT_FOUND,
@@ -641,7 +929,76 @@ _handle_get_group_by_name (
     }
 
     gum_disposable_set_auto_dispose (GUM_DISPOSABLE (self), TRUE);
+}
 
+static gboolean
+_handle_get_group_by_name (
+        GumdDbusGroupServiceAdapter *self,
+        GDBusMethodInvocation *invocation,
+        const gchar *groupname,
+        gpointer group_data)
+{
+    if (self->priv->threaded_reads) {
+        /* already running in a GDBus worker thread */
+        g_object_ref (self);
+        _get_group_by_name (self, invocation);
+        g_object_unref (self);
+    } else {
+        gumd_dbus_scheduler_push (self->priv->scheduler,
+                GUMD_DBUS_REQUEST_READ, G_OBJECT (self), invocation,
+                (GumdDbusSchedulerFunc)_get_group_by_name);
+    }
+    return TRUE;
+}
+
+static void
+_get_changes_since (
+        GumdDbusGroupServiceAdapter *self,
+        GDBusMethodInvocation *invocation)
+{
+    guint64 since = 0;
+    guint64 generation = 0;
+    gboolean resync = FALSE;
+    GError *error = NULL;
+    GVariant *changes = NULL;
+
+    g_variant_get (g_dbus_method_invocation_get_parameters (invocation),
+            "(t)", &since);
+    DBG ("since %" G_GUINT64_FORMAT, since);
+
+    gum_disposable_set_auto_dispose (GUM_DISPOSABLE (self), FALSE);
+
+    changes = gumd_daemon_get_group_changes (self->priv->daemon, since,
+            &generation, &resync, &error);
+    if (changes) {
+        gum_dbus_group_service_complete_get_changes_since (
+                self->priv->dbus_group_service, invocation, generation, resync,
+                changes);
+    } else {
+        g_dbus_method_invocation_return_gerror (invocation, error);
+        g_error_free (error);
+    }
+
+    gum_disposable_set_auto_dispose (GUM_DISPOSABLE (self), TRUE);
+}
+
+static gboolean
+_handle_get_changes_since (
+        GumdDbusGroupServiceAdapter *self,
+        GDBusMethodInvocation *invocation,
+        guint64 since,
+        gpointer group_data)
+{
+    if (self->priv->threaded_reads) {
+        /* already running in a GDBus worker thread */
+        g_object_ref (self);
+        _get_changes_since (self, invocation);
+        g_object_unref (self);
+    } else {
+        gumd_dbus_scheduler_push (self->priv->scheduler,
+                GUMD_DBUS_REQUEST_READ, G_OBJECT (self), invocation,
+                (GumdDbusSchedulerFunc)_get_changes_since);
+    }
     return TRUE;
 }
 
@@ -660,16 +1017,22 @@ gumd_dbus_group_service_adapter_new_with_connection (
             "connection", bus_connection,
             NULL));
 
-    if (!g_dbus_interface_skeleton_export (
-            G_DBUS_INTERFACE_SKELETON(adapter->priv->dbus_group_service),
-            adapter->priv->connection, GUM_GROUP_SERVICE_OBJECTPATH, &err)) {
-        WARN ("failed to register object: %s", err->message);
-        g_error_free (err);
-        g_object_unref (adapter);
-        return NULL;
+    /* lookups only touch the locked daemon caches and hand out copies, so on
+     * the message bus they can be served straight from GDBus worker threads;
+     * new group adapters are still exported from the adapter's context */
+    if (bus_type == GUMD_DBUS_SERVER_BUSTYPE_MSG_BUS &&
+        gum_config_get_int (gumd_daemon_get_config (adapter->priv->daemon),
+                GUM_CONFIG_DBUS_THREADED_READS, 0)) {
+        adapter->priv->threaded_reads = TRUE;
+        g_dbus_interface_skeleton_set_flags (
+                G_DBUS_INTERFACE_SKELETON (adapter->priv->dbus_group_service),
+                G_DBUS_INTERFACE_SKELETON_FLAGS_HANDLE_METHOD_INVOCATIONS_IN_THREAD);
     }
-    DBG("(+) started group service interface '%p' at path '%s' on connection"
-            " '%p'", adapter, GUM_GROUP_SERVICE_OBJECTPATH, bus_connection);
+
+    adapter->priv->batch_delay = (guint) MAX (0, gum_config_get_int (
+            gumd_daemon_get_config (adapter->priv->daemon),
+            GUM_CONFIG_DBUS_CHANGE_SIGNAL_DELAY,
+            GUMD_DBUS_CHANGE_SIGNAL_DELAY_DEFAULT));
 
     timeout = gumd_daemon_get_timeout (adapter->priv->daemon);
     if (timeout && bus_type != GUMD_DBUS_SERVER_BUSTYPE_P2P) {
@@ -684,6 +1047,9 @@ gumd_dbus_group_service_adapter_new_with_connection (
     g_signal_connect_swapped (adapter->priv->dbus_group_service,
         "handle-get-group-by-name", G_CALLBACK(_handle_get_group_by_name),
         adapter);
+    g_signal_connect_swapped (adapter->priv->dbus_group_service,
+        "handle-get-changes-since", G_CALLBACK(_handle_get_changes_since),
+        adapter);
 
     g_signal_connect (G_OBJECT (adapter->priv->daemon), "group-added",
             G_CALLBACK (_on_group_added), adapter);
@@ -692,5 +1058,16 @@ gumd_dbus_group_service_adapter_new_with_connection (
     g_signal_connect (G_OBJECT (adapter->priv->daemon), "group-updated",
             G_CALLBACK (_on_group_updated), adapter);
 
+    if (!g_dbus_interface_skeleton_export (
+            G_DBUS_INTERFACE_SKELETON(adapter->priv->dbus_group_service),
+            adapter->priv->connection, GUM_GROUP_SERVICE_OBJECTPATH, &err)) {
+        WARN ("failed to register object: %s", err->message);
+        g_error_free (err);
+        g_object_unref (adapter);
+        return NULL;
+    }
+    DBG("(+) started group service interface '%p' at path '%s' on connection"
+            " '%p'", adapter, GUM_GROUP_SERVICE_OBJECTPATH, bus_connection);
+
     return adapter;
 }
@@ -0,0 +1,767 @@
+/* vi: set et sw=4 ts=4 cino=t0,(0: */
+/* -*- Mode: C; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+/*
+ * This file is part of gumd
+ *
+ * Copyright (C) 2013 Intel Corporation.
+ *
+ * Contact: Imran Zaman <imran.zaman@intel.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+
+#include "config.h"
+
+#include <string.h>
+
+#include "common/gum-log.h"
+#include "common/gum-error.h"
+#include "common/gum-defines.h"
+#include "common/gum-disposable.h"
+#include "common/gum-config.h"
+#include "common/gum-string-utils.h"
+
+#include "gumd-dbus-scheduler.h"
+#include "daemon/core/gumd-daemon.h"
+
+/* limits are opt-in, as batch provisioning legitimately issues bursts */
+#define GUMD_DBUS_WRITE_RATE_DEFAULT    0
+#define GUMD_DBUS_WRITE_BURST_DEFAULT   20
+#define GUMD_DBUS_CREATE_RATE_DEFAULT   0
+#define GUMD_DBUS_CREATE_BURST_DEFAULT  10
+
+/* number of peers tracked per limit before full buckets are dropped */
+#define GUMD_DBUS_LIMIT_PEERS_MAX       256
+
+/* number of requests of a class a peer may have queued at a time */
+#define GUMD_DBUS_PEER_JOBS_MAX         256
+
+/* id given to each p2p connection, as socket fds and addresses get reused */
+#define GUMD_DBUS_PEER_ID_KEY           "gumd-dbus-peer-id"
+
+/* number of requests of a class dispatched in a row before a waiting request
+ * of a lower class is let through, so that writes and heavy requests are
+ * delayed by reads but never starved */
+static const guint _burst_size[GUMD_DBUS_REQUEST_MAX] = { 8, 4, 1 };
+
+typedef struct {
+    GObject *object;
+    GDBusMethodInvocation *invocation;
+    GumdDbusSchedulerFunc func;
+    gint64 queued_at;
+} GumdDbusSchedulerJob;
+
+typedef struct {
+    gchar *name;
+    GQueue jobs;
+} GumdDbusSchedulerPeer;
+
+typedef struct {
+    GHashTable *peers;  /* (peer name:GumdDbusSchedulerPeer) */
+    GQueue ring;        /* peers with queued jobs, in round-robin order */
+    guint burst;
+    GumdDbusSchedulerStats stats;
+} GumdDbusSchedulerQueue;
+
+typedef struct {
+    gdouble tokens;
+    gint64 updated;
+} GumdDbusSchedulerBucket;
+
+typedef struct {
+    guint rate;         /* tokens refilled per minute, 0 for no limit */
+    guint burst;        /* bucket size */
+    GHashTable *buckets; /* (peer name:GumdDbusSchedulerBucket) */
+    GumdDbusLimitStats stats;
+} GumdDbusSchedulerLimit;
+
+struct _GumdDbusSchedulerPrivate
+{
+    GMutex lock;
+    GMainContext *context;
+    GSource *source;
+    GumdDbusSchedulerQueue queues[GUMD_DBUS_REQUEST_MAX];
+    GumdDbusSchedulerLimit limits[GUMD_DBUS_LIMIT_MAX];
+};
+
+G_DEFINE_TYPE (GumdDbusScheduler, gumd_dbus_scheduler, G_TYPE_OBJECT)
+
+#define GUMD_DBUS_SCHEDULER_PRIV(obj) G_TYPE_INSTANCE_GET_PRIVATE ((obj), \
+        GUMD_TYPE_DBUS_SCHEDULER, GumdDbusSchedulerPrivate)
+
+/* one scheduler per main context, shared by all adapters served from it */
+static GHashTable *schedulers = NULL; /* (GMainContext:GumdDbusScheduler) */
+G_LOCK_DEFINE_STATIC (schedulers);
+
+static const gchar *_type_names[GUMD_DBUS_REQUEST_MAX] = {
+    "read", "write", "heavy"
+};
+
+static const gchar *_limit_names[GUMD_DBUS_LIMIT_MAX] = {
+    "write", "create"
+};
+
+static gint _peer_serial = 0;
+
+static gchar *
+_get_peer_name (
+        GDBusMethodInvocation *invocation)
+{
+    GDBusConnection *connection = NULL;
+    guint id = 0;
+    const gchar *sender = g_dbus_method_invocation_get_sender (invocation);
+
+    /* unique bus name on message bus, connection on p2p */
+    if (sender)
+        return g_strdup (sender);
+
+    connection = g_dbus_method_invocation_get_connection (invocation);
+    id = GPOINTER_TO_UINT (g_object_get_data (G_OBJECT (connection),
+            GUMD_DBUS_PEER_ID_KEY));
+    if (!id) {
+        id = (guint) g_atomic_int_add (&_peer_serial, 1) + 1;
+        g_object_set_data (G_OBJECT (connection), GUMD_DBUS_PEER_ID_KEY,
+                GUINT_TO_POINTER (id));
+    }
+    return g_strdup_printf ("p2p:%u", id);
+}
+
+static void
+_peer_free (
+        GumdDbusSchedulerPeer *peer)
+{
+    GUM_STR_FREE (peer->name);
+    g_slice_free (GumdDbusSchedulerPeer, peer);
+}
+
+static void
+_job_release (
+        GumdDbusSchedulerJob *job)
+{
+    if (GUM_IS_DISPOSABLE (job->object))
+        gum_disposable_set_auto_dispose (GUM_DISPOSABLE (job->object), TRUE);
+    GUM_OBJECT_UNREF (job->object);
+    g_slice_free (GumdDbusSchedulerJob, job);
+}
+
+static GumdDbusSchedulerJob *
+_queue_pop (
+        GumdDbusSchedulerQueue *queue)
+{
+    GumdDbusSchedulerPeer *peer = NULL;
+    GumdDbusSchedulerJob *job = NULL;
+
+    peer = (GumdDbusSchedulerPeer *) g_queue_pop_head (&queue->ring);
+    if (!peer)
+        return NULL;
+
+    job = (GumdDbusSchedulerJob *) g_queue_pop_head (&peer->jobs);
+    if (g_queue_is_empty (&peer->jobs)) {
+        g_hash_table_remove (queue->peers, peer->name);
+    } else {
+        /* back of the line until all other peers had their turn */
+        g_queue_push_tail (&queue->ring, peer);
+    }
+    queue->stats.depth--;
+
+    return job;
+}
+
+static gint
+_pick_type (
+        GumdDbusSchedulerPrivate *priv)
+{
+    gint type, lower;
+
+    for (type = 0; type < GUMD_DBUS_REQUEST_MAX; type++) {
+        if (g_queue_is_empty (&priv->queues[type].ring)) {
+            priv->queues[type].burst = 0;
+            continue;
+        }
+        if (priv->queues[type].burst >= _burst_size[type]) {
+            for (lower = type + 1; lower < GUMD_DBUS_REQUEST_MAX; lower++) {
+                if (!g_queue_is_empty (&priv->queues[lower].ring)) {
+                    priv->queues[type].burst = 0;
+                    return lower;
+                }
+            }
+        }
+        return type;
+    }
+
+    return -1;
+}
+
+static gboolean
+_dispatch (
+        gpointer user_data)
+{
+    GumdDbusScheduler *self = GUMD_DBUS_SCHEDULER (user_data);
+    GumdDbusSchedulerQueue *queue = NULL;
+    GumdDbusSchedulerJob *job = NULL;
+    guint64 wait = 0;
+    gint type;
+
+    g_mutex_lock (&self->priv->lock);
+    type = _pick_type (self->priv);
+    if (type < 0) {
+        g_source_unref (self->priv->source);
+        self->priv->source = NULL;
+        g_mutex_unlock (&self->priv->lock);
+        return G_SOURCE_REMOVE;
+    }
+
+    queue = &self->priv->queues[type];
+    job = _queue_pop (queue);
+    queue->burst++;
+
+    wait = (guint64) (g_get_monotonic_time () - job->queued_at);
+    queue->stats.dispatched++;
+    queue->stats.total_wait += wait;
+    if (wait > queue->stats.max_wait)
+        queue->stats.max_wait = wait;
+    g_mutex_unlock (&self->priv->lock);
+
+    DBG ("%s request %s waited %" G_GUINT64_FORMAT " us",
+            _type_names[type],
+            g_dbus_method_invocation_get_method_name (job->invocation), wait);
+
+    /* the job may drop the last reference held on the scheduler */
+    g_object_ref (self);
+    job->func (job->object, job->invocation);
+    _job_release (job);
+    g_object_unref (self);
+
+    return G_SOURCE_CONTINUE;
+}
+
+static void
+_queue_init (
+        GumdDbusSchedulerQueue *queue)
+{
+    queue->peers = g_hash_table_new_full (g_str_hash, g_str_equal, NULL,
+            (GDestroyNotify)_peer_free);
+    g_queue_init (&queue->ring);
+    queue->burst = 0;
+    memset (&queue->stats, 0, sizeof (queue->stats));
+}
+
+static void
+_queue_drain (
+        GumdDbusSchedulerQueue *queue)
+{
+    GumdDbusSchedulerJob *job = NULL;
+
+    while ((job = _queue_pop (queue)) != NULL) {
+        g_dbus_method_invocation_return_error (job->invocation, GUM_ERROR,
+                GUM_ERROR_INTERNAL_SERVER, "Service is shutting down");
+        _job_release (job);
+    }
+}
+
+static void
+_limit_init (
+        GumdDbusSchedulerLimit *limit,
+        gint rate,
+        gint burst)
+{
+    limit->rate = rate > 0 ? (guint) rate : 0;
+    limit->burst = burst > 0 ? (guint) burst : 1;
+    limit->buckets = g_hash_table_new_full (g_str_hash, g_str_equal, g_free,
+            NULL);
+    memset (&limit->stats, 0, sizeof (limit->stats));
+}
+
+static void
+_limit_refill (
+        GumdDbusSchedulerLimit *limit,
+        GumdDbusSchedulerBucket *bucket,
+        gint64 now)
+{
+    bucket->tokens += (gdouble) (now - bucket->updated) * limit->rate /
+            (60 * G_USEC_PER_SEC);
+    if (bucket->tokens > limit->burst)
+        bucket->tokens = limit->burst;
+    bucket->updated = now;
+}
+
+static gboolean
+_limit_prune_bucket (
+        gpointer key,
+        gpointer value,
+        gpointer user_data)
+{
+    GumdDbusSchedulerLimit *limit = (GumdDbusSchedulerLimit *) user_data;
+    GumdDbusSchedulerBucket *bucket = (GumdDbusSchedulerBucket *) value;
+
+    /* a full bucket is the same as no bucket at all */
+    _limit_refill (limit, bucket, g_get_monotonic_time ());
+    if (bucket->tokens >= limit->burst) {
+        g_slice_free (GumdDbusSchedulerBucket, bucket);
+        return TRUE;
+    }
+    return FALSE;
+}
+
+static gboolean
+_limit_take (
+        GumdDbusSchedulerLimit *limit,
+        const gchar *peer_name)
+{
+    GumdDbusSchedulerBucket *bucket = NULL;
+    gint64 now = g_get_monotonic_time ();
+
+    if (limit->rate == 0) {
+        limit->stats.admitted++;
+        return TRUE;
+    }
+
+    bucket = g_hash_table_lookup (limit->buckets, peer_name);
+    if (!bucket) {
+        if (g_hash_table_size (limit->buckets) >= GUMD_DBUS_LIMIT_PEERS_MAX) {
+            g_hash_table_foreach_remove (limit->buckets, _limit_prune_bucket,
+                    limit);
+        }
+        bucket = g_slice_new0 (GumdDbusSchedulerBucket);
+        bucket->tokens = limit->burst;
+        bucket->updated = now;
+        g_hash_table_insert (limit->buckets, g_strdup (peer_name), bucket);
+    } else {
+        _limit_refill (limit, bucket, now);
+    }
+    limit->stats.peers = g_hash_table_size (limit->buckets);
+
+    if (bucket->tokens < 1.0) {
+        limit->stats.rejected++;
+        return FALSE;
+    }
+    bucket->tokens -= 1.0;
+    limit->stats.admitted++;
+
+    return TRUE;
+}
+
+static void
+_limit_clear (
+        GumdDbusSchedulerLimit *limit)
+{
+    GHashTableIter iter;
+    gpointer bucket = NULL;
+
+    g_hash_table_iter_init (&iter, limit->buckets);
+    while (g_hash_table_iter_next (&iter, NULL, &bucket)) {
+        g_slice_free (GumdDbusSchedulerBucket, bucket);
+    }
+    g_hash_table_unref (limit->buckets);
+    limit->buckets = NULL;
+}
+
+static GObject*
+_constructor (GType type,
+              guint n_construct_params,
+              GObjectConstructParam *construct_params)
+{
+    GMainContext *context = g_main_context_ref_thread_default ();
+    GObject *scheduler = NULL;
+
+    G_LOCK (schedulers);
+    if (schedulers)
+        scheduler = g_hash_table_lookup (schedulers, context);
+    if (scheduler) {
+        g_object_ref (scheduler);
+    } else {
+        scheduler = G_OBJECT_CLASS (gumd_dbus_scheduler_parent_class)->
+                constructor (type, n_construct_params, construct_params);
+        if (!schedulers)
+            schedulers = g_hash_table_new (g_direct_hash, g_direct_equal);
+        g_hash_table_insert (schedulers, context, scheduler);
+    }
+    G_UNLOCK (schedulers);
+    g_main_context_unref (context);
+
+    return scheduler;
+}
+
+static void
+_dispose (GObject *object)
+{
+    GumdDbusScheduler *self = GUMD_DBUS_SCHEDULER (object);
+    gint type;
+
+    G_LOCK (schedulers);
+    if (schedulers && self->priv->context &&
+        g_hash_table_lookup (schedulers, self->priv->context) == self)
+        g_hash_table_remove (schedulers, self->priv->context);
+    G_UNLOCK (schedulers);
+
+    if (self->priv->source) {
+        g_source_destroy (self->priv->source);
+        g_source_unref (self->priv->source);
+        self->priv->source = NULL;
+    }
+
+    for (type = 0; type < GUMD_DBUS_REQUEST_MAX; type++) {
+        if (self->priv->queues[type].peers) {
+            _queue_drain (&self->priv->queues[type]);
+            g_hash_table_unref (self->priv->queues[type].peers);
+            self->priv->queues[type].peers = NULL;
+        }
+    }
+
+    for (type = 0; type < GUMD_DBUS_LIMIT_MAX; type++) {
+        if (self->priv->limits[type].buckets) {
+            _limit_clear (&self->priv->limits[type]);
+        }
+    }
+
+    if (self->priv->context) {
+        g_main_context_unref (self->priv->context);
+        self->priv->context = NULL;
+    }
+
+    G_OBJECT_CLASS (gumd_dbus_scheduler_parent_class)->dispose (object);
+}
+
+static void
+_finalize (GObject *object)
+{
+    GumdDbusScheduler *self = GUMD_DBUS_SCHEDULER (object);
+
+    g_mutex_clear (&self->priv->lock);
+
+    G_OBJECT_CLASS (gumd_dbus_scheduler_parent_class)->finalize (object);
+}
+
+static void
+gumd_dbus_scheduler_init (
+        GumdDbusScheduler *self)
+{
+    GumdDaemon *daemon = NULL;
+    GumConfig *config = NULL;
+    gint type;
+
+    self->priv = GUMD_DBUS_SCHEDULER_PRIV (self);
+    g_mutex_init (&self->priv->lock);
+    self->priv->context = g_main_context_ref_thread_default ();
+    self->priv->source = NULL;
+    for (type = 0; type < GUMD_DBUS_REQUEST_MAX; type++) {
+        _queue_init (&self->priv->queues[type]);
+    }
+
+    daemon = gumd_daemon_new ();
+    config = gumd_daemon_get_config (daemon);
+    _limit_init (&self->priv->limits[GUMD_DBUS_LIMIT_WRITE],
+            gum_config_get_int (config, GUM_CONFIG_DBUS_WRITE_RATE,
+                    GUMD_DBUS_WRITE_RATE_DEFAULT),
+            gum_config_get_int (config, GUM_CONFIG_DBUS_WRITE_BURST,
+                    GUMD_DBUS_WRITE_BURST_DEFAULT));
+    _limit_init (&self->priv->limits[GUMD_DBUS_LIMIT_CREATE],
+            gum_config_get_int (config, GUM_CONFIG_DBUS_CREATE_RATE,
+                    GUMD_DBUS_CREATE_RATE_DEFAULT),
+            gum_config_get_int (config, GUM_CONFIG_DBUS_CREATE_BURST,
+                    GUMD_DBUS_CREATE_BURST_DEFAULT));
+    g_object_unref (daemon);
+}
+
+static void
+gumd_dbus_scheduler_class_init (
+        GumdDbusSchedulerClass *klass)
+{
+    GObjectClass* object_class = G_OBJECT_CLASS (klass);
+
+    g_type_class_add_private (object_class, sizeof (GumdDbusSchedulerPrivate));
+
+    object_class->constructor = _constructor;
+    object_class->dispose = _dispose;
+    object_class->finalize = _finalize;
+}
+
+GumdDbusScheduler *
+gumd_dbus_scheduler_new ()
+{
+    return GUMD_DBUS_SCHEDULER (g_object_new (GUMD_TYPE_DBUS_SCHEDULER, NULL));
+}
+
+/*
+ * Queues the request to be run later from the scheduler's main context.
+ * Pending requests are dispatched one at a time at default priority, taking
+ * turns with the incoming messages rather than waiting for the context to go
+ * idle: reads go first, writes and heavy requests follow, and peers within a
+ * class are served round-robin. A peer having GUMD_DBUS_PEER_JOBS_MAX
+ * requests of the class queued already gets GUM_ERROR_RATE_LIMITED.
+ */
+void
+gumd_dbus_scheduler_push (
+        GumdDbusScheduler *self,
+        GumdDbusRequestType type,
+        GObject *object,
+        GDBusMethodInvocation *invocation,
+        GumdDbusSchedulerFunc func)
+{
+    GumdDbusSchedulerQueue *queue = NULL;
+    GumdDbusSchedulerPeer *peer = NULL;
+    GumdDbusSchedulerJob *job = NULL;
+    gchar *peer_name = NULL;
+
+    g_return_if_fail (self && GUMD_IS_DBUS_SCHEDULER (self));
+    g_return_if_fail (type < GUMD_DBUS_REQUEST_MAX && invocation && func);
+
+    if (type != GUMD_DBUS_REQUEST_READ &&
+        !gumd_dbus_scheduler_admit (self, GUMD_DBUS_LIMIT_WRITE, invocation))
+        return;
+
+    peer_name = _get_peer_name (invocation);
+
+    g_mutex_lock (&self->priv->lock);
+    queue = &self->priv->queues[type];
+    peer = g_hash_table_lookup (queue->peers, peer_name);
+    if (peer && g_queue_get_length (&peer->jobs) >= GUMD_DBUS_PEER_JOBS_MAX) {
+        g_mutex_unlock (&self->priv->lock);
+        DBG ("%s queue full for peer %s", _type_names[type], peer_name);
+        g_dbus_method_invocation_return_error (invocation, GUM_ERROR,
+                GUM_ERROR_RATE_LIMITED, "Too many pending requests");
+        g_free (peer_name);
+        return;
+    }
+
+    job = g_slice_new0 (GumdDbusSchedulerJob);
+    job->object = g_object_ref (object);
+    job->invocation = invocation;
+    job->func = func;
+    job->queued_at = g_get_monotonic_time ();
+
+    /* keep the adapter alive while the request is pending */
+    if (GUM_IS_DISPOSABLE (object))
+        gum_disposable_set_auto_dispose (GUM_DISPOSABLE (object), FALSE);
+
+    if (!peer) {
+        peer = g_slice_new0 (GumdDbusSchedulerPeer);
+        peer->name = peer_name;
+        g_queue_init (&peer->jobs);
+        g_hash_table_insert (queue->peers, peer->name, peer);
+        g_queue_push_tail (&queue->ring, peer);
+    } else {
+        g_free (peer_name);
+    }
+    g_queue_push_tail (&peer->jobs, job);
+
+    queue->stats.depth++;
+    if (queue->stats.depth > queue->stats.max_depth)
+        queue->stats.max_depth = queue->stats.depth;
+
+    if (!self->priv->source) {
+        self->priv->source = g_idle_source_new ();
+        g_source_set_priority (self->priv->source, G_PRIORITY_DEFAULT);
+        g_source_set_callback (self->priv->source, _dispatch, self, NULL);
+        g_source_attach (self->priv->source, self->priv->context);
+    }
+    g_mutex_unlock (&self->priv->lock);
+}
+
+/*
+ * Charges the request against the peer's token bucket for the given limit.
+ * Requests over the limit are rejected right away with GUM_ERROR_RATE_LIMITED
+ * and FALSE is returned, in which case the invocation must not be used again.
+ */
+gboolean
+gumd_dbus_scheduler_admit (
+        GumdDbusScheduler *self,
+        GumdDbusLimitType limit,
+        GDBusMethodInvocation *invocation)
+{
+    gchar *peer_name = NULL;
+    gboolean admitted = FALSE;
+
+    g_return_val_if_fail (self && GUMD_IS_DBUS_SCHEDULER (self), FALSE);
+    g_return_val_if_fail (limit < GUMD_DBUS_LIMIT_MAX && invocation, FALSE);
+
+    peer_name = _get_peer_name (invocation);
+
+    g_mutex_lock (&self->priv->lock);
+    admitted = _limit_take (&self->priv->limits[limit], peer_name);
+    g_mutex_unlock (&self->priv->lock);
+
+    if (!admitted) {
+        DBG ("%s limit exceeded by peer %s for %s", _limit_names[limit],
+                peer_name,
+                g_dbus_method_invocation_get_method_name (invocation));
+        g_dbus_method_invocation_return_error (invocation, GUM_ERROR,
+                GUM_ERROR_RATE_LIMITED, "Request rate limit exceeded");
+    }
+    g_free (peer_name);
+
+    return admitted;
+}
+
+gboolean
+gumd_dbus_scheduler_get_stats (
+        GumdDbusScheduler *self,
+        GumdDbusRequestType type,
+        GumdDbusSchedulerStats *stats)
+{
+    g_return_val_if_fail (self && GUMD_IS_DBUS_SCHEDULER (self), FALSE);
+    g_return_val_if_fail (type < GUMD_DBUS_REQUEST_MAX && stats, FALSE);
+
+    g_mutex_lock (&self->priv->lock);
+    *stats = self->priv->queues[type].stats;
+    g_mutex_unlock (&self->priv->lock);
+
+    return TRUE;
+}
+
+gboolean
+gumd_dbus_scheduler_get_limit_stats (
+        GumdDbusScheduler *self,
+        GumdDbusLimitType limit,
+        GumdDbusLimitStats *stats)
+{
+    g_return_val_if_fail (self && GUMD_IS_DBUS_SCHEDULER (self), FALSE);
+    g_return_val_if_fail (limit < GUMD_DBUS_LIMIT_MAX && stats, FALSE);
+
+    g_mutex_lock (&self->priv->lock);
+    *stats = self->priv->limits[limit].stats;
+    g_mutex_unlock (&self->priv->lock);
+
+    return TRUE;
+}
+
+static void
+_add_stats (
+        GumdDbusSchedulerStats *total,
+        const GumdDbusSchedulerStats *stats)
+{
+    total->depth += stats->depth;
+    total->max_depth = MAX (total->max_depth, stats->max_depth);
+    total->dispatched += stats->dispatched;
+    total->total_wait += stats->total_wait;
+    total->max_wait = MAX (total->max_wait, stats->max_wait);
+}
+
+/*
+ * Sums up the stats of the given class over the schedulers of all the main
+ * contexts; the maximums are the highest seen by any of them.
+ */
+void
+gumd_dbus_scheduler_get_total_stats (
+        GumdDbusRequestType type,
+        GumdDbusSchedulerStats *stats)
+{
+    GHashTableIter iter;
+    gpointer scheduler = NULL;
+    GumdDbusSchedulerPrivate *priv = NULL;
+
+    g_return_if_fail (type < GUMD_DBUS_REQUEST_MAX && stats);
+
+    memset (stats, 0, sizeof (*stats));
+
+    G_LOCK (schedulers);
+    if (schedulers) {
+        g_hash_table_iter_init (&iter, schedulers);
+        while (g_hash_table_iter_next (&iter, NULL, &scheduler)) {
+            priv = GUMD_DBUS_SCHEDULER (scheduler)->priv;
+            g_mutex_lock (&priv->lock);
+            _add_stats (stats, &priv->queues[type].stats);
+            g_mutex_unlock (&priv->lock);
+        }
+    }
+    G_UNLOCK (schedulers);
+}
+
+/*
+ * Sums up the stats of the given limit over the schedulers of all the main
+ * contexts.
+ */
+void
+gumd_dbus_scheduler_get_total_limit_stats (
+        GumdDbusLimitType limit,
+        GumdDbusLimitStats *stats)
+{
+    GHashTableIter iter;
+    gpointer scheduler = NULL;
+    GumdDbusSchedulerPrivate *priv = NULL;
+
+    g_return_if_fail (limit < GUMD_DBUS_LIMIT_MAX && stats);
+
+    memset (stats, 0, sizeof (*stats));
+
+    G_LOCK (schedulers);
+    if (schedulers) {
+        g_hash_table_iter_init (&iter, schedulers);
+        while (g_hash_table_iter_next (&iter, NULL, &scheduler)) {
+            priv = GUMD_DBUS_SCHEDULER (scheduler)->priv;
+            g_mutex_lock (&priv->lock);
+            stats->peers += priv->limits[limit].stats.peers;
+            stats->admitted += priv->limits[limit].stats.admitted;
+            stats->rejected += priv->limits[limit].stats.rejected;
+            g_mutex_unlock (&priv->lock);
+        }
+    }
+    G_UNLOCK (schedulers);
+}
+
+/*
+ * Zeroes the counters of all the schedulers, but for the requests still
+ * queued and the peers still tracked.
+ */
+void
+gumd_dbus_scheduler_reset_stats (void)
+{
+    GHashTableIter iter;
+    gpointer scheduler = NULL;
+    GumdDbusSchedulerPrivate *priv = NULL;
+    GumdDbusSchedulerStats *stats = NULL;
+    gint type;
+
+    G_LOCK (schedulers);
+    if (schedulers) {
+        g_hash_table_iter_init (&iter, schedulers);
+        while (g_hash_table_iter_next (&iter, NULL, &scheduler)) {
+            priv = GUMD_DBUS_SCHEDULER (scheduler)->priv;
+            g_mutex_lock (&priv->lock);
+            for (type = 0; type < GUMD_DBUS_REQUEST_MAX; type++) {
+                stats = &priv->queues[type].stats;
+                stats->max_depth = stats->depth;
+                stats->dispatched = 0;
+                stats->total_wait = 0;
+                stats->max_wait = 0;
+            }
+            for (type = 0; type < GUMD_DBUS_LIMIT_MAX; type++) {
+                priv->limits[type].stats.admitted = 0;
+                priv->limits[type].stats.rejected = 0;
+            }
+            g_mutex_unlock (&priv->lock);
+        }
+    }
+    G_UNLOCK (schedulers);
+}
+
+const gchar *
+gumd_dbus_scheduler_get_type_name (
+        GumdDbusRequestType type)
+{
+    g_return_val_if_fail (type < GUMD_DBUS_REQUEST_MAX, NULL);
+
+    return _type_names[type];
+}
+
+const gchar *
+gumd_dbus_scheduler_get_limit_name (
+        GumdDbusLimitType limit)
+{
+    g_return_val_if_fail (limit < GUMD_DBUS_LIMIT_MAX, NULL);
+
+    return _limit_names[limit];
+}
@@ -0,0 +1,156 @@
+/* vi: set et sw=4 ts=4 cino=t0,(0: */
+/* -*- Mode: C; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+/*
+ * This file is part of gumd
+ *
+ * Copyright (C) 2013 Intel Corporation.
+ *
+ * Contact: Imran Zaman <imran.zaman@intel.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+
+#ifndef __GUMD_DBUS_SCHEDULER_H_
+#define __GUMD_DBUS_SCHEDULER_H_
+
+#include <glib.h>
+#include <glib-object.h>
+#include <gio/gio.h>
+
+G_BEGIN_DECLS
+
+#define GUMD_TYPE_DBUS_SCHEDULER           (gumd_dbus_scheduler_get_type())
+#define GUMD_DBUS_SCHEDULER(obj)           (G_TYPE_CHECK_INSTANCE_CAST((obj),\
+        GUMD_TYPE_DBUS_SCHEDULER, GumdDbusScheduler))
+#define GUMD_DBUS_SCHEDULER_CLASS(klass)   (G_TYPE_CHECK_CLASS_CAST((klass),\
+        GUMD_TYPE_DBUS_SCHEDULER, GumdDbusSchedulerClass))
+#define GUMD_IS_DBUS_SCHEDULER(obj)        (G_TYPE_CHECK_INSTANCE_TYPE((obj),\
+        GUMD_TYPE_DBUS_SCHEDULER))
+#define GUMD_IS_DBUS_SCHEDULER_CLASS(klass) (G_TYPE_CHECK_CLASS_TYPE((klass),\
+        GUMD_TYPE_DBUS_SCHEDULER))
+#define GUMD_DBUS_SCHEDULER_GET_CLASS(obj) (G_TYPE_INSTANCE_GET_CLASS((obj),\
+        GUMD_TYPE_DBUS_SCHEDULER, GumdDbusSchedulerClass))
+
+typedef struct _GumdDbusScheduler GumdDbusScheduler;
+typedef struct _GumdDbusSchedulerClass GumdDbusSchedulerClass;
+typedef struct _GumdDbusSchedulerPrivate GumdDbusSchedulerPrivate;
+
+/* request classes in order of priority */
+typedef enum {
+    GUMD_DBUS_REQUEST_READ = 0,
+    GUMD_DBUS_REQUEST_WRITE,
+    GUMD_DBUS_REQUEST_HEAVY,
+
+    GUMD_DBUS_REQUEST_MAX
+} GumdDbusRequestType;
+
+typedef struct {
+    guint depth;            /* requests currently queued */
+    guint max_depth;        /* highest queue depth seen */
+    guint64 dispatched;     /* requests dispatched so far */
+    guint64 total_wait;     /* accumulated queueing time in microseconds */
+    guint64 max_wait;       /* longest queueing time in microseconds */
+} GumdDbusSchedulerStats;
+
+/* per peer admission limits */
+typedef enum {
+    GUMD_DBUS_LIMIT_WRITE = 0,
+    GUMD_DBUS_LIMIT_CREATE,
+
+    GUMD_DBUS_LIMIT_MAX
+} GumdDbusLimitType;
+
+typedef struct {
+    guint peers;            /* peers currently tracked */
+    guint64 admitted;       /* requests let through */
+    guint64 rejected;       /* requests rejected as over the limit */
+} GumdDbusLimitStats;
+
+/* runs a queued request; must complete or return an error on invocation,
+ * possibly later from the thread default main context */
+typedef void (*GumdDbusSchedulerFunc) (
+        GObject *object,
+        GDBusMethodInvocation *invocation);
+
+struct _GumdDbusScheduler
+{
+    GObject parent;
+
+    /* priv */
+    GumdDbusSchedulerPrivate *priv;
+};
+
+struct _GumdDbusSchedulerClass
+{
+    GObjectClass parent_class;
+};
+
+GType
+gumd_dbus_scheduler_get_type (void) G_GNUC_CONST;
+
+GumdDbusScheduler *
+gumd_dbus_scheduler_new ();
+
+void
+gumd_dbus_scheduler_push (
+        GumdDbusScheduler *self,
+        GumdDbusRequestType type,
+        GObject *object,
+        GDBusMethodInvocation *invocation,
+        GumdDbusSchedulerFunc func);
+
+gboolean
+gumd_dbus_scheduler_admit (
+        GumdDbusScheduler *self,
+        GumdDbusLimitType limit,
+        GDBusMethodInvocation *invocation);
+
+gboolean
+gumd_dbus_scheduler_get_stats (
+        GumdDbusScheduler *self,
+        GumdDbusRequestType type,
+        GumdDbusSchedulerStats *stats);
+
+gboolean
+gumd_dbus_scheduler_get_limit_stats (
+        GumdDbusScheduler *self,
+        GumdDbusLimitType limit,
+        GumdDbusLimitStats *stats);
+
+void
+gumd_dbus_scheduler_get_total_stats (
+        GumdDbusRequestType type,
+        GumdDbusSchedulerStats *stats);
+
+void
+gumd_dbus_scheduler_get_total_limit_stats (
+        GumdDbusLimitType limit,
+        GumdDbusLimitStats *stats);
+
+void
+gumd_dbus_scheduler_reset_stats (void);
+
+const gchar *
+gumd_dbus_scheduler_get_type_name (
+        GumdDbusRequestType type);
+
+const gchar *
+gumd_dbus_scheduler_get_limit_name (
+        GumdDbusLimitType limit);
+
+G_END_DECLS
+
+#endif /* __GUMD_DBUS_SCHEDULER_H_ */
@@ -36,6 +36,7 @@
 #include "gumd-dbus-server-interface.h"
 #include "gumd-dbus-user-service-adapter.h"
 #include "gumd-dbus-group-service-adapter.h"
+#include "gumd-dbus-stats-adapter.h"
 #include "daemon/core/gumd-daemon.h"
 
 enum
@@ -68,6 +69,7 @@ struct _GumdDbusServerMsgBusPrivate
     GumdDaemon *daemon;
     GumdDbusUserServiceAdapter *user_service;
     GumdDbusGroupServiceAdapter *group_service;
+    GumdDbusStatsAdapter *stats;
     guint name_owner_id;
 };
 
@@ -161,6 +163,9 @@ _on_bus_acquired (
     g_object_weak_ref (G_OBJECT (server->priv->group_service),
             _on_group_interface_dispose, server);
 
+    server->priv->stats = gumd_dbus_stats_adapter_new_with_connection (
+            connection);
+
     /* In case of session bus, privileges are dropped in the daemon start phase
      * as it is not needed. Besides in order for session bus to work, effective
      * uid/gid should be same as real uid/gid as 'set-user bit on execution(s)'
@@ -262,6 +267,7 @@ gumd_dbus_server_msg_bus_init (
     self->priv->daemon = gumd_daemon_new ();
     self->priv->user_service = NULL;
     self->priv->group_service = NULL;
+    self->priv->stats = NULL;
     self->priv->name_owner_id = 0;
 }
 
@@ -299,6 +305,8 @@ _gumd_dbus_server_msg_bus_stop (
 
     GumdDbusServerMsgBus *server = GUMD_DBUS_SERVER_MSG_BUS (self);
 
+    GUM_OBJECT_UNREF (server->priv->stats);
+
     if (server->priv->group_service) {
         g_object_weak_unref (G_OBJECT (server->priv->group_service),
                 _on_group_interface_dispose, server);
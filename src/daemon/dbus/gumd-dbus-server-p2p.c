@@ -34,6 +34,7 @@
 #include "common/gum-utils.h"
 #include "common/gum-log.h"
 #include "common/gum-defines.h"
+#include "common/gum-config.h"
 
 #include "gumd-dbus-server-p2p.h"
 #include "gumd-dbus-server-interface.h"
@@ -41,6 +42,7 @@
 #include "gumd-dbus-user-service-adapter.h"
 #include "gumd-dbus-group-adapter.h"
 #include "gumd-dbus-group-service-adapter.h"
+#include "gumd-dbus-stats-adapter.h"
 #include "daemon/core/gumd-daemon.h"
 
 enum
@@ -53,15 +55,44 @@ enum
     N_PROPERTIES
 };
 
+/* a thread with its own main context, serving a shard of the connections */
+typedef struct {
+    GThread *thread;
+    GMainContext *context;
+    GMainLoop *loop;
+    guint n_connections;
+} GumdDbusServerP2PWorker;
+
+/* hands a new connection over to a worker and waits until it is served */
+typedef struct {
+    GumdDbusServerP2P *server;
+    GDBusConnection *connection;
+    GMutex lock;
+    GCond cond;
+    gboolean done;
+} GumdDbusServerP2PStart;
+
+typedef struct {
+    GObject *user_service;
+    GObject *group_service;
+    GObject *stats;
+} GumdDbusServerP2PRelease;
+
 struct _GumdDbusServerP2PPrivate
 {
     GumdDaemon *daemon;
+    GMutex lock;        /* guards the adapter tables and worker loads */
     GHashTable *user_service_adapters;
     GHashTable *group_service_adapters;
+    GHashTable *stats_adapters;
     GDBusServer *bus_server;
     gchar *address;
+    GumdDbusServerP2PWorker *workers;
+    guint n_workers;
 };
 
+#define GUMD_DBUS_SERVER_P2P_WORKER_KEY "gumd-p2p-worker"
+
 static void
 _gumd_dbus_server_p2p_interface_init (
         GumdDbusServerInterface *iface);
@@ -148,8 +179,10 @@ _on_user_service_dispose (
 {
     GumdDbusServerP2P *server = GUMD_DBUS_SERVER_P2P (data);
     g_return_if_fail (server);
+    g_mutex_lock (&server->priv->lock);
     g_hash_table_foreach_steal (server->priv->user_service_adapters,
                 _compare_by_pointer, dead);
+    g_mutex_unlock (&server->priv->lock);
 }
 
 static void
@@ -159,8 +192,10 @@ _on_group_service_dispose (
 {
     GumdDbusServerP2P *server = GUMD_DBUS_SERVER_P2P (data);
     g_return_if_fail (server);
+    g_mutex_lock (&server->priv->lock);
     g_hash_table_foreach_steal (server->priv->group_service_adapters,
                 _compare_by_pointer, dead);
+    g_mutex_unlock (&server->priv->lock);
 }
 
 static void
@@ -197,8 +232,10 @@ _add_user_watchers (
             server);
     g_object_weak_ref (G_OBJECT (user_service), _on_user_service_dispose,
             server);
+    g_mutex_lock (&server->priv->lock);
     g_hash_table_insert (server->priv->user_service_adapters, connection,
             user_service);
+    g_mutex_unlock (&server->priv->lock);
 }
 
 static void
@@ -211,8 +248,78 @@ _add_group_watchers (
             server);
     g_object_weak_ref (G_OBJECT (group_service), _on_group_service_dispose,
             server);
+    g_mutex_lock (&server->priv->lock);
     g_hash_table_insert (server->priv->group_service_adapters, connection,
             group_service);
+    g_mutex_unlock (&server->priv->lock);
+}
+
+static gpointer
+_worker_run (
+        gpointer data)
+{
+    GumdDbusServerP2PWorker *worker = (GumdDbusServerP2PWorker *) data;
+
+    /* objects exported from this thread get their calls dispatched here */
+    g_main_context_push_thread_default (worker->context);
+    g_main_loop_run (worker->loop);
+    g_main_context_pop_thread_default (worker->context);
+
+    return NULL;
+}
+
+static gboolean
+_worker_quit (
+        gpointer data)
+{
+    g_main_loop_quit ((GMainLoop *) data);
+    return G_SOURCE_REMOVE;
+}
+
+static void
+_start_workers (
+        GumdDbusServerP2P *self)
+{
+    GumConfig *config = gumd_daemon_get_config (self->priv->daemon);
+    gint n_workers = gum_config_get_int (config, GUM_CONFIG_DBUS_P2P_WORKERS,
+            0);
+    guint i;
+
+    if (self->priv->workers || n_workers <= 0)
+        return;
+
+    DBG ("Starting %d P2P worker threads", n_workers);
+    self->priv->n_workers = (guint) n_workers;
+    self->priv->workers = g_new0 (GumdDbusServerP2PWorker, n_workers);
+    for (i = 0; i < self->priv->n_workers; i++) {
+        GumdDbusServerP2PWorker *worker = &self->priv->workers[i];
+        gchar *name = g_strdup_printf ("gumd-p2p-%u", i);
+
+        worker->context = g_main_context_new ();
+        worker->loop = g_main_loop_new (worker->context, FALSE);
+        worker->thread = g_thread_new (name, _worker_run, worker);
+        g_free (name);
+    }
+}
+
+static void
+_stop_workers (
+        GumdDbusServerP2P *self)
+{
+    guint i;
+
+    for (i = 0; i < self->priv->n_workers; i++) {
+        GumdDbusServerP2PWorker *worker = &self->priv->workers[i];
+
+        /* quit from within the loop, it may not be running yet */
+        g_main_context_invoke (worker->context, _worker_quit, worker->loop);
+        g_thread_join (worker->thread);
+        g_main_loop_unref (worker->loop);
+        g_main_context_unref (worker->context);
+    }
+    g_free (self->priv->workers);
+    self->priv->workers = NULL;
+    self->priv->n_workers = 0;
 }
 
 static void
@@ -221,6 +328,9 @@ _dispose (
 {
     GumdDbusServerP2P *self = GUMD_DBUS_SERVER_P2P (object);
 
+    /* nothing may be served from the workers while adapters go away */
+    _stop_workers (self);
+
     if (self->priv->group_service_adapters) {
         g_hash_table_foreach (self->priv->group_service_adapters,
                 _clear_group_watchers, self);
@@ -235,6 +345,8 @@ _dispose (
         self->priv->user_service_adapters = NULL;
     }
 
+    GUM_HASHTABLE_UNREF (self->priv->stats_adapters);
+
     _gumd_dbus_server_p2p_stop (GUMD_DBUS_SERVER (self));
 
     GUM_OBJECT_UNREF (self->priv->daemon);
@@ -247,6 +359,8 @@ _finalize (
         GObject *object)
 {
     GumdDbusServerP2P *self = GUMD_DBUS_SERVER_P2P (object);
+
+    g_mutex_clear (&self->priv->lock);
     if (self->priv->address) {
         if (g_str_has_prefix (self->priv->address, "unix:path=")) {
             const gchar *path = g_strstr_len(self->priv->address, -1,
@@ -292,11 +406,35 @@ gumd_dbus_server_p2p_init (
     self->priv = GUMD_DBUS_SERVER_P2P_GET_PRIV(self);
     self->priv->bus_server = NULL;
     self->priv->address = NULL;
+    self->priv->workers = NULL;
+    self->priv->n_workers = 0;
+    g_mutex_init (&self->priv->lock);
     self->priv->daemon = gumd_daemon_new ();
     self->priv->user_service_adapters = g_hash_table_new_full (g_direct_hash,
             g_direct_equal, NULL, g_object_unref);
     self->priv->group_service_adapters = g_hash_table_new_full (g_direct_hash,
             g_direct_equal, NULL, g_object_unref);
+    self->priv->stats_adapters = g_hash_table_new_full (g_direct_hash,
+            g_direct_equal, NULL, g_object_unref);
+}
+
+static gboolean
+_release_in_worker (
+        gpointer data)
+{
+    /* the actual release happens in _release_free () once the source is
+     * destroyed, which also covers workers stopped before getting here */
+    return G_SOURCE_REMOVE;
+}
+
+static void
+_release_free (
+        GumdDbusServerP2PRelease *release)
+{
+    GUM_OBJECT_UNREF (release->user_service);
+    GUM_OBJECT_UNREF (release->group_service);
+    GUM_OBJECT_UNREF (release->stats);
+    g_slice_free (GumdDbusServerP2PRelease, release);
 }
 
 static void
@@ -307,24 +445,60 @@ _on_connection_closed (
         gpointer user_data)
 {
     GumdDbusServerP2P *server = GUMD_DBUS_SERVER_P2P (user_data);
-    gpointer service = g_hash_table_lookup (server->priv->user_service_adapters,
+    GumdDbusServerP2PWorker *worker = NULL;
+    GumdDbusServerP2PRelease *release = g_slice_new0 (
+            GumdDbusServerP2PRelease);
+    gpointer service = NULL;
+
+    /* steal under the lock, release outside of it: the weak ref notifies
+     * take the lock again */
+    g_mutex_lock (&server->priv->lock);
+    service = g_hash_table_lookup (server->priv->user_service_adapters,
             connection);
     if  (service) {
-        _clear_user_watchers (connection, service, user_data);
-        DBG("P2P dbus connection(%p) user service closed (peer vanished : %d)"
-                " with error: %s", connection, remote_peer_vanished,
-                error ? error->message : "NONE");
-        g_hash_table_remove (server->priv->user_service_adapters, connection);
+        g_hash_table_steal (server->priv->user_service_adapters, connection);
+        release->user_service = G_OBJECT (service);
     }
 
     service = g_hash_table_lookup (server->priv->group_service_adapters,
             connection);
     if  (service) {
-        _clear_group_watchers (connection, service, user_data);
+        g_hash_table_steal (server->priv->group_service_adapters, connection);
+        release->group_service = G_OBJECT (service);
+    }
+
+    service = g_hash_table_lookup (server->priv->stats_adapters, connection);
+    if  (service) {
+        g_hash_table_steal (server->priv->stats_adapters, connection);
+        release->stats = G_OBJECT (service);
+    }
+
+    worker = g_object_get_data (G_OBJECT (connection),
+            GUMD_DBUS_SERVER_P2P_WORKER_KEY);
+    if (worker && (release->user_service || release->group_service))
+        worker->n_connections--;
+    g_mutex_unlock (&server->priv->lock);
+
+    if (release->user_service) {
+        _clear_user_watchers (connection, release->user_service, user_data);
+        DBG("P2P dbus connection(%p) user service closed (peer vanished : %d)"
+                " with error: %s", connection, remote_peer_vanished,
+                error ? error->message : "NONE");
+    }
+
+    if (release->group_service) {
+        _clear_group_watchers (connection, release->group_service, user_data);
         DBG("P2P dbus connection(%p) group_service closed (peer vanished : %d)"
                 " with error: %s", connection, remote_peer_vanished,
                 error ? error->message : "NONE");
-        g_hash_table_remove (server->priv->group_service_adapters, connection);
+    }
+
+    if (worker) {
+        /* adapters are torn down in the thread serving them */
+        g_main_context_invoke_full (worker->context, G_PRIORITY_DEFAULT,
+                _release_in_worker, release, (GDestroyNotify)_release_free);
+    } else {
+        _release_free (release);
     }
 }
 
@@ -335,6 +509,7 @@ _gumd_dbus_server_p2p_start_user_service (
 {
     GumdDbusUserServiceAdapter *user_service = NULL;
     GumdDbusGroupServiceAdapter *group_service = NULL;
+    GumdDbusStatsAdapter *stats = NULL;
 
     DBG("Export interfaces on connection %p", connection);
 
@@ -345,6 +520,72 @@ _gumd_dbus_server_p2p_start_user_service (
     group_service = gumd_dbus_group_service_adapter_new_with_connection (
             connection, server->priv->daemon, GUMD_DBUS_SERVER_BUSTYPE_P2P);
     _add_group_watchers (connection, group_service, server);
+
+    /* not disposable, so only released along with the connection */
+    stats = gumd_dbus_stats_adapter_new_with_connection (connection);
+    if (stats) {
+        g_mutex_lock (&server->priv->lock);
+        g_hash_table_insert (server->priv->stats_adapters, connection, stats);
+        g_mutex_unlock (&server->priv->lock);
+    }
+}
+
+static gboolean
+_start_in_worker (
+        gpointer data)
+{
+    GumdDbusServerP2PStart *start = (GumdDbusServerP2PStart *) data;
+
+    _gumd_dbus_server_p2p_start_user_service (start->server,
+            start->connection);
+
+    g_mutex_lock (&start->lock);
+    start->done = TRUE;
+    g_cond_signal (&start->cond);
+    g_mutex_unlock (&start->lock);
+
+    return G_SOURCE_REMOVE;
+}
+
+static void
+_gumd_dbus_server_p2p_start_user_service_in_worker (
+        GumdDbusServerP2P *server,
+        GDBusConnection *connection)
+{
+    GumdDbusServerP2PWorker *worker = NULL;
+    GumdDbusServerP2PStart start;
+    guint i;
+
+    g_mutex_lock (&server->priv->lock);
+    worker = &server->priv->workers[0];
+    for (i = 1; i < server->priv->n_workers; i++) {
+        if (server->priv->workers[i].n_connections < worker->n_connections)
+            worker = &server->priv->workers[i];
+    }
+    worker->n_connections++;
+    g_mutex_unlock (&server->priv->lock);
+
+    DBG ("Serving connection %p from worker %p", connection, worker->thread);
+    g_object_set_data (G_OBJECT (connection), GUMD_DBUS_SERVER_P2P_WORKER_KEY,
+            worker);
+
+    /* interfaces have to be exported before returning, as the connection
+     * starts processing messages right after */
+    start.server = server;
+    start.connection = connection;
+    start.done = FALSE;
+    g_mutex_init (&start.lock);
+    g_cond_init (&start.cond);
+
+    g_main_context_invoke (worker->context, _start_in_worker, &start);
+
+    g_mutex_lock (&start.lock);
+    while (!start.done)
+        g_cond_wait (&start.cond, &start.lock);
+    g_mutex_unlock (&start.lock);
+
+    g_cond_clear (&start.cond);
+    g_mutex_clear (&start.lock);
 }
 
 static gboolean
@@ -358,7 +599,12 @@ _on_client_request (
         WARN ("memory corruption");
         return TRUE;
     }
-    _gumd_dbus_server_p2p_start_user_service (server, connection);
+    if (server->priv->n_workers > 0) {
+        _gumd_dbus_server_p2p_start_user_service_in_worker (server,
+                connection);
+    } else {
+        _gumd_dbus_server_p2p_start_user_service (server, connection);
+    }
     return TRUE;
 }
 
@@ -390,6 +636,8 @@ _gumd_dbus_server_p2p_start (
                 G_CALLBACK(_on_client_request), server);
     }
 
+    _start_workers (server);
+
     if (!g_dbus_server_is_active (server->priv->bus_server)) {
         const gchar *path = NULL;
         g_dbus_server_start (server->priv->bus_server);
@@ -0,0 +1,397 @@
+/* vi: set et sw=4 ts=4 cino=t0,(0: */
+/* -*- Mode: C; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+/*
+ * This file is part of gumd
+ *
+ * Copyright (C) 2013 Intel Corporation.
+ *
+ * Contact: Imran Zaman <imran.zaman@intel.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+
+#include "config.h"
+
+#include "common/gum-log.h"
+#include "common/gum-dbus.h"
+#include "common/gum-defines.h"
+#include "common/gum-stats.h"
+#include "common/gum-trace.h"
+
+#include "gumd-dbus-stats-adapter.h"
+#include "gumd-dbus-scheduler.h"
+
+enum
+{
+    PROP_0,
+
+    PROP_CONNECTION,
+
+    N_PROPERTIES
+};
+
+static GParamSpec *properties[N_PROPERTIES];
+
+/* method calls waiting for their reply, shared with the message filter which
+ * may outlive the adapter for a while as it runs in the GDBus worker thread */
+typedef struct
+{
+    GMutex lock;
+    GHashTable *pending; //(sender/serial:GumdDbusStatsCall)
+} GumdDbusStatsCalls;
+
+typedef struct
+{
+    gchar *name;
+    gint64 start_time;
+} GumdDbusStatsCall;
+
+struct _GumdDbusStatsAdapterPrivate
+{
+    GDBusConnection *connection;
+    GumDbusStats *dbus_stats;
+    guint filter_id;
+};
+
+G_DEFINE_TYPE (GumdDbusStatsAdapter, gumd_dbus_stats_adapter, G_TYPE_OBJECT)
+
+#define GUMD_DBUS_STATS_ADAPTER_GET_PRIV(obj) \
+    G_TYPE_INSTANCE_GET_PRIVATE ((obj), GUMD_TYPE_STATS_ADAPTER, \
+            GumdDbusStatsAdapterPrivate)
+
+static gboolean
+_handle_get_stats (
+        GumdDbusStatsAdapter *self,
+        GDBusMethodInvocation *invocation,
+        gpointer user_data);
+
+static gboolean
+_handle_get_queue_stats (
+        GumdDbusStatsAdapter *self,
+        GDBusMethodInvocation *invocation,
+        gpointer user_data);
+
+static gboolean
+_handle_get_limit_stats (
+        GumdDbusStatsAdapter *self,
+        GDBusMethodInvocation *invocation,
+        gpointer user_data);
+
+static gboolean
+_handle_reset (
+        GumdDbusStatsAdapter *self,
+        GDBusMethodInvocation *invocation,
+        gpointer user_data);
+
+static void
+_set_property (
+        GObject *object,
+        guint property_id,
+        const GValue *value,
+        GParamSpec *pspec)
+{
+    GumdDbusStatsAdapter *self = GUMD_DBUS_STATS_ADAPTER (object);
+
+    switch (property_id) {
+        case PROP_CONNECTION:
+            self->priv->connection = g_value_dup_object (value);
+            break;
+        default:
+            G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
+    }
+}
+
+static void
+_get_property (
+        GObject *object,
+        guint property_id,
+        GValue *value,
+        GParamSpec *pspec)
+{
+    GumdDbusStatsAdapter *self = GUMD_DBUS_STATS_ADAPTER (object);
+
+    switch (property_id) {
+        case PROP_CONNECTION:
+            g_value_set_object (value, self->priv->connection);
+            break;
+        default:
+            G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
+    }
+}
+
+static void
+_call_free (
+        GumdDbusStatsCall *call)
+{
+    g_free (call->name);
+    g_slice_free (GumdDbusStatsCall, call);
+}
+
+static GumdDbusStatsCalls *
+_calls_new (void)
+{
+    GumdDbusStatsCalls *calls = g_slice_new0 (GumdDbusStatsCalls);
+
+    g_mutex_init (&calls->lock);
+    calls->pending = g_hash_table_new_full (g_str_hash, g_str_equal, g_free,
+            (GDestroyNotify) _call_free);
+    return calls;
+}
+
+static void
+_calls_free (
+        GumdDbusStatsCalls *calls)
+{
+    g_hash_table_unref (calls->pending);
+    g_mutex_clear (&calls->lock);
+    g_slice_free (GumdDbusStatsCalls, calls);
+}
+
+static GDBusMessage *
+_on_message (
+        GDBusConnection *connection,
+        GDBusMessage *message,
+        gboolean incoming,
+        gpointer user_data)
+{
+    GumdDbusStatsCalls *calls = (GumdDbusStatsCalls *) user_data;
+    GDBusMessageType type = g_dbus_message_get_message_type (message);
+    GumdDbusStatsCall *call = NULL;
+    const gchar *peer = NULL;
+    const gchar *interface = NULL;
+    gchar *key = NULL;
+
+    /* a method call is timed from its arrival until its reply is sent, which
+     * covers the time spent queued as well as in the handler */
+    if (incoming && type == G_DBUS_MESSAGE_TYPE_METHOD_CALL) {
+        interface = g_dbus_message_get_interface (message);
+        if (!interface ||
+            !g_str_has_prefix (interface, GUM_SERVICE_PREFIX ".") ||
+            (g_dbus_message_get_flags (message) &
+                    G_DBUS_MESSAGE_FLAGS_NO_REPLY_EXPECTED)) {
+            return message;
+        }
+        peer = g_dbus_message_get_sender (message);
+        key = g_strdup_printf ("%s/%u", peer ? peer : "",
+                g_dbus_message_get_serial (message));
+
+        call = g_slice_new (GumdDbusStatsCall);
+        call->start_time = g_get_monotonic_time ();
+        call->name = g_strdup_printf ("dbus.%s.%s",
+                interface + sizeof (GUM_SERVICE_PREFIX),
+                g_dbus_message_get_member (message));
+        GUM_TRACE2 (dbus_call__start, call->name,
+                g_dbus_message_get_serial (message));
+
+        g_mutex_lock (&calls->lock);
+        g_hash_table_replace (calls->pending, key, call);
+        g_mutex_unlock (&calls->lock);
+    } else if (!incoming && (type == G_DBUS_MESSAGE_TYPE_METHOD_RETURN ||
+               type == G_DBUS_MESSAGE_TYPE_ERROR)) {
+        peer = g_dbus_message_get_destination (message);
+        key = g_strdup_printf ("%s/%u", peer ? peer : "",
+                g_dbus_message_get_reply_serial (message));
+
+        g_mutex_lock (&calls->lock);
+        if (g_hash_table_lookup_extended (calls->pending, key, NULL,
+                (gpointer *) &call)) {
+            g_hash_table_steal (calls->pending, key);
+        }
+        g_mutex_unlock (&calls->lock);
+        g_free (key);
+
+        if (call) {
+            gum_stats_record (call->name, call->start_time,
+                    type == G_DBUS_MESSAGE_TYPE_ERROR);
+            GUM_TRACE4 (dbus_call__done, call->name,
+                    g_dbus_message_get_reply_serial (message),
+                    type == G_DBUS_MESSAGE_TYPE_ERROR,
+                    g_get_monotonic_time () - call->start_time);
+            _call_free (call);
+        }
+    }
+
+    return message;
+}
+
+static void
+_dispose (
+        GObject *object)
+{
+    GumdDbusStatsAdapter *self = GUMD_DBUS_STATS_ADAPTER (object);
+
+    if (self->priv->filter_id) {
+        g_dbus_connection_remove_filter (self->priv->connection,
+                self->priv->filter_id);
+        self->priv->filter_id = 0;
+    }
+
+    if (self->priv->dbus_stats) {
+        g_dbus_interface_skeleton_unexport (G_DBUS_INTERFACE_SKELETON (
+                self->priv->dbus_stats));
+        g_object_unref (self->priv->dbus_stats);
+        self->priv->dbus_stats = NULL;
+    }
+
+    GUM_OBJECT_UNREF (self->priv->connection);
+
+    G_OBJECT_CLASS (gumd_dbus_stats_adapter_parent_class)->dispose (object);
+}
+
+static void
+gumd_dbus_stats_adapter_class_init (
+        GumdDbusStatsAdapterClass *klass)
+{
+    GObjectClass* object_class = G_OBJECT_CLASS (klass);
+
+    g_type_class_add_private (object_class,
+            sizeof (GumdDbusStatsAdapterPrivate));
+
+    object_class->get_property = _get_property;
+    object_class->set_property = _set_property;
+    object_class->dispose = _dispose;
+
+    properties[PROP_CONNECTION] = g_param_spec_object (
+            "connection",
+            "Bus connection",
+            "DBus connection used",
+            G_TYPE_DBUS_CONNECTION,
+            G_PARAM_READWRITE | G_PARAM_CONSTRUCT_ONLY);
+
+    g_object_class_install_properties (object_class, N_PROPERTIES, properties);
+}
+
+static void
+gumd_dbus_stats_adapter_init (
+        GumdDbusStatsAdapter *self)
+{
+    self->priv = GUMD_DBUS_STATS_ADAPTER_GET_PRIV (self);
+
+    self->priv->connection = NULL;
+    self->priv->filter_id = 0;
+    self->priv->dbus_stats = gum_dbus_stats_skeleton_new ();
+}
+
+static gboolean
+_handle_get_stats (
+        GumdDbusStatsAdapter *self,
+        GDBusMethodInvocation *invocation,
+        gpointer user_data)
+{
+    gum_dbus_stats_complete_get_stats (self->priv->dbus_stats, invocation,
+            gum_stats_to_variant ());
+    return TRUE;
+}
+
+static gboolean
+_handle_get_queue_stats (
+        GumdDbusStatsAdapter *self,
+        GDBusMethodInvocation *invocation,
+        gpointer user_data)
+{
+    GVariantBuilder builder;
+    GumdDbusSchedulerStats stats;
+    gint type;
+
+    g_variant_builder_init (&builder, G_VARIANT_TYPE ("a{s(uuttt)}"));
+    for (type = 0; type < GUMD_DBUS_REQUEST_MAX; type++) {
+        gumd_dbus_scheduler_get_total_stats (type, &stats);
+        g_variant_builder_add (&builder, "{s(uuttt)}",
+                gumd_dbus_scheduler_get_type_name (type), stats.depth,
+                stats.max_depth, stats.dispatched, stats.total_wait,
+                stats.max_wait);
+    }
+    gum_dbus_stats_complete_get_queue_stats (self->priv->dbus_stats,
+            invocation, g_variant_builder_end (&builder));
+    return TRUE;
+}
+
+static gboolean
+_handle_get_limit_stats (
+        GumdDbusStatsAdapter *self,
+        GDBusMethodInvocation *invocation,
+        gpointer user_data)
+{
+    GVariantBuilder builder;
+    GumdDbusLimitStats stats;
+    gint limit;
+
+    g_variant_builder_init (&builder, G_VARIANT_TYPE ("a{s(utt)}"));
+    for (limit = 0; limit < GUMD_DBUS_LIMIT_MAX; limit++) {
+        gumd_dbus_scheduler_get_total_limit_stats (limit, &stats);
+        g_variant_builder_add (&builder, "{s(utt)}",
+                gumd_dbus_scheduler_get_limit_name (limit), stats.peers,
+                stats.admitted, stats.rejected);
+    }
+    gum_dbus_stats_complete_get_limit_stats (self->priv->dbus_stats,
+            invocation, g_variant_builder_end (&builder));
+    return TRUE;
+}
+
+static gboolean
+_handle_reset (
+        GumdDbusStatsAdapter *self,
+        GDBusMethodInvocation *invocation,
+        gpointer user_data)
+{
+    DBG ("Resetting stats");
+    gum_stats_reset ();
+    gumd_dbus_scheduler_reset_stats ();
+    gum_dbus_stats_complete_reset (self->priv->dbus_stats, invocation);
+    return TRUE;
+}
+
+GumdDbusStatsAdapter *
+gumd_dbus_stats_adapter_new_with_connection (
+        GDBusConnection *bus_connection)
+{
+    GError *err = NULL;
+    GumdDbusStatsAdapter *adapter = GUMD_DBUS_STATS_ADAPTER (
+        g_object_new (GUMD_TYPE_STATS_ADAPTER,
+            "connection", bus_connection,
+            NULL));
+
+    g_signal_connect_swapped (adapter->priv->dbus_stats,
+        "handle-get-stats", G_CALLBACK (_handle_get_stats), adapter);
+    g_signal_connect_swapped (adapter->priv->dbus_stats,
+        "handle-get-queue-stats", G_CALLBACK (_handle_get_queue_stats),
+        adapter);
+    g_signal_connect_swapped (adapter->priv->dbus_stats,
+        "handle-get-limit-stats", G_CALLBACK (_handle_get_limit_stats),
+        adapter);
+    g_signal_connect_swapped (adapter->priv->dbus_stats,
+        "handle-reset", G_CALLBACK (_handle_reset), adapter);
+
+    if (!g_dbus_interface_skeleton_export (
+            G_DBUS_INTERFACE_SKELETON (adapter->priv->dbus_stats),
+            adapter->priv->connection, GUM_STATS_OBJECTPATH, &err)) {
+        WARN ("failed to register object: %s", err->message);
+        g_error_free (err);
+        g_object_unref (adapter);
+        return NULL;
+    }
+
+    /* all methods of all the interfaces are timed in one place, rather than
+     * in each of the handlers */
+    adapter->priv->filter_id = g_dbus_connection_add_filter (
+            adapter->priv->connection, _on_message, _calls_new (),
+            (GDestroyNotify) _calls_free);
+
+    DBG("(+) started stats interface '%p' at path '%s' on connection '%p'",
+            adapter, GUM_STATS_OBJECTPATH, bus_connection);
+
+    return adapter;
+}
@@ -29,6 +29,7 @@
 #include "common/gum-error.h"
 
 #include "gumd-dbus-user-adapter.h"
+#include "gumd-dbus-scheduler.h"
 #include "daemon/core/gumd-daemon.h"
 
 enum
@@ -50,6 +51,7 @@ struct _GumdDbusUserAdapterPrivate
     GumDbusUser *dbus_user;
     const gchar *prop_name_in_change;
     GumdDaemon *daemon;
+    GumdDbusScheduler *scheduler;
 };
 
 G_DEFINE_TYPE (GumdDbusUserAdapter, gumd_dbus_user_adapter, \
@@ -117,6 +119,7 @@ _dispose (
     DBG ("user adapter (%p) dispose beg", object);
 
     GUM_OBJECT_UNREF (self->priv->daemon);
+    GUM_OBJECT_UNREF (self->priv->scheduler);
     GUM_OBJECT_UNREF (self->priv->user);
 
     if (self->priv->dbus_user) {
@@ -249,17 +252,16 @@ _sync_user_properties(
     g_free (properties);
 }
 
-static gboolean
-_handle_add_user (
+static void
+_add_user (
         GumdDbusUserAdapter *self,
-        GDBusMethodInvocation *invocation,
-        gpointer user_data)
+        GDBusMethodInvocation *invocation)
 {
     GError *error = NULL;
     gboolean rval = FALSE;
     uid_t uid = GUM_USER_INVALID_UID;
 
-    g_return_val_if_fail (self && GUMD_IS_DBUS_USER_ADAPTER(self), FALSE);
+    g_return_if_fail (self && GUMD_IS_DBUS_USER_ADAPTER(self));
 
     gum_disposable_set_auto_dispose (GUM_DISPOSABLE (self), FALSE);
 
@@ -279,47 +281,86 @@ _handle_add_user (
     }
 
     gum_disposable_set_auto_dispose (GUM_DISPOSABLE (self), TRUE);
-
-    return TRUE;
 }
 
 static gboolean
-_handle_delete_user (
+_handle_add_user (
         GumdDbusUserAdapter *self,
         GDBusMethodInvocation *invocation,
-        gboolean rem_home_dir,
         gpointer user_data)
 {
-    GError *error = NULL;
+    gumd_dbus_scheduler_push (self->priv->scheduler, GUMD_DBUS_REQUEST_HEAVY,
+            G_OBJECT (self), invocation,
+            (GumdDbusSchedulerFunc)_add_user);
+    return TRUE;
+}
 
-    g_return_val_if_fail (self && GUMD_IS_DBUS_USER_ADAPTER(self), FALSE);
+static void
+_on_user_deleted (
+        GumdDaemon *daemon,
+        GumdDaemonUser *user,
+        const GError *error,
+        gpointer user_data)
+{
+    GDBusMethodInvocation *invocation = G_DBUS_METHOD_INVOCATION (user_data);
+    GumdDbusUserAdapter *self = g_object_get_data (G_OBJECT (invocation),
+            "adapter");
 
-    gum_disposable_set_auto_dispose (GUM_DISPOSABLE (self), FALSE);
-    if (gumd_daemon_delete_user (self->priv->daemon, self->priv->user,
-            rem_home_dir, &error)) {
+    if (!error) {
         gum_dbus_user_complete_delete_user (self->priv->dbus_user, invocation);
         gum_disposable_set_auto_dispose (GUM_DISPOSABLE (self), TRUE);
         /* delete successful so not needed anymore */
         gum_disposable_delete_later (GUM_DISPOSABLE (self));
     } else {
         g_dbus_method_invocation_return_gerror (invocation, error);
-        g_error_free (error);
         gum_disposable_set_auto_dispose (GUM_DISPOSABLE (self), TRUE);
     }
+    g_object_unref (invocation);
+}
 
-    return TRUE;
+/* completed once the sessions of the user are gone, so that its uid is not
+ * freed while its processes still run */
+static void
+_delete_user (
+        GumdDbusUserAdapter *self,
+        GDBusMethodInvocation *invocation)
+{
+    gboolean rem_home_dir = FALSE;
+
+    g_return_if_fail (self && GUMD_IS_DBUS_USER_ADAPTER(self));
+
+    g_variant_get (g_dbus_method_invocation_get_parameters (invocation),
+            "(b)", &rem_home_dir);
+
+    gum_disposable_set_auto_dispose (GUM_DISPOSABLE (self), FALSE);
+    g_object_set_data_full (G_OBJECT (invocation), "adapter",
+            g_object_ref (self), g_object_unref);
+    gumd_daemon_delete_user_async (self->priv->daemon, self->priv->user,
+            rem_home_dir, _on_user_deleted, g_object_ref (invocation));
 }
 
 static gboolean
-_handle_update_user (
+_handle_delete_user (
         GumdDbusUserAdapter *self,
         GDBusMethodInvocation *invocation,
+        gboolean rem_home_dir,
         gpointer user_data)
+{
+    gumd_dbus_scheduler_push (self->priv->scheduler, GUMD_DBUS_REQUEST_HEAVY,
+            G_OBJECT (self), invocation,
+            (GumdDbusSchedulerFunc)_delete_user);
+    return TRUE;
+}
+
+static void
+_update_user (
+        GumdDbusUserAdapter *self,
+        GDBusMethodInvocation *invocation)
 {
     GError *error = NULL;
     gboolean rval = FALSE;
 
-    g_return_val_if_fail (self && GUMD_IS_DBUS_USER_ADAPTER(self), FALSE);
+    g_return_if_fail (self && GUMD_IS_DBUS_USER_ADAPTER(self));
 
     gum_disposable_set_auto_dispose (GUM_DISPOSABLE (self), FALSE);
 
@@ -338,7 +379,17 @@ _handle_update_user (
     }
 
     gum_disposable_set_auto_dispose (GUM_DISPOSABLE (self), TRUE);
+}
 
+static gboolean
+_handle_update_user (
+        GumdDbusUserAdapter *self,
+        GDBusMethodInvocation *invocation,
+        gpointer user_data)
+{
+    gumd_dbus_scheduler_push (self->priv->scheduler, GUMD_DBUS_REQUEST_WRITE,
+            G_OBJECT (self), invocation,
+            (GumdDbusSchedulerFunc)_update_user);
     return TRUE;
 }
 
@@ -353,6 +404,7 @@ gumd_dbus_user_adapter_init (
     self->priv->dbus_user = gum_dbus_user_skeleton_new ();
     self->priv->prop_name_in_change = NULL;
     self->priv->daemon = gumd_daemon_new ();
+    self->priv->scheduler = gumd_dbus_scheduler_new ();
 }
 
 GumdDbusUserAdapter *
@@ -24,13 +24,19 @@
  */
 
 #include "config.h"
+#include <unistd.h>
+#include <gio/gunixfdlist.h>
+
 #include "common/gum-log.h"
 #include "common/gum-error.h"
+#include "common/gum-config.h"
 #include "common/gum-dbus.h"
 #include "common/gum-defines.h"
 #include "common/gum-string-utils.h"
+#include "common/gum-utils.h"
 
 #include "gumd-dbus-user-service-adapter.h"
+#include "gumd-dbus-scheduler.h"
 #include "gumd-dbus-user-adapter.h"
 
 enum
@@ -46,6 +52,8 @@ enum
 
 static GParamSpec *properties[N_PROPERTIES];
 
+#define GUMD_DBUS_CHANGE_SIGNAL_DELAY_DEFAULT 100
+
 typedef struct
 {
     gchar *peer_name;
@@ -58,9 +66,17 @@ struct _GumdDbusUserServiceAdapterPrivate
     GDBusConnection *connection;
     GumDbusUserService *dbus_user_service;
     GumdDaemon  *daemon;
+    GumdDbusScheduler *scheduler;
     GumdDbusServerBusType  dbus_server_type;
+    GMutex cache_lock; /* guards peer_users and caller_watchers */
     GList *peer_users;
     GHashTable *caller_watchers; //(dbus_caller:watcher_id)
+    gboolean threaded_reads;
+    GMainContext *context;
+    GMutex batch_lock;  /* guards the pending usersChanged batch */
+    GHashTable *batch;  //(uid:GumdDaemonChangeOp)
+    GSource *batch_source;
+    guint batch_delay;
 };
 
 G_DEFINE_TYPE (GumdDbusUserServiceAdapter, gumd_dbus_user_service_adapter, \
@@ -97,6 +113,28 @@ _handle_get_user_list (
         const gchar *const *types,
         gpointer user_data);
 
+static gboolean
+_handle_get_changes_since (
+        GumdDbusUserServiceAdapter *self,
+        GDBusMethodInvocation *invocation,
+        guint64 since,
+        gpointer user_data);
+
+static gboolean
+_handle_get_user_list_fd (
+        GumdDbusUserServiceAdapter *self,
+        GDBusMethodInvocation *invocation,
+        GUnixFDList *fd_list,
+        const gchar *const *types,
+        gpointer user_data);
+
+static gboolean
+_handle_get_snapshot (
+        GumdDbusUserServiceAdapter *self,
+        GDBusMethodInvocation *invocation,
+        GUnixFDList *fd_list,
+        gpointer user_data);
+
 static void
 _on_dbus_user_adapter_disposed (
         gpointer data,
@@ -153,6 +191,126 @@ _get_property (
     }
 }
 
+static GVariant *
+_ids_to_variant (
+        GArray *ids)
+{
+    return g_variant_new_fixed_array (G_VARIANT_TYPE_UINT32, ids->data,
+            ids->len, sizeof (guint32));
+}
+
+static gboolean
+_flush_changes (
+        gpointer user_data)
+{
+    GumdDbusUserServiceAdapter *self = GUMD_DBUS_USER_SERVICE_ADAPTER (
+            user_data);
+    GHashTable *batch = NULL;
+    GHashTableIter iter;
+    gpointer key = NULL, value = NULL;
+    GArray *added = NULL, *updated = NULL, *removed = NULL;
+    guint32 id = 0;
+
+    g_mutex_lock (&self->priv->batch_lock);
+    batch = self->priv->batch;
+    self->priv->batch = NULL;
+    if (self->priv->batch_source) {
+        g_source_unref (self->priv->batch_source);
+        self->priv->batch_source = NULL;
+    }
+    g_mutex_unlock (&self->priv->batch_lock);
+
+    /* changes cancelled each other out */
+    if (!batch || g_hash_table_size (batch) == 0) {
+        GUM_HASHTABLE_UNREF (batch);
+        return FALSE;
+    }
+
+    added = g_array_new (FALSE, FALSE, sizeof (guint32));
+    updated = g_array_new (FALSE, FALSE, sizeof (guint32));
+    removed = g_array_new (FALSE, FALSE, sizeof (guint32));
+    g_hash_table_iter_init (&iter, batch);
+    while (g_hash_table_iter_next (&iter, &key, &value)) {
+        id = GPOINTER_TO_UINT (key);
+        switch (GPOINTER_TO_UINT (value)) {
+            case GUMD_DAEMON_CHANGE_ADDED:
+                g_array_append_val (added, id);
+                break;
+            case GUMD_DAEMON_CHANGE_DELETED:
+                g_array_append_val (removed, id);
+                break;
+            default:
+                g_array_append_val (updated, id);
+        }
+    }
+    g_hash_table_unref (batch);
+
+    DBG ("users changed: %u added, %u updated, %u removed", added->len,
+            updated->len, removed->len);
+    gum_dbus_user_service_emit_users_changed (self->priv->dbus_user_service,
+            _ids_to_variant (added), _ids_to_variant (updated),
+            _ids_to_variant (removed));
+
+    g_array_free (added, TRUE);
+    g_array_free (updated, TRUE);
+    g_array_free (removed, TRUE);
+
+    return FALSE;
+}
+
+/* daemon signals may come from any thread; the batch is flushed from the
+ * context the adapter was created in */
+static void
+_queue_change (
+        GumdDbusUserServiceAdapter *self,
+        GumdDaemonChangeOp op,
+        guint id)
+{
+    guint old_op = 0, new_op = 0;
+
+    g_mutex_lock (&self->priv->batch_lock);
+    if (self->priv->batch_delay == 0) {
+        g_mutex_unlock (&self->priv->batch_lock);
+        return;
+    }
+
+    if (!self->priv->batch) {
+        self->priv->batch = g_hash_table_new (g_direct_hash, g_direct_equal);
+    }
+
+    /* fold the change into what is already pending for this user */
+    old_op = GPOINTER_TO_UINT (g_hash_table_lookup (self->priv->batch,
+            GUINT_TO_POINTER (id)));
+    switch (op) {
+        case GUMD_DAEMON_CHANGE_ADDED:
+            /* id reused within the window */
+            new_op = old_op == GUMD_DAEMON_CHANGE_DELETED ?
+                    GUMD_DAEMON_CHANGE_UPDATED : GUMD_DAEMON_CHANGE_ADDED;
+            break;
+        case GUMD_DAEMON_CHANGE_DELETED:
+            new_op = old_op == GUMD_DAEMON_CHANGE_ADDED ?
+                    0 : GUMD_DAEMON_CHANGE_DELETED;
+            break;
+        default:
+            new_op = old_op ? old_op : GUMD_DAEMON_CHANGE_UPDATED;
+    }
+    if (new_op) {
+        g_hash_table_insert (self->priv->batch, GUINT_TO_POINTER (id),
+                GUINT_TO_POINTER (new_op));
+    } else {
+        g_hash_table_remove (self->priv->batch, GUINT_TO_POINTER (id));
+    }
+
+    if (!self->priv->batch_source) {
+        self->priv->batch_source = g_timeout_source_new (
+                self->priv->batch_delay);
+        g_source_set_callback (self->priv->batch_source, _flush_changes, self,
+                NULL);
+        g_source_attach (self->priv->batch_source, self->priv->context);
+    }
+    g_mutex_unlock (&self->priv->batch_lock);
+}
+
 static void
 _on_user_added (
         GObject *object,
@@ -162,6 +320,7 @@ _on_user_added (
     GumdDbusUserServiceAdapter *self = GUMD_DBUS_USER_SERVICE_ADAPTER (
             user_data);
     gum_dbus_user_service_emit_user_added (self->priv->dbus_user_service, uid);
+    _queue_change (self, GUMD_DAEMON_CHANGE_ADDED, uid);
 }
 
 static void
@@ -174,6 +333,7 @@ _on_user_deleted (
             user_data);
     gum_dbus_user_service_emit_user_deleted (self->priv->dbus_user_service,
             uid);
+    _queue_change (self, GUMD_DAEMON_CHANGE_DELETED, uid);
 }
 
 static void
@@ -186,6 +346,7 @@ _on_user_updated (
             user_data);
     gum_dbus_user_service_emit_user_updated (self->priv->dbus_user_service,
             uid);
+    _queue_change (self, GUMD_DAEMON_CHANGE_UPDATED, uid);
 }
 
 static PeerUserService *
@@ -252,6 +413,22 @@ _dispose (
             _on_user_updated, self);
 
     GUM_OBJECT_UNREF (self->priv->daemon);
+    GUM_OBJECT_UNREF (self->priv->scheduler);
+
+    g_mutex_lock (&self->priv->batch_lock);
+    self->priv->batch_delay = 0;
+    if (self->priv->batch_source) {
+        g_source_destroy (self->priv->batch_source);
+        g_source_unref (self->priv->batch_source);
+        self->priv->batch_source = NULL;
+    }
+    GUM_HASHTABLE_UNREF (self->priv->batch);
+    g_mutex_unlock (&self->priv->batch_lock);
+
+    if (self->priv->context) {
+        g_main_context_unref (self->priv->context);
+        self->priv->context = NULL;
+    }
 
     if (self->priv->dbus_user_service) {
         g_dbus_interface_skeleton_unexport (G_DBUS_INTERFACE_SKELETON (
@@ -291,6 +468,8 @@ _finalize (
         g_list_free (self->priv->peer_users);
         self->priv->peer_users = NULL;
     }
+    g_mutex_clear (&self->priv->cache_lock);
+    g_mutex_clear (&self->priv->batch_lock);
 
     G_OBJECT_CLASS (gumd_dbus_user_service_adapter_parent_class)->finalize (
             object);
@@ -343,7 +522,15 @@ gumd_dbus_user_service_adapter_init (GumdDbusUserServiceAdapter *self)
 
     self->priv->connection = 0;
     self->priv->daemon = NULL;
+    self->priv->scheduler = gumd_dbus_scheduler_new ();
+    g_mutex_init (&self->priv->cache_lock);
     self->priv->peer_users = NULL;
+    self->priv->threaded_reads = FALSE;
+    self->priv->context = g_main_context_ref_thread_default ();
+    g_mutex_init (&self->priv->batch_lock);
+    self->priv->batch = NULL;
+    self->priv->batch_source = NULL;
+    self->priv->batch_delay = 0;
     self->priv->dbus_user_service = gum_dbus_user_service_skeleton_new ();
     self->priv->caller_watchers = g_hash_table_new_full (g_str_hash,
             g_str_equal, g_free, (GDestroyNotify)g_bus_unwatch_name);
@@ -387,6 +574,7 @@ _on_bus_name_lost (
     peer_user.peer_name = (gchar *)peer_name;
     peer_user.user_adapter = NULL;
     peer_user.user_service = self;
+    g_mutex_lock (&self->priv->cache_lock);
     g_list_foreach (self->priv->peer_users, (GFunc)_clear_cache_for_peer_name,
             (gpointer)&peer_user);
 
@@ -395,6 +583,7 @@ _on_bus_name_lost (
     if (g_list_length (self->priv->peer_users) == 0) {
         gum_disposable_set_auto_dispose (GUM_DISPOSABLE (self), TRUE);
     }
+    g_mutex_unlock (&self->priv->cache_lock);
 }
 
 static void
@@ -450,12 +639,14 @@ _on_dbus_user_adapter_disposed (
 
     peer_user.user_adapter = GUMD_DBUS_USER_ADAPTER (object);
     peer_user.user_service = self;
+    g_mutex_lock (&self->priv->cache_lock);
     g_list_foreach (self->priv->peer_users, (GFunc)_clear_cache_for_user,
             (gpointer)&peer_user);
 
     if (g_list_length (self->priv->peer_users) == 0) {
         gum_disposable_set_auto_dispose (GUM_DISPOSABLE (self), TRUE);
     }
+    g_mutex_unlock (&self->priv->cache_lock);
 }
 
 static gchar *
@@ -490,6 +681,7 @@ _create_and_cache_user_adapter (
                     connection, user,
                     gumd_daemon_get_user_timeout (self->priv->daemon));
 
+    g_mutex_lock (&self->priv->cache_lock);
     /* keep alive till this user object gets disposed */
     if (g_list_length (self->priv->peer_users) == 0)
         gum_disposable_set_auto_dispose (GUM_DISPOSABLE (self), FALSE);
@@ -502,9 +694,81 @@ _create_and_cache_user_adapter (
 
     /* watchers used for msg-bus only */
     _add_bus_name_watcher (self, user_adapter, invocation);
+    g_mutex_unlock (&self->priv->cache_lock);
 
     DBG ("created user adapter %p for user %p", user_adapter, user);
-    return user_adapter;
+    return g_object_ref (user_adapter);
+}
+
+typedef void (*GumdDbusUserCompleteFunc) (
+        GumDbusUserService *object,
+        GDBusMethodInvocation *invocation,
+        const gchar *object_path);
+
+typedef struct {
+    GumdDbusUserServiceAdapter *self;
+    GumdDaemonUser *user;
+    GDBusMethodInvocation *invocation;
+    GumdDbusUserCompleteFunc complete;
+} GumdDbusUserExport;
+
+static GumdDbusUserAdapter *
+_get_user_adapter_from_cache (
+        GumdDbusUserServiceAdapter *self,
+        GDBusMethodInvocation *invocation,
+        uid_t uid);
+
+static gboolean
+_export_user_adapter (
+        gpointer data)
+{
+    GumdDbusUserExport *export = (GumdDbusUserExport *) data;
+    GumdDbusUserServiceAdapter *self = export->self;
+    GumdDbusUserAdapter *user_adapter = NULL;
+    uid_t uid = GUM_USER_INVALID_UID;
+
+    /* another request may have exported it meanwhile */
+    g_object_get (G_OBJECT (export->user), "uid", &uid, NULL);
+    user_adapter = _get_user_adapter_from_cache (self, export->invocation,
+            uid);
+    if (user_adapter) {
+        g_object_unref (export->user);
+    } else {
+        user_adapter = _create_and_cache_user_adapter (self, export->user,
+                export->invocation);
+    }
+    export->complete (self->priv->dbus_user_service, export->invocation,
+            gumd_dbus_user_adapter_get_object_path (user_adapter));
+    g_object_unref (user_adapter);
+
+    gum_disposable_set_auto_dispose (GUM_DISPOSABLE (self), TRUE);
+    g_object_unref (self);
+    g_slice_free (GumdDbusUserExport, export);
+
+    return G_SOURCE_REMOVE;
+}
+
+/*
+ * Completes the invocation with the object path of the user's adapter, which
+ * is created if need be. Adapters are only created, exported and watched from
+ * the context the service adapter belongs to, so that their method calls are
+ * dispatched there even if the lookup ran in a GDBus worker thread. Takes over
+ * the user and re-enables auto dispose once done.
+ */
+static void
+_complete_with_user_adapter (
+        GumdDbusUserServiceAdapter *self,
+        GumdDaemonUser *user,
+        GDBusMethodInvocation *invocation,
+        GumdDbusUserCompleteFunc complete)
+{
+    GumdDbusUserExport *export = g_slice_new0 (GumdDbusUserExport);
+
+    export->self = g_object_ref (self);
+    export->user = user;
+    export->invocation = invocation;
+    export->complete = complete;
+    g_main_context_invoke (self->priv->context, _export_user_adapter, export);
 }
 
 static GumdDbusUserAdapter *
@@ -515,7 +779,7 @@ _get_user_adapter_from_cache (
 {
     GumdDbusUserAdapter *user_adapter = NULL;
     PeerUserService *peer_user = NULL;
-    GList *list = self->priv->peer_users;
+    GList *list = NULL;
     gchar *peer_name = NULL;
     gboolean delete_later = FALSE;
 
@@ -525,7 +789,9 @@ _get_user_adapter_from_cache (
 
     peer_name = _get_sender (self, invocation);
     DBG ("peername:%s uid %u", peer_name, uid);
-    for ( ; list != NULL; list = g_list_next (list)) {
+    g_mutex_lock (&self->priv->cache_lock);
+    for (list = self->priv->peer_users; list != NULL;
+         list = g_list_next (list)) {
         peer_user = (PeerUserService *) list->data;
         if (g_strcmp0 (peer_name, peer_user->peer_name) == 0 &&
             gumd_dbus_user_adapter_get_uid (peer_user->user_adapter) == uid) {
@@ -533,28 +799,27 @@ _get_user_adapter_from_cache (
             g_object_get (G_OBJECT (peer_user->user_adapter), "delete-later",
                     &delete_later, NULL);
             if (!delete_later) {
-                user_adapter = peer_user->user_adapter;
+                user_adapter = g_object_ref (peer_user->user_adapter);
                 break;
             }
         }
     }
+    g_mutex_unlock (&self->priv->cache_lock);
     g_free (peer_name);
 
     DBG ("user adapter %p", user_adapter);
     return user_adapter;
 }
 
-static gboolean
-_handle_create_new_user (
+static void
+_create_new_user (
         GumdDbusUserServiceAdapter *self,
-        GDBusMethodInvocation *invocation,
-        gpointer user_data)
+        GDBusMethodInvocation *invocation)
 {
     GumdDaemonUser *user = NULL;
     GError *error = NULL;
 
-    g_return_val_if_fail (self && GUMD_IS_DBUS_USER_SERVICE_ADAPTER(self),
-            FALSE);
+    g_return_if_fail (self && GUMD_IS_DBUS_USER_SERVICE_ADAPTER(self));
     DBG ("");
 
     gum_disposable_set_auto_dispose (GUM_DISPOSABLE (self), FALSE);
@@ -566,25 +831,43 @@ _handle_create_new_user (
         gum_dbus_user_service_complete_create_new_user (
                 self->priv->dbus_user_service, invocation,
                 gumd_dbus_user_adapter_get_object_path (user_adapter));
+        g_object_unref (user_adapter);
     } else {
         g_dbus_method_invocation_return_gerror (invocation, error);
         g_error_free (error);
     }
     gum_disposable_set_auto_dispose (GUM_DISPOSABLE (self), TRUE);
-    
-    return TRUE;
 }
 
 static gboolean
-_handle_get_user (
+_handle_create_new_user (
         GumdDbusUserServiceAdapter *self,
         GDBusMethodInvocation *invocation,
-        guint32 uid,
         gpointer user_data)
 {
+    /* only an object is created here, the write token is charged when
+     * the user is added */
+    if (gumd_dbus_scheduler_admit (self->priv->scheduler,
+            GUMD_DBUS_LIMIT_CREATE, invocation)) {
+        gumd_dbus_scheduler_push (self->priv->scheduler,
+                GUMD_DBUS_REQUEST_READ, G_OBJECT (self), invocation,
+                (GumdDbusSchedulerFunc)_create_new_user);
+    }
+    return TRUE;
+}
+
+static void
+_get_user (
+        GumdDbusUserServiceAdapter *self,
+        GDBusMethodInvocation *invocation)
+{
+    guint32 uid = GUM_USER_INVALID_UID;
     GumdDaemonUser *user = NULL;
     GError *error = NULL;
     GumdDbusUserAdapter *user_adapter = NULL;
+
+    g_variant_get (g_dbus_method_invocation_get_parameters (invocation),
+            "(u)", &uid);
     DBG ("uid %d", uid);
 
     gum_disposable_set_auto_dispose (GUM_DISPOSABLE (self), FALSE);
@@ -593,8 +876,9 @@ _handle_get_user (
     if (!user_adapter) {
     	user = gumd_daemon_get_user (self->priv->daemon, (uid_t)uid, &error);
     	if (user) {
-            user_adapter = _create_and_cache_user_adapter (self, user,
-                invocation);
+            _complete_with_user_adapter (self, user, invocation,
+                    gum_dbus_user_service_complete_get_user);
+            return;
     	}
     }
 
@@ -602,6 +886,7 @@ _handle_get_user (
         gum_dbus_user_service_complete_get_user (self->priv->dbus_user_service,
                 invocation, gumd_dbus_user_adapter_get_object_path (
                         user_adapter));
+        g_object_unref (user_adapter);
     } else {
         if (!error) {
             error = GUM_GET_ERROR_FOR_ID (GUM_ERROR_USER_NOT_FOUND,
@@ -612,35 +897,56 @@ _handle_get_user (
     }
 
     gum_disposable_set_auto_dispose (GUM_DISPOSABLE (self), TRUE);
-
-    return TRUE;
 }
 
 static gboolean
-_handle_get_user_by_name (
+_handle_get_user (
         GumdDbusUserServiceAdapter *self,
         GDBusMethodInvocation *invocation,
-        const gchar *username,
+        guint32 uid,
         gpointer user_data)
 {
+    if (self->priv->threaded_reads) {
+        /* already running in a GDBus worker thread */
+        g_object_ref (self);
+        _get_user (self, invocation);
+        g_object_unref (self);
+    } else {
+        gumd_dbus_scheduler_push (self->priv->scheduler,
+                GUMD_DBUS_REQUEST_READ, G_OBJECT (self), invocation,
+                (GumdDbusSchedulerFunc)_get_user);
+    }
+    return TRUE;
+}
+
+static void
+_get_user_by_name (
+        GumdDbusUserServiceAdapter *self,
+        GDBusMethodInvocation *invocation)
+{
+    const gchar *username = NULL;
     GumdDaemonUser *user = NULL;
     GError *error = NULL;
     GumdDbusUserAdapter *user_adapter = NULL;
     uid_t uid = GUM_USER_INVALID_UID;
 
+    g_variant_get (g_dbus_method_invocation_get_parameters (invocation),
+            "(&s)", &username);
     DBG ("username %s", username);
 
     gum_disposable_set_auto_dispose (GUM_DISPOSABLE (self), FALSE);
 
-    uid = gumd_daemon_user_get_uid_by_name (username, gumd_daemon_get_config (
-    		self->priv->daemon));
-
-    user_adapter = _get_user_adapter_from_cache (self, invocation, uid);
-    if (!user_adapter) {
-        user = gumd_daemon_get_user (self->priv->daemon, (uid_t)uid, &error);
-        if (user) {
-            user_adapter = _create_and_cache_user_adapter (self, user,
-                    invocation);
+    user = gumd_daemon_get_user_by_name (self->priv->daemon, username,
+            &error);
+    if (user) {
+        g_object_get (G_OBJECT (user), "uid", &uid, NULL);
+        user_adapter = _get_user_adapter_from_cache (self, invocation, uid);
+        if (user_adapter) {
+            g_object_unref (user);
+        } else {
+            _complete_with_user_adapter (self, user, invocation,
+                    gum_dbus_user_service_complete_get_user_by_name);
+            return;
         }
     }
 
@@ -648,6 +954,7 @@ _handle_get_user_by_name (
         gum_dbus_user_service_complete_get_user_by_name (
         		self->priv->dbus_user_service, invocation,
                 gumd_dbus_user_adapter_get_object_path (user_adapter));
+        g_object_unref (user_adapter);
     } else {
         if (!error) {
             error = GUM_GET_ERROR_FOR_ID (GUM_ERROR_USER_NOT_FOUND,
@@ -658,25 +965,46 @@ _handle_get_user_by_name (
     }
 
     gum_disposable_set_auto_dispose (GUM_DISPOSABLE (self), TRUE);
-
-    return TRUE;
 }
 
 static gboolean
-_handle_get_user_list (
+_handle_get_user_by_name (
         GumdDbusUserServiceAdapter *self,
         GDBusMethodInvocation *invocation,
-        const gchar *const *types,
+        const gchar *username,
         gpointer user_data)
 {
+    if (self->priv->threaded_reads) {
+        /* already running in a GDBus worker thread */
+        g_object_ref (self);
+        _get_user_by_name (self, invocation);
+        g_object_unref (self);
+    } else {
+        gumd_dbus_scheduler_push (self->priv->scheduler,
+                GUMD_DBUS_REQUEST_READ, G_OBJECT (self), invocation,
+                (GumdDbusSchedulerFunc)_get_user_by_name);
+    }
+    return TRUE;
+}
+
+static void
+_get_user_list (
+        GumdDbusUserServiceAdapter *self,
+        GDBusMethodInvocation *invocation)
+{
+    const gchar **types = NULL;
     GError *error = NULL;
     GVariant *users = NULL;
 
+    g_variant_get (g_dbus_method_invocation_get_parameters (invocation),
+            "(^a&s)", &types);
     DBG ("");
 
     gum_disposable_set_auto_dispose (GUM_DISPOSABLE (self), FALSE);
 
-    users = gumd_daemon_get_user_list (self->priv->daemon, types, &error);
+    users = gumd_daemon_get_user_list (self->priv->daemon,
+            (const gchar *const *)types, &error);
+    g_free (types);
 
     if (users) {
         gum_dbus_user_service_complete_get_user_list (
@@ -691,7 +1019,218 @@ _handle_get_user_list (
     }
 
     gum_disposable_set_auto_dispose (GUM_DISPOSABLE (self), TRUE);
+}
+
+static gboolean
+_handle_get_user_list (
+        GumdDbusUserServiceAdapter *self,
+        GDBusMethodInvocation *invocation,
+        const gchar *const *types,
+        gpointer user_data)
+{
+    if (self->priv->threaded_reads) {
+        /* already running in a GDBus worker thread */
+        g_object_ref (self);
+        _get_user_list (self, invocation);
+        g_object_unref (self);
+    } else {
+        gumd_dbus_scheduler_push (self->priv->scheduler,
+                GUMD_DBUS_REQUEST_READ, G_OBJECT (self), invocation,
+                (GumdDbusSchedulerFunc)_get_user_list);
+    }
+    return TRUE;
+}
+
+static void
+_get_changes_since (
+        GumdDbusUserServiceAdapter *self,
+        GDBusMethodInvocation *invocation)
+{
+    guint64 since = 0;
+    guint64 generation = 0;
+    gboolean resync = FALSE;
+    GError *error = NULL;
+    GVariant *changes = NULL;
+
+    g_variant_get (g_dbus_method_invocation_get_parameters (invocation),
+            "(t)", &since);
+    DBG ("since %" G_GUINT64_FORMAT, since);
+
+    gum_disposable_set_auto_dispose (GUM_DISPOSABLE (self), FALSE);
+
+    changes = gumd_daemon_get_user_changes (self->priv->daemon, since,
+            &generation, &resync, &error);
+    if (changes) {
+        gum_dbus_user_service_complete_get_changes_since (
+                self->priv->dbus_user_service, invocation, generation, resync,
+                changes);
+    } else {
+        g_dbus_method_invocation_return_gerror (invocation, error);
+        g_error_free (error);
+    }
+
+    gum_disposable_set_auto_dispose (GUM_DISPOSABLE (self), TRUE);
+}
+
+static gboolean
+_handle_get_changes_since (
+        GumdDbusUserServiceAdapter *self,
+        GDBusMethodInvocation *invocation,
+        guint64 since,
+        gpointer user_data)
+{
+    if (self->priv->threaded_reads) {
+        /* already running in a GDBus worker thread */
+        g_object_ref (self);
+        _get_changes_since (self, invocation);
+        g_object_unref (self);
+    } else {
+        gumd_dbus_scheduler_push (self->priv->scheduler,
+                GUMD_DBUS_REQUEST_READ, G_OBJECT (self), invocation,
+                (GumdDbusSchedulerFunc)_get_changes_since);
+    }
+    return TRUE;
+}
+
+static void
+_get_user_list_fd (
+        GumdDbusUserServiceAdapter *self,
+        GDBusMethodInvocation *invocation)
+{
+    const gchar **types = NULL;
+    GError *error = NULL;
+    GVariant *users = NULL;
+    GUnixFDList *fd_list = NULL;
+    gint fd = -1;
+    gint index = -1;
+
+    g_variant_get (g_dbus_method_invocation_get_parameters (invocation),
+            "(^a&s)", &types);
+    DBG ("");
+
+    gum_disposable_set_auto_dispose (GUM_DISPOSABLE (self), FALSE);
+
+    if (!(g_dbus_connection_get_capabilities (
+            g_dbus_method_invocation_get_connection (invocation)) &
+            G_DBUS_CAPABILITY_FLAGS_UNIX_FD_PASSING)) {
+        error = GUM_GET_ERROR_FOR_ID (GUM_ERROR_FILE_OPEN,
+                "File descriptor passing not supported");
+    } else {
+        users = gumd_daemon_get_user_records (self->priv->daemon,
+                (const gchar *const *)types, &error);
+        if (!users && !error) {
+            error = GUM_GET_ERROR_FOR_ID (GUM_ERROR_USER_NOT_FOUND,
+                    "Users Not Found");
+        }
+    }
+    g_free (types);
+
+    if (users) {
+        fd = gum_utils_variant_to_fd (users, &error);
+        g_variant_unref (users);
+    }
+
+    if (fd >= 0) {
+        fd_list = g_unix_fd_list_new ();
+        index = g_unix_fd_list_append (fd_list, fd, &error);
+        close (fd);
+    }
+
+    if (index >= 0) {
+        gum_dbus_user_service_complete_get_user_list_fd (
+                self->priv->dbus_user_service, invocation, fd_list,
+                g_variant_new_handle (index));
+    } else {
+        g_dbus_method_invocation_return_gerror (invocation, error);
+        g_error_free (error);
+    }
+    GUM_OBJECT_UNREF (fd_list);
+
+    gum_disposable_set_auto_dispose (GUM_DISPOSABLE (self), TRUE);
+}
 
+static gboolean
+_handle_get_user_list_fd (
+        GumdDbusUserServiceAdapter *self,
+        GDBusMethodInvocation *invocation,
+        GUnixFDList *fd_list,
+        const gchar *const *types,
+        gpointer user_data)
+{
+    if (self->priv->threaded_reads) {
+        /* already running in a GDBus worker thread */
+        g_object_ref (self);
+        _get_user_list_fd (self, invocation);
+        g_object_unref (self);
+    } else {
+        gumd_dbus_scheduler_push (self->priv->scheduler,
+                GUMD_DBUS_REQUEST_READ, G_OBJECT (self), invocation,
+                (GumdDbusSchedulerFunc)_get_user_list_fd);
+    }
+    return TRUE;
+}
+
+static void
+_get_snapshot (
+        GumdDbusUserServiceAdapter *self,
+        GDBusMethodInvocation *invocation)
+{
+    guint64 generation = 0;
+    GError *error = NULL;
+    GUnixFDList *fd_list = NULL;
+    gint fd = -1;
+    gint index = -1;
+
+    DBG ("");
+
+    gum_disposable_set_auto_dispose (GUM_DISPOSABLE (self), FALSE);
+
+    if (!(g_dbus_connection_get_capabilities (
+            g_dbus_method_invocation_get_connection (invocation)) &
+            G_DBUS_CAPABILITY_FLAGS_UNIX_FD_PASSING)) {
+        error = GUM_GET_ERROR_FOR_ID (GUM_ERROR_FILE_OPEN,
+                "File descriptor passing not supported");
+    } else {
+        fd = gumd_daemon_get_snapshot_fd (self->priv->daemon, &generation,
+                &error);
+    }
+
+    if (fd >= 0) {
+        fd_list = g_unix_fd_list_new ();
+        index = g_unix_fd_list_append (fd_list, fd, &error);
+        close (fd);
+    }
+
+    if (index >= 0) {
+        gum_dbus_user_service_complete_get_snapshot (
+                self->priv->dbus_user_service, invocation, fd_list,
+                g_variant_new_handle (index), generation);
+    } else {
+        g_dbus_method_invocation_return_gerror (invocation, error);
+        g_error_free (error);
+    }
+    GUM_OBJECT_UNREF (fd_list);
+
+    gum_disposable_set_auto_dispose (GUM_DISPOSABLE (self), TRUE);
+}
+
+static gboolean
+_handle_get_snapshot (
+        GumdDbusUserServiceAdapter *self,
+        GDBusMethodInvocation *invocation,
+        GUnixFDList *fd_list,
+        gpointer user_data)
+{
+    if (self->priv->threaded_reads) {
+        /* already running in a GDBus worker thread */
+        g_object_ref (self);
+        _get_snapshot (self, invocation);
+        g_object_unref (self);
+    } else {
+        gumd_dbus_scheduler_push (self->priv->scheduler,
+                GUMD_DBUS_REQUEST_READ, G_OBJECT (self), invocation,
+                (GumdDbusSchedulerFunc)_get_snapshot);
+    }
     return TRUE;
 }
 
@@ -710,16 +1249,22 @@ gumd_dbus_user_service_adapter_new_with_connection (
             "connection", bus_connection,
             NULL));
 
-    if (!g_dbus_interface_skeleton_export (
-            G_DBUS_INTERFACE_SKELETON(adapter->priv->dbus_user_service),
-            adapter->priv->connection, GUM_USER_SERVICE_OBJECTPATH, &err)) {
-        WARN ("failed to register object: %s", err->message);
-        g_error_free (err);
-        g_object_unref (adapter);
-        return NULL;
+    /* lookups only touch the locked daemon caches and hand out copies, so on
+     * the message bus they can be served straight from GDBus worker threads;
+     * new user adapters are still exported from the adapter's context */
+    if (bus_type == GUMD_DBUS_SERVER_BUSTYPE_MSG_BUS &&
+        gum_config_get_int (gumd_daemon_get_config (adapter->priv->daemon),
+                GUM_CONFIG_DBUS_THREADED_READS, 0)) {
+        adapter->priv->threaded_reads = TRUE;
+        g_dbus_interface_skeleton_set_flags (
+                G_DBUS_INTERFACE_SKELETON (adapter->priv->dbus_user_service),
+                G_DBUS_INTERFACE_SKELETON_FLAGS_HANDLE_METHOD_INVOCATIONS_IN_THREAD);
     }
-    DBG("(+) started user service interface '%p' at path '%s' on connection"
-            " '%p'", adapter, GUM_USER_SERVICE_OBJECTPATH, bus_connection);
+
+    adapter->priv->batch_delay = (guint) MAX (0, gum_config_get_int (
+            gumd_daemon_get_config (adapter->priv->daemon),
+            GUM_CONFIG_DBUS_CHANGE_SIGNAL_DELAY,
+            GUMD_DBUS_CHANGE_SIGNAL_DELAY_DEFAULT));
 
     timeout = gumd_daemon_get_timeout (adapter->priv->daemon);
     if (timeout && bus_type != GUMD_DBUS_SERVER_BUSTYPE_P2P) {
@@ -737,6 +1282,14 @@ gumd_dbus_user_service_adapter_new_with_connection (
     g_signal_connect_swapped (adapter->priv->dbus_user_service,
         "handle-get-user-list", G_CALLBACK(_handle_get_user_list),
         adapter);
+    g_signal_connect_swapped (adapter->priv->dbus_user_service,
+        "handle-get-changes-since", G_CALLBACK(_handle_get_changes_since),
+        adapter);
+    g_signal_connect_swapped (adapter->priv->dbus_user_service,
+        "handle-get-user-list-fd", G_CALLBACK(_handle_get_user_list_fd),
+        adapter);
+    g_signal_connect_swapped (adapter->priv->dbus_user_service,
+        "handle-get-snapshot", G_CALLBACK(_handle_get_snapshot), adapter);
 
     g_signal_connect (G_OBJECT (adapter->priv->daemon), "user-added",
             G_CALLBACK (_on_user_added), adapter);
@@ -745,5 +1298,16 @@ gumd_dbus_user_service_adapter_new_with_connection (
     g_signal_connect (G_OBJECT (adapter->priv->daemon), "user-updated",
             G_CALLBACK (_on_user_updated), adapter);
 
+    if (!g_dbus_interface_skeleton_export (
+            G_DBUS_INTERFACE_SKELETON(adapter->priv->dbus_user_service),
+            adapter->priv->connection, GUM_USER_SERVICE_OBJECTPATH, &err)) {
+        WARN ("failed to register object: %s", err->message);
+        g_error_free (err);
+        g_object_unref (adapter);
+        return NULL;
+    }
+    DBG("(+) started user service interface '%p' at path '%s' on connection"
+            " '%p'", adapter, GUM_USER_SERVICE_OBJECTPATH, bus_connection);
+
     return adapter;
 }
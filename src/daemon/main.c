@@ -37,6 +37,9 @@
 
 #include "common/gum-log.h"
 #include "common/gum-dbus.h"
+#include "core/gumd-daemon.h"
+#include "core/gumd-home-reaper.h"
+#include "core/gumd-login1.h"
 #include "dbus/gumd-dbus-server-interface.h"
 #include "dbus/gumd-dbus-server-msg-bus.h"
 #include "dbus/gumd-dbus-server-p2p.h"
@@ -72,6 +75,33 @@ _handle_quit_signal (
     return FALSE;
 }
 
+static void
+_publish_snapshot (void)
+{
+    GumdDaemon *daemon = gumd_daemon_new ();
+    GError *error = NULL;
+
+    /* readers going to the snapshot file directly (e.g. the NSS module)
+     * should not have to wait for the first client to request it */
+    if (!gumd_daemon_publish_snapshot (daemon, &error)) {
+        WARN ("Failed to publish database snapshot: %s", error->message);
+        g_error_free (error);
+    }
+    g_object_unref (daemon);
+}
+
+static void
+_start_home_reaper (void)
+{
+    GumdDaemon *daemon = gumd_daemon_new ();
+
+    /* without the reaper home directories are deleted synchronously */
+    if (!gumd_home_reaper_start (gumd_daemon_get_config (daemon))) {
+        WARN ("Failed to start home directory reaper");
+    }
+    g_object_unref (daemon);
+}
+
 static gboolean
 _start_dbus_server (
 		GMainLoop *main_loop)
@@ -98,6 +128,7 @@ _start_dbus_server (
 
     g_object_weak_ref (G_OBJECT (_server), _on_server_closed,
     		main_loop);
+    _publish_snapshot ();
 	return TRUE;
 }
 
@@ -211,6 +242,8 @@ main (int argc, char **argv)
         return -1;
     }
 
+    _start_home_reaper ();
+    gumd_login1_start ();
     _install_sighandlers (main_loop);
 
     INFO ("Entering main event loop");
@@ -219,6 +252,8 @@ main (int argc, char **argv)
     DBG ("");
 
     if(_server) g_object_unref (_server);
+    gumd_home_reaper_stop ();
+    gumd_login1_stop ();
     DBG ("");
  
     if (main_loop) g_main_loop_unref (main_loop);
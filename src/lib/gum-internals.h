@@ -28,6 +28,9 @@
 
 #include <glib.h>
 
+#include "common/gum-snapshot.h"
+#include "gum-user.h"
+
 G_BEGIN_DECLS
 
 #define GUM_OPERATION_IS_NOT_CANCELLED(error) \
@@ -35,6 +38,17 @@ G_BEGIN_DECLS
         error->domain != G_IO_ERROR || \
         error->code != G_IO_ERROR_CANCELLED)
 
+GumSnapshot *
+gum_user_service_get_snapshot (void);
+
+gboolean
+gum_user_service_snapshot_is_in_sync (
+        GumSnapshot *current);
+
+GumUser *
+gum_user_new_from_record (
+        GVariant *record);
+
 G_END_DECLS
 
 #endif /* __GUM_INTERNALS_H_ */
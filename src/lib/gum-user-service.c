@@ -25,11 +25,16 @@
 
 #include "config.h"
 
+#include <unistd.h>
+#include <gio/gunixfdlist.h>
+
 #include "common/dbus/gum-dbus-user-service-gen.h"
+#include "common/gum-config.h"
 #include "common/gum-dbus.h"
 #include "common/gum-error.h"
 #include "common/gum-log.h"
 #include "common/gum-defines.h"
+#include "common/gum-utils.h"
 
 #include "daemon/core/gumd-daemon.h"
 #include "gum-user.h"
@@ -135,6 +140,8 @@ typedef struct {
     gpointer user_data;
     GError *error;
     GumUserList *users;
+    gchar **types;      /* to fall back to getUserList */
+    GumUserListFlags flags;
     guint cb_id;
 } GumUserServiceOp;
 
@@ -168,6 +175,19 @@ static GObject *self = 0;
 static GHashTable *dbus_service_objects = NULL;
 static GMutex mutex;
 
+/* do not ask the daemon again for a while if it cannot hand out a snapshot */
+#define GUM_SNAPSHOT_RETRY_INTERVAL (5 * G_USEC_PER_SEC)
+
+static GMutex snapshot_lock;
+static GumSnapshot *snapshot = NULL;    /* guarded by snapshot_lock */
+static gint64 snapshot_retry_time = 0;  /* guarded by snapshot_lock */
+/* resolved once, as the configuration does not change while the process
+ * runs; kept until the process exits */
+static gchar *snapshot_passwd_file = NULL;
+static gchar *snapshot_group_file = NULL;
+static GPrivate thread_snapshot = G_PRIVATE_INIT (
+        (GDestroyNotify) gum_snapshot_unref);
+
 static void
 _thread_dbus_service_free (
         GWeakRef *data)
@@ -245,6 +265,7 @@ _free_op (
         }
         if (self->priv->op->error) g_error_free (self->priv->op->error);
         gum_user_service_list_free (self->priv->op->users);
+        g_strfreev (self->priv->op->types);
         g_free (self->priv->op);
         self->priv->op = NULL;
     }
@@ -428,6 +449,123 @@ _uids_variant_to_user_list(
     return users;
 }
 
+/* large lists are handed over in a sealed memory file which is mapped
+ * directly, instead of being copied through the bus */
+static gboolean
+_use_fd_transfer (
+        GumUserService *self)
+{
+#ifdef HAVE_MEMFD_CREATE
+    return (g_dbus_connection_get_capabilities (g_dbus_proxy_get_connection (
+            G_DBUS_PROXY (self->priv->dbus_service))) &
+            G_DBUS_CAPABILITY_FLAGS_UNIX_FD_PASSING) != 0;
+#else
+    return FALSE;
+#endif
+}
+
+/* users are built from their records, without fetching their objects, only
+ * if asked for with GUM_USER_LIST_FLAGS_RECORDS */
+static GumUserList *
+_records_variant_to_user_list (
+        GVariant *records,
+        GumUserListFlags flags)
+{
+    GumUserList *users = NULL;
+    GumUser *user = NULL;
+    GVariantIter iter;
+    GVariant *record = NULL;
+    guint32 uid = GUM_USER_INVALID_UID;
+
+    g_variant_iter_init (&iter, records);
+    while ((record = g_variant_iter_next_value (&iter))) {
+        if (flags & GUM_USER_LIST_FLAGS_RECORDS) {
+            user = gum_user_new_from_record (record);
+        } else {
+            uid = GUM_USER_INVALID_UID;
+            g_variant_lookup (record, "uid", "u", &uid);
+            user = gum_user_get_sync (uid, FALSE);
+            if (!user)
+                WARN ("unable to get user for uid %d", uid);
+        }
+        if (user)
+            users = g_list_prepend (users, user);
+        g_variant_unref (record);
+    }
+    return g_list_reverse (users);
+}
+
+static GVariant *
+_records_variant_from_fd (
+        GVariant *handle,
+        GUnixFDList *fd_list,
+        GError **error)
+{
+    GVariant *records = NULL;
+    gint fd = -1;
+
+    if (!handle || !fd_list) {
+        GUM_RETURN_WITH_ERROR (GUM_ERROR_FILE_OPEN,
+                "No file descriptor received", error, NULL);
+    }
+
+    fd = g_unix_fd_list_get (fd_list, g_variant_get_handle (handle), error);
+    if (fd >= 0) {
+        records = gum_utils_variant_new_from_fd (fd,
+                G_VARIANT_TYPE ("aa{sv}"), error);
+        close (fd);
+    }
+    return records;
+}
+
+static void
+_on_get_user_list_cb (
+        GObject *object,
+        GAsyncResult *res,
+        gpointer user_data);
+
+static void
+_on_get_user_list_fd_cb (
+        GObject *object,
+        GAsyncResult *res,
+        gpointer user_data)
+{
+    GumUserService *self = (GumUserService*)user_data;
+    GumDbusUserService *proxy = GUM_DBUS_USER_SERVICE (object);
+    GVariant *handle = NULL;
+    GUnixFDList *fd_list = NULL;
+    GVariant *records = NULL;
+    GError *error = NULL;
+    GumUserList *users = NULL;
+
+    g_return_if_fail (self != NULL);
+
+    DBG ("");
+
+    if (gum_dbus_user_service_call_get_user_list_fd_finish (proxy, &handle,
+            &fd_list, res, &error)) {
+        records = _records_variant_from_fd (handle, fd_list, &error);
+    }
+
+    if (error && GUM_OPERATION_IS_NOT_CANCELLED (error) && self->priv->op) {
+        /* e.g. daemon without sealed memory files or getUserListFd */
+        DBG ("Falling back to getUserList: %s", error->message);
+        gum_dbus_user_service_call_get_user_list (proxy,
+                (const gchar *const *) self->priv->op->types,
+                self->priv->cancellable, _on_get_user_list_cb, self);
+    } else if (GUM_OPERATION_IS_NOT_CANCELLED (error)) {
+        if (!error && self->priv->op) {
+            users = _records_variant_to_user_list (records,
+                    self->priv->op->flags);
+        }
+        _setup_idle_user_list_callback (self, users, error);
+    }
+    if (records) g_variant_unref (records);
+    if (handle) g_variant_unref (handle);
+    GUM_OBJECT_UNREF (fd_list);
+    g_clear_error (&error);
+}
+
 static void
 _on_get_user_list_cb (
         GObject *object,
@@ -652,7 +790,8 @@ gum_user_service_create_sync (
  * @user_data: user data
  *
  * This method gets the user over the DBus asynchronously. Callback is used
- * to notify when the user list is retrieved.
+ * to notify when the user list is retrieved. Same as
+ * #gum_user_service_get_user_list_full with #GUM_USER_LIST_FLAGS_NONE.
  *
  * Returns: returns TRUE if the request has been pushed and is waiting for
  * the response, FALSE otherwise. No callback is triggered, in case the
@@ -664,6 +803,57 @@ gum_user_service_get_user_list (
         const gchar *const *types,
         GumUserServiceListCb callback,
         gpointer user_data)
+{
+    return gum_user_service_get_user_list_full (self, types,
+            GUM_USER_LIST_FLAGS_NONE, callback, user_data);
+}
+
+/**
+ * gum_user_service_get_user_list_sync:
+ * @self: #GumUserService object
+ * @types: (transfer none): a string array of user types (e.g admin, normal etc)
+ *
+ * This method gets the list of users based on the type. In case offline mode is
+ * enabled, then the users is retrieved directly without using dbus otherwise
+ * the users gets retrieved over the DBus synchronously. Same as
+ * #gum_user_service_get_user_list_full_sync with #GUM_USER_LIST_FLAGS_NONE.
+ *
+ * Returns: (transfer full): #GumUserList of #GumUser. use
+ * gum_user_list_free to free the list of the users.
+ */
+GumUserList *
+gum_user_service_get_user_list_sync (
+        GumUserService *self,
+        const gchar *const *types)
+{
+    return gum_user_service_get_user_list_full_sync (self, types,
+            GUM_USER_LIST_FLAGS_NONE);
+}
+
+/**
+ * gum_user_service_get_user_list_full:
+ * @self: #GumUserService object
+ * @types: (transfer none): a string array of user types (e.g admin, normal etc)
+ * @flags: #GumUserListFlags
+ * @callback: #GumUserServiceListCb to be invoked when user list is retrieved
+ * @user_data: user data
+ *
+ * This method gets the user over the DBus asynchronously, as
+ * #gum_user_service_get_user_list. With #GUM_USER_LIST_FLAGS_RECORDS, the
+ * users are built from their records and have no remote object until they
+ * are changed, so that listing many users does not cost a DBus call per user.
+ *
+ * Returns: returns TRUE if the request has been pushed and is waiting for
+ * the response, FALSE otherwise. No callback is triggered, in case the
+ * function returns FALSE.
+ */
+gboolean
+gum_user_service_get_user_list_full (
+        GumUserService *self,
+        const gchar *const *types,
+        GumUserListFlags flags,
+        GumUserServiceListCb callback,
+        gpointer user_data)
 {
     DBG ("");
     g_return_val_if_fail (GUM_IS_USER_SERVICE (self), FALSE);
@@ -673,33 +863,46 @@ gum_user_service_get_user_list (
         return FALSE;
     }
     _create_op (self, (gpointer)callback, user_data);
-    gum_dbus_user_service_call_get_user_list (self->priv->dbus_service,
-            types, self->priv->cancellable, _on_get_user_list_cb, self);
+    if (_use_fd_transfer (self)) {
+        self->priv->op->types = g_strdupv ((gchar **) types);
+        self->priv->op->flags = flags;
+        gum_dbus_user_service_call_get_user_list_fd (self->priv->dbus_service,
+                types, NULL, self->priv->cancellable, _on_get_user_list_fd_cb,
+                self);
+    } else {
+        gum_dbus_user_service_call_get_user_list (self->priv->dbus_service,
+                types, self->priv->cancellable, _on_get_user_list_cb, self);
+    }
 
     return TRUE;
 }
 
 /**
- * gum_user_service_get_user_list_sync:
+ * gum_user_service_get_user_list_full_sync:
  * @self: #GumUserService object
  * @types: (transfer none): a string array of user types (e.g admin, normal etc)
+ * @flags: #GumUserListFlags
  *
- * This method gets the list of users based on the type. In case offline mode is
- * enabled, then the users is retrieved directly without using dbus otherwise
- * the users gets retrieved over the DBus synchronously.
+ * This method gets the list of users based on the type synchronously, as
+ * #gum_user_service_get_user_list_full. In offline mode the flags are
+ * ignored.
  *
  * Returns: (transfer full): #GumUserList of #GumUser. use
  * gum_user_list_free to free the list of the users.
  */
 GumUserList *
-gum_user_service_get_user_list_sync (
+gum_user_service_get_user_list_full_sync (
         GumUserService *self,
-        const gchar *const *types)
+        const gchar *const *types,
+        GumUserListFlags flags)
 {
     GError *error = NULL;
     gboolean rval = FALSE;
     GumUserList *users = NULL;
     GVariant *uids = NULL;
+    GVariant *records = NULL;
+    GVariant *handle = NULL;
+    GUnixFDList *fd_list = NULL;
 
     DBG ("");
     g_return_val_if_fail (GUM_IS_USER_SERVICE (self), NULL);
@@ -712,6 +915,24 @@ gum_user_service_get_user_list_sync (
             g_variant_unref (uids);
         }
     } else if (self->priv->dbus_service) {
+        if (_use_fd_transfer (self)) {
+            if (gum_dbus_user_service_call_get_user_list_fd_sync (
+                    self->priv->dbus_service, types, NULL, &handle, &fd_list,
+                    NULL, &error)) {
+                records = _records_variant_from_fd (handle, fd_list, &error);
+                g_variant_unref (handle);
+                GUM_OBJECT_UNREF (fd_list);
+            }
+            if (records) {
+                users = _records_variant_to_user_list (records, flags);
+                g_variant_unref (records);
+                return users;
+            }
+            /* e.g. daemon without sealed memory files or getUserListFd */
+            DBG ("Falling back to getUserList: %s",
+                    error ? error->message : "");
+            g_clear_error (&error);
+        }
         rval = gum_dbus_user_service_call_get_user_list_sync (
                 self->priv->dbus_service, types, &uids, NULL, &error);
         if (!rval && error) {
@@ -741,6 +962,97 @@ gum_user_service_list_free (
         g_list_free_full (users, _gum_user_service_list_free);
 }
 
+static GumSnapshot *
+_fetch_snapshot ()
+{
+    GumUserService *service = NULL;
+    GumSnapshot *fetched = NULL;
+    GUnixFDList *fd_list = NULL;
+    GVariant *handle = NULL;
+    guint64 generation = 0;
+    GError *error = NULL;
+    gint fd = -1;
+
+    service = gum_user_service_create_sync (FALSE);
+    if (service && service->priv->dbus_service &&
+        gum_dbus_user_service_call_get_snapshot_sync (
+                service->priv->dbus_service, NULL, &handle, &generation,
+                &fd_list, NULL, &error) && fd_list) {
+        fd = g_unix_fd_list_get (fd_list, g_variant_get_handle (handle),
+                &error);
+        if (fd >= 0) {
+            fetched = gum_snapshot_new_from_fd (fd, &error);
+        }
+    }
+
+    if (error) {
+        DBG ("Snapshot not available: %s", error->message);
+        g_error_free (error);
+    }
+    if (handle) g_variant_unref (handle);
+    GUM_OBJECT_UNREF (fd_list);
+    GUM_OBJECT_UNREF (service);
+
+    return fetched;
+}
+
+/* Gets the database snapshot published by the daemon, fetching it again over
+ * the DBus once it has been replaced. Each thread keeps its own reference,
+ * so lookups only take the lock when the snapshot changes. The returned
+ * snapshot is owned by the calling thread and valid until the next call. */
+GumSnapshot *
+gum_user_service_get_snapshot ()
+{
+    GumSnapshot *current = g_private_get (&thread_snapshot);
+
+    if (current && gum_snapshot_is_current (current))
+        return current;
+
+    g_mutex_lock (&snapshot_lock);
+    if (snapshot && !gum_snapshot_is_current (snapshot)) {
+        gum_snapshot_unref (snapshot);
+        snapshot = NULL;
+    }
+    if (!snapshot && g_get_monotonic_time () >= snapshot_retry_time) {
+        snapshot = _fetch_snapshot ();
+        if (!snapshot) {
+            snapshot_retry_time = g_get_monotonic_time () +
+                    GUM_SNAPSHOT_RETRY_INTERVAL;
+        }
+    }
+    current = snapshot ? gum_snapshot_ref (snapshot) : NULL;
+    g_mutex_unlock (&snapshot_lock);
+
+    g_private_replace (&thread_snapshot, current);
+
+    return current;
+}
+
+/* Checks that the snapshot still reflects the passwd and group files, which
+ * is not the case right after a write until the daemon has published the
+ * next snapshot, or after the files have been edited behind its back. Takes
+ * no lock: the file paths are only resolved on the first call. */
+gboolean
+gum_user_service_snapshot_is_in_sync (
+        GumSnapshot *current)
+{
+    static gsize files_resolved = 0;
+    GumConfig *config = NULL;
+
+    if (g_once_init_enter (&files_resolved)) {
+        config = gum_config_new (NULL);
+        snapshot_passwd_file = g_strdup (gum_config_get_string (config,
+                GUM_CONFIG_GENERAL_PASSWD_FILE));
+        snapshot_group_file = g_strdup (gum_config_get_string (config,
+                GUM_CONFIG_GENERAL_GROUP_FILE));
+        g_object_unref (config);
+        g_once_init_leave (&files_resolved, 1);
+    }
+
+    return gum_snapshot_is_in_sync (current, snapshot_passwd_file,
+            snapshot_group_file);
+}
+
 /**
  * gum_user_service_get_dbus_proxy:
  * @self: #GumUserService object
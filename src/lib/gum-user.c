@@ -23,6 +23,9 @@
  * 02110-1301 USA
  */
 
+#include <string.h>
+#include <errno.h>
+
 #include "common/gum-defines.h"
 #include "common/gum-log.h"
 #include "common/gum-error.h"
@@ -119,6 +122,7 @@ struct _GumUserPrivate
     GumdDaemon *offline_service;
     GumDbusUser *dbus_user;
     GumdDaemonUser *offline_user;
+    GVariant *record;       /* properties of a listed user not fetched yet */
     GCancellable *cancellable;
     GumUserOp *op;
 };
@@ -220,6 +224,65 @@ _on_user_remote_object_destroyed(
 
     GUM_OBJECT_UNREF (self->priv->dbus_user);
 }
+static void
+_create_dbus_user (
+        GumUser *user,
+        gchar *object_path,
+        GError *error);
+
+static gboolean
+_get_record_property (
+        GVariant *record,
+        const gchar *name,
+        GValue *value)
+{
+    GVariant *prop = g_variant_lookup_value (record, name, NULL);
+    GValue prop_value = G_VALUE_INIT;
+
+    if (!prop)
+        return FALSE;
+
+    g_dbus_gvariant_to_gvalue (prop, &prop_value);
+    g_value_transform (&prop_value, value);
+    g_value_unset (&prop_value);
+    g_variant_unref (prop);
+    return TRUE;
+}
+
+/* a user built from its record only gets its remote object once it is to be
+ * changed or a property the record lacks (e.g. icon) is read */
+static void
+_attach_dbus_user (
+        GumUser *self)
+{
+    GError *error = NULL;
+    gchar *object_path = NULL;
+    guint32 uid = GUM_USER_INVALID_UID;
+
+    if (!self->priv->record || self->priv->dbus_user ||
+        !self->priv->dbus_service) {
+        return;
+    }
+
+    g_variant_lookup (self->priv->record, "uid", "u", &uid);
+    if (gum_dbus_user_service_call_get_user_sync (
+            (GumDbusUserService*) gum_user_service_get_dbus_proxy (
+            self->priv->dbus_service), uid, &object_path,
+            self->priv->cancellable, &error)) {
+        _create_dbus_user (self, object_path, error);
+    }
+    g_free (object_path);
+
+    if (error) {
+        WARN ("Failed with error %d:%s", error->code, error->message);
+        g_error_free (error);
+    }
+    if (self->priv->dbus_user) {
+        g_variant_unref (self->priv->record);
+        self->priv->record = NULL;
+    }
+}
+
 static void
 _set_property (
         GObject *object,
@@ -239,6 +302,7 @@ _set_property (
             break;
         }
         default: {
+            _attach_dbus_user (self);
             if (self->priv->offline_user) {
                 g_object_set_property (G_OBJECT(self->priv->offline_user),
                         pspec->name, value);
@@ -270,6 +334,14 @@ _get_property (
             } else if (self->priv->dbus_user) {
                 g_object_get_property (G_OBJECT(self->priv->dbus_user),
                         pspec->name, value);
+            } else if (self->priv->record) {
+                if (!_get_record_property (self->priv->record, pspec->name,
+                        value)) {
+                    _attach_dbus_user (self);
+                    if (self->priv->dbus_user)
+                        g_object_get_property (G_OBJECT(self->priv->dbus_user),
+                                pspec->name, value);
+                }
             }
         }
     }
@@ -296,6 +368,10 @@ _dispose (GObject *object)
     GUM_OBJECT_UNREF (self->priv->dbus_service);
     GUM_OBJECT_UNREF (self->priv->offline_user);
     GUM_OBJECT_UNREF (self->priv->offline_service);
+    if (self->priv->record) {
+        g_variant_unref (self->priv->record);
+        self->priv->record = NULL;
+    }
 
     G_OBJECT_CLASS (gum_user_parent_class)->dispose (object);
 }
@@ -313,6 +389,7 @@ gum_user_init (
     self->priv = GUM_USER_PRIV (self);
     self->priv->dbus_user = NULL;
     self->priv->offline_user = NULL;
+    self->priv->record = NULL;
     self->priv->cancellable = NULL;
     self->priv->dbus_service = NULL;
     self->priv->op = NULL;
@@ -937,6 +1014,20 @@ gum_user_get_sync (
     return user;
 }
 
+/* builds a user from its record, as returned by getUserListFd, without any
+ * DBus call */
+GumUser *
+gum_user_new_from_record (
+        GVariant *record)
+{
+    GumUser *user = GUM_USER (g_object_new (GUM_TYPE_USER, "offline", FALSE,
+            NULL));
+
+    if (user)
+        user->priv->record = g_variant_ref (record);
+    return user;
+}
+
 /**
  * gum_user_get_by_name:
  * @username: name of the user
@@ -1126,6 +1217,7 @@ gum_user_delete (
     DBG ("");
     g_return_val_if_fail (GUM_IS_USER (self), FALSE);
 
+    _attach_dbus_user (self);
     if (!self->priv->dbus_user) {
         WARN ("Remote dbus object not valid");
         return FALSE;
@@ -1159,6 +1251,7 @@ gum_user_delete_sync (
     DBG ("");
     g_return_val_if_fail (GUM_IS_USER (self), FALSE);
 
+    _attach_dbus_user (self);
     if (self->priv->offline_user) {
         rval = gumd_daemon_delete_user (self->priv->offline_service,
                 self->priv->offline_user, rem_home_dir, &error);
@@ -1199,6 +1292,7 @@ gum_user_update (
     DBG ("");
     g_return_val_if_fail (GUM_IS_USER (self), FALSE);
 
+    _attach_dbus_user (self);
     if (!self->priv->dbus_user) {
         WARN ("Remote dbus object not valid");
         return FALSE;
@@ -1232,6 +1326,7 @@ gum_user_update_sync (
     DBG ("");
     g_return_val_if_fail (GUM_IS_USER (self), FALSE);
 
+    _attach_dbus_user (self);
     if (self->priv->offline_user) {
         rval = gumd_daemon_update_user (self->priv->offline_service,
                 self->priv->offline_user, &error);
@@ -1248,3 +1343,180 @@ gum_user_update_sync (
     }
     return rval;
 }
+
+static gchar *
+_copy_string (
+        gchar **buf,
+        const gchar *str)
+{
+    gchar *copy = *buf;
+    gsize len = strlen (str) + 1;
+    memcpy (copy, str, len);
+    *buf += len;
+    return copy;
+}
+
+static gint
+_lookup_snapshot (
+        uid_t uid,
+        const gchar *username,
+        struct passwd **pwd)
+{
+    GumSnapshot *snapshot = gum_user_service_get_snapshot ();
+    gsize buflen = 256;
+    gint res = EAGAIN;
+
+    *pwd = NULL;
+    if (!snapshot || !gum_user_service_snapshot_is_in_sync (snapshot))
+        return res;
+
+    do {
+        *pwd = g_realloc (*pwd, sizeof (struct passwd) + buflen);
+        if (username) {
+            res = gum_snapshot_getpwnam (snapshot, username, *pwd,
+                    (gchar *) (*pwd + 1), buflen);
+        } else {
+            res = gum_snapshot_getpwuid (snapshot, uid, *pwd,
+                    (gchar *) (*pwd + 1), buflen);
+        }
+        buflen *= 2;
+    } while (res == ERANGE);
+
+    if (res != 0) {
+        g_free (*pwd);
+        *pwd = NULL;
+    }
+    return res;
+}
+
+static struct passwd *
+_user_to_passwd (
+        GumUser *user)
+{
+    struct passwd *pwd = NULL;
+    gchar *username = NULL, *realname = NULL, *office = NULL;
+    gchar *officephone = NULL, *homephone = NULL;
+    gchar *homedir = NULL, *shell = NULL;
+    gchar *gecos = NULL;
+    gchar *buf = NULL;
+    uid_t uid = GUM_USER_INVALID_UID;
+    gid_t gid = GUM_GROUP_INVALID_GID;
+    gsize len = 0;
+
+    g_object_get (G_OBJECT (user), "username", &username, "uid", &uid,
+            "gid", &gid, "realname", &realname, "office", &office,
+            "officephone", &officephone, "homephone", &homephone,
+            "homedir", &homedir, "shell", &shell, NULL);
+
+    /* gecos fields in file order, without the trailing empty ones */
+    gecos = g_strjoin (",", realname ? realname : "", office ? office : "",
+            officephone ? officephone : "", homephone ? homephone : "", NULL);
+    len = strlen (gecos);
+    while (len > 0 && gecos[len - 1] == ',')
+        gecos[--len] = '\0';
+
+    if (!username) username = g_strdup ("");
+    if (!homedir) homedir = g_strdup ("");
+    if (!shell) shell = g_strdup ("");
+
+    len = strlen (username) + strlen (gecos) + strlen (homedir) +
+            strlen (shell) + 6;
+    pwd = g_malloc (sizeof (struct passwd) + len);
+    buf = (gchar *) (pwd + 1);
+    pwd->pw_name = _copy_string (&buf, username);
+    pwd->pw_passwd = _copy_string (&buf, "x");
+    pwd->pw_uid = uid;
+    pwd->pw_gid = gid;
+    pwd->pw_gecos = _copy_string (&buf, gecos);
+    pwd->pw_dir = _copy_string (&buf, homedir);
+    pwd->pw_shell = _copy_string (&buf, shell);
+
+    g_free (username);
+    g_free (realname);
+    g_free (office);
+    g_free (officephone);
+    g_free (homephone);
+    g_free (homedir);
+    g_free (shell);
+    g_free (gecos);
+
+    return pwd;
+}
+
+/**
+ * gum_user_lookup_by_uid:
+ * @uid: user id of the user
+ *
+ * This method looks the user up in the read-only snapshot of the user
+ * database published by the daemon. The snapshot is mapped into the process
+ * and searched locally, so the lookup needs neither DBus nor any lock unless
+ * the database has changed since the previous lookup: it only stat()s the
+ * snapshot and the passwd and group files to find out. If the snapshot
+ * is not available or no longer reflects the passwd and group files (e.g.
+ * right after a write), the user is retrieved over the DBus synchronously.
+ *
+ * Returns: (transfer full): passwd structure of the user (password field set
+ * to 'x') if found, NULL otherwise. The structure and its strings are a single
+ * block to be freed with g_free.
+ */
+struct passwd *
+gum_user_lookup_by_uid (
+        uid_t uid)
+{
+    struct passwd *pwd = NULL;
+    GumUser *user = NULL;
+    gint res = 0;
+
+    /* not found in an up to date snapshot is final; fall back only if the
+     * snapshot is missing, unreadable or stale */
+    res = _lookup_snapshot (uid, NULL, &pwd);
+    if (res == 0 || res == ENOENT) {
+        return pwd;
+    }
+
+    user = gum_user_get_sync (uid, FALSE);
+    if (!user)
+        return NULL;
+    pwd = _user_to_passwd (user);
+    g_object_unref (user);
+
+    return pwd;
+}
+
+/**
+ * gum_user_lookup_by_name:
+ * @username: name of the user
+ *
+ * This method looks the user up by name in the same way as
+ * #gum_user_lookup_by_uid.
+ *
+ * Returns: (transfer full): passwd structure of the user (password field set
+ * to 'x') if found, NULL otherwise. The structure and its strings are a single
+ * block to be freed with g_free.
+ */
+struct passwd *
+gum_user_lookup_by_name (
+        const gchar *username)
+{
+    struct passwd *pwd = NULL;
+    GumUser *user = NULL;
+    gint res = 0;
+
+    if (!username) {
+        WARN ("username not specified");
+        return NULL;
+    }
+
+    res = _lookup_snapshot (GUM_USER_INVALID_UID, username, &pwd);
+    if (res == 0 || res == ENOENT) {
+        return pwd;
+    }
+
+    user = gum_user_get_by_name_sync (username, FALSE);
+    if (!user)
+        return NULL;
+    pwd = _user_to_passwd (user);
+    g_object_unref (user);
+
+    return pwd;
+}
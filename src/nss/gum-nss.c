@@ -0,0 +1,677 @@
+/* vi: set et sw=4 ts=4 cino=t0,(0: */
+/* -*- Mode: C; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+/*
+ * This file is part of gum
+ *
+ * Copyright (C) 2013 Intel Corporation.
+ *
+ * Contact: Imran Zaman <imran.zaman@intel.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+
+#include "config.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <nss.h>
+#include <pthread.h>
+#include <pwd.h>
+#include <grp.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "common/gum-snapshot-format.h"
+
+/*
+ * NSS module serving the passwd and group databases from the snapshot
+ * published by gumd (see #GumSnapshot), instead of parsing the files on
+ * every lookup. Shadow entries are not part of the snapshot and keep being
+ * served by the files module.
+ *
+ * Whenever the snapshot is missing, disabled or out of sync with the passwd
+ * and group files (e.g. because they were edited without gumd), the module
+ * returns NSS_STATUS_UNAVAIL so that the lookup falls through to the files
+ * module. When the snapshot is in sync it holds exactly what the files do,
+ * so the recommended nsswitch.conf configuration is:
+ *
+ *   passwd: gum [NOTFOUND=return] files
+ *   group:  gum [NOTFOUND=return] files
+ *
+ * which also keeps the entries from being enumerated twice.
+ *
+ * The module is loaded into every process resolving users, setuid ones
+ * included, so it reads the snapshot by itself rather than through
+ * libgum-common and GLib, and only uses the paths gumd was configured with
+ * at build time: neither gumd.conf nor the environment can point it to
+ * another snapshot or database file.
+ */
+
+#define GUM_NSS_SNAPSHOT_FILE   GUM_SNAPSHOT_FILE
+#define GUM_NSS_PASSWD_FILE     GUM_PASSWD_FILE
+#define GUM_NSS_GROUP_FILE      GUM_GROUP_FILE
+
+typedef struct {
+    int ref_count;
+    int fd;
+    const uint8_t *data;
+    size_t size;
+    const GumSnapshotHeader *header;
+    const GumSnapshotUser *users;
+    const GumSnapshotGroup *groups;
+    const uint32_t *uid_index;
+    const uint32_t *username_index;
+    const uint32_t *gid_index;
+    const uint32_t *groupname_index;
+    const char *strings;
+} GumNssSnapshot;
+
+typedef struct {
+    GumNssSnapshot *snapshot;
+    uint32_t index;
+} GumNssEnumeration;
+
+static pthread_mutex_t nss_lock = PTHREAD_MUTEX_INITIALIZER;
+static GumNssSnapshot *nss_snapshot = NULL;
+static GumNssEnumeration nss_pwent = { NULL, 0 };
+static GumNssEnumeration nss_grent = { NULL, 0 };
+
+static int
+_check_range (
+        size_t size,
+        uint32_t offset,
+        uint32_t count,
+        size_t elem_size)
+{
+    return (offset % sizeof (uint32_t)) == 0 &&
+           (uint64_t) offset + (uint64_t) count * elem_size <= size;
+}
+
+static int
+_is_power_of_two (
+        uint32_t n)
+{
+    return n != 0 && (n & (n - 1)) == 0;
+}
+
+/* same checks as gum_snapshot_new_from_fd () */
+static int
+_validate (
+        GumNssSnapshot *self)
+{
+    const GumSnapshotHeader *h = self->header;
+
+    return h->magic == GUM_SNAPSHOT_MAGIC &&
+           h->version == GUM_SNAPSHOT_VERSION &&
+           h->size == self->size &&
+           _is_power_of_two (h->user_slots) &&
+           _is_power_of_two (h->group_slots) &&
+           h->n_users < h->user_slots &&
+           h->n_groups < h->group_slots &&
+           _check_range (self->size, h->users, h->n_users,
+                   sizeof (GumSnapshotUser)) &&
+           _check_range (self->size, h->groups, h->n_groups,
+                   sizeof (GumSnapshotGroup)) &&
+           _check_range (self->size, h->uid_index, h->user_slots,
+                   sizeof (uint32_t)) &&
+           _check_range (self->size, h->username_index, h->user_slots,
+                   sizeof (uint32_t)) &&
+           _check_range (self->size, h->gid_index, h->group_slots,
+                   sizeof (uint32_t)) &&
+           _check_range (self->size, h->groupname_index, h->group_slots,
+                   sizeof (uint32_t)) &&
+           h->strings_size > 0 &&
+           (uint64_t) h->strings + h->strings_size <= self->size &&
+           self->data[h->strings + h->strings_size - 1] == '\0';
+}
+
+static void
+_snapshot_unref (
+        GumNssSnapshot *self)
+{
+    if (!self || __atomic_sub_fetch (&self->ref_count, 1, __ATOMIC_ACQ_REL))
+        return;
+
+    munmap ((void *) self->data, self->size);
+    close (self->fd);
+    free (self);
+}
+
+static GumNssSnapshot *
+_snapshot_ref (
+        GumNssSnapshot *self)
+{
+    __atomic_add_fetch (&self->ref_count, 1, __ATOMIC_RELAXED);
+    return self;
+}
+
+static GumNssSnapshot *
+_snapshot_open (void)
+{
+    GumNssSnapshot *self = NULL;
+    struct stat st;
+    void *data = NULL;
+    int fd = -1;
+
+    fd = open (GUM_NSS_SNAPSHOT_FILE, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return NULL;
+
+    if (fstat (fd, &st) != 0 ||
+        st.st_size < (off_t) sizeof (GumSnapshotHeader) ||
+        st.st_size > UINT32_MAX ||
+        (data = mmap (NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0)) ==
+                MAP_FAILED ||
+        !(self = calloc (1, sizeof (GumNssSnapshot)))) {
+        if (data && data != MAP_FAILED)
+            munmap (data, st.st_size);
+        close (fd);
+        return NULL;
+    }
+
+    self->ref_count = 1;
+    self->fd = fd;
+    self->data = data;
+    self->size = st.st_size;
+    self->header = data;
+    if (!_validate (self)) {
+        _snapshot_unref (self);
+        return NULL;
+    }
+
+    self->users = (const GumSnapshotUser *)
+            (self->data + self->header->users);
+    self->groups = (const GumSnapshotGroup *)
+            (self->data + self->header->groups);
+    self->uid_index = (const uint32_t *)
+            (self->data + self->header->uid_index);
+    self->username_index = (const uint32_t *)
+            (self->data + self->header->username_index);
+    self->gid_index = (const uint32_t *)
+            (self->data + self->header->gid_index);
+    self->groupname_index = (const uint32_t *)
+            (self->data + self->header->groupname_index);
+    self->strings = (const char *) (self->data + self->header->strings);
+
+    return self;
+}
+
+static int
+_snapshot_is_current (
+        GumNssSnapshot *self)
+{
+    struct stat st;
+
+    /* a replaced snapshot has been unlinked by the rename */
+    return fstat (self->fd, &st) == 0 && st.st_nlink > 0;
+}
+
+static int
+_match_stamp (
+        const GumSnapshotStamp *stamp,
+        const char *path)
+{
+    struct stat st;
+
+    return stat (path, &st) == 0 &&
+           stamp->dev == (uint64_t) st.st_dev &&
+           stamp->ino == (uint64_t) st.st_ino &&
+           stamp->size == (uint64_t) st.st_size &&
+           stamp->mtime_sec == (int64_t) st.st_mtim.tv_sec &&
+           stamp->mtime_nsec == (int64_t) st.st_mtim.tv_nsec;
+}
+
+/* called with the lock held */
+static GumNssSnapshot *
+_get_snapshot (void)
+{
+    if (nss_snapshot && !_snapshot_is_current (nss_snapshot)) {
+        _snapshot_unref (nss_snapshot);
+        nss_snapshot = NULL;
+    }
+    if (!nss_snapshot)
+        nss_snapshot = _snapshot_open ();
+
+    if (!nss_snapshot ||
+        !_match_stamp (&nss_snapshot->header->passwd_stamp,
+                GUM_NSS_PASSWD_FILE) ||
+        !_match_stamp (&nss_snapshot->header->group_stamp,
+                GUM_NSS_GROUP_FILE)) {
+        return NULL;
+    }
+
+    return _snapshot_ref (nss_snapshot);
+}
+
+static GumNssSnapshot *
+_snapshot (void)
+{
+    GumNssSnapshot *snapshot = NULL;
+
+    pthread_mutex_lock (&nss_lock);
+    snapshot = _get_snapshot ();
+    pthread_mutex_unlock (&nss_lock);
+
+    return snapshot;
+}
+
+static const char *
+_string (
+        GumNssSnapshot *self,
+        uint32_t offset)
+{
+    if (offset >= self->header->strings_size)
+        return NULL;
+    return self->strings + offset;
+}
+
+static const GumSnapshotUser *
+_find_user_by_uid (
+        GumNssSnapshot *self,
+        uid_t uid)
+{
+    uint32_t mask = self->header->user_slots - 1;
+    uint32_t i = gum_snapshot_hash_id (uid) & mask;
+    uint32_t n, slot;
+
+    for (n = 0; n <= mask; n++, i = (i + 1) & mask) {
+        slot = self->uid_index[i];
+        if (slot == 0 || slot > self->header->n_users)
+            break;
+        if (self->users[slot - 1].uid == uid)
+            return &self->users[slot - 1];
+    }
+    return NULL;
+}
+
+static const GumSnapshotUser *
+_find_user_by_name (
+        GumNssSnapshot *self,
+        const char *name)
+{
+    uint32_t mask = self->header->user_slots - 1;
+    uint32_t i = gum_snapshot_hash_name (name) & mask;
+    const char *str = NULL;
+    uint32_t n, slot;
+
+    for (n = 0; n <= mask; n++, i = (i + 1) & mask) {
+        slot = self->username_index[i];
+        if (slot == 0 || slot > self->header->n_users)
+            break;
+        str = _string (self, self->users[slot - 1].name);
+        if (str && strcmp (str, name) == 0)
+            return &self->users[slot - 1];
+    }
+    return NULL;
+}
+
+static const GumSnapshotGroup *
+_find_group_by_gid (
+        GumNssSnapshot *self,
+        gid_t gid)
+{
+    uint32_t mask = self->header->group_slots - 1;
+    uint32_t i = gum_snapshot_hash_id (gid) & mask;
+    uint32_t n, slot;
+
+    for (n = 0; n <= mask; n++, i = (i + 1) & mask) {
+        slot = self->gid_index[i];
+        if (slot == 0 || slot > self->header->n_groups)
+            break;
+        if (self->groups[slot - 1].gid == gid)
+            return &self->groups[slot - 1];
+    }
+    return NULL;
+}
+
+static const GumSnapshotGroup *
+_find_group_by_name (
+        GumNssSnapshot *self,
+        const char *name)
+{
+    uint32_t mask = self->header->group_slots - 1;
+    uint32_t i = gum_snapshot_hash_name (name) & mask;
+    const char *str = NULL;
+    uint32_t n, slot;
+
+    for (n = 0; n <= mask; n++, i = (i + 1) & mask) {
+        slot = self->groupname_index[i];
+        if (slot == 0 || slot > self->header->n_groups)
+            break;
+        str = _string (self, self->groups[slot - 1].name);
+        if (str && strcmp (str, name) == 0)
+            return &self->groups[slot - 1];
+    }
+    return NULL;
+}
+
+static char *
+_copy_string (
+        char **buf,
+        const char *str)
+{
+    char *copy = *buf;
+    size_t len = strlen (str) + 1;
+    memcpy (copy, str, len);
+    *buf += len;
+    return copy;
+}
+
+static int
+_fill_passwd (
+        GumNssSnapshot *self,
+        const GumSnapshotUser *user,
+        struct passwd *pwd,
+        char *buf,
+        size_t buflen)
+{
+    const char *name, *gecos, *dir, *shell;
+
+    if (!user)
+        return ENOENT;
+
+    name = _string (self, user->name);
+    gecos = _string (self, user->gecos);
+    dir = _string (self, user->dir);
+    shell = _string (self, user->shell);
+    if (!name || !gecos || !dir || !shell)
+        return EIO;
+
+    if (strlen (name) + strlen (gecos) + strlen (dir) + strlen (shell) + 6 >
+            buflen)
+        return ERANGE;
+
+    pwd->pw_name = _copy_string (&buf, name);
+    pwd->pw_passwd = _copy_string (&buf, "x");
+    pwd->pw_uid = user->uid;
+    pwd->pw_gid = user->gid;
+    pwd->pw_gecos = _copy_string (&buf, gecos);
+    pwd->pw_dir = _copy_string (&buf, dir);
+    pwd->pw_shell = _copy_string (&buf, shell);
+
+    return 0;
+}
+
+static int
+_fill_group (
+        GumNssSnapshot *self,
+        const GumSnapshotGroup *group,
+        struct group *grp,
+        char *buf,
+        size_t buflen)
+{
+    const char *name = NULL;
+    const char *members = NULL;
+    size_t align = 0;
+    size_t members_len = 0;
+    size_t offset = 0;
+    uint32_t i;
+
+    if (!group)
+        return ENOENT;
+
+    name = _string (self, group->name);
+    if (!name)
+        return EIO;
+
+    if (group->n_members > 0) {
+        members = _string (self, group->members);
+        if (!members || group->n_members > self->header->strings_size)
+            return EIO;
+        for (i = 0, offset = group->members; i < group->n_members; i++) {
+            if (offset >= self->header->strings_size)
+                return EIO;
+            offset += strlen (self->strings + offset) + 1;
+        }
+        members_len = offset - group->members;
+    }
+
+    align = (- (uintptr_t) buf) & (sizeof (char *) - 1);
+    if (align + (group->n_members + 1) * sizeof (char *) + strlen (name) +
+            members_len + 3 > buflen)
+        return ERANGE;
+
+    grp->gr_mem = (char **) (buf + align);
+    buf += align + (group->n_members + 1) * sizeof (char *);
+    grp->gr_name = _copy_string (&buf, name);
+    grp->gr_passwd = _copy_string (&buf, "x");
+    grp->gr_gid = group->gid;
+    if (members_len > 0) {
+        memcpy (buf, members, members_len);
+    }
+    for (i = 0; i < group->n_members; i++) {
+        grp->gr_mem[i] = buf;
+        buf += strlen (buf) + 1;
+    }
+    grp->gr_mem[group->n_members] = NULL;
+
+    return 0;
+}
+
+static enum nss_status
+_status (
+        int res,
+        int *errnop)
+{
+    switch (res) {
+        case 0:
+            return NSS_STATUS_SUCCESS;
+        case ENOENT:
+            *errnop = ENOENT;
+            return NSS_STATUS_NOTFOUND;
+        case ERANGE:
+            /* caller retries with a bigger buffer */
+            *errnop = ERANGE;
+            return NSS_STATUS_TRYAGAIN;
+        default:
+            *errnop = ENOENT;
+            return NSS_STATUS_UNAVAIL;
+    }
+}
+
+static enum nss_status
+_set_enumeration (
+        GumNssEnumeration *enumeration)
+{
+    enum nss_status status = NSS_STATUS_SUCCESS;
+
+    pthread_mutex_lock (&nss_lock);
+    _snapshot_unref (enumeration->snapshot);
+    enumeration->snapshot = _get_snapshot ();
+    enumeration->index = 0;
+    if (!enumeration->snapshot)
+        status = NSS_STATUS_UNAVAIL;
+    pthread_mutex_unlock (&nss_lock);
+
+    return status;
+}
+
+static enum nss_status
+_end_enumeration (
+        GumNssEnumeration *enumeration)
+{
+    pthread_mutex_lock (&nss_lock);
+    _snapshot_unref (enumeration->snapshot);
+    enumeration->snapshot = NULL;
+    enumeration->index = 0;
+    pthread_mutex_unlock (&nss_lock);
+
+    return NSS_STATUS_SUCCESS;
+}
+
+enum nss_status
+_nss_gum_getpwnam_r (
+        const char *name,
+        struct passwd *pwd,
+        char *buf,
+        size_t buflen,
+        int *errnop)
+{
+    GumNssSnapshot *snapshot = _snapshot ();
+    int res = 0;
+
+    if (!snapshot)
+        return _status (EIO, errnop);
+
+    res = name ? _fill_passwd (snapshot, _find_user_by_name (snapshot, name),
+            pwd, buf, buflen) : ENOENT;
+    _snapshot_unref (snapshot);
+
+    return _status (res, errnop);
+}
+
+enum nss_status
+_nss_gum_getpwuid_r (
+        uid_t uid,
+        struct passwd *pwd,
+        char *buf,
+        size_t buflen,
+        int *errnop)
+{
+    GumNssSnapshot *snapshot = _snapshot ();
+    int res = 0;
+
+    if (!snapshot)
+        return _status (EIO, errnop);
+
+    res = _fill_passwd (snapshot, _find_user_by_uid (snapshot, uid), pwd, buf,
+            buflen);
+    _snapshot_unref (snapshot);
+
+    return _status (res, errnop);
+}
+
+enum nss_status
+_nss_gum_setpwent (
+        int stayopen)
+{
+    return _set_enumeration (&nss_pwent);
+}
+
+enum nss_status
+_nss_gum_endpwent (void)
+{
+    return _end_enumeration (&nss_pwent);
+}
+
+enum nss_status
+_nss_gum_getpwent_r (
+        struct passwd *pwd,
+        char *buf,
+        size_t buflen,
+        int *errnop)
+{
+    int res = EIO;
+
+    pthread_mutex_lock (&nss_lock);
+    if (!nss_pwent.snapshot)
+        nss_pwent.snapshot = _get_snapshot ();
+    if (nss_pwent.snapshot) {
+        res = _fill_passwd (nss_pwent.snapshot,
+                nss_pwent.index < nss_pwent.snapshot->header->n_users ?
+                &nss_pwent.snapshot->users[nss_pwent.index] : NULL,
+                pwd, buf, buflen);
+        if (res == 0)
+            nss_pwent.index++;
+    }
+    pthread_mutex_unlock (&nss_lock);
+
+    return _status (res, errnop);
+}
+
+enum nss_status
+_nss_gum_getgrnam_r (
+        const char *name,
+        struct group *grp,
+        char *buf,
+        size_t buflen,
+        int *errnop)
+{
+    GumNssSnapshot *snapshot = _snapshot ();
+    int res = 0;
+
+    if (!snapshot)
+        return _status (EIO, errnop);
+
+    res = name ? _fill_group (snapshot, _find_group_by_name (snapshot, name),
+            grp, buf, buflen) : ENOENT;
+    _snapshot_unref (snapshot);
+
+    return _status (res, errnop);
+}
+
+enum nss_status
+_nss_gum_getgrgid_r (
+        gid_t gid,
+        struct group *grp,
+        char *buf,
+        size_t buflen,
+        int *errnop)
+{
+    GumNssSnapshot *snapshot = _snapshot ();
+    int res = 0;
+
+    if (!snapshot)
+        return _status (EIO, errnop);
+
+    res = _fill_group (snapshot, _find_group_by_gid (snapshot, gid), grp, buf,
+            buflen);
+    _snapshot_unref (snapshot);
+
+    return _status (res, errnop);
+}
+
+enum nss_status
+_nss_gum_setgrent (
+        int stayopen)
+{
+    return _set_enumeration (&nss_grent);
+}
+
+enum nss_status
+_nss_gum_endgrent (void)
+{
+    return _end_enumeration (&nss_grent);
+}
+
+enum nss_status
+_nss_gum_getgrent_r (
+        struct group *grp,
+        char *buf,
+        size_t buflen,
+        int *errnop)
+{
+    int res = EIO;
+
+    pthread_mutex_lock (&nss_lock);
+    if (!nss_grent.snapshot)
+        nss_grent.snapshot = _get_snapshot ();
+    if (nss_grent.snapshot) {
+        res = _fill_group (nss_grent.snapshot,
+                nss_grent.index < nss_grent.snapshot->header->n_groups ?
+                &nss_grent.snapshot->groups[nss_grent.index] : NULL,
+                grp, buf, buflen);
+        if (res == 0)
+            nss_grent.index++;
+    }
+    pthread_mutex_unlock (&nss_lock);
+
+    return _status (res, errnop);
+}
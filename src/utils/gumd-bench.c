@@ -0,0 +1,644 @@
+/* vi: set et sw=4 ts=4 cino=t0,(0: */
+/* -*- Mode: C; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+/*
+ * This file is part of gum
+ *
+ * Copyright (C) 2013 Intel Corporation.
+ *
+ * Contact: Imran Zaman <imran.zaman@intel.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+
+#include "config.h"
+
+#include <errno.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <glib.h>
+#include <glib/gstdio.h>
+
+#include "gum-user.h"
+#include "gum-user-service.h"
+#include "common/gum-dbus.h"
+#include "common/gum-defines.h"
+#include "common/gum-log.h"
+#include "common/gum-user-types.h"
+
+/*
+ * Load generator for gumd: starts a private gumd (or uses a running one with
+ * --external), forks the given number of libgum clients, each with its own
+ * D-Bus connection, and has them run a weighted mix of user operations for
+ * the given duration. Latencies are collected by the clients and reported
+ * per operation by the parent once all of them are done.
+ *
+ * Clients add the users they work on (named gbench<client>u<n>), and delete
+ * the ones that are left at the end. The private daemon gets the
+ * UM_CONF_FILE and UM_*_FILE environment variables, which only a debug build
+ * of gumd honours, so it is started only if this is a test (and thus debug)
+ * build and UM_CONF_FILE is set, to keep it away from the system databases.
+ * --external is needed to load a running daemon.
+ */
+
+#define GUM_BENCH_MIX_DEFAULT   "get=60,list=5,add=10,update=15,delete=10"
+#define GUM_BENCH_START_TIMEOUT 10  /* secs */
+
+typedef enum {
+    GUM_BENCH_OP_GET = 0,
+    GUM_BENCH_OP_LIST,
+    GUM_BENCH_OP_ADD,
+    GUM_BENCH_OP_UPDATE,
+    GUM_BENCH_OP_DELETE,
+    GUM_BENCH_OP_LAST
+} GumBenchOp;
+
+static const gchar *op_names[GUM_BENCH_OP_LAST] = {
+    "get", "list", "add", "update", "delete"
+};
+
+typedef struct {
+    GArray *samples;    /* gint64 usecs */
+    guint32 failed;
+} GumBenchResult;
+
+static gint clients = 4;
+static gint duration = 10;
+static gint seed_users = 10;
+static gchar *mix = NULL;
+static gchar *gumd_path = NULL;
+static gchar *dbus_config = NULL;
+static gboolean external = FALSE;
+
+static GOptionEntry options[] = {
+    { "clients", 'c', 0, G_OPTION_ARG_INT, &clients,
+      "number of concurrent clients (default: 4)", "N" },
+    { "duration", 'd', 0, G_OPTION_ARG_INT, &duration,
+      "duration of the run in seconds (default: 10)", "SECS" },
+    { "users", 'u', 0, G_OPTION_ARG_INT, &seed_users,
+      "users added by each client before the run (default: 10)", "N" },
+    { "mix", 'm', 0, G_OPTION_ARG_STRING, &mix,
+      "weights of the operations (default: " GUM_BENCH_MIX_DEFAULT ")",
+      "OP=WEIGHT,..." },
+    { "gumd", 'g', 0, G_OPTION_ARG_FILENAME, &gumd_path,
+      "gumd binary to start in P2P mode (default: " GUM_BENCH_GUMD ")",
+      "PATH" },
+    { "dbus-config", 'b', 0, G_OPTION_ARG_FILENAME, &dbus_config,
+      "dbus-daemon configuration to start the private bus with, e.g. "
+      "test-gumd-dbus.conf", "FILE" },
+    { "external", 'e', 0, G_OPTION_ARG_NONE, &external,
+      "use the running gumd instead of starting a private one", NULL },
+    { NULL }
+};
+
+static gboolean
+_parse_mix (
+        const gchar *str,
+        guint *weights)
+{
+    gchar **items = g_strsplit (str, ",", -1);
+    gboolean ret = TRUE;
+    gint i, op;
+
+    memset (weights, 0, sizeof (guint) * GUM_BENCH_OP_LAST);
+    for (i = 0; items[i] && ret; i++) {
+        gchar **kv = g_strsplit (items[i], "=", 2);
+        ret = FALSE;
+        for (op = 0; kv[0] && kv[1] && op < GUM_BENCH_OP_LAST; op++) {
+            if (g_strcmp0 (g_strstrip (kv[0]), op_names[op]) == 0) {
+                weights[op] = (guint) g_ascii_strtoull (kv[1], NULL, 10);
+                ret = TRUE;
+                break;
+            }
+        }
+        if (!ret)
+            g_printerr ("invalid operation weight '%s'\n", items[i]);
+        g_strfreev (kv);
+    }
+    g_strfreev (items);
+
+    return ret;
+}
+
+static gboolean
+_write_all (
+        gint fd,
+        gconstpointer data,
+        gsize len)
+{
+    const gchar *buf = data;
+
+    while (len > 0) {
+        gssize n = write (fd, buf, len);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return FALSE;
+        buf += n;
+        len -= n;
+    }
+    return TRUE;
+}
+
+static gboolean
+_read_all (
+        gint fd,
+        gpointer data,
+        gsize len)
+{
+    gchar *buf = data;
+
+    while (len > 0) {
+        gssize n = read (fd, buf, len);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return FALSE;
+        buf += n;
+        len -= n;
+    }
+    return TRUE;
+}
+
+static GumUser *
+_add_user (
+        gint client,
+        guint *serial)
+{
+    GumUser *user = gum_user_create_sync (FALSE);
+    gchar *name = NULL;
+
+    if (!user)
+        return NULL;
+
+    name = g_strdup_printf ("gbench%du%u", client, (*serial)++);
+    g_object_set (G_OBJECT (user), "usertype", GUM_USERTYPE_NORMAL,
+            "username", name, NULL);
+    g_free (name);
+    if (!gum_user_add_sync (user)) {
+        g_object_unref (user);
+        return NULL;
+    }
+    return user;
+}
+
+static gboolean
+_run_op (
+        GumBenchOp op,
+        gint client,
+        guint *serial,
+        GPtrArray *pool,
+        GRand *rand,
+        GumUserService *service)
+{
+    GumUser *user = NULL;
+    GumUserList *list = NULL;
+    gboolean ok = FALSE;
+    guint pos = 0;
+    uid_t uid = GUM_USER_INVALID_UID;
+
+    if (pool->len > 0)
+        pos = g_rand_int_range (rand, 0, pool->len);
+
+    switch (op) {
+        case GUM_BENCH_OP_GET:
+            g_object_get (G_OBJECT (g_ptr_array_index (pool, pos)), "uid",
+                    &uid, NULL);
+            user = gum_user_get_sync (uid, FALSE);
+            ok = user != NULL;
+            if (user)
+                g_object_unref (user);
+            break;
+        case GUM_BENCH_OP_LIST:
+            list = gum_user_service_get_user_list_sync (service, NULL);
+            ok = list != NULL;
+            gum_user_service_list_free (list);
+            break;
+        case GUM_BENCH_OP_ADD:
+            user = _add_user (client, serial);
+            ok = user != NULL;
+            if (user)
+                g_ptr_array_add (pool, user);
+            break;
+        case GUM_BENCH_OP_UPDATE:
+            user = g_ptr_array_index (pool, pos);
+            g_object_set (G_OBJECT (user), "office",
+                    (*serial)++ % 2 ? "bench" : "hcneb", NULL);
+            ok = gum_user_update_sync (user);
+            break;
+        case GUM_BENCH_OP_DELETE:
+            user = g_ptr_array_index (pool, pos);
+            ok = gum_user_delete_sync (user, TRUE);
+            if (ok)
+                g_ptr_array_remove_index_fast (pool, pos);
+            break;
+        default:
+            break;
+    }
+    return ok;
+}
+
+static void
+_run_client (
+        gint client,
+        const guint *weights,
+        gint result_fd,
+        gint go_fd)
+{
+    GumBenchResult results[GUM_BENCH_OP_LAST];
+    GumUserService *service = NULL;
+    GPtrArray *pool = NULL;
+    GRand *rand = NULL;
+    GumUser *user = NULL;
+    guint serial = 0, total = 0, pick = 0;
+    gint64 start = 0, end = 0, usecs = 0;
+    gchar c = 0;
+    gboolean ok = FALSE;
+    gint op, i;
+
+    pool = g_ptr_array_new_with_free_func (g_object_unref);
+    rand = g_rand_new_with_seed (client);
+    for (op = 0; op < GUM_BENCH_OP_LAST; op++) {
+        results[op].samples = g_array_new (FALSE, FALSE, sizeof (gint64));
+        results[op].failed = 0;
+        total += weights[op];
+    }
+
+    service = gum_user_service_create_sync (FALSE);
+    for (i = 0; i < seed_users; i++) {
+        user = _add_user (client, &serial);
+        if (user)
+            g_ptr_array_add (pool, user);
+    }
+
+    /* tell the parent we are ready, then wait for the others */
+    c = service ? 'r' : 'f';
+    _write_all (result_fd, &c, 1);
+    while (read (go_fd, &c, 1) < 0 && errno == EINTR)
+        ;
+
+    end = g_get_monotonic_time () + (gint64) duration * G_USEC_PER_SEC;
+    while (service && g_get_monotonic_time () < end) {
+        pick = g_rand_int_range (rand, 0, total);
+        for (op = 0; pick >= weights[op]; op++)
+            pick -= weights[op];
+        /* nothing to work on: make something */
+        if (pool->len == 0 && (op == GUM_BENCH_OP_GET ||
+            op == GUM_BENCH_OP_UPDATE || op == GUM_BENCH_OP_DELETE))
+            op = GUM_BENCH_OP_ADD;
+
+        start = g_get_monotonic_time ();
+        ok = _run_op (op, client, &serial, pool, rand, service);
+        usecs = g_get_monotonic_time () - start;
+        g_array_append_val (results[op].samples, usecs);
+        if (!ok)
+            results[op].failed++;
+    }
+
+    for (op = 0; op < GUM_BENCH_OP_LAST; op++) {
+        guint32 count = results[op].samples->len;
+        _write_all (result_fd, &count, sizeof (count));
+        _write_all (result_fd, &results[op].failed, sizeof (guint32));
+        _write_all (result_fd, results[op].samples->data,
+                count * sizeof (gint64));
+        g_array_unref (results[op].samples);
+    }
+    close (result_fd);
+
+    for (i = 0; i < (gint) pool->len; i++)
+        gum_user_delete_sync (g_ptr_array_index (pool, i), TRUE);
+    g_ptr_array_unref (pool);
+    g_rand_free (rand);
+    if (service)
+        g_object_unref (service);
+}
+
+static gboolean
+_read_results (
+        gint fd,
+        GumBenchResult *results)
+{
+    gint op;
+
+    for (op = 0; op < GUM_BENCH_OP_LAST; op++) {
+        guint32 count = 0, failed = 0;
+        guint len = results[op].samples->len;
+
+        if (!_read_all (fd, &count, sizeof (count)) ||
+            !_read_all (fd, &failed, sizeof (failed)))
+            return FALSE;
+        g_array_set_size (results[op].samples, len + count);
+        if (!_read_all (fd, &g_array_index (results[op].samples, gint64, len),
+                count * sizeof (gint64)))
+            return FALSE;
+        results[op].failed += failed;
+    }
+    return TRUE;
+}
+
+static gint
+_compare_samples (
+        gconstpointer a,
+        gconstpointer b)
+{
+    gint64 sa = *(const gint64 *) a;
+    gint64 sb = *(const gint64 *) b;
+
+    return sa < sb ? -1 : (sa > sb ? 1 : 0);
+}
+
+static gint64
+_percentile (
+        GArray *samples,
+        guint permille)
+{
+    guint pos = (samples->len * permille + 999) / 1000;
+
+    if (pos > 0)
+        pos--;
+    return g_array_index (samples, gint64, pos);
+}
+
+static void
+_print_results (
+        GumBenchResult *results,
+        gint64 elapsed)
+{
+    gdouble secs = (gdouble) elapsed / G_USEC_PER_SEC;
+    guint count = 0;
+    gint op;
+
+    g_print ("%-8s %9s %7s %10s %9s %9s %9s %9s %9s\n", "op", "count",
+            "failed", "ops/s", "p50(us)", "p95(us)", "p99(us)", "p99.9(us)",
+            "max(us)");
+    for (op = 0; op < GUM_BENCH_OP_LAST; op++) {
+        GArray *samples = results[op].samples;
+
+        count += samples->len;
+        if (samples->len == 0) {
+            g_print ("%-8s %9u\n", op_names[op], 0);
+            continue;
+        }
+        g_array_sort (samples, _compare_samples);
+        g_print ("%-8s %9u %7u %10.1f %9" G_GINT64_FORMAT " %9"
+                G_GINT64_FORMAT " %9" G_GINT64_FORMAT " %9" G_GINT64_FORMAT
+                " %9" G_GINT64_FORMAT "\n", op_names[op], samples->len,
+                results[op].failed, samples->len / secs,
+                _percentile (samples, 500), _percentile (samples, 950),
+                _percentile (samples, 990), _percentile (samples, 999),
+                g_array_index (samples, gint64, samples->len - 1));
+    }
+    g_print ("%-8s %9u %7s %10.1f\n", "total", count, "", count / secs);
+}
+
+#ifdef GUM_BUS_TYPE_P2P
+static GPid
+_start_daemon (
+        gchar **runtime_dir)
+{
+    gchar *argv[] = { NULL, NULL };
+    gchar *socket = NULL;
+    GError *error = NULL;
+    GPid pid = 0;
+    gint i;
+
+    /* keep the private daemon from clashing with the system one */
+    *runtime_dir = g_dir_make_tmp ("gumd-bench-XXXXXX", &error);
+    if (!*runtime_dir) {
+        g_printerr ("failed to create runtime dir: %s\n", error->message);
+        g_error_free (error);
+        return 0;
+    }
+    g_setenv ("XDG_RUNTIME_DIR", *runtime_dir, TRUE);
+
+    argv[0] = gumd_path ? gumd_path : GUM_BENCH_GUMD;
+    if (!g_spawn_async (NULL, argv, NULL, G_SPAWN_SEARCH_PATH, NULL, NULL, &pid,
+            &error)) {
+        g_printerr ("failed to start %s: %s\n", argv[0], error->message);
+        g_error_free (error);
+        return 0;
+    }
+
+    socket = g_build_filename (*runtime_dir, "gumd", "bus-sock", NULL);
+    for (i = 0; i < GUM_BENCH_START_TIMEOUT * 10 &&
+            !g_file_test (socket, G_FILE_TEST_EXISTS); i++)
+        g_usleep (G_USEC_PER_SEC / 10);
+    if (!g_file_test (socket, G_FILE_TEST_EXISTS))
+        g_printerr ("gumd did not come up within %d secs\n",
+                GUM_BENCH_START_TIMEOUT);
+    g_free (socket);
+
+    return pid;
+}
+#else
+static GPid
+_start_daemon (
+        gchar **runtime_dir)
+{
+    gchar *argv[] = { "dbus-daemon", NULL, NULL, NULL };
+    gchar address[512];
+    gint pipe_fd[2];
+    gssize len = 0;
+    GError *error = NULL;
+    GPid pid = 0;
+
+    /* gumd itself gets activated on the private bus */
+    if (!dbus_config) {
+        g_printerr ("--dbus-config is needed to start a private bus\n");
+        return 0;
+    }
+    if (pipe (pipe_fd) < 0) {
+        g_printerr ("failed to create pipe: %s\n", strerror (errno));
+        return 0;
+    }
+
+    argv[1] = g_strdup_printf ("--config-file=%s", dbus_config);
+    argv[2] = g_strdup_printf ("--print-address=%d", pipe_fd[1]);
+    if (!g_spawn_async (NULL, argv, NULL,
+            G_SPAWN_SEARCH_PATH | G_SPAWN_LEAVE_DESCRIPTORS_OPEN, NULL, NULL,
+            &pid, &error)) {
+        g_printerr ("failed to start dbus-daemon: %s\n", error->message);
+        g_error_free (error);
+        pid = 0;
+    }
+    g_free (argv[1]);
+    g_free (argv[2]);
+    close (pipe_fd[1]);
+
+    if (pid) {
+        while ((len = read (pipe_fd[0], address, sizeof (address) - 1)) < 0 &&
+                errno == EINTR)
+            ;
+        if (len <= 0) {
+            g_printerr ("failed to read the bus address\n");
+            kill (pid, SIGTERM);
+            pid = 0;
+        } else {
+            address[len] = '\0';
+            g_strchomp (address);
+            g_setenv (GUM_BUS_TYPE == G_BUS_TYPE_SYSTEM ?
+                    "DBUS_SYSTEM_BUS_ADDRESS" : "DBUS_SESSION_BUS_ADDRESS",
+                    address, TRUE);
+        }
+    }
+    close (pipe_fd[0]);
+
+    return pid;
+}
+#endif
+
+int
+main (int argc, char *argv[])
+{
+    GOptionContext *context = NULL;
+    GError *error = NULL;
+    GumBenchResult results[GUM_BENCH_OP_LAST];
+    guint weights[GUM_BENCH_OP_LAST];
+    gint *result_fds = NULL;
+    GPid *pids = NULL;
+    GPid daemon_pid = 0;
+    gchar *runtime_dir = NULL;
+    gint go_fd[2], fd[2];
+    gint64 start = 0, elapsed = 0;
+    gint ret = EXIT_SUCCESS;
+    gint i, op;
+    gchar c = 0;
+
+#if !GLIB_CHECK_VERSION (2, 36, 0)
+    g_type_init ();
+#endif
+
+    context = g_option_context_new ("- load generator for gumd");
+    g_option_context_add_main_entries (context, options, NULL);
+    if (!g_option_context_parse (context, &argc, &argv, &error)) {
+        g_printerr ("%s\n", error->message);
+        g_error_free (error);
+        g_option_context_free (context);
+        return EXIT_FAILURE;
+    }
+    g_option_context_free (context);
+
+    if (!_parse_mix (mix ? mix : GUM_BENCH_MIX_DEFAULT, weights))
+        return EXIT_FAILURE;
+    for (i = 0, op = 0; op < GUM_BENCH_OP_LAST; op++)
+        i += weights[op];
+    if (i == 0 || clients <= 0 || duration <= 0 || seed_users < 0) {
+        g_printerr ("invalid clients, duration, users or mix\n");
+        return EXIT_FAILURE;
+    }
+
+    if (!external) {
+#ifdef ENABLE_DEBUG
+        if (!g_getenv ("UM_CONF_FILE") ||
+            !g_file_test (g_getenv ("UM_CONF_FILE"), G_FILE_TEST_IS_REGULAR)) {
+            g_printerr ("UM_CONF_FILE is to point to the configuration of "
+                    "the private gumd, or --external be given\n");
+            return EXIT_FAILURE;
+        }
+#else
+        g_printerr ("a private gumd needs a debug build, use --external to "
+                "load a running one\n");
+        return EXIT_FAILURE;
+#endif
+        daemon_pid = _start_daemon (&runtime_dir);
+        if (!daemon_pid)
+            return EXIT_FAILURE;
+    }
+
+    /* clients are forked before any D-Bus connection exists, so that each
+     * of them gets its own */
+    if (pipe (go_fd) < 0) {
+        g_printerr ("failed to create pipe: %s\n", strerror (errno));
+        ret = EXIT_FAILURE;
+        goto _finished;
+    }
+    result_fds = g_new0 (gint, clients);
+    pids = g_new0 (GPid, clients);
+    for (i = 0; i < clients; i++) {
+        if (pipe (fd) < 0 || (pids[i] = fork ()) < 0) {
+            g_printerr ("failed to start client: %s\n", strerror (errno));
+            clients = i;
+            ret = EXIT_FAILURE;
+            break;
+        }
+        if (pids[i] == 0) {
+            close (fd[0]);
+            close (go_fd[1]);
+            _run_client (i, weights, fd[1], go_fd[0]);
+            _exit (EXIT_SUCCESS);
+        }
+        close (fd[1]);
+        result_fds[i] = fd[0];
+    }
+    close (go_fd[0]);
+
+    for (i = 0; i < clients; i++) {
+        if (!_read_all (result_fds[i], &c, 1) || c != 'r') {
+            g_printerr ("client %d failed to start\n", i);
+            ret = EXIT_FAILURE;
+        }
+    }
+
+    /* closing the pipe starts the clients */
+    start = g_get_monotonic_time ();
+    close (go_fd[1]);
+
+    for (op = 0; op < GUM_BENCH_OP_LAST; op++) {
+        results[op].samples = g_array_new (FALSE, FALSE, sizeof (gint64));
+        results[op].failed = 0;
+    }
+    for (i = 0; i < clients; i++) {
+        if (!_read_results (result_fds[i], results)) {
+            g_printerr ("failed to read the results of client %d\n", i);
+            ret = EXIT_FAILURE;
+        }
+        close (result_fds[i]);
+    }
+    elapsed = g_get_monotonic_time () - start;
+    for (i = 0; i < clients; i++)
+        waitpid (pids[i], NULL, 0);
+
+    g_print ("%d clients, %d secs\n", clients, duration);
+    _print_results (results, MAX (elapsed, 1));
+    for (op = 0; op < GUM_BENCH_OP_LAST; op++)
+        g_array_unref (results[op].samples);
+
+_finished:
+    if (daemon_pid) {
+        kill (daemon_pid, SIGTERM);
+        waitpid (daemon_pid, NULL, 0);
+        g_spawn_close_pid (daemon_pid);
+    }
+    if (runtime_dir) {
+        gchar *path = g_build_filename (runtime_dir, "gumd", "bus-sock", NULL);
+        g_remove (path);
+        g_free (path);
+        path = g_build_filename (runtime_dir, "gumd", NULL);
+        g_rmdir (path);
+        g_free (path);
+        g_rmdir (runtime_dir);
+        g_free (runtime_dir);
+    }
+    g_free (result_fds);
+    g_free (pids);
+    g_free (mix);
+    g_free (gumd_path);
+    g_free (dbus_config);
+    return ret;
+}
@@ -23,7 +23,10 @@
  */
 
 #include <glib.h>
+#include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
 
 #include "gum-user.h"
 #include "gum-user-service.h"
@@ -33,7 +36,10 @@
 #include "common/gum-error.h"
 #include "common/gum-user-types.h"
 #include "gum-group.h"
+#include "lib/gum-group-service.h"
 #include "common/gum-group-types.h"
+#include "daemon/core/gumd-daemon-user.h"
+#include "daemon/core/gumd-manifest.h"
 #include "config.h"
 
 #ifdef HAVE_LIBTLM_NFC
@@ -65,6 +71,26 @@ typedef struct {
     uid_t mem_uid; /*used in adding/deleting a member from the group*/
 } InputGroup;
 
+typedef struct {
+    gboolean is_user_add_op;
+    gboolean is_user_del_op;
+    gboolean is_user_up_op;
+    gboolean is_user_get_op;
+    gboolean is_user_get_by_name_op;
+    gboolean is_user_list_op;
+    gchar *user_types;
+    InputUser *user;
+
+    gboolean is_group_add_op;
+    gboolean is_group_del_op;
+    gboolean is_group_up_op;
+    gboolean is_group_get_op;
+    gboolean is_group_get_by_name_op;
+    gboolean is_group_add_mem_op;
+    gboolean is_group_del_mem_op;
+    InputGroup *group;
+} InputCommand;
+
 static gboolean offline_mode = FALSE;
 
 static InputUser *
@@ -111,6 +137,39 @@ _free_test_group (
     }
 }
 
+static InputCommand *
+_create_command ()
+{
+    InputCommand *cmd = g_malloc0 (sizeof (InputCommand));
+    cmd->user = _create_test_user ();
+    cmd->group = _create_test_group ();
+    return cmd;
+}
+
+static void
+_free_command (
+        InputCommand *cmd)
+{
+    if (cmd) {
+        _free_test_user (cmd->user);
+        _free_test_group (cmd->group);
+        g_free (cmd->user_types);
+        g_free (cmd);
+    }
+}
+
+static guint
+_get_command_op_count (
+        InputCommand *cmd)
+{
+    return cmd->is_user_add_op + cmd->is_user_del_op + cmd->is_user_up_op +
+            cmd->is_user_get_op + cmd->is_user_get_by_name_op +
+            cmd->is_user_list_op + cmd->is_group_add_op +
+            cmd->is_group_del_op + cmd->is_group_up_op +
+            cmd->is_group_get_op + cmd->is_group_get_by_name_op +
+            cmd->is_group_add_mem_op + cmd->is_group_del_mem_op;
+}
+
 static void
 _set_user_update_prop (
         GumUser *guser,
@@ -161,12 +220,10 @@ _set_user_prop (
     _set_user_update_prop (guser, user);
 }
 
-static void
-_print_user_prop (
-		GumUser *guser)
+static InputUser *
+_get_user_prop (
+        GumUser *guser)
 {
-	if (!guser) return;
-
 	InputUser *user = _create_test_user ();
 	GumUserType ut = GUM_USERTYPE_NONE;
 	g_object_get (G_OBJECT (guser), "uid", &user->uid, NULL);
@@ -183,6 +240,16 @@ _print_user_prop (
     g_object_get (G_OBJECT (guser), "homedir", &user->home_dir, NULL);
     g_object_get (G_OBJECT (guser), "shell", &user->shell, NULL);
     g_object_get (G_OBJECT (guser), "icon", &user->icon, NULL);
+    return user;
+}
+
+static void
+_print_user_prop (
+		GumUser *guser)
+{
+	if (!guser) return;
+
+	InputUser *user = _get_user_prop (guser);
 
     INFO ("uid : %u", user->uid);
     INFO ("gid : %u", user->gid);
@@ -435,14 +502,22 @@ _set_group_prop (
 }
 
 
-static void
-_print_group_prop (
-		GumGroup *grp)
+static InputGroup *
+_get_group_prop (
+        GumGroup *grp)
 {
 	InputGroup *group = _create_test_group ();
 
 	g_object_get (G_OBJECT (grp), "gid", &group->gid, NULL);
     g_object_get (G_OBJECT (grp), "groupname", &group->group_name, NULL);
+    return group;
+}
+
+static void
+_print_group_prop (
+		GumGroup *grp)
+{
+	InputGroup *group = _get_group_prop (grp);
 
     INFO ("gid : %u", group->gid);
     INFO ("groupname : %s", group->group_name ? group->group_name : "UNKNOWN");
@@ -583,88 +658,61 @@ _handle_group_del_mem (
     g_object_unref (grp);
 }
 
-int
-main (int argc, char *argv[])
+static void
+_add_command_options (
+        GOptionContext *context,
+        InputCommand *cmd)
 {
-    GError *error = NULL;
-    GOptionContext *context = NULL;
-    gboolean rval = FALSE;
-    GumConfig *config = NULL;
-    gchar *sysroot = NULL;
-    gchar *user_types = NULL;
-
-    gboolean is_user_list_op = FALSE;
     GOptionGroup* user_serv_option = NULL;
-
-    gboolean is_user_add_op = FALSE, is_user_del_op = FALSE;
-    gboolean is_user_up_op = FALSE, is_user_get_op = FALSE;
-    gboolean is_user_get_by_name_op = FALSE;
     GOptionGroup* user_option = NULL;
-    InputUser *user = NULL;
-    
-    gboolean is_group_add_op = FALSE, is_group_del_op = FALSE;
-    gboolean is_group_up_op = FALSE, is_group_get_op = FALSE;
-    gboolean is_group_get_by_name_op = FALSE, is_group_add_mem_op = FALSE;
-    gboolean is_group_del_mem_op = FALSE;
-    gboolean is_write_nfc = FALSE;
     GOptionGroup* group_option = NULL;
-    InputGroup *group = NULL;
-
-    user = _create_test_user();
-    group = _create_test_group();
+    InputUser *user = cmd->user;
+    InputGroup *group = cmd->group;
 
-    GOptionEntry main_entries[] =
+    GOptionEntry command_entries[] =
     {
-        { "add-user", 'a', 0, G_OPTION_ARG_NONE, &is_user_add_op, "add user"
-                " -- username (or nickname) and user_type is mandatory", NULL},
-        { "delete-user", 'd', 0, G_OPTION_ARG_NONE, &is_user_del_op,
+        { "add-user", 'a', 0, G_OPTION_ARG_NONE, &cmd->is_user_add_op,
+                "add user -- username (or nickname) and user_type is "
+                "mandatory", NULL},
+        { "delete-user", 'd', 0, G_OPTION_ARG_NONE, &cmd->is_user_del_op,
                 "delete user -- uid is mandatory", NULL},
-        { "update-user", 'u', 0, G_OPTION_ARG_NONE, &is_user_up_op,
+        { "update-user", 'u', 0, G_OPTION_ARG_NONE, &cmd->is_user_up_op,
                 "update user -- uid is mandatory; possible props that can be "
                 "updated are secret, realname, office, officephone, homephone, "
                 "icon and shell", NULL},
-        { "get-user", 'b', 0, G_OPTION_ARG_NONE, &is_user_get_op, "get user"
-                " -- uid is mandatory", NULL},
+        { "get-user", 'b', 0, G_OPTION_ARG_NONE, &cmd->is_user_get_op,
+                "get user -- uid is mandatory", NULL},
         { "get-user-by-name", 'c', 0, G_OPTION_ARG_NONE,
-                &is_user_get_by_name_op, "get user by name -- username is"
+                &cmd->is_user_get_by_name_op, "get user by name -- username is"
                         " mandatory", NULL},
 
-        { "add-group", 'g', 0, G_OPTION_ARG_NONE, &is_group_add_op, "add group"
-                " -- groupname and group_type are mandatory", NULL},
-        { "delete-group", 'h', 0, G_OPTION_ARG_NONE, &is_group_del_op,
+        { "add-group", 'g', 0, G_OPTION_ARG_NONE, &cmd->is_group_add_op,
+                "add group -- groupname and group_type are mandatory", NULL},
+        { "delete-group", 'h', 0, G_OPTION_ARG_NONE, &cmd->is_group_del_op,
                 "delete group -- gid is mandatory", NULL},
-        { "update-group", 'i', 0, G_OPTION_ARG_NONE, &is_group_up_op,
+        { "update-group", 'i', 0, G_OPTION_ARG_NONE, &cmd->is_group_up_op,
                 "update group -- gid is mandatory; possible props that can be "
                 "updated are secret", NULL},
-        { "get-group", 'j', 0, G_OPTION_ARG_NONE, &is_group_get_op, "get group"
-                " -- gid is mandatory",
-                NULL},
+        { "get-group", 'j', 0, G_OPTION_ARG_NONE, &cmd->is_group_get_op,
+                "get group -- gid is mandatory", NULL},
         { "get-group-by-name", 'k', 0, G_OPTION_ARG_NONE,
-                &is_group_get_by_name_op, "get group by name -- groupname"
+                &cmd->is_group_get_by_name_op, "get group by name -- groupname"
                         " is mandatory", NULL},
-        { "add-member", 'm', 0, G_OPTION_ARG_NONE, &is_group_add_mem_op,
+        { "add-member", 'm', 0, G_OPTION_ARG_NONE, &cmd->is_group_add_mem_op,
                 "group add member -- gid and mem_uid are mandatory", NULL},
-        { "delete-member", 'n', 0, G_OPTION_ARG_NONE, &is_group_del_mem_op,
+        { "delete-member", 'n', 0, G_OPTION_ARG_NONE,
+                &cmd->is_group_del_mem_op,
                 "group delete member -- gid and mem_uid are mandatory", NULL},
-        { "write-nfc", 'p', 0, G_OPTION_ARG_NONE, &is_write_nfc,
-                "write username and secret to an NFC tag when creating or"
-                " updating a user", NULL},
-        { "offline", 'o', 0, G_OPTION_ARG_NONE, &offline_mode,
-                "offline mode triggers libgum synchronous APIs without (dbus) "
-                "gumd to perform op add/delete/update/get",
-                NULL},
-        { "sysroot", 'q', 0, G_OPTION_ARG_STRING, &sysroot, "sysroot path "
-                "[Offline mode ONLY]", "sysroot"},
-        { "user-list", 'r', 0, G_OPTION_ARG_NONE, &is_user_list_op,
+        { "user-list", 'r', 0, G_OPTION_ARG_NONE, &cmd->is_user_list_op,
                 "if usertypes argument is specified, then the calls will "
                 "return the specified users only otherwise all the users will "
                 "be returned", NULL},
         { NULL }
     };
-    
+
     GOptionEntry user_serv_entries[] =
     {
-        { "usertypes", 0, 0, G_OPTION_ARG_STRING, &user_types,
+        { "usertypes", 0, 0, G_OPTION_ARG_STRING, &cmd->user_types,
                 "valid usertypes can be system or admin or guest or normal."
                 "Multiple user types can be specified as comma separated "
                 "values e.g. normal,system",
@@ -716,16 +764,7 @@ main (int argc, char *argv[])
         { NULL }
     };
 
-#if !GLIB_CHECK_VERSION (2, 36, 0)
-    g_type_init ();
-#endif   
-    
-    context = g_option_context_new ("\n"
-            "  To add user in non-offline mode, gum-utils -a --username=user1 "
-            "  --usertype=normal\n"
-            "  To delete user in offline mode, gum-utils -o -d --uid=2001\n"
-            "  NOTE: Only one command can be run at one time.");
-    g_option_context_add_main_entries (context, main_entries, NULL);
+    g_option_context_add_main_entries (context, command_entries, NULL);
 
     user_serv_option = g_option_group_new("user-service-options", "User service "
             "specific options", "User service specific options", NULL, NULL);
@@ -741,60 +780,840 @@ main (int argc, char *argv[])
             "Group specific options", NULL, NULL);
     g_option_group_add_entries(group_option, group_entries);
     g_option_context_add_group (context, group_option);
+}
+
+static void
+_handle_command (
+        InputCommand *cmd,
+        gboolean write_nfc)
+{
+    if (cmd->is_user_add_op) {
+        _handle_user_add (cmd->user, write_nfc);
+    } else if (cmd->is_user_del_op) {
+    	_handle_user_del (cmd->user);
+    } else if (cmd->is_user_up_op) {
+    	_handle_user_up (cmd->user, write_nfc);
+    } else if (cmd->is_user_get_op) {
+    	_handle_user_get (cmd->user);
+    } else if (cmd->is_user_get_by_name_op) {
+    	_handle_user_get_by_name (cmd->user);
+    } else if (cmd->is_user_list_op) {
+        _handle_user_get_list (cmd->user_types);
+    }
+
+    /* group */
+    else if (cmd->is_group_add_op) {
+    	_handle_group_add (cmd->group);
+    } else if (cmd->is_group_del_op) {
+    	_handle_group_del (cmd->group);
+    } else if (cmd->is_group_up_op) {
+    	_handle_group_up (cmd->group);
+    } else if (cmd->is_group_get_op) {
+    	_handle_group_get (cmd->group);
+    } else if (cmd->is_group_get_by_name_op) {
+    	_handle_group_get_by_name (cmd->group);
+    } else if (cmd->is_group_add_mem_op) {
+    	_handle_group_add_mem (cmd->group);
+    } else if (cmd->is_group_del_mem_op) {
+    	_handle_group_del_mem (cmd->group);
+    } else {
+        INFO ("No option specified");
+    }
+}
+
+/*
+ * Batch mode: commands are read one per line, either in the option syntax
+ * (e.g. "-a --username=user1 --usertype=normal") or as a flat JSON object
+ * keyed by the long option names (e.g. {"add-user": true, "username":
+ * "user1", "usertype": "normal"}). Empty lines and lines starting with '#'
+ * are skipped.
+ *
+ * All the requests go over the one user service and group service
+ * connection, with up to max_inflight requests outstanding at a time; as
+ * they complete in any order, the requests in flight must not depend on each
+ * other (use --max-inflight=1 to run them one after the other). If the daemon
+ * has the [RateLimits] of gumd.conf enabled, a batch of writes longer than
+ * WRITE_BURST has requests failing with RateLimited errors, which are
+ * reported like any other failure and not retried. The results
+ * are printed as one JSON object per line, in the input order, e.g.
+ *
+ *   {"line":1,"status":"ok","user":{"uid":2001,...}}
+ *   {"line":2,"status":"error","code":160,"message":"..."}
+ */
+#define GUM_UTILS_MAX_INFLIGHT_DEFAULT 16
+
+typedef struct {
+    GMainLoop *loop;
+    GIOChannel *channel;
+    guint watch_id;
+    guint idle_id;
+    gint max_inflight;
+    gint inflight;
+    guint line;
+    gboolean eof;
+    gboolean failed;
+    GQueue requests;
+    GQueue user_lists; /* the user service has one request slot only */
+    gboolean user_list_busy;
+    GumUserService *service;
+    GumDbusGroupService *group_service;
+} Batch;
+
+typedef struct {
+    Batch *batch;
+    guint line;
+    InputCommand *cmd;
+    gboolean done;
+    guint step;
+    GString *result;
+    GError *error;
+    GumUser *user;
+    GumGroup *group;
+} BatchRequest;
+
+static void
+_free_batch_request (
+        BatchRequest *req)
+{
+    if (req) {
+        _free_command (req->cmd);
+        if (req->result) g_string_free (req->result, TRUE);
+        if (req->error) g_error_free (req->error);
+        if (req->user) g_object_unref (req->user);
+        if (req->group) g_object_unref (req->group);
+        g_free (req);
+    }
+}
+
+static const gchar *
+_json_skip_ws (
+        const gchar *p)
+{
+    while (g_ascii_isspace (*p)) p++;
+    return p;
+}
+
+static gchar *
+_json_parse_string (
+        const gchar **pos)
+{
+    const gchar *p = *pos + 1;
+    GString *str = g_string_new (NULL);
+    gchar hex[5] = { 0 };
+    gunichar c = 0;
+    gint i = 0;
+
+    while (*p && *p != '"') {
+        if (*p != '\\') {
+            g_string_append_c (str, *p++);
+            continue;
+        }
+        switch (*++p) {
+            case '"': case '\\': case '/':
+                g_string_append_c (str, *p);
+                break;
+            case 'b': g_string_append_c (str, '\b'); break;
+            case 'f': g_string_append_c (str, '\f'); break;
+            case 'n': g_string_append_c (str, '\n'); break;
+            case 'r': g_string_append_c (str, '\r'); break;
+            case 't': g_string_append_c (str, '\t'); break;
+            case 'u':
+                for (i = 0; i < 4; i++) {
+                    if (!g_ascii_isxdigit (p[i + 1])) goto _fail;
+                    hex[i] = p[i + 1];
+                }
+                c = (gunichar) g_ascii_strtoull (hex, NULL, 16);
+                /* surrogate pairs are not needed for the option values */
+                if (c == 0 || (c >= 0xD800 && c <= 0xDFFF)) goto _fail;
+                g_string_append_unichar (str, c);
+                p += 4;
+                break;
+            default:
+                goto _fail;
+        }
+        p++;
+    }
+    if (*p != '"') goto _fail;
+
+    *pos = p + 1;
+    return g_string_free (str, FALSE);
+
+_fail:
+    g_string_free (str, TRUE);
+    return NULL;
+}
+
+static gchar **
+_json_to_argv (
+        const gchar *line,
+        GError **error)
+{
+    GPtrArray *args = g_ptr_array_new_with_free_func (g_free);
+    const gchar *p = _json_skip_ws (line + 1);
+    const gchar *start = NULL;
+    gchar *key = NULL;
+    gchar *value = NULL;
+
+    g_ptr_array_add (args, g_strdup ("gum-utils"));
+    if (*p == '}')
+        goto _done;
+
+    while (TRUE) {
+        p = _json_skip_ws (p);
+        if (*p != '"' || !(key = _json_parse_string (&p)))
+            goto _fail;
+        p = _json_skip_ws (p);
+        if (*p != ':')
+            goto _fail;
+        p = _json_skip_ws (p + 1);
+
+        if (*p == '"') {
+            if (!(value = _json_parse_string (&p)))
+                goto _fail;
+        } else if (g_str_has_prefix (p, "true")) {
+            g_ptr_array_add (args, g_strdup_printf ("--%s", key));
+            p += 4;
+        } else if (g_str_has_prefix (p, "false")) {
+            p += 5;
+        } else if (g_str_has_prefix (p, "null")) {
+            p += 4;
+        } else if (*p == '-' || g_ascii_isdigit (*p)) {
+            start = p++;
+            while (g_ascii_isdigit (*p)) p++;
+            value = g_strndup (start, p - start);
+        } else {
+            goto _fail;
+        }
+        if (value)
+            g_ptr_array_add (args, g_strdup_printf ("--%s=%s", key, value));
+        g_free (key); key = NULL;
+        g_free (value); value = NULL;
+
+        p = _json_skip_ws (p);
+        if (*p == '}')
+            break;
+        if (*p++ != ',')
+            goto _fail;
+    }
+
+_done:
+    if (*_json_skip_ws (p + 1) != '\0')
+        goto _fail;
+    g_ptr_array_add (args, NULL);
+    return (gchar **) g_ptr_array_free (args, FALSE);
+
+_fail:
+    g_free (key);
+    g_free (value);
+    g_ptr_array_free (args, TRUE);
+    if (error) {
+        *error = GUM_GET_ERROR_FOR_ID (GUM_ERROR_INVALID_INPUT,
+                "Invalid JSON command at offset %ld", (glong) (p - line));
+    }
+    return NULL;
+}
+
+static InputCommand *
+_parse_command (
+        const gchar *line,
+        GError **error)
+{
+    InputCommand *cmd = NULL;
+    GOptionContext *context = NULL;
+    gchar *cmd_line = NULL;
+    gchar **argv = NULL;
+    gchar **args = NULL;
+    gint argc = 0;
+    GError *err = NULL;
+
+    if (line[0] == '{') {
+        argv = _json_to_argv (line, &err);
+    } else {
+        cmd_line = g_strconcat ("gum-utils ", line, NULL);
+        g_shell_parse_argv (cmd_line, NULL, &argv, &err);
+        g_free (cmd_line);
+    }
+
+    if (argv) {
+        cmd = _create_command ();
+        context = g_option_context_new (NULL);
+        g_option_context_set_help_enabled (context, FALSE);
+        _add_command_options (context, cmd);
+
+        /* parsing drops the options from the array but does not free them */
+        argc = g_strv_length (argv);
+        args = g_memdup (argv, (argc + 1) * sizeof (gchar *));
+        if (g_option_context_parse (context, &argc, &args, &err)) {
+            if (argc > 1) {
+                err = GUM_GET_ERROR_FOR_ID (GUM_ERROR_INVALID_INPUT,
+                        "Unexpected argument %s", args[1]);
+            } else if (_get_command_op_count (cmd) != 1) {
+                err = GUM_GET_ERROR_FOR_ID (GUM_ERROR_INVALID_INPUT,
+                        "Exactly one command must be specified");
+            }
+        }
+        g_free (args);
+        g_strfreev (argv);
+        g_option_context_free (context);
+    }
+
+    if (err) {
+        if (err->domain != GUM_ERROR) {
+            GError *tmp = err;
+            err = GUM_GET_ERROR_FOR_ID (GUM_ERROR_INVALID_INPUT, "%s",
+                    tmp->message);
+            g_error_free (tmp);
+        }
+        g_propagate_error (error, err);
+        _free_command (cmd);
+        return NULL;
+    }
+    return cmd;
+}
+
+static void
+_append_json_string (
+        GString *json,
+        const gchar *str)
+{
+    const gchar *p = NULL;
+
+    if (!str) {
+        g_string_append (json, "null");
+        return;
+    }
+    g_string_append_c (json, '"');
+    for (p = str; *p; p++) {
+        switch (*p) {
+            case '"': g_string_append (json, "\\\""); break;
+            case '\\': g_string_append (json, "\\\\"); break;
+            case '\n': g_string_append (json, "\\n"); break;
+            case '\r': g_string_append (json, "\\r"); break;
+            case '\t': g_string_append (json, "\\t"); break;
+            default:
+                if ((guchar) *p < 0x20)
+                    g_string_append_printf (json, "\\u%04x", (guchar) *p);
+                else
+                    g_string_append_c (json, *p);
+        }
+    }
+    g_string_append_c (json, '"');
+}
+
+static void
+_append_json_member (
+        GString *json,
+        const gchar *key,
+        const gchar *value)
+{
+    g_string_append_printf (json, ",\"%s\":", key);
+    _append_json_string (json, value);
+}
+
+static void
+_append_user_json (
+        GString *json,
+        GumUser *guser)
+{
+    InputUser *user = _get_user_prop (guser);
+
+    g_string_append_printf (json, "{\"uid\":%u,\"gid\":%u", user->uid,
+            user->gid);
+    _append_json_member (json, "username", user->user_name);
+    _append_json_member (json, "usertype", user->user_type);
+    _append_json_member (json, "nickname", user->nick_name);
+    _append_json_member (json, "realname", user->real_name);
+    _append_json_member (json, "office", user->office);
+    _append_json_member (json, "officephone", user->office_phone);
+    _append_json_member (json, "homephone", user->home_phone);
+    _append_json_member (json, "homedir", user->home_dir);
+    _append_json_member (json, "shell", user->shell);
+    _append_json_member (json, "icon", user->icon);
+    g_string_append_c (json, '}');
+
+    _free_test_user (user);
+}
+
+static void
+_append_group_json (
+        GString *json,
+        GumGroup *grp)
+{
+    InputGroup *group = _get_group_prop (grp);
+
+    g_string_append_printf (json, "{\"gid\":%u", group->gid);
+    _append_json_member (json, "groupname", group->group_name);
+    g_string_append_c (json, '}');
+
+    _free_test_group (group);
+}
+
+static gboolean _batch_process (gpointer data);
+static gboolean _on_batch_input (GIOChannel *channel, GIOCondition condition,
+        gpointer data);
+
+static void
+_batch_schedule (
+        Batch *batch)
+{
+    /* the user and group objects can not be released from their own
+     * callbacks, so the completed requests are handled from an idle */
+    if (!batch->idle_id)
+        batch->idle_id = g_idle_add (_batch_process, batch);
+}
+
+static void
+_batch_finish (
+        BatchRequest *req,
+        const GError *error)
+{
+    if (error) {
+        req->error = g_error_copy (error);
+        req->batch->failed = TRUE;
+    }
+    req->done = TRUE;
+    req->batch->inflight--;
+    _batch_schedule (req->batch);
+}
+
+static void
+_batch_fail (
+        BatchRequest *req,
+        const gchar *message)
+{
+    GError *error = GUM_GET_ERROR_FOR_ID (GUM_ERROR_UNKNOWN, "%s", message);
+    _batch_finish (req, error);
+    g_error_free (error);
+}
+
+static void
+_on_batch_user (
+        GumUser *user,
+        const GError *error,
+        gpointer user_data)
+{
+    BatchRequest *req = (BatchRequest *) user_data;
+    InputCommand *cmd = req->cmd;
+    gboolean pushed = FALSE;
+
+    if (error) {
+        _batch_finish (req, error);
+        return;
+    }
+
+    if (req->step++ == 0 && (cmd->is_user_add_op || cmd->is_user_del_op ||
+        cmd->is_user_up_op)) {
+        if (cmd->is_user_add_op) {
+            _set_user_prop (user, cmd->user);
+            pushed = gum_user_add (user, _on_batch_user, req);
+        } else if (cmd->is_user_del_op) {
+            pushed = gum_user_delete (user, TRUE, _on_batch_user, req);
+        } else {
+            _set_user_update_prop (user, cmd->user);
+            pushed = gum_user_update (user, _on_batch_user, req);
+        }
+        if (!pushed)
+            _batch_fail (req, "Failed to send the user request");
+        return;
+    }
+
+    if (!cmd->is_user_del_op) {
+        req->result = g_string_new ("\"user\":");
+        _append_user_json (req->result, user);
+    }
+    _batch_finish (req, NULL);
+}
+
+static void
+_on_batch_group (
+        GumGroup *group,
+        const GError *error,
+        gpointer user_data)
+{
+    BatchRequest *req = (BatchRequest *) user_data;
+    InputCommand *cmd = req->cmd;
+    gboolean pushed = FALSE;
+
+    if (error) {
+        _batch_finish (req, error);
+        return;
+    }
+
+    if (req->step++ == 0 && !cmd->is_group_get_op &&
+        !cmd->is_group_get_by_name_op) {
+        if (cmd->is_group_add_op) {
+            _set_group_prop (group, cmd->group);
+            pushed = gum_group_add (group, _on_batch_group, req);
+        } else if (cmd->is_group_del_op) {
+            pushed = gum_group_delete (group, _on_batch_group, req);
+        } else if (cmd->is_group_up_op) {
+            _set_group_update_prop (group, cmd->group);
+            pushed = gum_group_update (group, _on_batch_group, req);
+        } else if (cmd->is_group_add_mem_op) {
+            pushed = gum_group_add_member (group, cmd->group->mem_uid, TRUE,
+                    _on_batch_group, req);
+        } else {
+            pushed = gum_group_delete_member (group, cmd->group->mem_uid,
+                    _on_batch_group, req);
+        }
+        if (!pushed)
+            _batch_fail (req, "Failed to send the group request");
+        return;
+    }
+
+    if (cmd->is_group_add_op || cmd->is_group_up_op ||
+        cmd->is_group_get_op || cmd->is_group_get_by_name_op) {
+        req->result = g_string_new ("\"group\":");
+        _append_group_json (req->result, group);
+    }
+    _batch_finish (req, NULL);
+}
+
+static void
+_on_batch_user_list (
+        GumUserService *service,
+        GumUserList *users,
+        const GError *error,
+        gpointer user_data)
+{
+    BatchRequest *req = (BatchRequest *) user_data;
+    GumUserList *src_list = NULL;
+
+    req->batch->user_list_busy = FALSE;
+    if (error) {
+        _batch_finish (req, error);
+        return;
+    }
+
+    req->result = g_string_new ("\"users\":[");
+    for (src_list = users; src_list != NULL;
+         src_list = g_list_next (src_list)) {
+        if (src_list != users)
+            g_string_append_c (req->result, ',');
+        _append_user_json (req->result, (GumUser *) src_list->data);
+    }
+    g_string_append_c (req->result, ']');
+    gum_user_service_list_free (users);
+    _batch_finish (req, NULL);
+}
+
+static void
+_batch_start_user_list (
+        Batch *batch)
+{
+    BatchRequest *req = NULL;
+    gchar **strv = NULL;
+
+    if (batch->user_list_busy ||
+        !(req = g_queue_pop_head (&batch->user_lists)))
+        return;
+
+    if (req->cmd->user_types)
+         strv = g_strsplit (req->cmd->user_types, ",", -1);
+    else
+         strv = g_malloc0 (sizeof (gchar *));
+
+    batch->user_list_busy = gum_user_service_get_user_list (batch->service,
+            (const gchar *const *)strv, _on_batch_user_list, req);
+    g_strfreev (strv);
+    if (!batch->user_list_busy)
+        _batch_fail (req, "Failed to send the user list request");
+}
+
+static void
+_batch_submit (
+        Batch *batch,
+        const gchar *line)
+{
+    BatchRequest *req = g_malloc0 (sizeof (BatchRequest));
+    InputCommand *cmd = NULL;
+    GError *error = NULL;
+
+    req->batch = batch;
+    req->line = batch->line;
+    g_queue_push_tail (&batch->requests, req);
+    batch->inflight++;
+
+    cmd = req->cmd = _parse_command (line, &error);
+    if (!cmd) {
+        _batch_finish (req, error);
+        g_error_free (error);
+        return;
+    }
+
+    if (cmd->is_user_add_op) {
+        req->user = gum_user_create (_on_batch_user, req);
+    } else if (cmd->is_user_get_by_name_op) {
+        req->user = gum_user_get_by_name (cmd->user->user_name,
+                _on_batch_user, req);
+    } else if (cmd->is_user_list_op) {
+        g_queue_push_tail (&batch->user_lists, req);
+        _batch_start_user_list (batch);
+        return;
+    } else if (cmd->is_group_add_op) {
+        req->group = gum_group_create (_on_batch_group, req);
+    } else if (cmd->is_group_get_by_name_op) {
+        req->group = gum_group_get_by_name (cmd->group->group_name,
+                _on_batch_group, req);
+    } else if (cmd->is_group_del_op || cmd->is_group_up_op ||
+               cmd->is_group_get_op || cmd->is_group_add_mem_op ||
+               cmd->is_group_del_mem_op) {
+        req->group = gum_group_get (cmd->group->gid, _on_batch_group, req);
+    } else {
+        req->user = gum_user_get (cmd->user->uid, _on_batch_user, req);
+    }
+
+    if (!req->user && !req->group)
+        _batch_fail (req, "Failed to send the request");
+}
+
+static gboolean
+_batch_process (
+        gpointer data)
+{
+    Batch *batch = (Batch *) data;
+    BatchRequest *req = NULL;
+    GString *out = g_string_new (NULL);
+
+    batch->idle_id = 0;
+
+    while ((req = g_queue_peek_head (&batch->requests)) && req->done) {
+        g_queue_pop_head (&batch->requests);
+        g_string_append_printf (out, "{\"line\":%u,\"status\":", req->line);
+        if (req->error) {
+            g_string_append_printf (out, "\"error\",\"code\":%d,\"message\":",
+                    req->error->code);
+            _append_json_string (out, req->error->message);
+        } else {
+            g_string_append (out, "\"ok\"");
+            if (req->result)
+                g_string_append_printf (out, ",%s", req->result->str);
+        }
+        g_string_append (out, "}\n");
+        _free_batch_request (req);
+    }
+    if (out->len > 0) {
+        fputs (out->str, stdout);
+        fflush (stdout);
+    }
+    g_string_free (out, TRUE);
+
+    _batch_start_user_list (batch);
+
+    if (!batch->eof && !batch->watch_id &&
+        batch->inflight < batch->max_inflight) {
+        batch->watch_id = g_io_add_watch (batch->channel,
+                G_IO_IN | G_IO_HUP | G_IO_ERR, _on_batch_input, batch);
+    }
+
+    if (batch->eof && g_queue_is_empty (&batch->requests))
+        g_main_loop_quit (batch->loop);
+
+    return FALSE;
+}
+
+static gboolean
+_on_batch_input (
+        GIOChannel *channel,
+        GIOCondition condition,
+        gpointer data)
+{
+    Batch *batch = (Batch *) data;
+    GIOStatus status = G_IO_STATUS_NORMAL;
+    GError *error = NULL;
+    gchar *line = NULL;
+
+    /* one line at a time, so that the replies are not held up by reading */
+    status = g_io_channel_read_line (channel, &line, NULL, NULL, &error);
+    if (status == G_IO_STATUS_AGAIN)
+        return TRUE;
+
+    if (status != G_IO_STATUS_NORMAL) {
+        if (error) {
+            WARN ("Failed to read the batch input: %s", error->message);
+            g_error_free (error);
+            batch->failed = TRUE;
+        }
+        batch->eof = TRUE;
+        batch->watch_id = 0;
+        _batch_schedule (batch);
+        return FALSE;
+    }
+
+    batch->line++;
+    g_strstrip (line);
+    if (line[0] != '\0' && line[0] != '#')
+        _batch_submit (batch, line);
+    g_free (line);
+
+    if (batch->inflight < batch->max_inflight)
+        return TRUE;
+    batch->watch_id = 0;
+    return FALSE;
+}
+
+static gint
+_handle_batch (
+        const gchar *batch_file,
+        gint max_inflight)
+{
+    Batch batch;
+    GError *error = NULL;
+
+    memset (&batch, 0, sizeof (Batch));
+    if (g_strcmp0 (batch_file, "-") == 0)
+        batch.channel = g_io_channel_unix_new (STDIN_FILENO);
+    else
+        batch.channel = g_io_channel_new_file (batch_file, "r", &error);
+    if (!batch.channel) {
+        INFO ("Failed to open %s: %s", batch_file, error->message);
+        g_error_free (error);
+        return 1;
+    }
+    g_io_channel_set_encoding (batch.channel, NULL, NULL);
+
+    batch.service = gum_user_service_create_sync (FALSE);
+    batch.group_service = gum_group_service_get_instance ();
+    if (!batch.service || !batch.group_service) {
+        INFO ("Failed to connect to gumd");
+        if (batch.service) g_object_unref (batch.service);
+        if (batch.group_service) g_object_unref (batch.group_service);
+        g_io_channel_unref (batch.channel);
+        return 1;
+    }
+
+    batch.max_inflight = max_inflight;
+    g_queue_init (&batch.requests);
+    g_queue_init (&batch.user_lists);
+    batch.loop = g_main_loop_new (NULL, FALSE);
+    batch.watch_id = g_io_add_watch (batch.channel,
+            G_IO_IN | G_IO_HUP | G_IO_ERR, _on_batch_input, &batch);
+
+    g_main_loop_run (batch.loop);
+
+    if (batch.idle_id) g_source_remove (batch.idle_id);
+    g_main_loop_unref (batch.loop);
+    g_object_unref (batch.service);
+    g_object_unref (batch.group_service);
+    g_io_channel_unref (batch.channel);
+
+    return batch.failed ? 1 : 0;
+}
+
+int
+main (int argc, char *argv[])
+{
+    GError *error = NULL;
+    GOptionContext *context = NULL;
+    gboolean rval = FALSE;
+    GumConfig *config = NULL;
+    gchar *sysroot = NULL;
+    InputCommand *cmd = NULL;
+    gboolean is_write_nfc = FALSE;
+    gchar *manifest_file = NULL;
+    gboolean no_home_dirs = FALSE;
+    gboolean migrate_home_dirs = FALSE;
+    guint moved = 0;
+    gchar *batch_file = NULL;
+    gint max_inflight = GUM_UTILS_MAX_INFLIGHT_DEFAULT;
+    gint ret = 0;
+
+    cmd = _create_command ();
+
+    GOptionEntry main_entries[] =
+    {
+        { "write-nfc", 'p', 0, G_OPTION_ARG_NONE, &is_write_nfc,
+                "write username and secret to an NFC tag when creating or"
+                " updating a user", NULL},
+        { "offline", 'o', 0, G_OPTION_ARG_NONE, &offline_mode,
+                "offline mode triggers libgum synchronous APIs without (dbus) "
+                "gumd to perform op add/delete/update/get",
+                NULL},
+        { "sysroot", 'q', 0, G_OPTION_ARG_STRING, &sysroot, "sysroot path "
+                "[Offline mode, manifest and home dir migration ONLY]",
+                "sysroot"},
+        { "apply-manifest", 'f', 0, G_OPTION_ARG_FILENAME, &manifest_file,
+                "add the users, groups and memberships of the manifest file "
+                "in one go, directly to the files as in offline mode", "file"},
+        { "no-home-dirs", 0, 0, G_OPTION_ARG_NONE, &no_home_dirs,
+                "do not create the home directories when applying a manifest; "
+                "they are created by the next apply", NULL},
+        { "migrate-home-dirs", 0, 0, G_OPTION_ARG_NONE, &migrate_home_dirs,
+                "move the home directories to the HOME_DIR_LAYOUT set in "
+                "gumd.conf, directly as in offline mode; refused while gumd is "
+                "running unless a sysroot is given", NULL},
+        { "batch", 0, 0, G_OPTION_ARG_FILENAME, &batch_file,
+                "run the commands of the file ('-' for stdin), one per line in "
+                "the option syntax or as a JSON object, over one connection; "
+                "the results are printed as JSON lines in the input order",
+                "file"},
+        { "max-inflight", 0, 0, G_OPTION_ARG_INT, &max_inflight,
+                "maximum number of batch requests in flight (default: 16); "
+                "use 1 when the commands depend on each other", "N"},
+        { NULL }
+    };
+
+#if !GLIB_CHECK_VERSION (2, 36, 0)
+    g_type_init ();
+#endif   
+    
+    context = g_option_context_new ("\n"
+            "  To add user in non-offline mode, gum-utils -a --username=user1 "
+            "  --usertype=normal\n"
+            "  To delete user in offline mode, gum-utils -o -d --uid=2001\n"
+            "  To provision a sysroot, gum-utils -f manifest --sysroot=/path\n"
+            "  To run many commands, gum-utils --batch=commands.txt\n"
+            "  NOTE: Only one command can be run at one time.");
+    _add_command_options (context, cmd);
+    g_option_context_add_main_entries (context, main_entries, NULL);
 
     rval = g_option_context_parse (context, &argc, &argv, &error);
     g_option_context_free(context);
     if (!rval) {
         INFO ("option parsing failed: %s\n", error->message);
-        g_free (user);
-        g_free (group);
+        _free_command (cmd);
         exit (1);
     }
 
-    if (!offline_mode && sysroot) {
+    if (!offline_mode && !manifest_file && !migrate_home_dirs && sysroot) {
         INFO ("sysroot is ONLY supported in offline mode\n");
         g_free (sysroot); sysroot = NULL;
     }
 
     config = gum_config_new (sysroot);
     
-    if (is_user_add_op) {
-        _handle_user_add (user, is_write_nfc);
-    } else if (is_user_del_op) {
-    	_handle_user_del (user);
-    } else if (is_user_up_op) {
-    	_handle_user_up (user, is_write_nfc);
-    } else if (is_user_get_op) {
-    	_handle_user_get (user);
-    } else if (is_user_get_by_name_op) {
-    	_handle_user_get_by_name (user);
-    } else if (is_user_list_op) {
-        _handle_user_get_list (user_types);
-    }
-
-    /* group */
-    else if (is_group_add_op) {
-    	_handle_group_add (group);
-    } else if (is_group_del_op) {
-    	_handle_group_del (group);
-    } else if (is_group_up_op) {
-    	_handle_group_up (group);
-    } else if (is_group_get_op) {
-    	_handle_group_get (group);
-    } else if (is_group_get_by_name_op) {
-    	_handle_group_get_by_name (group);
-    } else if (is_group_add_mem_op) {
-    	_handle_group_add_mem (group);
-    } else if (is_group_del_mem_op) {
-    	_handle_group_del_mem (group);
+    if (manifest_file) {
+        if (!gumd_manifest_apply (config, manifest_file, !no_home_dirs,
+                &error)) {
+            INFO ("Failed to apply manifest %s: %s", manifest_file,
+                    error ? error->message : "");
+            if (error) g_error_free (error);
+            ret = 1;
+        }
+    } else if (migrate_home_dirs) {
+        if (!gumd_daemon_user_migrate_home_dirs (config, &moved, &error)) {
+            INFO ("Failed to migrate home dirs: %s",
+                    error ? error->message : "");
+            if (error) g_error_free (error);
+            ret = 1;
+        } else {
+            INFO ("Moved %u home dirs", moved);
+        }
+    } else if (batch_file) {
+        if (offline_mode || max_inflight < 1) {
+            INFO ("batch needs gumd and at least one request in flight");
+            ret = 1;
+        } else {
+            ret = _handle_batch (batch_file, max_inflight);
+        }
     } else {
-        INFO ("No option specified");
+        _handle_command (cmd, is_write_nfc);
     }
 
     if (config) g_object_unref (config);
-    _free_test_user (user);
-    _free_test_group (group);
-    g_free (user_types);
+    _free_command (cmd);
+    g_free (manifest_file);
+    g_free (batch_file);
 
-    return 0;
+    return ret;
 }
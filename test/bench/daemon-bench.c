@@ -0,0 +1,521 @@
+/* vi: set et sw=4 ts=4 cino=t0,(0: */
+/* -*- Mode: C; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+/*
+ * This file is part of gum
+ *
+ * Copyright (C) 2013 Intel Corporation.
+ *
+ * Contact: Imran Zaman <imran.zaman@intel.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+
+#include "config.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <glib.h>
+#include <glib/gstdio.h>
+
+#include "common/gum-config.h"
+#include "common/gum-defines.h"
+#include "common/gum-log.h"
+#include "common/gum-user-types.h"
+#include "daemon/core/gumd-daemon.h"
+#include "daemon/core/gumd-daemon-user.h"
+#include "daemon/core/gumd-daemon-group.h"
+
+/*
+ * Times the GumdDaemon operations against synthetic user/group databases of
+ * increasing size, and prints the results as JSON, one object per database
+ * size and operation, e.g.:
+ *
+ *   { "entries": 1000, "operation": "get_user", "count": 100, "failed": 0,
+ *     "ops_per_sec": 85034.0, "min_us": 9, "mean_us": 11.7, "p50_us": 11,
+ *     "p95_us": 15, "p99_us": 22, "max_us": 40 }
+ *
+ * Each database is generated under its own directory in the sysroot, with
+ * its own gumd.conf, and a new daemon instance is used for each of them.
+ * Unless given, the sysroot is a new private directory in the temporary
+ * directory, removed at exit unless the databases are kept.
+ */
+
+#define GUM_BENCH_SYSROOT_TEMPLATE  "gum-bench-XXXXXX"
+#define GUM_BENCH_SIZES_DEFAULT     "1000,10000,100000,1000000"
+#define GUM_BENCH_ITERATIONS        100
+#define GUM_BENCH_ID_MIN            2000
+#define GUM_BENCH_ID_MAX            4000000
+#define GUM_BENCH_SEED              0x67756d64
+
+typedef struct {
+    const gchar *operation;
+    GArray *samples;    /* gint64 usecs */
+    guint failed;
+    gint64 elapsed;
+} GumBenchResult;
+
+static gchar *sysroot = NULL;
+static gchar *sizes = NULL;
+static gint iterations = GUM_BENCH_ITERATIONS;
+static gchar *output = NULL;
+static gboolean keep = FALSE;
+
+static GOptionEntry options[] = {
+    { "sysroot", 'r', 0, G_OPTION_ARG_FILENAME, &sysroot,
+      "directory to generate the databases in (default: a new "
+      GUM_BENCH_SYSROOT_TEMPLATE " temporary directory)", "DIR" },
+    { "sizes", 's', 0, G_OPTION_ARG_STRING, &sizes,
+      "comma separated database sizes (default: " GUM_BENCH_SIZES_DEFAULT
+      ")", "N,..." },
+    { "iterations", 'n', 0, G_OPTION_ARG_INT, &iterations,
+      "iterations per operation", "N" },
+    { "output", 'o', 0, G_OPTION_ARG_FILENAME, &output,
+      "file to write the JSON results to (default: stdout)", "FILE" },
+    { "keep", 'k', 0, G_OPTION_ARG_NONE, &keep,
+      "keep the generated databases", NULL },
+    { NULL }
+};
+
+static gboolean
+_write_db (
+        const gchar *path,
+        const gchar *format,
+        guint entries)
+{
+    FILE *fp = NULL;
+    guint i;
+    gboolean ret = TRUE;
+
+    fp = fopen (path, "w");
+    if (!fp) {
+        WARN ("failed to create %s: %s", path, strerror (errno));
+        return FALSE;
+    }
+
+    /* every entry has its own user private group with the same id */
+    for (i = 0; i < entries && ret; i++) {
+        if (fprintf (fp, format, GUM_BENCH_ID_MIN + i) < 0)
+            ret = FALSE;
+    }
+
+    if (fclose (fp) != 0)
+        ret = FALSE;
+    return ret;
+}
+
+static gchar *
+_generate (
+        guint entries)
+{
+    gchar *dir = NULL;
+    gchar *path = NULL;
+    gchar *conf = NULL;
+    gboolean ret = FALSE;
+
+    dir = g_strdup_printf ("%s/%u", sysroot, entries);
+    path = g_build_filename (dir, "skel", NULL);
+    if (g_mkdir_with_parents (path, 0755) != 0) {
+        WARN ("failed to create %s: %s", path, strerror (errno));
+        goto _finished;
+    }
+    g_free (path);
+
+    path = g_build_filename (dir, "passwd", NULL);
+    if (!_write_db (path,
+            "bench%1$07u:x:%1$u:%1$u::/home/bench%1$07u:/bin/sh\n", entries))
+        goto _finished;
+    g_free (path);
+
+    path = g_build_filename (dir, "shadow", NULL);
+    if (!_write_db (path, "bench%1$07u:!:16000:0:99999:7:::\n", entries))
+        goto _finished;
+    g_free (path);
+
+    path = g_build_filename (dir, "group", NULL);
+    if (!_write_db (path, "bench%1$07u:x:%1$u:\n", entries))
+        goto _finished;
+    g_free (path);
+
+    path = g_build_filename (dir, "gshadow", NULL);
+    if (!_write_db (path, "bench%1$07u:!::\n", entries))
+        goto _finished;
+    g_free (path);
+
+    conf = g_strdup_printf (
+            "[General]\n"
+            "PASSWD_FILE=%s/passwd\n"
+            "SHADOW_FILE=%s/shadow\n"
+            "GROUP_FILE=%s/group\n"
+            "GSHADOW_FILE=%s/gshadow\n"
+            "HOME_DIR=%s/home\n"
+            "SKEL_DIR=%s/skel\n"
+            "SNAPSHOT_FILE=%s/snapshot\n"
+            "DEFAULT_USR_GROUPS=\n"
+            "UID_MIN=%u\nUID_MAX=%u\n"
+            "GID_MIN=%u\nGID_MAX=%u\n"
+            "[RateLimits]\n"
+            "WRITE_RATE=0\n"
+            "CREATE_RATE=0\n",
+            dir, dir, dir, dir, dir, dir, dir,
+            GUM_BENCH_ID_MIN, GUM_BENCH_ID_MAX,
+            GUM_BENCH_ID_MIN, GUM_BENCH_ID_MAX);
+    path = g_build_filename (dir, "gumd.conf", NULL);
+    ret = g_file_set_contents (path, conf, -1, NULL);
+    g_free (conf);
+
+_finished:
+    g_free (path);
+    if (!ret) {
+        g_free (dir);
+        return NULL;
+    }
+    return dir;
+}
+
+static void
+_result_init (
+        GumBenchResult *result,
+        const gchar *operation)
+{
+    result->operation = operation;
+    result->samples = g_array_sized_new (FALSE, FALSE, sizeof (gint64),
+            iterations);
+    result->failed = 0;
+    result->elapsed = 0;
+}
+
+static void
+_result_add (
+        GumBenchResult *result,
+        gint64 start,
+        gboolean ok)
+{
+    gint64 usecs = g_get_monotonic_time () - start;
+
+    g_array_append_val (result->samples, usecs);
+    result->elapsed += usecs;
+    if (!ok)
+        result->failed++;
+}
+
+static gint
+_compare_samples (
+        gconstpointer a,
+        gconstpointer b)
+{
+    gint64 sa = *(const gint64 *) a;
+    gint64 sb = *(const gint64 *) b;
+
+    return sa < sb ? -1 : (sa > sb ? 1 : 0);
+}
+
+static gint64
+_percentile (
+        GArray *samples,
+        guint percent)
+{
+    guint pos = (samples->len * percent + 99) / 100;
+
+    if (pos > 0)
+        pos--;
+    return g_array_index (samples, gint64, pos);
+}
+
+static void
+_result_print (
+        GumBenchResult *result,
+        guint entries,
+        GString *json)
+{
+    GArray *samples = result->samples;
+    gdouble mean = 0;
+    gdouble rate = 0;
+
+    if (json->len > 2)
+        g_string_append (json, ",\n");
+
+    if (samples->len == 0) {
+        g_string_append_printf (json, "  { \"entries\": %u, "
+                "\"operation\": \"%s\", \"count\": 0 }", entries,
+                result->operation);
+        goto _finished;
+    }
+
+    g_array_sort (samples, _compare_samples);
+    mean = (gdouble) result->elapsed / samples->len;
+    if (result->elapsed > 0)
+        rate = (gdouble) samples->len * G_USEC_PER_SEC / result->elapsed;
+
+    g_string_append_printf (json, "  { \"entries\": %u, "
+            "\"operation\": \"%s\", \"count\": %u, \"failed\": %u, "
+            "\"ops_per_sec\": %.1f, \"min_us\": %" G_GINT64_FORMAT ", "
+            "\"mean_us\": %.1f, \"p50_us\": %" G_GINT64_FORMAT ", "
+            "\"p95_us\": %" G_GINT64_FORMAT ", "
+            "\"p99_us\": %" G_GINT64_FORMAT ", "
+            "\"max_us\": %" G_GINT64_FORMAT " }",
+            entries, result->operation, samples->len, result->failed, rate,
+            g_array_index (samples, gint64, 0), mean,
+            _percentile (samples, 50), _percentile (samples, 95),
+            _percentile (samples, 99),
+            g_array_index (samples, gint64, samples->len - 1));
+
+_finished:
+    g_array_unref (samples);
+    result->samples = NULL;
+}
+
+static void
+_run (
+        guint entries,
+        GString *json)
+{
+    GumdDaemon *daemon = NULL;
+    GumdDaemonUser *user = NULL;
+    GumdDaemonGroup *group = NULL;
+    GVariant *list = NULL;
+    GError *error = NULL;
+    GRand *rand = NULL;
+    GumBenchResult get_user, get_user_by_name, get_user_list;
+    GumBenchResult add_user, update_user, delete_user;
+    GumBenchResult add_member, delete_member;
+    GPtrArray *added = NULL;
+    gchar *dir = NULL;
+    gchar *name = NULL;
+    gint64 start = 0;
+    gboolean ok = FALSE;
+    uid_t uid = GUM_USER_INVALID_UID;
+    gint i;
+
+    DBG ("generating %u entries", entries);
+    dir = _generate (entries);
+    if (!dir) {
+        WARN ("failed to generate database of %u entries", entries);
+        return;
+    }
+    g_setenv ("UM_CONF_FILE", dir, TRUE);
+
+    /* a new daemon picks up the database and configuration of this size */
+    daemon = gumd_daemon_new ();
+    rand = g_rand_new_with_seed (GUM_BENCH_SEED);
+    added = g_ptr_array_new_with_free_func (g_object_unref);
+
+    _result_init (&get_user, "get_user");
+    for (i = 0; i < iterations; i++) {
+        uid = GUM_BENCH_ID_MIN + g_rand_int_range (rand, 0, entries);
+        start = g_get_monotonic_time ();
+        user = gumd_daemon_get_user (daemon, uid, &error);
+        _result_add (&get_user, start, user != NULL);
+        if (user)
+            g_object_unref (user);
+        g_clear_error (&error);
+    }
+
+    _result_init (&get_user_by_name, "get_user_by_name");
+    for (i = 0; i < iterations; i++) {
+        name = g_strdup_printf ("bench%07u", GUM_BENCH_ID_MIN +
+                g_rand_int_range (rand, 0, entries));
+        start = g_get_monotonic_time ();
+        user = gumd_daemon_get_user_by_name (daemon, name, &error);
+        _result_add (&get_user_by_name, start, user != NULL);
+        if (user)
+            g_object_unref (user);
+        g_clear_error (&error);
+        g_free (name);
+    }
+
+    _result_init (&get_user_list, "get_user_list");
+    for (i = 0; i < iterations; i++) {
+        start = g_get_monotonic_time ();
+        list = gumd_daemon_get_user_list (daemon, NULL, &error);
+        _result_add (&get_user_list, start, list != NULL);
+        if (list)
+            g_variant_unref (list);
+        g_clear_error (&error);
+    }
+
+    _result_init (&add_user, "add_user");
+    for (i = 0; i < iterations; i++) {
+        name = g_strdup_printf ("benchadd%07d", i);
+        user = gumd_daemon_user_new (gumd_daemon_get_config (daemon));
+        g_object_set (G_OBJECT (user), "usertype", GUM_USERTYPE_NORMAL,
+                "username", name, NULL);
+        start = g_get_monotonic_time ();
+        ok = gumd_daemon_add_user (daemon, user, &error);
+        _result_add (&add_user, start, ok);
+        if (ok)
+            g_ptr_array_add (added, user);
+        else
+            g_object_unref (user);
+        g_clear_error (&error);
+        g_free (name);
+    }
+
+    _result_init (&update_user, "update_user");
+    for (i = 0; i < (gint) added->len; i++) {
+        user = g_ptr_array_index (added, i);
+        name = g_strdup_printf ("Bench User %d", i);
+        g_object_set (G_OBJECT (user), "realname", name, NULL);
+        start = g_get_monotonic_time ();
+        ok = gumd_daemon_update_user (daemon, user, &error);
+        _result_add (&update_user, start, ok);
+        g_clear_error (&error);
+        g_free (name);
+    }
+
+    /* the added users join and leave groups of the generated ones */
+    _result_init (&add_member, "add_group_member");
+    _result_init (&delete_member, "delete_group_member");
+    for (i = 0; i < (gint) added->len; i++) {
+        g_object_get (G_OBJECT (g_ptr_array_index (added, i)), "uid", &uid,
+                NULL);
+        group = gumd_daemon_get_group (daemon, GUM_BENCH_ID_MIN +
+                g_rand_int_range (rand, 0, entries), &error);
+        if (!group) {
+            g_clear_error (&error);
+            continue;
+        }
+
+        start = g_get_monotonic_time ();
+        ok = gumd_daemon_add_group_member (daemon, group, uid, FALSE, &error);
+        _result_add (&add_member, start, ok);
+        g_clear_error (&error);
+
+        start = g_get_monotonic_time ();
+        ok = gumd_daemon_delete_group_member (daemon, group, uid, &error);
+        _result_add (&delete_member, start, ok);
+        g_clear_error (&error);
+
+        g_object_unref (group);
+    }
+
+    _result_init (&delete_user, "delete_user");
+    for (i = 0; i < (gint) added->len; i++) {
+        start = g_get_monotonic_time ();
+        ok = gumd_daemon_delete_user (daemon, g_ptr_array_index (added, i),
+                TRUE, &error);
+        _result_add (&delete_user, start, ok);
+        g_clear_error (&error);
+    }
+
+    _result_print (&get_user, entries, json);
+    _result_print (&get_user_by_name, entries, json);
+    _result_print (&get_user_list, entries, json);
+    _result_print (&add_user, entries, json);
+    _result_print (&update_user, entries, json);
+    _result_print (&add_member, entries, json);
+    _result_print (&delete_member, entries, json);
+    _result_print (&delete_user, entries, json);
+
+    g_ptr_array_unref (added);
+    g_rand_free (rand);
+    g_object_unref (daemon);
+
+    if (!keep) {
+        name = g_strdup_printf ("rm -rf %s", dir);
+        if (system (name) != 0)
+            WARN ("failed to remove %s", dir);
+        g_free (name);
+    }
+    g_free (dir);
+}
+
+int
+main (int argc, char *argv[])
+{
+    GOptionContext *context = NULL;
+    GError *error = NULL;
+    GString *json = NULL;
+    gchar **sizev = NULL;
+    gint i;
+    gint ret = EXIT_SUCCESS;
+    gboolean tmp_sysroot = FALSE;
+
+#if !GLIB_CHECK_VERSION (2, 36, 0)
+    g_type_init ();
+#endif
+
+    context = g_option_context_new ("- benchmark gumd daemon operations");
+    g_option_context_add_main_entries (context, options, NULL);
+    if (!g_option_context_parse (context, &argc, &argv, &error)) {
+        g_printerr ("%s\n", error->message);
+        g_error_free (error);
+        g_option_context_free (context);
+        return EXIT_FAILURE;
+    }
+    g_option_context_free (context);
+
+    if (!sysroot) {
+        sysroot = g_dir_make_tmp (GUM_BENCH_SYSROOT_TEMPLATE, &error);
+        if (!sysroot) {
+            g_printerr ("%s\n", error->message);
+            g_error_free (error);
+            return EXIT_FAILURE;
+        }
+        tmp_sysroot = TRUE;
+    }
+    if (!sizes)
+        sizes = g_strdup (GUM_BENCH_SIZES_DEFAULT);
+    if (iterations <= 0)
+        iterations = 1;
+
+    /* everything comes from the generated gumd.conf */
+    g_unsetenv ("UM_PASSWD_FILE");
+    g_unsetenv ("UM_SHADOW_FILE");
+    g_unsetenv ("UM_GROUP_FILE");
+    g_unsetenv ("UM_GSHADOW_FILE");
+    g_unsetenv ("UM_HOMEDIR_PREFIX");
+    g_unsetenv ("UM_SKEL_DIR");
+    g_unsetenv ("UM_SNAPSHOT_FILE");
+
+    json = g_string_new ("[\n");
+    sizev = g_strsplit (sizes, ",", -1);
+    for (i = 0; sizev[i]; i++) {
+        guint64 entries = g_ascii_strtoull (sizev[i], NULL, 10);
+        if (entries == 0 ||
+            entries > GUM_BENCH_ID_MAX - GUM_BENCH_ID_MIN - iterations) {
+            g_printerr ("invalid database size '%s'\n", sizev[i]);
+            ret = EXIT_FAILURE;
+            continue;
+        }
+        _run ((guint) entries, json);
+    }
+    g_strfreev (sizev);
+    g_string_append (json, "\n]\n");
+
+    if (output) {
+        if (!g_file_set_contents (output, json->str, json->len, &error)) {
+            g_printerr ("%s\n", error->message);
+            g_error_free (error);
+            ret = EXIT_FAILURE;
+        }
+    } else {
+        fputs (json->str, stdout);
+    }
+
+    g_string_free (json, TRUE);
+    if (tmp_sysroot) {
+        if (keep)
+            g_printerr ("databases kept in %s\n", sysroot);
+        else if (g_rmdir (sysroot) != 0)
+            WARN ("failed to remove %s", sysroot);
+    }
+    g_free (sysroot);
+    g_free (sizes);
+    g_free (output);
+    return ret;
+}
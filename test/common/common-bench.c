@@ -0,0 +1,263 @@
+/* vi: set et sw=4 ts=4 cino=t0,(0: */
+/* -*- Mode: C; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+/*
+ * This file is part of gum
+ *
+ * Copyright (C) 2013 Intel Corporation.
+ *
+ * Contact: Imran Zaman <imran.zaman@intel.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <glib.h>
+
+#include "common/gum-config.h"
+#include "common/gum-crypt.h"
+#include "common/gum-dictionary.h"
+#include "common/gum-utils.h"
+#include "common/gum-validate.h"
+
+/*
+ * Microbenchmarks for the gum-common functions on the request paths. Each
+ * one is run with doubling iteration counts until it takes at least the
+ * given time, and reported as JSON with the time and the number of heap
+ * allocations (malloc, calloc and realloc calls) per operation, e.g.:
+ *
+ *   { "benchmark": "validate_name", "iterations": 262144,
+ *     "ns_per_op": 1523.4, "allocs_per_op": 4.00 }
+ *
+ * Allocations are counted by interposing the allocator, which is only done
+ * with glibc; elsewhere allocs_per_op is reported as -1.
+ */
+
+#define GUM_BENCH_MIN_TIME_DEFAULT  200 /* msecs */
+
+typedef void (*GumBenchFunc) (gpointer data);
+
+typedef struct {
+    const gchar *name;
+    GumBenchFunc func;
+} GumBench;
+
+static gint min_time = GUM_BENCH_MIN_TIME_DEFAULT;
+static gchar *filter = NULL;
+static GumConfig *config = NULL;
+static GumDictionary *dict = NULL;
+
+static GOptionEntry options[] = {
+    { "time", 't', 0, G_OPTION_ARG_INT, &min_time,
+      "minimum time per benchmark in msecs (default: 200)", "MSECS" },
+    { "filter", 'f', 0, G_OPTION_ARG_STRING, &filter,
+      "run only the benchmarks whose name contains this", "STR" },
+    { NULL }
+};
+
+#ifdef __GLIBC__
+extern void *__libc_malloc (size_t size);
+extern void *__libc_calloc (size_t nmemb, size_t size);
+extern void *__libc_realloc (void *ptr, size_t size);
+
+static guint64 alloc_count = 0;
+
+void *
+malloc (size_t size)
+{
+    __atomic_add_fetch (&alloc_count, 1, __ATOMIC_RELAXED);
+    return __libc_malloc (size);
+}
+
+void *
+calloc (size_t nmemb, size_t size)
+{
+    __atomic_add_fetch (&alloc_count, 1, __ATOMIC_RELAXED);
+    return __libc_calloc (nmemb, size);
+}
+
+void *
+realloc (void *ptr, size_t size)
+{
+    __atomic_add_fetch (&alloc_count, 1, __ATOMIC_RELAXED);
+    return __libc_realloc (ptr, size);
+}
+
+static gint64
+_get_allocs (void)
+{
+    return (gint64) __atomic_load_n (&alloc_count, __ATOMIC_RELAXED);
+}
+#else
+static gint64
+_get_allocs (void)
+{
+    return -1;
+}
+#endif
+
+static void
+_bench_validate_name (
+        gpointer data)
+{
+    gum_validate_name ("bench_user01", NULL);
+}
+
+static void
+_bench_validate_db_string_entry (
+        gpointer data)
+{
+    gum_validate_db_string_entry ("Bench User, Room 101", NULL);
+}
+
+static void
+_bench_generate_nonce (
+        gpointer data)
+{
+    g_free (gum_utils_generate_nonce (G_CHECKSUM_SHA1));
+}
+
+static void
+_bench_encrypt_secret (
+        gpointer data)
+{
+    g_free (gum_crypt_encrypt_secret ("bench secret", "SHA512"));
+}
+
+static void
+_bench_dictionary_get (
+        gpointer data)
+{
+    gint32 value = 0;
+
+    gum_dictionary_get_int32 (dict, "General/UID_MIN", &value);
+}
+
+static void
+_bench_dictionary_set (
+        gpointer data)
+{
+    gum_dictionary_set_int32 (dict, "General/UID_MIN", 1000);
+}
+
+static void
+_bench_config_get_int (
+        gpointer data)
+{
+    gum_config_get_int (config, GUM_CONFIG_DBUS_USER_CACHE_SIZE, 0);
+}
+
+static void
+_bench_config_get_uint (
+        gpointer data)
+{
+    gum_config_get_uint (config, GUM_CONFIG_GENERAL_UID_MIN, 0);
+}
+
+static void
+_bench_config_get_string (
+        gpointer data)
+{
+    gum_config_get_string (config, GUM_CONFIG_GENERAL_PASSWD_FILE);
+}
+
+static const GumBench benches[] = {
+    { "validate_name", _bench_validate_name },
+    { "validate_db_string_entry", _bench_validate_db_string_entry },
+    { "utils_generate_nonce", _bench_generate_nonce },
+    { "crypt_encrypt_secret", _bench_encrypt_secret },
+    { "dictionary_get_int32", _bench_dictionary_get },
+    { "dictionary_set_int32", _bench_dictionary_set },
+    { "config_get_int", _bench_config_get_int },
+    { "config_get_uint", _bench_config_get_uint },
+    { "config_get_string", _bench_config_get_string },
+    { NULL, NULL }
+};
+
+static void
+_run (
+        const GumBench *bench,
+        GString *json)
+{
+    guint64 iterations = 1, i;
+    gint64 start = 0, elapsed = 0, allocs = 0;
+
+    /* warm up: one time initializations are not part of the cost */
+    bench->func (NULL);
+
+    while (TRUE) {
+        allocs = _get_allocs ();
+        start = g_get_monotonic_time ();
+        for (i = 0; i < iterations; i++)
+            bench->func (NULL);
+        elapsed = g_get_monotonic_time () - start;
+        allocs = allocs < 0 ? -1 : _get_allocs () - allocs;
+        if (elapsed >= (gint64) min_time * 1000 || iterations >= G_MAXUINT32)
+            break;
+        iterations *= 2;
+    }
+
+    if (json->len > 2)
+        g_string_append (json, ",\n");
+    g_string_append_printf (json, "  { \"benchmark\": \"%s\", "
+            "\"iterations\": %" G_GUINT64_FORMAT ", \"ns_per_op\": %.1f, "
+            "\"allocs_per_op\": %.2f }", bench->name, iterations,
+            (gdouble) elapsed * 1000 / iterations,
+            allocs < 0 ? -1.0 : (gdouble) allocs / iterations);
+}
+
+int
+main (int argc, char *argv[])
+{
+    GOptionContext *context = NULL;
+    GError *error = NULL;
+    GString *json = NULL;
+    gint i;
+
+#if !GLIB_CHECK_VERSION (2, 36, 0)
+    g_type_init ();
+#endif
+
+    context = g_option_context_new ("- benchmark gum common functions");
+    g_option_context_add_main_entries (context, options, NULL);
+    if (!g_option_context_parse (context, &argc, &argv, &error)) {
+        g_printerr ("%s\n", error->message);
+        g_error_free (error);
+        g_option_context_free (context);
+        return EXIT_FAILURE;
+    }
+    g_option_context_free (context);
+
+    config = gum_config_new (NULL);
+    dict = gum_dictionary_new ();
+
+    json = g_string_new ("[\n");
+    for (i = 0; benches[i].name; i++) {
+        if (!filter || strstr (benches[i].name, filter))
+            _run (&benches[i], json);
+    }
+    g_string_append (json, "\n]\n");
+    fputs (json->str, stdout);
+
+    g_string_free (json, TRUE);
+    gum_dictionary_unref (dict);
+    g_object_unref (config);
+    g_free (filter);
+    return EXIT_SUCCESS;
+}
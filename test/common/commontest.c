@@ -29,9 +29,11 @@
 #include <glib-object.h>
 #include <check.h>
 #include <stdlib.h>
+#include <errno.h>
 #include <unistd.h>
 #include <fcntl.h>
 #include <glib-unix.h>
+#include <gio/gio.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 
@@ -46,6 +48,8 @@
 #include "common/gum-string-utils.h"
 #include "common/gum-defines.h"
 #include "common/gum-dictionary.h"
+#include "common/gum-snapshot.h"
+#include "common/gum-stats.h"
 
 gboolean
 _create_file (
@@ -787,6 +791,7 @@ START_TEST (test_error)
     DBG("");
 
     GVariant *var = NULL;
+    gchar *name = NULL;
     GError *err = GUM_GET_ERROR_FOR_ID (GUM_ERROR_INVALID_INPUT, "testerror");
     fail_if (err == NULL);
 
@@ -802,6 +807,13 @@ START_TEST (test_error)
 
     g_error_free (err);
     g_variant_unref (var);
+
+    err = GUM_GET_ERROR_FOR_ID (GUM_ERROR_RATE_LIMITED, "ratelimited");
+    name = g_dbus_error_encode_gerror (err);
+    fail_if (g_strcmp0 (name,
+            "org.O1.SecurityAccounts.gUserManagement.Error.RateLimited") != 0);
+    g_free (name);
+    g_error_free (err);
 }
 END_TEST
 
@@ -937,6 +949,321 @@ START_TEST (test_usertype)
 }
 END_TEST
 
+START_TEST (test_snapshot)
+{
+    DBG("");
+    GumSnapshot *snapshot = NULL;
+    GError *error = NULL;
+    struct passwd pwd;
+    struct group grp;
+    gchar buf[512];
+    const gchar *path = "/tmp/gum/snapshot/test";
+    gchar *passwd_file = g_build_filename (GUM_TEST_DATA_DIR, "passwd", NULL);
+    gchar *group_file = g_build_filename (GUM_TEST_DATA_DIR, "group", NULL);
+
+    fail_if (gum_snapshot_write (path, "/tmp/gum/nofile", group_file, 1,
+            NULL) != FALSE);
+    fail_if (g_file_test (path, G_FILE_TEST_EXISTS) != FALSE);
+    fail_if (gum_snapshot_new_from_file (path, NULL) != NULL);
+
+    fail_if (gum_snapshot_write (path, passwd_file, group_file, 5,
+            &error) == FALSE);
+    fail_if (error != NULL);
+    snapshot = gum_snapshot_new_from_file (path, &error);
+    fail_if (snapshot == NULL || error != NULL);
+    fail_if (gum_snapshot_get_generation (snapshot) != 5);
+    fail_if (gum_snapshot_is_current (snapshot) == FALSE);
+
+    fail_if (gum_snapshot_getpwuid (snapshot, 1001, &pwd, buf,
+            sizeof (buf)) != 0);
+    fail_if (g_strcmp0 (pwd.pw_name, "foo") != 0 || pwd.pw_gid != 121);
+    fail_if (g_strcmp0 (pwd.pw_passwd, "x") != 0);
+    fail_if (g_strcmp0 (pwd.pw_gecos, "Foo Bar,,,") != 0);
+    fail_if (g_strcmp0 (pwd.pw_dir, "/tmp-home/foo") != 0);
+    fail_if (g_strcmp0 (pwd.pw_shell, "/bin/bash") != 0);
+    fail_if (gum_snapshot_getpwnam (snapshot, "ntp", &pwd, buf,
+            sizeof (buf)) != 0 || pwd.pw_uid != 120);
+    fail_if (gum_snapshot_getpwnam (snapshot, "nouser", &pwd, buf,
+            sizeof (buf)) != ENOENT);
+    fail_if (gum_snapshot_getpwuid (snapshot, 4242, &pwd, buf,
+            sizeof (buf)) != ENOENT);
+    fail_if (gum_snapshot_getpwuid (snapshot, 0, &pwd, buf, 8) != ERANGE);
+
+    fail_if (gum_snapshot_getgrnam (snapshot, "audio", &grp, buf,
+            sizeof (buf)) != 0 || grp.gr_gid != 29);
+    fail_if (g_strcmp0 (grp.gr_mem[0], "pulse") != 0 ||
+            grp.gr_mem[1] != NULL);
+    fail_if (gum_snapshot_getgrgid (snapshot, 0, &grp, buf,
+            sizeof (buf)) != 0 || g_strcmp0 (grp.gr_name, "root") != 0 ||
+            grp.gr_mem[0] != NULL);
+    fail_if (gum_snapshot_getgrgid (snapshot, 4242, &grp, buf,
+            sizeof (buf)) != ENOENT);
+
+    fail_if (gum_snapshot_getpwent (snapshot, 0, &pwd, buf,
+            sizeof (buf)) != 0 || g_strcmp0 (pwd.pw_name, "root") != 0);
+    fail_if (gum_snapshot_getpwent (snapshot, G_MAXUINT32, &pwd, buf,
+            sizeof (buf)) != ENOENT);
+    fail_if (gum_snapshot_getgrent (snapshot, 0, &grp, buf,
+            sizeof (buf)) != 0 || g_strcmp0 (grp.gr_name, "root") != 0);
+    fail_if (gum_snapshot_getgrent (snapshot, G_MAXUINT32, &grp, buf,
+            sizeof (buf)) != ENOENT);
+
+    fail_if (gum_snapshot_is_in_sync (snapshot, passwd_file,
+            group_file) == FALSE);
+    fail_if (gum_snapshot_is_in_sync (snapshot, group_file,
+            group_file) != FALSE);
+    fail_if (gum_snapshot_is_in_sync (snapshot, "/tmp/gum/nofile",
+            group_file) != FALSE);
+
+    /* replaced snapshot stays readable but is no longer current */
+    fail_if (gum_snapshot_write (path, passwd_file, group_file, 6,
+            NULL) == FALSE);
+    fail_if (gum_snapshot_is_current (snapshot) != FALSE);
+    fail_if (gum_snapshot_getpwuid (snapshot, 1001, &pwd, buf,
+            sizeof (buf)) != 0);
+    gum_snapshot_unref (snapshot);
+
+    snapshot = gum_snapshot_new_from_file (path, NULL);
+    fail_if (snapshot == NULL || gum_snapshot_get_generation (snapshot) != 6);
+    gum_snapshot_unref (snapshot);
+
+    fail_if (gum_snapshot_new_from_file (passwd_file, NULL) != NULL);
+
+    /* files modified behind the snapshot's back */
+    fail_if (_create_file ("/tmp/gum/snapshot/passwd", passwd_file) ==
+            FALSE);
+    fail_if (gum_snapshot_write (path, "/tmp/gum/snapshot/passwd",
+            group_file, 7, NULL) == FALSE);
+    snapshot = gum_snapshot_new_from_file (path, NULL);
+    fail_if (snapshot == NULL);
+    fail_if (gum_snapshot_is_in_sync (snapshot, "/tmp/gum/snapshot/passwd",
+            group_file) == FALSE);
+    fail_if (system ("echo 'bar:x:1002:1002::/home/bar:/bin/sh' >> "
+            "/tmp/gum/snapshot/passwd") != 0);
+    fail_if (gum_snapshot_is_in_sync (snapshot, "/tmp/gum/snapshot/passwd",
+            group_file) != FALSE);
+    gum_snapshot_unref (snapshot);
+
+    g_free (passwd_file);
+    g_free (group_file);
+}
+END_TEST
+
+START_TEST (test_stats)
+{
+    DBG("");
+    GVariant *stats = NULL;
+    GVariantIter *buckets = NULL;
+    guint64 calls = 0, errors = 0, total = 0, max = 0, p50 = 0, p90 = 0;
+    guint64 p99 = 0, bound = 0, count = 0, bucket_calls = 0;
+    gchar *pass = NULL;
+    gint64 now = g_get_monotonic_time ();
+
+    gum_stats_record ("test.op", now - 1000, FALSE);
+    gum_stats_record ("test.op", now - 1000, FALSE);
+    gum_stats_record ("test.op", now - 1000, FALSE);
+    gum_stats_record ("test.op", now - 100000, TRUE);
+
+    pass = gum_crypt_encrypt_secret ("pass123", "SHA512");
+    fail_if (pass == NULL);
+    g_free (pass);
+
+    stats = gum_stats_to_variant ();
+    fail_if (stats == NULL);
+    fail_unless (g_variant_is_of_type (stats, GUM_STATS_VARIANT_TYPE));
+    g_variant_ref_sink (stats);
+
+    fail_unless (g_variant_lookup (stats, GUM_STATS_PHASE_CRYPT,
+            "(ttttttta(tt))", &calls, NULL, NULL, NULL, NULL, NULL, NULL,
+            NULL));
+    fail_unless (calls >= 1);
+
+    fail_unless (g_variant_lookup (stats, "test.op", "(ttttttta(tt))",
+            &calls, &errors, &total, &max, &p50, &p90, &p99, &buckets));
+    fail_unless (calls == 4);
+    fail_unless (errors == 1);
+    fail_unless (total >= 103000);
+    fail_unless (max >= 100000);
+    /* percentiles are known within the bucket width */
+    fail_unless (p50 >= 1000 && p50 < 1000 + 1000 / 8 + 64);
+    fail_unless (p99 >= 100000 && p99 <= max);
+    while (g_variant_iter_next (buckets, "(tt)", &bound, &count)) {
+        fail_unless (count > 0);
+        bucket_calls += count;
+    }
+    g_variant_iter_free (buckets);
+    fail_unless (bucket_calls == 4);
+    g_variant_unref (stats);
+
+    gum_stats_reset ();
+    stats = gum_stats_to_variant ();
+    g_variant_ref_sink (stats);
+    fail_unless (g_variant_lookup (stats, "test.op", "(ttttttta(tt))",
+            &calls, &errors, &total, &max, &p50, &p90, &p99, &buckets));
+    fail_unless (calls == 0 && errors == 0 && total == 0 && max == 0);
+    fail_unless (p50 == 0 && p99 == 0);
+    fail_unless (g_variant_iter_n_children (buckets) == 0);
+    g_variant_iter_free (buckets);
+    g_variant_unref (stats);
+}
+END_TEST
+
+START_TEST (test_skel_manifest)
+{
+    DBG("");
+    GumConfig *config = NULL;
+    GError *error = NULL;
+    const gchar *skel_dir = NULL;
+    gchar *hdir = NULL, *fpath = NULL, *contents = NULL;
+    guint umask = 0;
+    struct stat sb;
+
+    config = gum_config_new (NULL);
+    fail_if (config == NULL);
+    skel_dir = gum_config_get_string (config, GUM_CONFIG_GENERAL_SKEL_DIR);
+    umask = gum_config_get_uint (config, GUM_CONFIG_GENERAL_UMASK, GUM_UMASK);
+    hdir = g_build_filename (gum_config_get_string (config,
+            GUM_CONFIG_GENERAL_HOME_DIR_PREF), "test_skel_user", NULL);
+
+    fail_unless (gum_file_create_home_dir (hdir, getuid (), getgid (), umask,
+            &error) == TRUE);
+    fail_unless (error == NULL);
+    fpath = g_build_filename (hdir, "recur", "examples.desktop", NULL);
+    fail_unless (stat (fpath, &sb) == 0 && S_ISREG (sb.st_mode));
+    g_free (fpath);
+    fail_unless (gum_file_delete_home_dir (hdir, &error) == TRUE);
+
+    /* changes to the skeleton are picked up by the next home dir */
+    fpath = g_build_filename (skel_dir, "recur", "skel_manifest", NULL);
+    fail_unless (g_file_set_contents (fpath, "manifest", -1, NULL));
+    g_free (fpath);
+    fpath = g_build_filename (skel_dir, ".profile", NULL);
+    fail_unless (chmod (fpath, 0600) == 0);
+    g_free (fpath);
+
+    fail_unless (gum_file_create_home_dir (hdir, getuid (), getgid (), umask,
+            &error) == TRUE);
+    fpath = g_build_filename (hdir, "recur", "skel_manifest", NULL);
+    fail_unless (g_file_get_contents (fpath, &contents, NULL, NULL));
+    fail_unless (g_strcmp0 (contents, "manifest") == 0);
+    g_free (contents);
+    g_free (fpath);
+    fpath = g_build_filename (hdir, ".profile", NULL);
+    fail_unless (stat (fpath, &sb) == 0 && (sb.st_mode & 0777) == 0600);
+    g_free (fpath);
+    fail_unless (gum_file_delete_home_dir (hdir, &error) == TRUE);
+
+    fpath = g_build_filename (skel_dir, "recur", "skel_manifest", NULL);
+    fail_unless (unlink (fpath) == 0);
+    g_free (fpath);
+    fpath = g_build_filename (skel_dir, ".profile", NULL);
+    fail_unless (chmod (fpath, 0644) == 0);
+    g_free (fpath);
+
+    fail_unless (gum_file_create_home_dir (hdir, getuid (), getgid (), umask,
+            &error) == TRUE);
+    fpath = g_build_filename (hdir, "recur", "skel_manifest", NULL);
+    fail_unless (stat (fpath, &sb) != 0);
+    g_free (fpath);
+    fail_unless (gum_file_delete_home_dir (hdir, &error) == TRUE);
+    fail_unless (error == NULL);
+
+    g_free (hdir);
+    g_object_unref (config);
+}
+END_TEST
+
+START_TEST (test_trash_home_dir)
+{
+    DBG("");
+    GumConfig *config = NULL;
+    GError *error = NULL;
+    gchar *hdir = NULL, *trash = NULL;
+    guint umask = 0;
+    struct stat sb;
+
+    config = gum_config_new (NULL);
+    fail_if (config == NULL);
+    umask = gum_config_get_uint (config, GUM_CONFIG_GENERAL_UMASK, GUM_UMASK);
+    hdir = g_build_filename (gum_config_get_string (config,
+            GUM_CONFIG_GENERAL_HOME_DIR_PREF), "test_trash_user", NULL);
+    trash = g_build_filename (gum_config_get_string (config,
+            GUM_CONFIG_GENERAL_HOME_DIR_PREF), ".test-trash", NULL);
+
+    fail_unless (gum_file_trash_home_dir (NULL, trash, &error) == FALSE);
+    fail_unless (error != NULL);
+    g_clear_error (&error);
+    fail_unless (gum_file_trash_home_dir (hdir, trash, &error) == FALSE);
+    fail_unless (error != NULL);
+    g_clear_error (&error);
+
+    /* twice to check that the trashed names do not clash */
+    fail_unless (gum_file_create_home_dir (hdir, getuid (), getgid (), umask,
+            &error) == TRUE);
+    fail_unless (gum_file_trash_home_dir (hdir, trash, &error) == TRUE);
+    fail_unless (gum_file_create_home_dir (hdir, getuid (), getgid (), umask,
+            &error) == TRUE);
+    fail_unless (gum_file_trash_home_dir (hdir, trash, &error) == TRUE);
+    fail_unless (error == NULL);
+    fail_unless (lstat (hdir, &sb) != 0);
+    fail_unless (stat (trash, &sb) == 0 && S_ISDIR (sb.st_mode));
+
+    fail_unless (gum_file_empty_trash_dir (trash, &error) == TRUE);
+    fail_unless (error == NULL);
+    fail_unless (rmdir (trash) == 0);
+    fail_unless (gum_file_empty_trash_dir (trash, &error) == TRUE);
+
+    g_free (trash);
+    g_free (hdir);
+    g_object_unref (config);
+}
+END_TEST
+
+START_TEST (test_home_dir_layout)
+{
+    DBG("");
+    GumConfig *config = NULL;
+    GError *error = NULL;
+    gchar *path = NULL;
+    guint umask = 0;
+    struct stat sb;
+
+    fail_unless (gum_file_get_home_dir_path (NULL, NULL, "newu") == NULL);
+    fail_unless (gum_file_get_home_dir_path ("/home", NULL, NULL) == NULL);
+
+    /* md5 ("newu") is 28ed9b6b... */
+    path = gum_file_get_home_dir_path ("/home", NULL, "newu");
+    fail_unless (g_strcmp0 (path, "/home/newu") == 0);
+    g_free (path);
+    path = gum_file_get_home_dir_path ("/home", "flat", "newu");
+    fail_unless (g_strcmp0 (path, "/home/newu") == 0);
+    g_free (path);
+    path = gum_file_get_home_dir_path ("/home", "hash2", "newu");
+    fail_unless (g_strcmp0 (path, "/home/28/newu") == 0);
+    g_free (path);
+    path = gum_file_get_home_dir_path ("/home", "hash2x2", "newu");
+    fail_unless (g_strcmp0 (path, "/home/28/ed/newu") == 0);
+    g_free (path);
+    path = gum_file_get_home_dir_path ("/home", "unknown", "newu");
+    fail_unless (g_strcmp0 (path, "/home/newu") == 0);
+    g_free (path);
+
+    /* the hash subdirectories are created along with the home dir */
+    config = gum_config_new (NULL);
+    fail_if (config == NULL);
+    umask = gum_config_get_uint (config, GUM_CONFIG_GENERAL_UMASK, GUM_UMASK);
+    path = gum_file_get_home_dir_path (gum_config_get_string (config,
+            GUM_CONFIG_GENERAL_HOME_DIR_PREF), "hash2x2", "newu");
+    fail_unless (gum_file_create_home_dir (path, getuid (), getgid (), umask,
+            &error) == TRUE);
+    fail_unless (error == NULL);
+    fail_unless (stat (path, &sb) == 0 && S_ISDIR (sb.st_mode));
+    fail_unless (gum_file_delete_home_dir (path, &error) == TRUE);
+    g_free (path);
+    g_object_unref (config);
+}
+END_TEST
+
 Suite* common_suite (void)
 {
     Suite *s = suite_create ("Common library");
@@ -949,11 +1276,16 @@ Suite* common_suite (void)
     tcase_add_test (tc_core, test_lock);
     tcase_add_test (tc_core, test_string);
     tcase_add_test (tc_core, test_file);
+    tcase_add_test (tc_core, test_skel_manifest);
+    tcase_add_test (tc_core, test_trash_home_dir);
+    tcase_add_test (tc_core, test_home_dir_layout);
     tcase_add_test (tc_core, test_validate);
     tcase_add_test (tc_core, test_crypt);
     tcase_add_test (tc_core, test_error);
     tcase_add_test (tc_core, test_dictionary);
     tcase_add_test (tc_core, test_usertype);
+    tcase_add_test (tc_core, test_snapshot);
+    tcase_add_test (tc_core, test_stats);
     suite_add_tcase (s, tc_core);
     return s;
 }
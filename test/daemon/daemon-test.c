@@ -33,8 +33,10 @@
 #include <unistd.h>
 #include <fcntl.h>
 #include <glib-unix.h>
+#include <gio/gunixfdlist.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/socket.h>
 
 #include "common/gum-dbus.h"
 #include "common/gum-error.h"
@@ -46,13 +48,18 @@
 #include "common/gum-user-types.h"
 #include "common/gum-group-types.h"
 #include "common/gum-string-utils.h"
+#include "common/gum-utils.h"
 #include "common/dbus/gum-dbus-user-service-gen.h"
 #include "common/dbus/gum-dbus-user-gen.h"
 #include "common/dbus/gum-dbus-group-service-gen.h"
 #include "common/dbus/gum-dbus-group-gen.h"
+#include "common/dbus/gum-dbus-stats-gen.h"
 #include "daemon/core/gumd-daemon.h"
 #include "daemon/core/gumd-daemon-user.h"
 #include "daemon/core/gumd-daemon-group.h"
+#include "daemon/core/gumd-home-reaper.h"
+#include "daemon/core/gumd-manifest.h"
+#include "daemon/dbus/gumd-dbus-scheduler.h"
 
 #ifdef GUM_BUS_TYPE_P2P
 #  ifdef GUM_SERVICE
@@ -103,6 +110,8 @@ _setup_env (void)
             FALSE);
     fail_if (g_setenv ("UM_HOMEDIR_PREFIX", "/tmp/gum/home", TRUE) == FALSE);
     fail_if (g_setenv ("UM_SKEL_DIR", "/tmp/gum/skel", TRUE) == FALSE);
+    fail_if (g_setenv ("UM_SNAPSHOT_FILE", "/tmp/gum/run/snapshot", TRUE) ==
+            FALSE);
 
     if (system("rm -rf /tmp/gum") != 0)
         WARN("failed to remove tmp gum directory");
@@ -139,6 +148,7 @@ static void
 _unset_env (void)
 {
     fail_if (system("rm -rf /tmp/gum") == -1);
+    g_unsetenv ("UM_SNAPSHOT_FILE");
     g_unsetenv ("UM_SKEL_DIR");
     g_unsetenv ("UM_HOMEDIR_PREFIX");
     g_unsetenv ("UM_PASSWD_FILE");
@@ -384,9 +394,397 @@ _get_user_proxy_by_name (
     return user;
 }
 
+START_TEST (test_daemon_cache)
+{
+    DBG("");
+    GError *error = NULL;
+    GumdDaemonUser *user = NULL;
+    GumdDaemonUser *user2 = NULL;
+    GumdDaemonGroup *group = NULL;
+    GumdDaemonGroup *group2 = NULL;
+    const gchar *passwd_file = NULL;
+    gchar *contents = NULL;
+    gchar *edited = NULL;
+    const gchar *entry = NULL;
+    gchar *str = NULL;
+
+    GumdDaemon *daemon = gumd_daemon_new ();
+    fail_if (daemon == NULL);
+
+    /* every lookup gets its own copy, uncommitted edits are not shared */
+    user = gumd_daemon_get_user (daemon, 0, &error);
+    fail_if (user == NULL, "Failed to get user : %s",
+            error ? error->message : "");
+    g_object_set (G_OBJECT (user), "realname", "uncommitted", NULL);
+
+    user2 = gumd_daemon_get_user (daemon, 0, &error);
+    fail_if (user2 == NULL, "Failed to get user : %s",
+            error ? error->message : "");
+    fail_if (user2 == user);
+    g_object_get (G_OBJECT (user2), "realname", &str, NULL);
+    fail_if (g_strcmp0 (str, "uncommitted") == 0,
+            "Uncommitted edit handed out by the daemon cache");
+    g_free (str); str = NULL;
+    g_object_unref (user2);
+    g_object_unref (user);
+
+    group = gumd_daemon_get_group (daemon, 0, &error);
+    fail_if (group == NULL, "Failed to get group : %s",
+            error ? error->message : "");
+    g_object_set (G_OBJECT (group), "secret", "uncommitted", NULL);
+
+    group2 = gumd_daemon_get_group (daemon, 0, &error);
+    fail_if (group2 == NULL, "Failed to get group : %s",
+            error ? error->message : "");
+    fail_if (group2 == group);
+    g_object_get (G_OBJECT (group2), "secret", &str, NULL);
+    fail_if (g_strcmp0 (str, "uncommitted") == 0,
+            "Uncommitted edit handed out by the daemon cache");
+    g_free (str); str = NULL;
+    g_object_unref (group2);
+    g_object_unref (group);
+
+    /* edits made behind the daemon's back invalidate cached entries */
+    user = gumd_daemon_get_user (daemon, 1, &error);
+    fail_if (user == NULL, "Failed to get user : %s",
+            error ? error->message : "");
+    g_object_unref (user);
+
+    passwd_file = gum_config_get_string (gumd_daemon_get_config (daemon),
+            GUM_CONFIG_GENERAL_PASSWD_FILE);
+    fail_unless (g_file_get_contents (passwd_file, &contents, NULL, NULL));
+    entry = strstr (contents, "\ndaemon:x:1:1:daemon:");
+    fail_if (entry == NULL);
+    str = g_strndup (contents, entry - contents);
+    edited = g_strconcat (str, "\ndaemon:x:1:1:external:",
+            entry + strlen ("\ndaemon:x:1:1:daemon:"), NULL);
+    g_free (str); str = NULL;
+    fail_unless (g_file_set_contents (passwd_file, edited, -1, NULL));
+    g_free (edited);
+
+    user = gumd_daemon_get_user (daemon, 1, &error);
+    fail_if (user == NULL, "Failed to get user : %s",
+            error ? error->message : "");
+    g_object_get (G_OBJECT (user), "realname", &str, NULL);
+    fail_unless (g_strcmp0 (str, "external") == 0,
+            "External edit not picked up: %s", str);
+    g_free (str);
+    g_object_unref (user);
+
+    fail_unless (g_file_set_contents (passwd_file, contents, -1, NULL));
+    g_free (contents);
+
+    fail_unless (gumd_daemon_clear_user_cache (daemon, &error) == TRUE);
+    fail_unless (gumd_daemon_clear_group_cache (daemon, &error) == TRUE);
+
+    g_object_unref (daemon);
+}
+END_TEST
+
+START_TEST (test_daemon_negative_cache)
+{
+    DBG("");
+    GError *error = NULL;
+    GumdDaemonUser *user = NULL;
+    uid_t uid = GUM_USER_INVALID_UID;
+
+    GumdDaemon *daemon = gumd_daemon_new ();
+    fail_if (daemon == NULL);
+
+    /* repeated misses are reported consistently */
+    fail_unless (gumd_daemon_get_user_by_name (daemon, "negcache_user1",
+            &error) == NULL);
+    fail_unless (error != NULL && error->code == GUM_ERROR_USER_NOT_FOUND);
+    g_error_free (error); error = NULL;
+
+    fail_unless (gumd_daemon_get_user_by_name (daemon, "negcache_user1",
+            &error) == NULL);
+    fail_unless (error != NULL && error->code == GUM_ERROR_USER_NOT_FOUND);
+    g_error_free (error); error = NULL;
+
+    /* a write invalidates remembered misses */
+    user = gumd_daemon_user_new (gumd_daemon_get_config (daemon));
+    g_object_set (G_OBJECT (user), "usertype", GUM_USERTYPE_NORMAL,
+            "username", "negcache_user1", NULL);
+    fail_unless (gumd_daemon_add_user (daemon, user, &error) == TRUE,
+            "Failed to add user : %s", error ? error->message : "");
+    g_object_get (G_OBJECT (user), "uid", &uid, NULL);
+    g_object_unref (user);
+
+    user = gumd_daemon_get_user_by_name (daemon, "negcache_user1", &error);
+    fail_if (user == NULL, "Failed to get user : %s",
+            error ? error->message : "");
+
+    fail_unless (gumd_daemon_delete_user (daemon, user, TRUE, &error) == TRUE);
+    g_object_unref (user);
+
+    fail_unless (gumd_daemon_get_user (daemon, uid, &error) == NULL);
+    fail_unless (error != NULL && error->code == GUM_ERROR_USER_NOT_FOUND);
+    g_error_free (error); error = NULL;
+
+    g_object_unref (daemon);
+}
+END_TEST
+
+static void
+_on_user_deleted (
+        GumdDaemon *daemon,
+        GumdDaemonUser *user,
+        const GError *error,
+        gpointer user_data)
+{
+    gint *result = (gint *) user_data;
+
+    *result = error ? error->code : GUM_ERROR_NONE;
+    if (g_main_loop_is_running (main_loop))
+        g_main_loop_quit (main_loop);
+}
+
+START_TEST (test_daemon_delete_user_async)
+{
+    DBG("");
+    GError *error = NULL;
+    GumdDaemonUser *user = NULL;
+    uid_t uid = GUM_USER_INVALID_UID;
+    gint result = -1;
+
+    GumdDaemon *daemon = gumd_daemon_new ();
+    fail_if (daemon == NULL);
+
+    user = gumd_daemon_user_new (gumd_daemon_get_config (daemon));
+    g_object_set (G_OBJECT (user), "usertype", GUM_USERTYPE_NORMAL,
+            "username", "asyncdel_user1", NULL);
+    fail_unless (gumd_daemon_add_user (daemon, user, &error) == TRUE,
+            "Failed to add user : %s", error ? error->message : "");
+    g_object_get (G_OBJECT (user), "uid", &uid, NULL);
+
+    /* the callback tells once the user is gone */
+    gumd_daemon_delete_user_async (daemon, user, TRUE, _on_user_deleted,
+            &result);
+    if (result < 0)
+        g_main_loop_run (main_loop);
+    fail_unless (result == GUM_ERROR_NONE, "Failed to delete user : %d",
+            result);
+    fail_unless (gumd_daemon_get_user (daemon, uid, &error) == NULL);
+    fail_unless (error != NULL && error->code == GUM_ERROR_USER_NOT_FOUND);
+    g_error_free (error); error = NULL;
+
+    /* a user which is gone is not deleted again */
+    result = -1;
+    gumd_daemon_delete_user_async (daemon, user, TRUE, _on_user_deleted,
+            &result);
+    if (result < 0)
+        g_main_loop_run (main_loop);
+    fail_unless (result == GUM_ERROR_USER_NOT_FOUND);
+
+    g_object_unref (user);
+    g_object_unref (daemon);
+}
+END_TEST
+
+static gboolean
+_has_change (
+        GVariant *changes,
+        guint32 op,
+        guint32 id)
+{
+    guint32 change_op = 0, change_id = 0;
+    gsize i;
+
+    for (i = 0; i < g_variant_n_children (changes); i++) {
+        g_variant_get_child (changes, i, "(tuuas)", NULL, &change_op,
+                &change_id, NULL);
+        if (change_op == op && change_id == id)
+            return TRUE;
+    }
+    return FALSE;
+}
+
+START_TEST (test_daemon_change_log)
+{
+    DBG("");
+    GError *error = NULL;
+    GumdDaemonUser *user = NULL;
+    GVariant *changes = NULL;
+    GVariantIter *fields = NULL;
+    guint64 since = 0, generation = 0, change_gen = 0;
+    gboolean resync = FALSE, realname_changed = FALSE;
+    guint32 op = 0, id = 0;
+    const gchar *field = NULL;
+    uid_t uid = GUM_USER_INVALID_UID;
+    gid_t gid = GUM_GROUP_INVALID_GID;
+    const gchar *group_file = NULL;
+    gchar *contents = NULL;
+
+    GumdDaemon *daemon = gumd_daemon_new ();
+    fail_if (daemon == NULL);
+
+    /* first call: no generation known yet */
+    changes = gumd_daemon_get_user_changes (daemon, 0, &since, &resync,
+            &error);
+    fail_if (changes == NULL);
+    fail_unless (resync == TRUE);
+    fail_unless (g_variant_n_children (changes) == 0);
+    g_variant_unref (changes);
+
+    user = gumd_daemon_user_new (gumd_daemon_get_config (daemon));
+    g_object_set (G_OBJECT (user), "usertype", GUM_USERTYPE_NORMAL,
+            "username", "changelog_user1", NULL);
+    fail_unless (gumd_daemon_add_user (daemon, user, &error) == TRUE,
+            "Failed to add user : %s", error ? error->message : "");
+    g_object_get (G_OBJECT (user), "uid", &uid, NULL);
+
+    changes = gumd_daemon_get_user_changes (daemon, since, &generation,
+            &resync, &error);
+    fail_if (changes == NULL);
+    fail_unless (resync == FALSE);
+    fail_unless (generation > since);
+    fail_unless (g_variant_n_children (changes) == 1);
+    g_variant_get_child (changes, 0, "(tuuas)", &change_gen, &op, &id, NULL);
+    fail_unless (change_gen > since && change_gen <= generation);
+    fail_unless (op == GUMD_DAEMON_CHANGE_ADDED);
+    fail_unless (id == uid);
+    g_variant_unref (changes);
+
+    /* user's private group was added as well */
+    g_object_get (G_OBJECT (user), "gid", &gid, NULL);
+    changes = gumd_daemon_get_group_changes (daemon, since, &generation,
+            &resync, &error);
+    fail_if (changes == NULL);
+    fail_unless (resync == FALSE);
+    fail_unless (_has_change (changes, GUMD_DAEMON_CHANGE_ADDED, gid));
+    g_variant_unref (changes);
+
+    since = generation;
+    g_object_set (G_OBJECT (user), "realname", "Change Log", NULL);
+    fail_unless (gumd_daemon_update_user (daemon, user, &error) == TRUE,
+            "Failed to update user : %s", error ? error->message : "");
+
+    changes = gumd_daemon_get_user_changes (daemon, since, &generation,
+            &resync, &error);
+    fail_unless (resync == FALSE);
+    fail_unless (g_variant_n_children (changes) == 1);
+    g_variant_get_child (changes, 0, "(tuuas)", &change_gen, &op, &id,
+            &fields);
+    fail_unless (op == GUMD_DAEMON_CHANGE_UPDATED);
+    fail_unless (id == uid);
+    while (g_variant_iter_next (fields, "&s", &field)) {
+        if (g_strcmp0 (field, "realname") == 0)
+            realname_changed = TRUE;
+    }
+    g_variant_iter_free (fields);
+    fail_unless (realname_changed == TRUE);
+    g_variant_unref (changes);
+
+    /* nothing new since the latest generation */
+    since = generation;
+    changes = gumd_daemon_get_user_changes (daemon, since, &generation,
+            &resync, &error);
+    fail_unless (resync == FALSE);
+    fail_unless (generation == since);
+    fail_unless (g_variant_n_children (changes) == 0);
+    g_variant_unref (changes);
+
+    /* generations not handed out by this daemon */
+    changes = gumd_daemon_get_user_changes (daemon, generation + 1, &generation,
+            &resync, &error);
+    fail_unless (resync == TRUE);
+    g_variant_unref (changes);
+
+    fail_unless (gumd_daemon_delete_user (daemon, user, TRUE, &error) == TRUE);
+    g_object_unref (user);
+
+    changes = gumd_daemon_get_user_changes (daemon, since, &generation,
+            &resync, &error);
+    fail_unless (resync == FALSE);
+    fail_unless (g_variant_n_children (changes) == 1);
+    g_variant_get_child (changes, 0, "(tuuas)", &change_gen, &op, &id, NULL);
+    fail_unless (op == GUMD_DAEMON_CHANGE_DELETED);
+    fail_unless (id == uid);
+    g_variant_unref (changes);
+
+    changes = gumd_daemon_get_group_changes (daemon, since, &generation,
+            &resync, &error);
+    fail_unless (resync == FALSE);
+    fail_unless (_has_change (changes, GUMD_DAEMON_CHANGE_DELETED, gid));
+    g_variant_unref (changes);
+
+    /* edits made behind the daemon's back can not be described */
+    since = generation;
+    group_file = gum_config_get_string (gumd_daemon_get_config (daemon),
+            GUM_CONFIG_GENERAL_GROUP_FILE);
+    fail_unless (g_file_get_contents (group_file, &contents, NULL, NULL));
+    fail_unless (g_file_set_contents (group_file, contents, -1, NULL));
+    g_free (contents);
+
+    changes = gumd_daemon_get_group_changes (daemon, since, &generation,
+            &resync, &error);
+    fail_unless (resync == TRUE);
+    fail_unless (generation > since);
+    g_variant_unref (changes);
+
+    g_object_unref (daemon);
+}
+END_TEST
+
 /*
  * User test cases
  */
+static gpointer
+_concurrent_lookups (
+        gpointer data)
+{
+    GumdDaemon *daemon = GUMD_DAEMON (data);
+    GumdDaemonUser *user = NULL;
+    GumdDaemonGroup *group = NULL;
+    gint failures = 0;
+    gint i;
+
+    for (i = 0; i < 200; i++) {
+        user = (i % 2) ? gumd_daemon_get_user (daemon, 0, NULL) :
+                gumd_daemon_get_user_by_name (daemon, "root", NULL);
+        if (!user)
+            failures++;
+        GUM_OBJECT_UNREF (user);
+
+        group = (i % 2) ? gumd_daemon_get_group (daemon, 0, NULL) :
+                gumd_daemon_get_group_by_name (daemon, "root", NULL);
+        if (!group)
+            failures++;
+        GUM_OBJECT_UNREF (group);
+
+        /* force loads alongside cache hits */
+        if (i % 50 == 0) {
+            gumd_daemon_clear_user_cache (daemon, NULL);
+            gumd_daemon_clear_group_cache (daemon, NULL);
+        }
+    }
+
+    return GINT_TO_POINTER (failures);
+}
+
+START_TEST (test_daemon_concurrent_lookups)
+{
+    DBG("");
+    GThread *threads[4];
+    gint failures = 0;
+    guint i;
+
+    GumdDaemon *daemon = gumd_daemon_new ();
+    fail_if (daemon == NULL);
+
+    for (i = 0; i < G_N_ELEMENTS (threads); i++) {
+        threads[i] = g_thread_new ("lookup", _concurrent_lookups, daemon);
+    }
+    for (i = 0; i < G_N_ELEMENTS (threads); i++) {
+        failures += GPOINTER_TO_INT (g_thread_join (threads[i]));
+    }
+    fail_unless (failures == 0, "%d concurrent lookups failed", failures);
+
+    g_object_unref (daemon);
+}
+END_TEST
+
 START_TEST (test_daemon_user)
 {
     DBG("");
@@ -1051,6 +1449,120 @@ START_TEST (test_update_user)
 }
 END_TEST
 
+static void
+_on_users_changed (
+        GumDbusUserService *user_service,
+        GVariant *added,
+        GVariant *updated,
+        GVariant *removed,
+        gpointer user_data)
+{
+    GVariant **changes = (GVariant **) user_data;
+
+    changes[0] = g_variant_ref (added);
+    changes[1] = g_variant_ref (updated);
+    changes[2] = g_variant_ref (removed);
+    _stop_mainloop ();
+}
+
+static gboolean
+_on_signal_timeout (
+        gpointer user_data)
+{
+    *((guint *) user_data) = 0;
+    _stop_mainloop ();
+    return FALSE;
+}
+
+static gboolean
+_ids_contain (
+        GVariant *ids,
+        guint32 id)
+{
+    gsize n_ids = 0, i = 0;
+    const guint32 *data = g_variant_get_fixed_array (ids, &n_ids,
+            sizeof (guint32));
+
+    for (i = 0; i < n_ids; i++) {
+        if (data[i] == id)
+            return TRUE;
+    }
+    return FALSE;
+}
+
+START_TEST (test_users_changed)
+{
+    DBG ("\n");
+    gboolean res = FALSE;
+    GError *error = NULL;
+    GDBusConnection *connection = NULL;
+    GumDbusUserService *user_service = NULL;
+    GumDbusUser *user_proxy = NULL;
+    uid_t user_id = GUM_USER_INVALID_UID;
+    GVariant *changes[3] = { NULL, NULL, NULL };
+    guint timer_id = 0;
+    gint i = 0;
+
+    connection = _get_bus_connection (&error);
+    fail_if (connection == NULL, "failed to get bus connection : %s",
+            error ? error->message : "(null)");
+
+    user_service = _get_user_service (connection, &error);
+    fail_if (user_service == NULL, "failed to get user_service : %s",
+            error ? error->message : "");
+    g_signal_connect (user_service, "users-changed",
+            G_CALLBACK (_on_users_changed), changes);
+
+    user_proxy = _create_new_user_proxy (user_service, &error);
+    fail_if (user_proxy == NULL, "Failed to create new user : %s",
+            error ? error->message : "");
+
+    g_object_set (G_OBJECT (user_proxy), "username", "test_chuser1",
+            "secret", "123456", "usertype", GUM_USERTYPE_NORMAL, NULL);
+    res = gum_dbus_user_call_add_user_sync (user_proxy, &user_id, NULL,
+            &error);
+    fail_if (res == FALSE, "Failed to add new user : %s",
+            error ? error->message : "");
+
+    /* updates within the window are folded into the addition */
+    g_object_set (G_OBJECT (user_proxy), "secret", "23456", NULL);
+    res = gum_dbus_user_call_update_user_sync (user_proxy, NULL, &error);
+    fail_if (res == FALSE, "Failed to update user : %s",
+            error ? error->message : "");
+
+    timer_id = g_timeout_add_seconds (5, _on_signal_timeout, &timer_id);
+    g_main_loop_run (main_loop);
+    if (timer_id) g_source_remove (timer_id);
+
+    fail_if (changes[0] == NULL, "usersChanged not received");
+    fail_unless (_ids_contain (changes[0], user_id) == TRUE);
+    fail_unless (_ids_contain (changes[1], user_id) == FALSE);
+    fail_unless (_ids_contain (changes[2], user_id) == FALSE);
+    for (i = 0; i < 3; i++) {
+        g_variant_unref (changes[i]);
+        changes[i] = NULL;
+    }
+
+    res = gum_dbus_user_call_delete_user_sync (user_proxy, TRUE, NULL, &error);
+    fail_if (res == FALSE, "Failed to delete user : %s",
+            error ? error->message : "");
+
+    timer_id = g_timeout_add_seconds (5, _on_signal_timeout, &timer_id);
+    g_main_loop_run (main_loop);
+    if (timer_id) g_source_remove (timer_id);
+
+    fail_if (changes[2] == NULL, "usersChanged not received");
+    fail_unless (_ids_contain (changes[2], user_id) == TRUE);
+    for (i = 0; i < 3; i++) {
+        g_variant_unref (changes[i]);
+    }
+
+    g_object_unref (user_proxy);
+    g_object_unref (user_service);
+    g_object_unref (connection);
+}
+END_TEST
+
 GumDbusGroupService *
 _get_group_service (
         GDBusConnection *connection,
@@ -1164,6 +1676,8 @@ START_TEST (test_daemon_group)
     GumdDaemonUser *user = NULL;
     uid_t uid = 0;
     gchar *str = NULL;
+    GArray *gids = NULL;
+    guint i;
 
     gchar *encr_secret = gum_crypt_encrypt_secret ("grouppass123", "SHA512");
 
@@ -1471,9 +1985,16 @@ START_TEST (test_daemon_group)
     g_free (str);
 
     /* case 26: delete user membership */
+    gids = g_array_new (FALSE, FALSE, sizeof (gid_t));
     fail_unless (gumd_daemon_group_delete_user_membership (config,
-            "nor_daemon_user_grp_add1", &error) == TRUE);
+            "nor_daemon_user_grp_add1", gids, &error) == TRUE);
     fail_unless (error == NULL);
+    for (i = 0; i < gids->len; i++) {
+        if (g_array_index (gids, gid_t, i) == gid)
+            break;
+    }
+    fail_unless (i < gids->len);
+    g_array_unref (gids);
 
     g_object_unref (group);
     group = gumd_daemon_group_new_by_gid (gid, config);
@@ -2015,6 +2536,59 @@ START_TEST (test_get_user_list)
 
     fail_if (g_variant_n_children (users) <= 0,
             "Expected no of users > 1, got '%d'", g_variant_n_children(users));
+
+#ifdef HAVE_MEMFD_CREATE
+    /* same list, handed over in a sealed memory file */
+    {
+        GVariant *handle = NULL;
+        GVariant *fd_users = NULL;
+        GVariant *record = NULL;
+        GUnixFDList *fd_list = NULL;
+        const gchar *username = NULL, *homedir = NULL;
+        guint32 uid = 0, record_uid = 0;
+        gsize i;
+        gint fd = -1;
+
+        strv = gum_string_utils_append_string (NULL,"system");
+        res = gum_dbus_user_service_call_get_user_list_fd_sync (user_service,
+                (const gchar *const *)strv, NULL, &handle, &fd_list, NULL,
+                &error);
+        g_strfreev (strv);
+        fail_if (res == FALSE, "Failed to get users fd : %s",
+                error ? error->message : "");
+        fail_if (fd_list == NULL, "No fd received");
+
+        fd = g_unix_fd_list_get (fd_list, g_variant_get_handle (handle),
+                &error);
+        fail_if (fd < 0);
+        /* sealed against modification */
+        fail_if (write (fd, "x", 1) == 1);
+        fail_if (ftruncate (fd, 0) == 0);
+        fd_users = gum_utils_variant_new_from_fd (fd,
+                G_VARIANT_TYPE ("aa{sv}"), &error);
+        close (fd);
+        fail_if (fd_users == NULL, "Failed to map users : %s",
+                error ? error->message : "");
+        /* records of the same users, in the same order */
+        fail_unless (g_variant_n_children (fd_users) ==
+                g_variant_n_children (users));
+        for (i = 0; i < g_variant_n_children (users); i++) {
+            g_variant_get_child (users, i, "u", &uid);
+            g_variant_get_child (fd_users, i, "@a{sv}", &record);
+            fail_unless (g_variant_lookup (record, "uid", "u", &record_uid));
+            fail_unless (record_uid == uid);
+            fail_unless (g_variant_lookup (record, "username", "&s",
+                    &username));
+            fail_unless (g_variant_lookup (record, "homedir", "&s",
+                    &homedir));
+            g_variant_unref (record);
+        }
+
+        g_variant_unref (fd_users);
+        g_variant_unref (handle);
+        g_object_unref (fd_list);
+    }
+#endif
     g_variant_unref (users);
 
     g_object_unref (user_proxy);
@@ -2023,6 +2597,648 @@ START_TEST (test_get_user_list)
 }
 END_TEST
 
+typedef struct {
+    GumdDbusScheduler *scheduler;
+    GString *order;
+    guint received;
+    guint replied;
+    guint limited;
+} SchedulerTest;
+
+static const gchar _scheduler_test_xml[] =
+    "<node>"
+    "  <interface name='org.O1.SecurityAccounts.gUserManagement.Test'>"
+    "    <method name='read'><arg name='id' type='s'/></method>"
+    "    <method name='write'><arg name='id' type='s'/></method>"
+    "  </interface>"
+    "</node>";
+
+static void
+_on_scheduler_test_job (
+        GObject *object,
+        GDBusMethodInvocation *invocation)
+{
+    SchedulerTest *test = g_object_get_data (object, "test");
+    const gchar *id = NULL;
+
+    g_variant_get (g_dbus_method_invocation_get_parameters (invocation),
+            "(&s)", &id);
+    g_string_append (test->order, id);
+    g_dbus_method_invocation_return_value (invocation, NULL);
+}
+
+static void
+_on_scheduler_test_call (
+        GDBusConnection *connection,
+        const gchar *sender,
+        const gchar *object_path,
+        const gchar *interface_name,
+        const gchar *method_name,
+        GVariant *parameters,
+        GDBusMethodInvocation *invocation,
+        gpointer user_data)
+{
+    GObject *object = G_OBJECT (user_data);
+    SchedulerTest *test = g_object_get_data (object, "test");
+
+    test->received++;
+    gumd_dbus_scheduler_push (test->scheduler,
+            g_strcmp0 (method_name, "read") == 0 ? GUMD_DBUS_REQUEST_READ :
+                    GUMD_DBUS_REQUEST_WRITE,
+            object, invocation, _on_scheduler_test_job);
+}
+
+static const GDBusInterfaceVTable _scheduler_test_vtable = {
+    _on_scheduler_test_call, NULL, NULL
+};
+
+static void
+_on_p2p_connection (
+        GObject *source,
+        GAsyncResult *res,
+        gpointer user_data)
+{
+    GDBusConnection **connection = (GDBusConnection **) user_data;
+    GError *error = NULL;
+
+    *connection = g_dbus_connection_new_finish (res, &error);
+    fail_if (*connection == NULL, "failed to connect : %s",
+            error ? error->message : "");
+}
+
+static void
+_new_p2p_connections (
+        GDBusConnection **server,
+        GDBusConnection **client)
+{
+    gint fds[2];
+    gchar *guid = g_dbus_generate_guid ();
+    GSocket *socket = NULL;
+    GSocketConnection *stream = NULL;
+    GDBusConnection **connections[2] = { server, client };
+    guint ind;
+
+    fail_unless (socketpair (AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+    *server = *client = NULL;
+    for (ind = 0; ind < 2; ind++) {
+        socket = g_socket_new_from_fd (fds[ind], NULL);
+        fail_if (socket == NULL);
+        stream = g_socket_connection_factory_create_connection (socket);
+        g_dbus_connection_new (G_IO_STREAM (stream), ind == 0 ? guid : NULL,
+                ind == 0 ? G_DBUS_CONNECTION_FLAGS_AUTHENTICATION_SERVER |
+                        G_DBUS_CONNECTION_FLAGS_AUTHENTICATION_ALLOW_ANONYMOUS :
+                        G_DBUS_CONNECTION_FLAGS_AUTHENTICATION_CLIENT,
+                NULL, NULL, _on_p2p_connection, connections[ind]);
+        g_object_unref (stream);
+        g_object_unref (socket);
+    }
+    while (*server == NULL || *client == NULL)
+        g_main_context_iteration (NULL, TRUE);
+    g_free (guid);
+}
+
+static void
+_on_scheduler_test_reply (
+        GObject *source,
+        GAsyncResult *res,
+        gpointer user_data)
+{
+    SchedulerTest *test = (SchedulerTest *) user_data;
+    GError *error = NULL;
+    GVariant *reply = NULL;
+
+    reply = g_dbus_connection_call_finish (G_DBUS_CONNECTION (source), res,
+            &error);
+    if (reply) {
+        g_variant_unref (reply);
+    } else {
+        if (g_error_matches (error, GUM_ERROR, GUM_ERROR_RATE_LIMITED))
+            test->limited++;
+        g_error_free (error);
+    }
+    test->replied++;
+}
+
+static void
+_scheduler_test_send (
+        SchedulerTest *test,
+        GDBusConnection *client,
+        const gchar *method,
+        const gchar * const *ids,
+        gboolean wait_reply)
+{
+    guint received = test->received;
+
+    for (; *ids; ids++, received++) {
+        g_dbus_connection_call (client, NULL, "/test",
+                "org.O1.SecurityAccounts.gUserManagement.Test", method,
+                g_variant_new ("(s)", *ids), NULL, G_DBUS_CALL_FLAGS_NONE, -1,
+                NULL, wait_reply ? _on_scheduler_test_reply : NULL,
+                wait_reply ? test : NULL);
+    }
+    /* all queued before the next peer sends anything */
+    while (test->received < received)
+        g_main_context_iteration (NULL, TRUE);
+}
+
+START_TEST (test_scheduler_order)
+{
+    DBG ("\n");
+    GError *error = NULL;
+    GDBusNodeInfo *info = NULL;
+    GMainContext *context = NULL;
+    GDBusConnection *servers[2] = { NULL, NULL };
+    GDBusConnection *clients[2] = { NULL, NULL };
+    GObject *object = NULL;
+    SchedulerTest test = { NULL, NULL, 0, 0, 0 };
+    const gchar *writes_a[] = { "w1", "w2", "w3", NULL };
+    const gchar *writes_b[] = { "w4", NULL };
+    const gchar *reads_a[] = { "r1", "r2", NULL };
+    const gchar *reads_b[] = { "r3", NULL };
+    guint ids[2];
+    guint ind;
+
+    info = g_dbus_node_info_new_for_xml (_scheduler_test_xml, &error);
+    fail_if (info == NULL, "failed to parse interface : %s",
+            error ? error->message : "");
+
+    /* the requests are only dispatched once all of them are queued */
+    context = g_main_context_new ();
+    g_main_context_push_thread_default (context);
+    test.scheduler = gumd_dbus_scheduler_new ();
+    g_main_context_pop_thread_default (context);
+    test.order = g_string_new (NULL);
+
+    object = g_object_new (G_TYPE_OBJECT, NULL);
+    g_object_set_data (object, "test", &test);
+
+    /* one p2p connection per peer */
+    for (ind = 0; ind < 2; ind++) {
+        _new_p2p_connections (&servers[ind], &clients[ind]);
+        ids[ind] = g_dbus_connection_register_object (servers[ind], "/test",
+                info->interfaces[0], &_scheduler_test_vtable, object, NULL,
+                &error);
+        fail_if (ids[ind] == 0, "failed to register object : %s",
+                error ? error->message : "");
+    }
+
+    _scheduler_test_send (&test, clients[0], "write", writes_a, FALSE);
+    _scheduler_test_send (&test, clients[1], "write", writes_b, FALSE);
+    _scheduler_test_send (&test, clients[0], "read", reads_a, FALSE);
+    _scheduler_test_send (&test, clients[1], "read", reads_b, FALSE);
+    fail_unless (test.order->len == 0);
+
+    while (g_main_context_iteration (context, FALSE));
+
+    /* reads before writes, peers taking turns within each class */
+    fail_unless (g_strcmp0 (test.order->str, "r1r3r2w1w4w2w3") == 0,
+            "unexpected order %s", test.order->str);
+
+    for (ind = 0; ind < 2; ind++) {
+        g_dbus_connection_unregister_object (servers[ind], ids[ind]);
+        g_dbus_connection_close_sync (clients[ind], NULL, NULL);
+        g_object_unref (clients[ind]);
+        g_object_unref (servers[ind]);
+    }
+    g_object_unref (test.scheduler);
+    g_object_unref (object);
+    g_string_free (test.order, TRUE);
+    g_main_context_unref (context);
+    g_dbus_node_info_unref (info);
+}
+END_TEST
+
+START_TEST (test_scheduler_rate_limit)
+{
+    DBG ("\n");
+    GError *error = NULL;
+    GumdDaemon *daemon = gumd_daemon_new ();
+    GumConfig *config = gumd_daemon_get_config (daemon);
+    GDBusNodeInfo *info = NULL;
+    GDBusConnection *server = NULL;
+    GDBusConnection *client = NULL;
+    GObject *object = NULL;
+    SchedulerTest test = { NULL, NULL, 0, 0, 0 };
+    GumdDbusLimitStats stats;
+    const gchar *writes[] = { "w1", "w2", "w3", "w4", NULL };
+    guint id = 0;
+    guint round;
+
+    info = g_dbus_node_info_new_for_xml (_scheduler_test_xml, &error);
+    fail_if (info == NULL, "failed to parse interface : %s",
+            error ? error->message : "");
+
+    object = g_object_new (G_TYPE_OBJECT, NULL);
+    g_object_set_data (object, "test", &test);
+    test.order = g_string_new (NULL);
+
+    _new_p2p_connections (&server, &client);
+    id = g_dbus_connection_register_object (server, "/test",
+            info->interfaces[0], &_scheduler_test_vtable, object, NULL,
+            &error);
+    fail_if (id == 0, "failed to register object : %s",
+            error ? error->message : "");
+
+    /* limits are off by default, then a burst of 2 writes and 1 per minute */
+    for (round = 0; round < 2; round++) {
+        if (round == 1) {
+            gum_config_set_int (config, GUM_CONFIG_DBUS_WRITE_RATE, 1);
+            gum_config_set_int (config, GUM_CONFIG_DBUS_WRITE_BURST, 2);
+        }
+        test.scheduler = gumd_dbus_scheduler_new ();
+        test.replied = test.limited = 0;
+        g_string_truncate (test.order, 0);
+
+        _scheduler_test_send (&test, client, "write", writes, TRUE);
+        while (test.replied < G_N_ELEMENTS (writes) - 1)
+            g_main_context_iteration (NULL, TRUE);
+
+        fail_unless (gumd_dbus_scheduler_get_limit_stats (test.scheduler,
+                GUMD_DBUS_LIMIT_WRITE, &stats));
+        if (round == 0) {
+            fail_unless (test.limited == 0);
+            fail_unless (g_strcmp0 (test.order->str, "w1w2w3w4") == 0);
+            fail_unless (stats.admitted == 4 && stats.rejected == 0);
+        } else {
+            fail_unless (test.limited == 2, "%u requests limited",
+                    test.limited);
+            fail_unless (g_strcmp0 (test.order->str, "w1w2") == 0);
+            fail_unless (stats.peers == 1);
+            fail_unless (stats.admitted == 2 && stats.rejected == 2);
+        }
+        g_object_unref (test.scheduler);
+    }
+
+    gum_config_set_int (config, GUM_CONFIG_DBUS_WRITE_RATE, 0);
+    gum_config_set_int (config, GUM_CONFIG_DBUS_WRITE_BURST, 20);
+
+    g_dbus_connection_unregister_object (server, id);
+    g_dbus_connection_close_sync (client, NULL, NULL);
+    g_object_unref (client);
+    g_object_unref (server);
+    g_object_unref (object);
+    g_string_free (test.order, TRUE);
+    g_dbus_node_info_unref (info);
+    g_object_unref (daemon);
+}
+END_TEST
+
+START_TEST (test_stats)
+{
+    DBG ("\n");
+    gboolean res = FALSE;
+    GError *error = NULL;
+    GDBusConnection *connection = NULL;
+    GumDbusUserService *user_service = NULL;
+    GumDbusStats *stats_proxy = NULL;
+    GVariant *stats = NULL;
+    gchar *path = NULL;
+    guint64 calls = 0, errors = 0, max = 0, p99 = 0;
+
+    connection = _get_bus_connection (&error);
+    fail_if (connection == NULL, "failed to get bus connection : %s",
+            error ? error->message : "(null)");
+
+    user_service = _get_user_service (connection, &error);
+    fail_if (user_service == NULL, "failed to get user_service : %s",
+            error ? error->message : "");
+
+    stats_proxy = gum_dbus_stats_proxy_new_sync (connection,
+            G_DBUS_PROXY_FLAGS_NONE, GUM_SERVICE, GUM_STATS_OBJECTPATH, NULL,
+            &error);
+    fail_if (stats_proxy == NULL, "failed to get stats : %s",
+            error ? error->message : "");
+
+    res = gum_dbus_stats_call_reset_sync (stats_proxy, NULL, &error);
+    fail_if (res == FALSE, "Failed to reset stats : %s",
+            error ? error->message : "");
+
+    res = gum_dbus_user_service_call_get_user_by_name_sync (user_service,
+            "no_such_user", &path, NULL, &error);
+    fail_unless (res == FALSE);
+    fail_unless (error != NULL);
+    g_error_free (error); error = NULL;
+
+    res = gum_dbus_stats_call_get_stats_sync (stats_proxy, &stats, NULL,
+            &error);
+    fail_if (res == FALSE, "Failed to get stats : %s",
+            error ? error->message : "");
+    fail_unless (g_variant_lookup (stats, "dbus.UserService.getUserByName",
+            "(ttttttta(tt))", &calls, &errors, NULL, &max, NULL, NULL, &p99,
+            NULL));
+    fail_unless (calls == 1);
+    fail_unless (errors == 1);
+    fail_unless (p99 <= max);
+    fail_unless (g_variant_lookup (stats, "dbus.Stats.reset",
+            "(ttttttta(tt))", &calls, &errors, NULL, NULL, NULL, NULL, NULL,
+            NULL));
+    fail_unless (calls == 1 && errors == 0);
+    g_variant_unref (stats);
+
+    res = gum_dbus_stats_call_get_queue_stats_sync (stats_proxy, &stats, NULL,
+            &error);
+    fail_if (res == FALSE, "Failed to get queue stats : %s",
+            error ? error->message : "");
+    fail_unless (g_variant_lookup (stats, "read", "(uuttt)", NULL, NULL, NULL,
+            NULL, NULL));
+    fail_unless (g_variant_lookup (stats, "write", "(uuttt)", NULL, NULL,
+            NULL, NULL, NULL));
+    fail_unless (g_variant_lookup (stats, "heavy", "(uuttt)", NULL, NULL,
+            NULL, NULL, NULL));
+    g_variant_unref (stats);
+
+    res = gum_dbus_stats_call_get_limit_stats_sync (stats_proxy, &stats, NULL,
+            &error);
+    fail_if (res == FALSE, "Failed to get limit stats : %s",
+            error ? error->message : "");
+    fail_unless (g_variant_lookup (stats, "write", "(utt)", NULL, NULL,
+            &errors));
+    fail_unless (errors == 0);
+    fail_unless (g_variant_lookup (stats, "create", "(utt)", NULL, NULL,
+            NULL));
+    g_variant_unref (stats);
+
+    g_object_unref (stats_proxy);
+    g_object_unref (user_service);
+    g_object_unref (connection);
+}
+END_TEST
+
+static gchar *
+_read_db_files (
+        GumConfig *config)
+{
+    const gchar *keys[] = {
+        GUM_CONFIG_GENERAL_PASSWD_FILE, GUM_CONFIG_GENERAL_SHADOW_FILE,
+        GUM_CONFIG_GENERAL_GROUP_FILE, GUM_CONFIG_GENERAL_GSHADOW_FILE
+    };
+    GString *str = g_string_new (NULL);
+    gchar *contents = NULL;
+    guint ind;
+
+    for (ind = 0; ind < G_N_ELEMENTS (keys); ind++) {
+        fail_unless (g_file_get_contents (gum_config_get_string (config,
+                keys[ind]), &contents, NULL, NULL));
+        g_string_append (str, contents);
+        g_free (contents);
+    }
+    return g_string_free (str, FALSE);
+}
+
+START_TEST (test_apply_manifest)
+{
+    DBG ("\n");
+    GError *error = NULL;
+    GumConfig *config = NULL;
+    struct passwd *pent = NULL;
+    struct group *grp = NULL;
+    struct sgrp *sgrp = NULL;
+    gchar *before = NULL, *after = NULL;
+    const gchar *manifest = "/tmp/gum/manifest";
+    const gchar *contents =
+            "[Group mfgroup]\n"
+            "Type=user\n"
+            "\n"
+            "[User mfuser]\n"
+            "Type=normal\n"
+            "RealName=Manifest User\n"
+            "SecretHash=$6$salt$hash\n"
+            "AdminGroups=mfgroup\n"
+            "\n"
+            "[User mfsystem]\n"
+            "Type=system\n";
+
+    config = gum_config_new (NULL);
+    fail_if (config == NULL);
+
+    fail_unless (g_file_set_contents (manifest, "[Users]\n", -1, NULL));
+    fail_unless (gumd_manifest_apply (config, manifest, TRUE, &error) ==
+            FALSE);
+    fail_unless (error != NULL && error->code == GUM_ERROR_INVALID_INPUT);
+    g_error_free (error); error = NULL;
+
+    fail_unless (g_file_set_contents (manifest, contents, -1, NULL));
+    fail_unless (gumd_manifest_apply (config, manifest, TRUE, &error),
+            "failed to apply manifest : %s", error ? error->message : "");
+
+    pent = gum_file_getpwnam ("mfuser", gum_config_get_string (config,
+            GUM_CONFIG_GENERAL_PASSWD_FILE));
+    fail_if (pent == NULL);
+    fail_unless (g_str_has_prefix (pent->pw_gecos, "Manifest User,"));
+    fail_unless (g_file_test (pent->pw_dir, G_FILE_TEST_IS_DIR));
+    grp = gum_file_getgrgid (pent->pw_gid, gum_config_get_string (config,
+            GUM_CONFIG_GENERAL_GROUP_FILE));
+    fail_unless (grp != NULL && g_strcmp0 (grp->gr_name, "mfuser") == 0);
+
+    grp = gum_file_getgrnam ("mfgroup", gum_config_get_string (config,
+            GUM_CONFIG_GENERAL_GROUP_FILE));
+    fail_if (grp == NULL);
+    fail_unless (gum_string_utils_search_stringv (grp->gr_mem, "mfuser"));
+    sgrp = gum_file_getsgnam ("mfgroup", gum_config_get_string (config,
+            GUM_CONFIG_GENERAL_GSHADOW_FILE));
+    fail_if (sgrp == NULL);
+    fail_unless (gum_string_utils_search_stringv (sgrp->sg_adm, "mfuser"));
+
+    fail_if (gum_file_getpwnam ("mfsystem", gum_config_get_string (config,
+            GUM_CONFIG_GENERAL_PASSWD_FILE)) == NULL);
+
+    /* applying it again does not change anything */
+    before = _read_db_files (config);
+    fail_unless (gumd_manifest_apply (config, manifest, TRUE, &error),
+            "failed to reapply manifest : %s", error ? error->message : "");
+    after = _read_db_files (config);
+    fail_unless (g_strcmp0 (before, after) == 0);
+
+    g_free (before);
+    g_free (after);
+    g_object_unref (config);
+}
+END_TEST
+
+START_TEST (test_home_reaper)
+{
+    DBG ("\n");
+    GError *error = NULL;
+    GumConfig *config = NULL;
+    GumdDaemonUser *user = NULL;
+    gchar *hdir = NULL, *trash = NULL, *other = NULL, *path = NULL;
+    GDir *dir = NULL;
+    uid_t uid = 0;
+    gint i;
+    struct stat sb;
+
+    config = gum_config_new (NULL);
+    fail_if (config == NULL);
+    trash = g_build_filename (gum_config_get_string (config,
+            GUM_CONFIG_GENERAL_HOME_DIR_PREF), GUMD_HOME_REAPER_TRASH_DIR,
+            NULL);
+
+    fail_unless (gumd_home_reaper_start (config) == TRUE);
+    fail_unless (gumd_home_reaper_is_running () == TRUE);
+
+    user = gumd_daemon_user_new (config);
+    g_object_set (G_OBJECT (user), "usertype", GUM_USERTYPE_NORMAL,
+            "username", "reaper_daemon_user1", NULL);
+    fail_unless (gumd_daemon_user_add (user, &uid, &error) == TRUE);
+    fail_unless (error == NULL);
+    g_object_get (G_OBJECT (user), "homedir", &hdir, NULL);
+    fail_unless (stat (hdir, &sb) == 0);
+
+    /* the home dir is gone right away, its contents soon after */
+    fail_unless (gumd_daemon_user_delete (user, TRUE, &error) == TRUE);
+    fail_unless (error == NULL);
+    fail_unless (lstat (hdir, &sb) != 0);
+    for (i = 0; i < 100; i++) {
+        fail_unless ((dir = g_dir_open (trash, 0, NULL)) != NULL);
+        if (!g_dir_read_name (dir)) break;
+        g_dir_close (dir);
+        dir = NULL;
+        g_usleep (50000);
+    }
+    fail_unless (dir != NULL);
+    g_dir_close (dir);
+    dir = NULL;
+
+    /* home of another user, only accessible with the privileges the
+     * reaper's child process gains */
+    other = g_build_filename (gum_config_get_string (config,
+            GUM_CONFIG_GENERAL_HOME_DIR_PREF), "reaper_other_home", NULL);
+    path = g_build_filename (other, "private", NULL);
+    fail_unless (g_mkdir_with_parents (path, 0700) == 0);
+    g_free (path);
+    path = g_build_filename (other, "private", "file", NULL);
+    fail_unless (g_file_set_contents (path, "x", -1, NULL) == TRUE);
+    if (geteuid () == 0) {
+        fail_unless (chown (path, 65534, 65534) == 0);
+        g_free (path);
+        path = g_build_filename (other, "private", NULL);
+        fail_unless (chown (path, 65534, 65534) == 0);
+        fail_unless (chown (other, 65534, 65534) == 0);
+    }
+    fail_unless (chmod (other, 0700) == 0);
+
+    fail_unless (gumd_home_reaper_delete_home_dir (other, &error) == TRUE);
+    fail_unless (error == NULL);
+    fail_unless (lstat (other, &sb) != 0);
+    for (i = 0; i < 100; i++) {
+        fail_unless ((dir = g_dir_open (trash, 0, NULL)) != NULL);
+        if (!g_dir_read_name (dir)) break;
+        g_dir_close (dir);
+        dir = NULL;
+        g_usleep (50000);
+    }
+    fail_unless (dir != NULL, "home of another user not reaped");
+    g_dir_close (dir);
+
+    gumd_home_reaper_stop ();
+    fail_unless (gumd_home_reaper_is_running () == FALSE);
+
+    g_free (path);
+    g_free (other);
+    g_free (hdir);
+    g_free (trash);
+    g_object_unref (user);
+    g_object_unref (config);
+}
+END_TEST
+
+START_TEST (test_home_dir_layout)
+{
+    DBG ("\n");
+    GError *error = NULL;
+    GumConfig *config = NULL, *sconfig = NULL;
+    GumdDaemonUser *user = NULL;
+    struct passwd *pent = NULL;
+    gchar *hdir = NULL, *path = NULL, *old_path = NULL;
+    const gchar *prefix = NULL;
+    const gchar *sysroot = "/tmp/gum/sysroot";
+    guint moved = 0;
+    uid_t uid = 0;
+    struct stat sb;
+
+    config = gum_config_new (NULL);
+    fail_if (config == NULL);
+    prefix = gum_config_get_string (config, GUM_CONFIG_GENERAL_HOME_DIR_PREF);
+
+    /* created in the configured layout */
+    gum_config_set_string (config, GUM_CONFIG_GENERAL_HOME_DIR_LAYOUT,
+            "hash2");
+    user = gumd_daemon_user_new (config);
+    g_object_set (G_OBJECT (user), "usertype", GUM_USERTYPE_NORMAL,
+            "username", "layout_daemon_user1", NULL);
+    fail_unless (gumd_daemon_user_add (user, &uid, &error) == TRUE);
+    fail_unless (error == NULL);
+    g_object_get (G_OBJECT (user), "homedir", &hdir, NULL);
+    path = gum_file_get_home_dir_path (prefix, "hash2",
+            "layout_daemon_user1");
+    fail_unless (g_strcmp0 (hdir, path) == 0);
+    fail_unless (stat (hdir, &sb) == 0 && S_ISDIR (sb.st_mode));
+    g_free (path);
+    g_free (hdir);
+
+    /* deleted from the configured layout */
+    g_object_unref (user);
+    user = gumd_daemon_user_new_by_name ("layout_daemon_user1", config);
+    fail_unless (user != NULL);
+    fail_unless (gumd_daemon_user_delete (user, TRUE, &error) == TRUE);
+    fail_unless (error == NULL);
+    path = gum_file_get_home_dir_path (prefix, "hash2",
+            "layout_daemon_user1");
+    fail_unless (lstat (path, &sb) != 0);
+    g_free (path);
+
+    /* moved to the new layout within a sysroot, gumd running or not */
+    sconfig = gum_config_new (sysroot);
+    fail_if (sconfig == NULL);
+    old_path = gum_file_get_home_dir_path (prefix, "hash2",
+            "layout_sysroot_user");
+    path = g_build_filename (sysroot, old_path, NULL);
+    fail_unless (g_mkdir_with_parents (path, 0700) == 0);
+    g_free (path);
+    path = g_path_get_dirname (gum_config_get_string (sconfig,
+            GUM_CONFIG_GENERAL_PASSWD_FILE));
+    fail_unless (g_mkdir_with_parents (path, 0755) == 0);
+    g_free (path);
+    path = g_strdup_printf ("layout_sysroot_user:x:3000:3000:,,,,normal:%s:"
+            "/bin/sh\n", old_path);
+    fail_unless (g_file_set_contents (gum_config_get_string (sconfig,
+            GUM_CONFIG_GENERAL_PASSWD_FILE), path, -1, NULL));
+    g_free (path);
+
+    gum_config_set_string (sconfig, GUM_CONFIG_GENERAL_HOME_DIR_LAYOUT,
+            "hash2x2");
+    fail_unless (gumd_daemon_user_migrate_home_dirs (sconfig, &moved, &error)
+            == TRUE);
+    fail_unless (error == NULL);
+    fail_unless (moved == 1);
+    pent = gum_file_getpwnam ("layout_sysroot_user", gum_config_get_string (
+            sconfig, GUM_CONFIG_GENERAL_PASSWD_FILE));
+    fail_unless (pent != NULL);
+    path = gum_file_get_home_dir_path (prefix, "hash2x2",
+            "layout_sysroot_user");
+    fail_unless (g_strcmp0 (pent->pw_dir, path) == 0);
+    hdir = g_build_filename (sysroot, path, NULL);
+    fail_unless (stat (hdir, &sb) == 0 && S_ISDIR (sb.st_mode));
+    g_free (hdir);
+    g_free (path);
+    path = g_build_filename (sysroot, old_path, NULL);
+    fail_unless (lstat (path, &sb) != 0);
+    g_free (path);
+    g_free (old_path);
+
+    /* nothing left to move */
+    fail_unless (gumd_daemon_user_migrate_home_dirs (sconfig, &moved, &error)
+            == TRUE);
+    fail_unless (moved == 0);
+    g_object_unref (sconfig);
+
+    gum_config_set_string (config, GUM_CONFIG_GENERAL_HOME_DIR_LAYOUT,
+            "flat");
+    g_object_unref (user);
+    g_object_unref (config);
+}
+END_TEST
+
 Suite* daemon_suite (void)
 {
     TCase *tc = NULL;
@@ -2034,6 +3250,12 @@ Suite* daemon_suite (void)
     tcase_add_unchecked_fixture (tc, _setup_daemon, _teardown_daemon);
     tcase_add_checked_fixture (tc, _create_mainloop, _stop_mainloop);
 
+    tcase_add_test (tc, test_daemon_cache);
+    tcase_add_test (tc, test_daemon_negative_cache);
+    tcase_add_test (tc, test_daemon_delete_user_async);
+    tcase_add_test (tc, test_daemon_change_log);
+    tcase_add_test (tc, test_daemon_concurrent_lookups);
+
     tcase_add_test (tc, test_daemon_user);
     tcase_add_test (tc, test_create_new_user);
     tcase_add_test (tc, test_add_user);
@@ -2041,6 +3263,7 @@ Suite* daemon_suite (void)
     tcase_add_test (tc, test_get_user_by_name);
     tcase_add_test (tc, test_delete_user);
     tcase_add_test (tc, test_update_user);
+    tcase_add_test (tc, test_users_changed);
 
     tcase_add_test (tc, test_daemon_group);
     tcase_add_test (tc, test_create_new_group);
@@ -2054,6 +3277,12 @@ Suite* daemon_suite (void)
     tcase_add_test (tc, test_delete_group_member);
 
     tcase_add_test (tc, test_get_user_list);
+    tcase_add_test (tc, test_scheduler_order);
+    tcase_add_test (tc, test_scheduler_rate_limit);
+    tcase_add_test (tc, test_stats);
+    tcase_add_test (tc, test_apply_manifest);
+    tcase_add_test (tc, test_home_reaper);
+    tcase_add_test (tc, test_home_dir_layout);
     suite_add_tcase (s, tc);
 
     return s;
@@ -67,6 +67,10 @@ GPid daemon_pid = 0;
 
 static GMainLoop *main_loop = NULL;
 
+/* worker threads the daemon serves p2p connections from, which also turns
+ * on the threaded reads on the message bus */
+static gint daemon_workers = 0;
+
 gboolean
 _create_file (
         const gchar *filename,
@@ -84,13 +88,42 @@ _create_file (
     return created;
 }
 
+static void
+_write_config (
+        const gchar *dir)
+{
+    GKeyFile *settings = g_key_file_new ();
+    gchar *fpath = NULL;
+    gchar *data = NULL;
+    gsize len = 0;
+
+    fpath = g_build_filename (GUM_TEST_DATA_DIR, "gumd.conf", NULL);
+    fail_unless (g_key_file_load_from_file (settings, fpath,
+            G_KEY_FILE_KEEP_COMMENTS, NULL));
+    g_free (fpath);
+
+    g_key_file_set_integer (settings, GUM_CONFIG_DBUS_THREADS, "P2P_WORKERS",
+            daemon_workers);
+    g_key_file_set_integer (settings, GUM_CONFIG_DBUS_THREADS,
+            "THREADED_READS", daemon_workers > 0 ? 1 : 0);
+    data = g_key_file_to_data (settings, &len, NULL);
+    g_key_file_free (settings);
+
+    fail_if (g_mkdir_with_parents (dir, 0755) != 0);
+    fpath = g_build_filename (dir, "gumd.conf", NULL);
+    fail_unless (g_file_set_contents (fpath, data, len, NULL));
+    g_free (fpath);
+    g_free (data);
+}
+
 static void
 _setup_env (void)
 {
     gchar *fpath = NULL;
     gchar *cmd = NULL;
 
-    fail_if (g_setenv ("UM_CONF_FILE", GUM_TEST_DATA_DIR, TRUE) == FALSE);
+    fail_if (g_setenv ("UM_CONF_FILE", daemon_workers > 0 ? "/tmp/gum/conf" :
+            GUM_TEST_DATA_DIR, TRUE) == FALSE);
     fail_if (g_setenv ("UM_DAEMON_TIMEOUT", "10", TRUE) == FALSE);
     fail_if (g_setenv ("UM_USER_TIMEOUT", "10", TRUE) == FALSE);
     fail_if (g_setenv ("UM_GROUP_TIMEOUT", "10", TRUE) == FALSE);
@@ -103,6 +136,8 @@ _setup_env (void)
             FALSE);
     fail_if (g_setenv ("UM_HOMEDIR_PREFIX", "/tmp/gum/home", TRUE) == FALSE);
     fail_if (g_setenv ("UM_SKEL_DIR", "/tmp/gum/skel", TRUE) == FALSE);
+    fail_if (g_setenv ("UM_SNAPSHOT_FILE", "/tmp/gum/run/snapshot", TRUE) ==
+            FALSE);
 
     if (system("rm -rf /tmp/gum") != 0)
         WARN("failed to remove tmp gum directory");
@@ -110,6 +145,9 @@ _setup_env (void)
     fail_if (system("mkdir -m +w -p /tmp/gum") != 0,
             "Failed to create temp gum dir: %s\n", strerror(errno));
 
+    if (daemon_workers > 0)
+        _write_config ("/tmp/gum/conf");
+
     fpath = g_build_filename (GUM_TEST_DATA_DIR, "skel", NULL);
     cmd = g_strdup_printf ("cp -p -r %s/ /tmp/gum/", fpath);
     g_free (fpath);
@@ -139,6 +177,7 @@ static void
 _unset_env (void)
 {
     fail_if (system("rm -rf /tmp/gum") == -1);
+    g_unsetenv ("UM_SNAPSHOT_FILE");
     g_unsetenv ("UM_SKEL_DIR");
     g_unsetenv ("UM_HOMEDIR_PREFIX");
     g_unsetenv ("UM_PASSWD_FILE");
@@ -269,10 +308,19 @@ _setup_daemon (void)
     DBG ("Daemon PID = %d\n", daemon_pid);
 }
 
+static void
+_setup_daemon_with_workers (void)
+{
+    daemon_workers = 2;
+    _setup_daemon ();
+}
+
 static void
 _teardown_daemon (void)
 {
     if (daemon_pid) kill (daemon_pid, SIGTERM);
+    daemon_pid = 0;
+    daemon_workers = 0;
 
     _unset_env ();
 }
@@ -578,6 +626,54 @@ START_TEST (test_delete_user)
 }
 END_TEST
 
+START_TEST (test_lookup_user)
+{
+    GumUser *user = NULL;
+    struct passwd *pwd = NULL;
+    uid_t uid = GUM_USER_INVALID_UID;
+    gboolean rval = FALSE;
+
+    DBG ("\n");
+
+    pwd = gum_user_lookup_by_uid (0);
+    fail_if (pwd == NULL, "failed to lookup root");
+    fail_if (g_strcmp0 (pwd->pw_name, "root") != 0);
+    fail_if (g_strcmp0 (pwd->pw_passwd, "x") != 0);
+    fail_if (g_strcmp0 (pwd->pw_dir, "/root") != 0);
+    g_free (pwd);
+
+    fail_if (gum_user_lookup_by_name ("test_lookupuser") != NULL);
+
+    /* lookups fall back to the DBus until the snapshot has been replaced */
+    user = gum_user_create_sync (FALSE);
+    fail_if (user == NULL, "failed to create new user");
+    g_object_set (G_OBJECT (user), "username", "test_lookupuser",
+            "secret", "123456", "usertype", GUM_USERTYPE_NORMAL,
+            "realname", "Lookup User", NULL);
+    rval = gum_user_add_sync (user);
+    fail_if (rval == FALSE, "failed to add user sync");
+    g_object_get (G_OBJECT (user), "uid", &uid, NULL);
+
+    pwd = gum_user_lookup_by_name ("test_lookupuser");
+    fail_if (pwd == NULL, "failed to lookup added user");
+    fail_if (pwd->pw_uid != uid);
+    fail_if (!g_str_has_prefix (pwd->pw_gecos, "Lookup User"));
+    g_free (pwd);
+
+    pwd = gum_user_lookup_by_uid (uid);
+    fail_if (pwd == NULL, "failed to lookup added user by uid");
+    fail_if (g_strcmp0 (pwd->pw_name, "test_lookupuser") != 0);
+    g_free (pwd);
+
+    rval = gum_user_delete_sync (user, TRUE);
+    fail_if (rval == FALSE, "failed to delete user");
+    g_object_unref (user);
+
+    fail_if (gum_user_lookup_by_uid (uid) != NULL);
+    fail_if (gum_user_lookup_by_name ("test_lookupuser") != NULL);
+}
+END_TEST
+
 START_TEST (test_update_user)
 {
     GumUser *user = NULL;
@@ -1051,7 +1147,12 @@ START_TEST (test_get_user_list)
     GumUserService *service = NULL;
     gboolean rval = FALSE;
     GumUserList *user_list = NULL;
+    GumUser *user = NULL, *added = NULL;
+    GList *list = NULL;
     gchar **strv = NULL;
+    gchar *username = NULL, *realname = NULL, *icon = NULL;
+    uid_t uid = GUM_USER_INVALID_UID, list_uid = GUM_USER_INVALID_UID;
+    guint usertype = GUM_USERTYPE_NONE;
 
     DBG ("\n");
 
@@ -1113,36 +1214,68 @@ START_TEST (test_get_user_list)
     g_object_unref (service);
 
     /* case 8: get user list sync -- success */
+    added = gum_user_create_sync (FALSE);
+    fail_if (added == NULL, "failed to create new user");
+    g_object_set (G_OBJECT (added), "username", "test_listuser",
+            "secret", "123456", "usertype", GUM_USERTYPE_NORMAL,
+            "realname", "List User", "icon", "/tmp/list_icon.png", NULL);
+    fail_if (gum_user_add_sync (added) == FALSE, "failed to add user sync");
+    g_object_get (G_OBJECT (added), "uid", &uid, NULL);
+
     service = gum_user_service_create_sync (FALSE);
     fail_if (service == NULL, "failed to create new user service");
     strv = gum_string_utils_append_string (NULL,"normal");
-    user_list = gum_user_service_get_user_list_sync (service,
-            (const gchar *const *)strv);
+    user_list = gum_user_service_get_user_list_full_sync (service,
+            (const gchar *const *)strv, GUM_USER_LIST_FLAGS_RECORDS);
     g_strfreev (strv);
     fail_if (user_list == NULL, "failed to get users uids");
     fail_if (g_list_length (user_list) <= 0, "no normal users found");
+
+    /* listed users are readable right away and fetch their remote object
+     * once updated or once a property missing from the record is read */
+    for (list = user_list; list && !user; list = g_list_next (list)) {
+        g_object_get (G_OBJECT (list->data), "uid", &list_uid, NULL);
+        if (list_uid == uid)
+            user = GUM_USER (list->data);
+    }
+    fail_if (user == NULL, "added user not listed");
+    g_object_get (G_OBJECT (user), "username", &username,
+            "usertype", &usertype, "realname", &realname, NULL);
+    fail_if (g_strcmp0 (username, "test_listuser") != 0);
+    fail_if (usertype != GUM_USERTYPE_NORMAL);
+    fail_if (g_strcmp0 (realname, "List User") != 0);
+    g_free (username);
+    g_free (realname);
+    g_object_get (G_OBJECT (user), "icon", &icon, NULL);
+    fail_if (g_strcmp0 (icon, "/tmp/list_icon.png") != 0);
+    g_free (icon);
+
+    g_object_set (G_OBJECT (user), "realname", "Listed User", NULL);
+    fail_if (gum_user_update_sync (user) == FALSE, "failed to update user");
+    g_object_get (G_OBJECT (user), "realname", &realname, NULL);
+    fail_if (g_strcmp0 (realname, "Listed User") != 0);
+    g_free (realname);
+
     gum_user_service_list_free (user_list);
     g_object_unref (service);
+
+    fail_if (gum_user_delete_sync (added, TRUE) == FALSE,
+            "failed to delete user");
+    g_object_unref (added);
 }
 END_TEST
 
-Suite* daemon_suite (void)
+static void
+_add_client_tests (
+        TCase *tc)
 {
-    TCase *tc = NULL;
-
-    Suite *s = suite_create ("Gum client");
-    
-    tc = tcase_create ("Client tests");
-    tcase_set_timeout(tc, 15);
-    tcase_add_unchecked_fixture (tc, _setup_daemon, _teardown_daemon);
-    tcase_add_checked_fixture (tc, _create_mainloop, _stop_mainloop);
-
     tcase_add_test (tc, test_create_new_user);
     tcase_add_test (tc, test_add_user);
     tcase_add_test (tc, test_get_user_by_uid);
     tcase_add_test (tc, test_get_user_by_name);
     tcase_add_test (tc, test_delete_user);
     tcase_add_test (tc, test_update_user);
+    tcase_add_test (tc, test_lookup_user);
 
     tcase_add_test (tc, test_create_new_group);
     tcase_add_test (tc, test_add_group);
@@ -1154,6 +1287,28 @@ Suite* daemon_suite (void)
     tcase_add_test (tc, test_delete_group_member);
 
     tcase_add_test (tc, test_get_user_list);
+}
+
+Suite* daemon_suite (void)
+{
+    TCase *tc = NULL;
+
+    Suite *s = suite_create ("Gum client");
+    
+    tc = tcase_create ("Client tests");
+    tcase_set_timeout(tc, 15);
+    tcase_add_unchecked_fixture (tc, _setup_daemon, _teardown_daemon);
+    tcase_add_checked_fixture (tc, _create_mainloop, _stop_mainloop);
+    _add_client_tests (tc);
+    suite_add_tcase (s, tc);
+
+    /* the same again with the daemon serving from worker threads */
+    tc = tcase_create ("Client tests with workers");
+    tcase_set_timeout(tc, 15);
+    tcase_add_unchecked_fixture (tc, _setup_daemon_with_workers,
+            _teardown_daemon);
+    tcase_add_checked_fixture (tc, _create_mainloop, _stop_mainloop);
+    _add_client_tests (tc);
     suite_add_tcase (s, tc);
 
     return s;